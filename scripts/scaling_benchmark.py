@@ -0,0 +1,48 @@
+#!/usr/bin/python
+
+# aligns the same reads with each thread count, without NUMA pinning, with --numa and with --numa-replicate-graph,
+# and prints the alignment throughput from the run summary as a table
+# usage: scaling_benchmark.py GraphAligner graph.gfa reads.fa 1,2,4,8,16 [other GraphAligner arguments]
+# speedup is relative to the per-thread throughput of the first thread count of the same configuration
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+aligner = sys.argv[1]
+graph_file = sys.argv[2]
+reads_file = sys.argv[3]
+thread_counts = [int(t) for t in sys.argv[4].split(',')]
+extra_args = sys.argv[5:]
+
+configurations = [("no pinning", []), ("numa", ["--numa"]), ("numa replicas", ["--numa-replicate-graph"])]
+wall_time_line = re.compile(r'Alignment wall time: (\d+)ms \((\d+)bp/s with (\d+) threads\)')
+
+output_dir = tempfile.mkdtemp()
+output_file = os.path.join(output_dir, "benchmark.gam")
+
+print("configuration\tthreads\twall time (ms)\tbp/s\tbp/s per thread\tspeedup")
+for name, args in configurations:
+	single_thread_speed = None
+	for threads in thread_counts:
+		command = [aligner, "-g", graph_file, "-f", reads_file, "-a", output_file, "-t", str(threads)] + args + extra_args
+		process = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+		stdout, stderr = process.communicate()
+		if process.returncode != 0:
+			sys.stderr.write(name + " with " + str(threads) + " threads failed:\n" + stderr)
+			continue
+		match = wall_time_line.search(stdout)
+		if match is None:
+			sys.stderr.write(name + " with " + str(threads) + " threads: no wall time in the run summary\n")
+			continue
+		wall_time = int(match.group(1))
+		speed = int(match.group(2))
+		if single_thread_speed is None: single_thread_speed = float(speed) / threads
+		speedup = speed / single_thread_speed if single_thread_speed > 0 else 0
+		print(name + "\t" + str(threads) + "\t" + str(wall_time) + "\t" + str(speed) + "\t" + str(speed // threads) + "\t" + "%.2f" % speedup)
+		sys.stdout.flush()
+
+if os.path.exists(output_file): os.remove(output_file)
+os.rmdir(output_dir)
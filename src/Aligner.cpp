@@ -4,17 +4,33 @@
 #include <functional>
 #include <algorithm>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <concurrentqueue.h> //https://github.com/cameron314/concurrentqueue
 #include <google/protobuf/util/json_util.h>
 #include "Aligner.h"
 #include "CommonUtils.h"
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "GamIndex.h"
 #include "fastqloader.h"
 #include "BigraphToDigraph.h"
 #include "ThreadReadAssertion.h"
 #include "GraphAlignerWrapper.h"
 #include "MummerSeeder.h"
+#include "NumaPlacement.h"
+#include "HugePages.h"
+#include "WindowStitching.h"
+
+//the output of one read, already serialized and gzipped. corrected and clipped are fasta records
+struct ReadOutput
+{
+	std::string readName;
+	std::string alignments;
+	std::string corrected;
+	std::string clipped;
+};
 
 struct Seeder
 {
@@ -25,12 +41,14 @@ struct Seeder
 	Mode mode;
 	size_t mumCount;
 	size_t memCount;
+	bool memEdgeSpanning;
 	size_t mxmLength;
 	const MummerSeeder* mummerSeeder;
 	const std::unordered_map<std::string, std::vector<SeedHit>>* fileSeeds;
 	Seeder(const AlignerParams& params, const std::unordered_map<std::string, std::vector<SeedHit>>* fileSeeds, const MummerSeeder* mummerSeeder) :
 		mumCount(params.mumCount),
 		memCount(params.memCount),
+		memEdgeSpanning(params.memEdgeSpanning),
 		mxmLength(params.mxmLength),
 		mummerSeeder(mummerSeeder),
 		fileSeeds(fileSeeds)
@@ -72,12 +90,28 @@ struct Seeder
 				return mummerSeeder->getMumSeeds(seq, mumCount, mxmLength);
 			case Mode::Mem:
 				assert(mummerSeeder != nullptr);
+				if (memEdgeSpanning) return mummerSeeder->getEdgeSpanningMemSeeds(seq, memCount, mxmLength);
 				return mummerSeeder->getMemSeeds(seq, memCount, mxmLength);
 			case Mode::None:
 				assert(false);
 		}
 		return std::vector<SeedHit>{};
 	}
+	//seeds of the part of the read starting at start, with sequence positions relative to the start
+	std::vector<SeedHit> getWindowSeeds(const std::string& seqName, const std::string& seq, size_t start, size_t length) const
+	{
+		if (mode != Mode::File) return getSeeds(seqName, seq.substr(start, length));
+		std::vector<SeedHit> result;
+		auto found = fileSeeds->find(seqName);
+		if (found == fileSeeds->end()) return result;
+		for (auto seed : found->second)
+		{
+			if (seed.seqPos < start || seed.seqPos >= start + length) continue;
+			seed.seqPos -= start;
+			result.push_back(seed);
+		}
+		return result;
+	}
 };
 
 struct AlignmentStats
@@ -95,6 +129,13 @@ struct AlignmentStats
 	bpInReadsWithASeed(0),
 	bpInAlignments(0),
 	bpInFullAlignments(0),
+	localSubgraphNodes(0),
+	splitReads(0),
+	windows(0),
+	seedLoopsStopped(0),
+	seedsDropped(0),
+	deferredReads(0),
+	bpInDeferredReads(0),
 	assertionBroke(false)
 	{
 	}
@@ -110,9 +151,45 @@ struct AlignmentStats
 	std::atomic<size_t> bpInReadsWithASeed;
 	std::atomic<size_t> bpInAlignments;
 	std::atomic<size_t> bpInFullAlignments;
+	std::atomic<size_t> localSubgraphNodes;
+	std::atomic<size_t> splitReads;
+	std::atomic<size_t> windows;
+	std::atomic<size_t> seedLoopsStopped;
+	std::atomic<size_t> seedsDropped;
+	std::atomic<size_t> deferredReads;
+	std::atomic<size_t> bpInDeferredReads;
 	std::atomic<bool> assertionBroke;
 };
 
+//a read longer than the window length, split into overlapping windows which any thread can align.
+//the thread which aligns the last window stitches the alignments of the windows and writes the read
+struct SplitRead
+{
+	std::shared_ptr<FastQ> read;
+	std::vector<size_t> windowStart;
+	size_t windowLength;
+	std::vector<AlignmentResult> windowAlignments;
+	std::vector<size_t> windowSeeds;
+	std::atomic<size_t> windowsLeft;
+	//seed hits of each window, kept in the first pass of a two pass run so the second pass doesn't seed again
+	std::vector<std::vector<SeedHit>> windowSeedHits;
+	bool seeded;
+};
+
+struct ReadWindow
+{
+	std::shared_ptr<SplitRead> read;
+	size_t index;
+};
+
+struct SecondPassQueues
+{
+	//reads which were aligned without seeds
+	moodycamel::ConcurrentQueue<std::shared_ptr<FastQ>> reads;
+	//windows with their seeds from the first pass. a read which wasn't split is one window
+	moodycamel::ConcurrentQueue<ReadWindow> windows;
+};
+
 bool is_file_exist(std::string fileName)
 {
 	std::ifstream infile(fileName);
@@ -134,6 +211,22 @@ void replaceDigraphNodeIdsWithOriginalNodeIds(vg::Alignment& alignment, const Al
 	}
 }
 
+//the graph sequence of the alignment path, alignment must still have the digraph node ids
+std::string alignmentPathSequence(const vg::Alignment& alignment, const AlignmentGraph& graph)
+{
+	std::string result;
+	for (int i = 0; i < alignment.path().mapping_size(); i++)
+	{
+		size_t len = 0;
+		for (int j = 0; j < alignment.path().mapping(i).edit_size(); j++)
+		{
+			len += alignment.path().mapping(i).edit(j).from_length();
+		}
+		result += graph.OriginalNodeSequence(alignment.path().mapping(i).position().node_id(), alignment.path().mapping(i).position().offset(), len);
+	}
+	return result;
+}
+
 void writeTrace(const std::vector<AlignmentResult::TraceItem>& trace, const std::string& filename)
 {
 	std::ofstream file { filename };
@@ -165,16 +258,24 @@ void readFastqs(const std::vector<std::string>& filenames, moodycamel::Concurren
 	readStreamingFinished = true;
 }
 
-void consumeVGsAndWrite(const std::string& filename, moodycamel::ConcurrentQueue<std::string*>& writequeue, moodycamel::ConcurrentQueue<std::string*>& deallocqueue, std::atomic<bool>& allThreadsDone, std::atomic<bool>& allWriteDone, bool verboseMode, bool outputJSON)
+void consumeVGsAndWrite(const std::string& filename, const std::string& correctedFilename, const std::string& clippedFilename, moodycamel::ConcurrentQueue<ReadOutput*>& writequeue, moodycamel::ConcurrentQueue<ReadOutput*>& deallocqueue, std::atomic<bool>& allThreadsDone, std::atomic<bool>& allWriteDone, bool verboseMode, bool outputJSON, bool writeReadIndex)
 {
 	assertSetRead("Writer", "No seed");
 	auto openmode = std::ios::out;
 	if (!outputJSON) openmode |= std::ios::binary;
-	std::ofstream outfile { filename, openmode };
+	std::ofstream outfile;
+	std::ofstream correctedfile;
+	std::ofstream clippedfile;
+	if (filename.size() > 0) outfile.open(filename, openmode);
+	if (correctedFilename.size() > 0) correctedfile.open(correctedFilename);
+	if (clippedFilename.size() > 0) clippedfile.open(clippedFilename);
 
 	bool wroteAny = false;
 
-	std::string* alns[100] {};
+	ReadOutput* alns[100] {};
+	//(read name hash, member offset) for the read name index
+	std::vector<std::pair<uint64_t, uint64_t>> indexEntries;
+	uint64_t writtenBytes = 0;
 
 	BufferedWriter coutoutput;
 	if (verboseMode)
@@ -198,13 +299,17 @@ void consumeVGsAndWrite(const std::string& filename, moodycamel::ConcurrentQueue
 		coutoutput << "write " << gotAlns << ", " << writequeue.size_approx() << " left" << BufferedWriter::Flush;
 		for (size_t i = 0; i < gotAlns; i++)
 		{
-			outfile.write(alns[i]->data(), alns[i]->size());
+			if (writeReadIndex && alns[i]->alignments.size() > 0) indexEntries.emplace_back(GamIndex::NameHash(alns[i]->readName), writtenBytes);
+			if (filename.size() > 0) outfile.write(alns[i]->alignments.data(), alns[i]->alignments.size());
+			writtenBytes += alns[i]->alignments.size();
+			if (correctedFilename.size() > 0) correctedfile << alns[i]->corrected;
+			if (clippedFilename.size() > 0) clippedfile << alns[i]->clipped;
 		}
 		deallocqueue.enqueue_bulk(alns, gotAlns);
 		wroteAny = true;
 	}
 
-	if (!outputJSON && !wroteAny)
+	if (filename.size() > 0 && !outputJSON && !wroteAny)
 	{
 		::google::protobuf::io::ZeroCopyOutputStream *raw_out =
 		      new ::google::protobuf::io::OstreamOutputStream(&outfile);
@@ -218,13 +323,329 @@ void consumeVGsAndWrite(const std::string& filename, moodycamel::ConcurrentQueue
 		delete raw_out;
 	}
 
+	if (writeReadIndex)
+	{
+		uint64_t fileSize = outfile.tellp();
+		outfile.close();
+		std::string indexFile = GamIndex::DefaultIndexFile(filename);
+		coutoutput << "write read name index to " << indexFile << BufferedWriter::Flush;
+		GamIndex::Write(indexFile, std::move(indexEntries), fileSize);
+	}
+
 	allWriteDone = true;
 }
 
-void runComponentMappings(const AlignmentGraph& alignmentGraph, moodycamel::ConcurrentQueue<std::shared_ptr<FastQ>>& readFastqsQueue, std::atomic<bool>& readStreamingFinished, int threadnum, const Seeder& seeder, AlignerParams params, moodycamel::ConcurrentQueue<std::string*>& alignmentsOut, moodycamel::ProducerToken& token, moodycamel::ConcurrentQueue<std::string*>& deallocqueue, AlignmentStats& stats)
+void enqueueOutput(ReadOutput* output, moodycamel::ConcurrentQueue<ReadOutput*>& alignmentsOut, moodycamel::ProducerToken& token)
+{
+	size_t waited = 0;
+	while (!alignmentsOut.try_enqueue(token, output) && !alignmentsOut.try_enqueue(output))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		waited++;
+		if (waited >= 1000)
+		{
+			if (alignmentsOut.size_approx() < 100 && alignmentsOut.enqueue(output)) break;
+		}
+	}
+}
+
+//reads without alignments are still written to the corrected reads, uncorrected
+void enqueueUnaligned(const FastQ& read, const AlignerParams& params, moodycamel::ConcurrentQueue<ReadOutput*>& alignmentsOut, moodycamel::ProducerToken& token)
+{
+	if (params.correctedOutFile.size() == 0) return;
+	enqueueOutput(new ReadOutput { read.seq_id, "", ">" + read.seq_id + "\n" + CommonUtils::ToLower(read.sequence) + "\n", "" }, alignmentsOut, token);
+}
+
+using AlignerState = GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState;
+
+//per-thread state for --local-subgraph. a state sized for a bigger graph works for a smaller one, so it is only reallocated when a subgraph is bigger than all earlier ones
+class LocalSubgraphState
+{
+public:
+	LocalSubgraphState() :
+	state(nullptr),
+	nodes(0),
+	components(0)
+	{
+	}
+	AlignerState& Get(const AlignmentGraph& subgraph, const AlignerParams& params)
+	{
+		if (state == nullptr || subgraph.NodeSize() > nodes || subgraph.ComponentSize() > components)
+		{
+			nodes = std::max(nodes, subgraph.NodeSize());
+			components = std::max(components, subgraph.ComponentSize());
+			state.reset();
+			state.reset(new AlignerState { nodes, components, std::max(params.initialBandwidth, params.rampBandwidth), !params.highMemory });
+		}
+		return *state;
+	}
+	void clear()
+	{
+		if (state != nullptr) state->clear();
+	}
+private:
+	std::unique_ptr<AlignerState> state;
+	size_t nodes;
+	size_t components;
+};
+
+AlignmentResult alignSeeded(const AlignmentGraph& alignmentGraph, const std::string& seqName, const std::string& sequence, const std::vector<SeedHit>& seeds, const AlignerParams& params, AlignerState& reusableState, LocalSubgraphState& localState, AlignmentStats& stats, BufferedWriter& coutoutput)
+{
+	if (params.localSubgraph)
+	{
+		std::vector<std::pair<int, size_t>> seedPositions;
+		for (auto seed : seeds)
+		{
+			seedPositions.emplace_back(seed.nodeID * 2 + (seed.reverse ? 1 : 0), seed.nodeOffset);
+		}
+		auto subgraph = alignmentGraph.GetLocalSubgraph(seedPositions, sequence.size() + params.localSubgraphMargin);
+		coutoutput << "Read " << seqName << " local subgraph has " << subgraph.NodeSize() << " nodes" << BufferedWriter::Flush;
+		stats.localSubgraphNodes += subgraph.NodeSize();
+		//alignment coordinates are already in the original node ids and offsets
+		return AlignOneWay(subgraph, seqName, sequence, params.initialBandwidth, params.rampBandwidth, params.maxCellsPerSlice, !params.verboseMode, !params.tryAllSeeds, seeds, localState.Get(subgraph, params), !params.highMemory, params.forceGlobal, params.preciseClipping, params.prefetchDistance, params.seedStopCoverage, params.seedStopIdentity);
+	}
+	return AlignOneWay(alignmentGraph, seqName, sequence, params.initialBandwidth, params.rampBandwidth, params.maxCellsPerSlice, !params.verboseMode, !params.tryAllSeeds, seeds, reusableState, !params.highMemory, params.forceGlobal, params.preciseClipping, params.prefetchDistance, params.seedStopCoverage, params.seedStopIdentity);
+}
+
+void writeReadAlignments(const AlignmentGraph& alignmentGraph, const FastQ& fastq, AlignmentResult& alignments, int threadnum, const AlignerParams& params, AlignerState& reusableState, moodycamel::ConcurrentQueue<ReadOutput*>& alignmentsOut, moodycamel::ProducerToken& token, AlignmentStats& stats, BufferedWriter& coutoutput, BufferedWriter& cerroutput)
+{
+	//failed alignment, don't output
+	if (alignments.alignments.size() == 0)
+	{
+		coutoutput << "Read " << fastq.seq_id << " alignment failed" << BufferedWriter::Flush;
+		cerroutput << "Read " << fastq.seq_id << " alignment failed" << BufferedWriter::Flush;
+		enqueueUnaligned(fastq, params, alignmentsOut, token);
+		return;
+	}
+
+	stats.seedsExtended += alignments.seedsExtended;
+	stats.readsWithAnAlignment += 1;
+	if (alignments.seedsDropped > 0)
+	{
+		stats.seedLoopsStopped += 1;
+		stats.seedsDropped += alignments.seedsDropped;
+	}
+
+	if (!params.outputAllAlns)
+	{
+		alignments.alignments = CommonUtils::SelectAlignments(alignments.alignments, std::numeric_limits<size_t>::max(), [](const AlignmentResult::AlignmentItem& aln) { return aln.alignment.get(); });
+	}
+	
+	std::sort(alignments.alignments.begin(), alignments.alignments.end(), [](const AlignmentResult::AlignmentItem& left, const AlignmentResult::AlignmentItem& right) { return left.alignmentStart < right.alignmentStart; });
+
+	std::string alignmentpositions;
+	//graph sequences of the alignments for the corrected read output
+	std::vector<CommonUtils::PartialAlignment> partials;
+	std::string clipped;
+	size_t timems = 0;
+	size_t totalcells = 0;
+	std::stringstream strstr;
+	::google::protobuf::io::ZeroCopyOutputStream *raw_out;
+	::google::protobuf::io::GzipOutputStream *gzip_out;
+	::google::protobuf::io::CodedOutputStream *coded_out;
+	if (!params.outputJSON)
+	{
+		raw_out = new ::google::protobuf::io::OstreamOutputStream(&strstr);
+	    gzip_out = new ::google::protobuf::io::GzipOutputStream(raw_out);
+	    coded_out = new ::google::protobuf::io::CodedOutputStream(gzip_out);
+		coded_out->WriteVarint64(alignments.alignments.size());
+	}
+	for (size_t i = 0; i < alignments.alignments.size(); i++)
+	{
+		try
+		{
+			assert(!alignments.alignments[i].alignmentFailed());
+			assert(alignments.alignments[i].alignment != nullptr);
+		}
+		catch (const ThreadReadAssertion::AssertionFailure& a)
+		{
+			reusableState.clear();
+			stats.assertionBroke = true;
+			continue;
+		}
+		stats.alignments += 1;
+		if (alignments.alignments[i].alignment->sequence().size() == fastq.sequence.size())
+		{
+			stats.fullLengthAlignments += 1;
+			stats.bpInFullAlignments += alignments.alignments[i].alignment->sequence().size();
+		}
+		stats.bpInAlignments += alignments.alignments[i].alignment->sequence().size();
+		if (params.correctedOutFile.size() > 0 || params.correctedClippedOutFile.size() > 0)
+		{
+			const vg::Alignment& aln = *alignments.alignments[i].alignment;
+			CommonUtils::PartialAlignment partial { (size_t)aln.query_position(), aln.query_position() + aln.sequence().size(), alignmentPathSequence(aln, alignmentGraph) };
+			clipped += ">" + fastq.seq_id + "_" + std::to_string(partial.start) + "_" + std::to_string(partial.end) + "\n" + partial.seq + "\n";
+			partials.push_back(std::move(partial));
+		}
+		replaceDigraphNodeIdsWithOriginalNodeIds(*alignments.alignments[i].alignment, alignmentGraph);
+		alignmentpositions += std::to_string(alignments.alignments[i].alignmentStart) + "-" + std::to_string(alignments.alignments[i].alignmentEnd) + ", ";
+		timems += alignments.alignments[i].elapsedMilliseconds;
+		totalcells += alignments.alignments[i].cellsProcessed;
+		if (params.outputJSON)
+		{
+			google::protobuf::util::JsonPrintOptions options;
+			options.preserve_proto_field_names = true;
+			std::string s;
+			google::protobuf::util::MessageToJsonString(*alignments.alignments[i].alignment, &s, options);
+			strstr << s;
+			strstr << '\n';
+		}
+		else
+		{
+			std::string s;
+			alignments.alignments[i].alignment->SerializeToString(&s);
+			coded_out->WriteVarint32(s.size());
+			coded_out->WriteRaw(s.data(), s.size());
+		}
+	}
+	if (!params.outputJSON)
+	{
+		delete coded_out;
+		delete gzip_out;
+		delete raw_out;
+	}
+	std::string corrected;
+	if (params.correctedOutFile.size() > 0)
+	{
+		corrected = ">" + fastq.seq_id + "\n" + CommonUtils::GetCorrectedSequence(fastq.sequence, std::move(partials), alignmentGraph.MaxEdgeOverlap()) + "\n";
+	}
+	enqueueOutput(new ReadOutput { fastq.seq_id, params.outputAlignmentFile.size() > 0 ? strstr.str() : "", corrected, clipped }, alignmentsOut, token);
+	alignmentpositions.pop_back();
+	alignmentpositions.pop_back();
+
+	coutoutput << "Read " << fastq.seq_id << " alignment took " << timems << "ms" << BufferedWriter::Flush;
+	coutoutput << "Read " << fastq.seq_id << " aligned by thread " << threadnum << " with positions: " << alignmentpositions << " (read " << fastq.sequence.size() << "bp)" << BufferedWriter::Flush;
+}
+
+//windows start every window length minus overlap bp, the last one ends at the end of the read
+void splitRead(std::shared_ptr<FastQ> fastq, const AlignerParams& params, moodycamel::ConcurrentQueue<ReadWindow>& windowQueue, AlignmentStats& stats, BufferedWriter& coutoutput)
+{
+	auto split = std::make_shared<SplitRead>();
+	split->read = fastq;
+	split->windowLength = params.windowLength;
+	size_t step = params.windowLength - params.windowOverlap;
+	for (size_t start = 0; ; start += step)
+	{
+		split->windowStart.push_back(std::min(start, fastq->sequence.size() - params.windowLength));
+		if (start + params.windowLength >= fastq->sequence.size()) break;
+	}
+	split->windowAlignments.resize(split->windowStart.size());
+	split->windowSeeds.resize(split->windowStart.size(), 0);
+	split->windowsLeft = split->windowStart.size();
+	if (params.twoPass) split->windowSeedHits.resize(split->windowStart.size());
+	split->seeded = false;
+	stats.splitReads += 1;
+	stats.windows += split->windowStart.size();
+	coutoutput << "Read " << fastq->seq_id << " split into " << split->windowStart.size() << " windows" << BufferedWriter::Flush;
+	for (size_t i = 0; i < split->windowStart.size(); i++)
+	{
+		windowQueue.enqueue(ReadWindow { split, i });
+	}
+}
+
+//returns true if this was the last window of the read to be aligned
+bool alignWindow(const AlignmentGraph& alignmentGraph, const ReadWindow& window, const Seeder& seeder, const AlignerParams& params, AlignerState& reusableState, LocalSubgraphState& localState, AlignmentStats& stats, BufferedWriter& coutoutput, BufferedWriter& cerroutput)
+{
+	SplitRead& split = *window.read;
+	const std::string& seqName = split.read->seq_id;
+	size_t start = split.windowStart[window.index];
+	std::string windowInfo = "window " + std::to_string(window.index) + "/" + std::to_string(split.windowStart.size());
+	assertSetRead(seqName, "No seed");
+	try
+	{
+		std::vector<SeedHit> seeds;
+		if (split.seeded)
+		{
+			std::swap(seeds, split.windowSeedHits[window.index]);
+		}
+		else
+		{
+			auto timeStart = std::chrono::system_clock::now();
+			seeds = seeder.getWindowSeeds(seqName, split.read->sequence, start, split.windowLength);
+			auto timeEnd = std::chrono::system_clock::now();
+			size_t time = std::chrono::duration_cast<std::chrono::milliseconds>(timeEnd - timeStart).count();
+			coutoutput << "Read " << seqName << " " << windowInfo << " seeding took " << time << "ms" << BufferedWriter::Flush;
+			stats.seeds += seeds.size();
+			stats.seedsFound += seeds.size();
+			if (split.windowSeedHits.size() > 0) split.windowSeedHits[window.index] = seeds;
+		}
+		split.windowSeeds[window.index] = seeds.size();
+		if (seeds.size() > 0)
+		{
+			split.windowAlignments[window.index] = alignSeeded(alignmentGraph, seqName, split.read->sequence.substr(start, split.windowLength), seeds, params, reusableState, localState, stats, coutoutput);
+		}
+	}
+	catch (const ThreadReadAssertion::AssertionFailure& a)
+	{
+		coutoutput << "Read " << seqName << " " << windowInfo << " alignment failed (assertion!)" << BufferedWriter::Flush;
+		cerroutput << "Read " << seqName << " " << windowInfo << " alignment failed (assertion!)" << BufferedWriter::Flush;
+		reusableState.clear();
+		localState.clear();
+		stats.assertionBroke = true;
+		split.windowAlignments[window.index] = AlignmentResult {};
+	}
+	return split.windowsLeft.fetch_sub(1) == 1;
+}
+
+bool alignedEndToEnd(const FastQ& fastq, const AlignmentResult& alignments)
+{
+	for (const auto& item : alignments.alignments)
+	{
+		if (item.alignment->sequence().size() == fastq.sequence.size()) return true;
+	}
+	return false;
+}
+
+//in the first pass of a two pass run, reads which didn't align end to end are queued for the second pass instead of being written, along with their seeds
+bool deferToSecondPass(std::shared_ptr<FastQ> fastq, std::vector<SeedHit>& seeds, const AlignmentResult& alignments, SecondPassQueues* secondPass, AlignmentStats& stats, BufferedWriter& coutoutput)
+{
+	if (secondPass == nullptr) return false;
+	if (alignedEndToEnd(*fastq, alignments)) return false;
+	coutoutput << "Read " << fastq->seq_id << " deferred to the second pass" << BufferedWriter::Flush;
+	stats.deferredReads += 1;
+	stats.bpInDeferredReads += fastq->sequence.size();
+	if (seeds.size() == 0)
+	{
+		secondPass->reads.enqueue(fastq);
+		return true;
+	}
+	auto split = std::make_shared<SplitRead>();
+	split->read = fastq;
+	split->windowLength = fastq->sequence.size();
+	split->windowStart.push_back(0);
+	split->windowAlignments.resize(1);
+	split->windowSeeds.resize(1, 0);
+	split->windowsLeft = 1;
+	split->windowSeedHits.emplace_back();
+	std::swap(split->windowSeedHits[0], seeds);
+	split->seeded = true;
+	secondPass->windows.enqueue(ReadWindow { split, 0 });
+	return true;
+}
+
+bool deferToSecondPass(std::shared_ptr<SplitRead> split, const AlignmentResult& alignments, SecondPassQueues* secondPass, AlignmentStats& stats, BufferedWriter& coutoutput)
+{
+	if (secondPass == nullptr) return false;
+	if (alignedEndToEnd(*split->read, alignments)) return false;
+	coutoutput << "Read " << split->read->seq_id << " deferred to the second pass" << BufferedWriter::Flush;
+	stats.deferredReads += 1;
+	stats.bpInDeferredReads += split->read->sequence.size();
+	split->windowAlignments.clear();
+	split->windowAlignments.resize(split->windowStart.size());
+	split->windowsLeft = split->windowStart.size();
+	split->seeded = true;
+	for (size_t i = 0; i < split->windowStart.size(); i++)
+	{
+		secondPass->windows.enqueue(ReadWindow { split, i });
+	}
+	return true;
+}
+
+void runComponentMappings(const AlignmentGraph& alignmentGraph, moodycamel::ConcurrentQueue<std::shared_ptr<FastQ>>& readFastqsQueue, std::atomic<bool>& readStreamingFinished, moodycamel::ConcurrentQueue<ReadWindow>& windowQueue, SecondPassQueues* secondPass, int threadnum, const Seeder& seeder, AlignerParams params, moodycamel::ConcurrentQueue<ReadOutput*>& alignmentsOut, moodycamel::ProducerToken& token, moodycamel::ConcurrentQueue<ReadOutput*>& deallocqueue, AlignmentStats& stats, size_t& bpProcessed)
 {
 	assertSetRead("Before any read", "No seed");
-	GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState reusableState { alignmentGraph, std::max(params.initialBandwidth, params.rampBandwidth), !params.highMemory };
+	AlignerState reusableState { alignmentGraph, std::max(params.initialBandwidth, params.rampBandwidth), !params.highMemory };
+	LocalSubgraphState localState;
 	BufferedWriter cerroutput;
 	BufferedWriter coutoutput;
 	if (params.verboseMode)
@@ -234,32 +655,70 @@ void runComponentMappings(const AlignmentGraph& alignmentGraph, moodycamel::Conc
 	}
 	while (true)
 	{
-		std::string* dealloc;
+		ReadOutput* dealloc;
 		while (deallocqueue.try_dequeue(dealloc))
 		{
 			delete dealloc;
 		}
+		//windows of reads which are already split go first so split reads are finished before new ones are started
+		ReadWindow window;
 		std::shared_ptr<FastQ> fastq = nullptr;
-		while (!readFastqsQueue.try_dequeue(fastq))
+		while (true)
 		{
+			if (windowQueue.try_dequeue(window)) break;
 			bool tryBreaking = readStreamingFinished;
-			if (!readFastqsQueue.try_dequeue(fastq) && tryBreaking) break;
+			if (readFastqsQueue.try_dequeue(fastq)) break;
+			if (tryBreaking && windowQueue.size_approx() == 0) break;
 			std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		}
+		if (window.read != nullptr)
+		{
+			//the bases up to the next window's start, so the windows of a read add up to its length
+			bpProcessed += (window.index + 1 < window.read->windowStart.size() ? window.read->windowStart[window.index + 1] : window.read->read->sequence.size()) - window.read->windowStart[window.index];
+			if (!alignWindow(alignmentGraph, window, seeder, params, reusableState, localState, stats, coutoutput, cerroutput)) continue;
+			const SplitRead& split = *window.read;
+			size_t seeds = 0;
+			for (auto windowSeeds : split.windowSeeds)
+			{
+				seeds += windowSeeds;
+			}
+			if (seeds == 0)
+			{
+				coutoutput << "Read " << split.read->seq_id << " has no seed hits" << BufferedWriter::Flush;
+				cerroutput << "Read " << split.read->seq_id << " has no seed hits" << BufferedWriter::Flush;
+			}
+			else
+			{
+				stats.readsWithASeed += 1;
+				stats.bpInReadsWithASeed += split.read->sequence.size();
+			}
+			AlignmentResult alignments = WindowStitching::StitchWindows(split.windowStart, window.read->windowAlignments, split.read->sequence);
+			if (deferToSecondPass(window.read, alignments, secondPass, stats, coutoutput)) continue;
+			writeReadAlignments(alignmentGraph, *split.read, alignments, threadnum, params, reusableState, alignmentsOut, token, stats, coutoutput, cerroutput);
+			continue;
+		}
 		if (fastq == nullptr) break;
 		assertSetRead(fastq->seq_id, "No seed");
 		coutoutput << "Read " << fastq->seq_id << " size " << fastq->sequence.size() << "bp" << BufferedWriter::Flush;
 		stats.reads += 1;
 		stats.bpInReads += fastq->sequence.size();
 
+		if (params.windowLength > 0 && seeder.mode != Seeder::Mode::None && fastq->sequence.size() > params.windowLength)
+		{
+			splitRead(fastq, params, windowQueue, stats, coutoutput);
+			continue;
+		}
+		bpProcessed += fastq->sequence.size();
+
 		AlignmentResult alignments;
+		std::vector<SeedHit> seeds;
 
 		try
 		{
 			if (seeder.mode != Seeder::Mode::None)
 			{
 				auto timeStart = std::chrono::system_clock::now();
-				std::vector<SeedHit> seeds = seeder.getSeeds(fastq->seq_id, fastq->sequence);
+				seeds = seeder.getSeeds(fastq->seq_id, fastq->sequence);
 				auto timeEnd = std::chrono::system_clock::now();
 				size_t time = std::chrono::duration_cast<std::chrono::milliseconds>(timeEnd - timeStart).count();
 				coutoutput << "Read " << fastq->seq_id << " seeding took " << time << "ms" << BufferedWriter::Flush;
@@ -270,16 +729,17 @@ void runComponentMappings(const AlignmentGraph& alignmentGraph, moodycamel::Conc
 					cerroutput << "Read " << fastq->seq_id << " has no seed hits" << BufferedWriter::Flush;
 					coutoutput << "Read " << fastq->seq_id << " alignment failed" << BufferedWriter::Flush;
 					cerroutput << "Read " << fastq->seq_id << " alignment failed" << BufferedWriter::Flush;
+					enqueueUnaligned(*fastq, params, alignmentsOut, token);
 					continue;
 				}
 				stats.seedsFound += seeds.size();
 				stats.readsWithASeed += 1;
 				stats.bpInReadsWithASeed += fastq->sequence.size();
-				alignments = AlignOneWay(alignmentGraph, fastq->seq_id, fastq->sequence, params.initialBandwidth, params.rampBandwidth, params.maxCellsPerSlice, !params.verboseMode, !params.tryAllSeeds, seeds, reusableState, !params.highMemory, params.forceGlobal, params.preciseClipping);
+				alignments = alignSeeded(alignmentGraph, fastq->seq_id, fastq->sequence, seeds, params, reusableState, localState, stats, coutoutput);
 			}
 			else
 			{
-				alignments = AlignOneWay(alignmentGraph, fastq->seq_id, fastq->sequence, params.initialBandwidth, params.rampBandwidth, !params.verboseMode, reusableState, !params.highMemory, params.forceGlobal, params.preciseClipping);
+				alignments = AlignOneWay(alignmentGraph, fastq->seq_id, fastq->sequence, params.initialBandwidth, params.rampBandwidth, !params.verboseMode, reusableState, !params.highMemory, params.forceGlobal, params.preciseClipping, params.prefetchDistance);
 			}
 		}
 		catch (const ThreadReadAssertion::AssertionFailure& a)
@@ -287,111 +747,20 @@ void runComponentMappings(const AlignmentGraph& alignmentGraph, moodycamel::Conc
 			coutoutput << "Read " << fastq->seq_id << " alignment failed (assertion!)" << BufferedWriter::Flush;
 			cerroutput << "Read " << fastq->seq_id << " alignment failed (assertion!)" << BufferedWriter::Flush;
 			reusableState.clear();
+			localState.clear();
 			stats.assertionBroke = true;
+			enqueueUnaligned(*fastq, params, alignmentsOut, token);
 			continue;
 		}
 
-		//failed alignment, don't output
-		if (alignments.alignments.size() == 0)
-		{
-			coutoutput << "Read " << fastq->seq_id << " alignment failed" << BufferedWriter::Flush;
-			cerroutput << "Read " << fastq->seq_id << " alignment failed" << BufferedWriter::Flush;
-			continue;
-		}
-
-		stats.seedsExtended += alignments.seedsExtended;
-		stats.readsWithAnAlignment += 1;
-
-		if (!params.outputAllAlns)
-		{
-			alignments.alignments = CommonUtils::SelectAlignments(alignments.alignments, std::numeric_limits<size_t>::max(), [](const AlignmentResult::AlignmentItem& aln) { return aln.alignment.get(); });
-		}
-		
-		std::sort(alignments.alignments.begin(), alignments.alignments.end(), [](const AlignmentResult::AlignmentItem& left, const AlignmentResult::AlignmentItem& right) { return left.alignmentStart < right.alignmentStart; });
-
-		std::string alignmentpositions;
-		size_t timems = 0;
-		size_t totalcells = 0;
-		std::stringstream strstr;
-		::google::protobuf::io::ZeroCopyOutputStream *raw_out;
-		::google::protobuf::io::GzipOutputStream *gzip_out;
-		::google::protobuf::io::CodedOutputStream *coded_out;
-		if (!params.outputJSON)
-		{
-			raw_out = new ::google::protobuf::io::OstreamOutputStream(&strstr);
-		    gzip_out = new ::google::protobuf::io::GzipOutputStream(raw_out);
-		    coded_out = new ::google::protobuf::io::CodedOutputStream(gzip_out);
-			coded_out->WriteVarint64(alignments.alignments.size());
-		}
-		for (size_t i = 0; i < alignments.alignments.size(); i++)
-		{
-			try
-			{
-				assert(!alignments.alignments[i].alignmentFailed());
-				assert(alignments.alignments[i].alignment != nullptr);
-			}
-			catch (const ThreadReadAssertion::AssertionFailure& a)
-			{
-				reusableState.clear();
-				stats.assertionBroke = true;
-				continue;
-			}
-			stats.alignments += 1;
-			if (alignments.alignments[i].alignment->sequence().size() == fastq->sequence.size())
-			{
-				stats.fullLengthAlignments += 1;
-				stats.bpInFullAlignments += alignments.alignments[i].alignment->sequence().size();
-			}
-			stats.bpInAlignments += alignments.alignments[i].alignment->sequence().size();
-			replaceDigraphNodeIdsWithOriginalNodeIds(*alignments.alignments[i].alignment, alignmentGraph);
-			alignmentpositions += std::to_string(alignments.alignments[i].alignmentStart) + "-" + std::to_string(alignments.alignments[i].alignmentEnd) + ", ";
-			timems += alignments.alignments[i].elapsedMilliseconds;
-			totalcells += alignments.alignments[i].cellsProcessed;
-			if (params.outputJSON)
-			{
-				google::protobuf::util::JsonPrintOptions options;
-				options.preserve_proto_field_names = true;
-				std::string s;
-				google::protobuf::util::MessageToJsonString(*alignments.alignments[i].alignment, &s, options);
-				strstr << s;
-				strstr << '\n';
-			}
-			else
-			{
-				std::string s;
-				alignments.alignments[i].alignment->SerializeToString(&s);
-				coded_out->WriteVarint32(s.size());
-				coded_out->WriteRaw(s.data(), s.size());
-			}
-		}
-		if (!params.outputJSON)
-		{
-			delete coded_out;
-			delete gzip_out;
-			delete raw_out;
-		}
-		std::string* writeAlns = new std::string { strstr.str() };
-		size_t waited = 0;
-		while (!alignmentsOut.try_enqueue(token, writeAlns) && !alignmentsOut.try_enqueue(writeAlns))
-		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-			waited++;
-			if (waited >= 1000)
-			{
-				if (alignmentsOut.size_approx() < 100 && alignmentsOut.enqueue(writeAlns)) break;
-			}
-		}
-		alignmentpositions.pop_back();
-		alignmentpositions.pop_back();
-
-		coutoutput << "Read " << fastq->seq_id << " alignment took " << timems << "ms" << BufferedWriter::Flush;
-		coutoutput << "Read " << fastq->seq_id << " aligned by thread " << threadnum << " with positions: " << alignmentpositions << " (read " << fastq->sequence.size() << "bp)" << BufferedWriter::Flush;
+		if (deferToSecondPass(fastq, seeds, alignments, secondPass, stats, coutoutput)) continue;
+		writeReadAlignments(alignmentGraph, *fastq, alignments, threadnum, params, reusableState, alignmentsOut, token, stats, coutoutput, cerroutput);
 	}
 	assertSetRead("After all reads", "No seed");
 	coutoutput << "Thread " << threadnum << " finished" << BufferedWriter::Flush;
 }
 
-AlignmentGraph getGraph(std::string graphFile, MummerSeeder** seeder, bool loadSeeder, bool tryDAG, const std::string& seederCachePrefix)
+AlignmentGraph loadGraph(std::string graphFile, MummerSeeder** seeder, bool loadSeeder, bool seederEdges, bool tryDAG, const std::string& seederCachePrefix)
 {
 	if (is_file_exist(graphFile)){
 		std::cout << "Load graph from " << graphFile << std::endl;
@@ -408,7 +777,7 @@ AlignmentGraph getGraph(std::string graphFile, MummerSeeder** seeder, bool loadS
 			{
 				auto graph = CommonUtils::LoadVGGraph(graphFile);
 				std::cout << "Build seeder from the graph" << std::endl;
-				*seeder = new MummerSeeder { graph, seederCachePrefix };
+				*seeder = new MummerSeeder { graph, seederCachePrefix, seederEdges };
 				return DirectedGraph::BuildFromVG(graph, tryDAG);
 			}
 			else
@@ -422,7 +791,7 @@ AlignmentGraph getGraph(std::string graphFile, MummerSeeder** seeder, bool loadS
 			if (loadSeeder)
 			{
 				std::cout << "Build seeder from the graph" << std::endl;
-				*seeder = new MummerSeeder { graph, seederCachePrefix };
+				*seeder = new MummerSeeder { graph, seederCachePrefix, seederEdges };
 			}
 			return DirectedGraph::BuildFromGFA(graph, tryDAG);
 		}
@@ -440,6 +809,58 @@ AlignmentGraph getGraph(std::string graphFile, MummerSeeder** seeder, bool loadS
 	}
 }
 
+MummerSeeder* loadSeederOnly(std::string graphFile, bool seederEdges, const std::string& seederCachePrefix)
+{
+	if (!is_file_exist(graphFile))
+	{
+		std::cerr << "No graph file exists" << std::endl;
+		std::exit(0);
+	}
+	std::cout << "Build seeder from " << graphFile << std::endl;
+	if (graphFile.substr(graphFile.size()-3) == ".vg")
+	{
+		return new MummerSeeder { CommonUtils::LoadVGGraph(graphFile), seederCachePrefix, seederEdges };
+	}
+	else if (graphFile.substr(graphFile.size() - 4) == ".gfa")
+	{
+		return new MummerSeeder { GfaGraph::LoadFromFile(graphFile, true), seederCachePrefix, seederEdges };
+	}
+	std::cerr << "Unknown graph type (" << graphFile << ")" << std::endl;
+	std::exit(0);
+}
+
+AlignmentGraph getGraph(std::string graphFile, MummerSeeder** seeder, bool loadSeeder, bool seederEdges, bool tryDAG, const std::string& seederCachePrefix, const std::string& outOfCoreGraphFile)
+{
+	if (outOfCoreGraphFile.size() == 0) return loadGraph(graphFile, seeder, loadSeeder, seederEdges, tryDAG, seederCachePrefix);
+	try
+	{
+		if (is_file_exist(outOfCoreGraphFile) && AlignmentGraph::BuiltFromSource(outOfCoreGraphFile, graphFile))
+		{
+			std::cout << "Reuse graph file " << outOfCoreGraphFile << std::endl;
+		}
+		else
+		{
+			if (is_file_exist(outOfCoreGraphFile)) std::cout << outOfCoreGraphFile << " is from a different graph or version, rebuild it" << std::endl;
+			//the graph has to be built in memory once. the seeder is built only after the graph is written and freed so they don't need memory at the same time
+			auto source = AlignmentGraph::StampSource(graphFile, true);
+			auto graph = loadGraph(graphFile, seeder, false, seederEdges, tryDAG, seederCachePrefix);
+			graph.RenumberForLocality();
+			std::cout << "Write graph to " << outOfCoreGraphFile << std::endl;
+			graph.SaveToFile(outOfCoreGraphFile, source);
+		}
+		//the seeder is built from the original graph
+		if (loadSeeder) *seeder = loadSeederOnly(graphFile, seederEdges, seederCachePrefix);
+		std::cout << "Map graph from " << outOfCoreGraphFile << std::endl;
+		return AlignmentGraph::LoadMapped(outOfCoreGraphFile, tryDAG);
+	}
+	catch (const CommonUtils::InvalidGraphException& e)
+	{
+		std::cout << "Error in the graph: " << e.what() << std::endl;
+		std::cerr << "Error in the graph: " << e.what() << std::endl;
+		std::exit(1);
+	}
+}
+
 void alignReads(AlignerParams params)
 {
 	assertSetRead("Preprocessing", "No seed");
@@ -447,7 +868,17 @@ void alignReads(AlignerParams params)
 	const std::unordered_map<std::string, std::vector<SeedHit>>* seedHitsToThreads = nullptr;
 	std::unordered_map<std::string, std::vector<SeedHit>> seedHits;
 	MummerSeeder* mummerseeder = nullptr;
-	auto alignmentGraph = getGraph(params.graphFile, &mummerseeder, params.mumCount != 0 || params.memCount != 0, params.maxCellsPerSlice == std::numeric_limits<size_t>::max(), params.seederCachePrefix);
+	auto alignmentGraph = getGraph(params.graphFile, &mummerseeder, params.mumCount != 0 || params.memCount != 0, params.memEdgeSpanning, params.maxCellsPerSlice == std::numeric_limits<size_t>::max(), params.seederCachePrefix, params.outOfCoreGraphFile);
+
+	if (params.hugePages)
+	{
+		if (!HugePages::TransparentHugePagesEnabled())
+		{
+			std::cerr << "Transparent huge pages are disabled in the kernel, --huge-pages has no effect" << std::endl;
+		}
+		alignmentGraph.MoveToHugePages();
+		if (mummerseeder != nullptr) mummerseeder->AdviseHugePages();
+	}
 
 	if (params.seedFiles.size() > 0)
 	{
@@ -455,13 +886,12 @@ void alignReads(AlignerParams params)
 		{
 			if (is_file_exist(file)){
 				std::cout << "Load seeds from " << file << std::endl;
-				std::ifstream seedfile { file, std::ios::in | std::ios::binary };
 				size_t numSeeds = 0;
 				std::function<void(vg::Alignment&)> alignmentLambda = [&seedHits, &numSeeds](vg::Alignment& seedhit) {
 					seedHits[seedhit.name()].emplace_back(seedhit.path().mapping(0).position().node_id(), seedhit.path().mapping(0).position().offset(), seedhit.query_position(), seedhit.path().mapping(0).edit(0).from_length(), seedhit.path().mapping(0).position().is_reverse());
 					numSeeds += 1;
 				};
-				stream::for_each(seedfile, alignmentLambda);
+				GamReader::ForEachOrdered(file, params.numThreads, alignmentLambda);
 				std::cout << numSeeds << " seeds" << std::endl;
 			}
 			else {
@@ -483,7 +913,9 @@ void alignReads(AlignerParams params)
 			std::cout << "MUM seeds, min length " << seeder.mxmLength << ", max count " << seeder.mumCount << std::endl;
 			break;
 		case Seeder::Mode::Mem:
-			std::cout << "MEM seeds, min length " << seeder.mxmLength << ", max count " << seeder.memCount << std::endl;
+			std::cout << "MEM seeds, min length " << seeder.mxmLength << ", max count " << seeder.memCount;
+			if (seeder.memEdgeSpanning) std::cout << ", extended over edges";
+			std::cout << std::endl;
 			break;
 		case Seeder::Mode::None:
 			std::cout << "No seeds, calculate the entire first row. VERY SLOW!" << std::endl;
@@ -493,15 +925,35 @@ void alignReads(AlignerParams params)
 	std::cout << "Initial bandwidth " << params.initialBandwidth;
 	if (params.rampBandwidth > 0) std::cout << ", ramp bandwidth " << params.rampBandwidth;
 	if (params.maxCellsPerSlice != std::numeric_limits<size_t>::max()) std::cout << ", tangle effort " << params.maxCellsPerSlice;
+	if (params.prefetchDistance > 0) std::cout << ", prefetch distance " << params.prefetchDistance;
+	if (params.windowLength > 0) std::cout << ", " << params.windowLength << "bp windows with " << params.windowOverlap << "bp overlap";
+	if (params.seedStopCoverage > 0) std::cout << ", stop extending seeds at " << params.seedStopCoverage << " coverage with identity " << params.seedStopIdentity;
 	std::cout << std::endl;
 
+	//the first pass of a two pass run has no ramp and a low tangle effort, the reads it doesn't align end to end are aligned again with the normal settings
+	AlignerParams firstPassParams = params;
+	if (params.twoPass)
+	{
+		firstPassParams.rampBandwidth = 0;
+		firstPassParams.maxCellsPerSlice = params.firstPassTangleEffort;
+		std::cout << "Two passes, first pass with bandwidth " << firstPassParams.initialBandwidth << " and tangle effort " << firstPassParams.maxCellsPerSlice << std::endl;
+	}
+
 	std::vector<std::thread> threads;
 
 	assertSetRead("Running alignments", "No seed");
 
-	moodycamel::ConcurrentQueue<std::string*> outputAlns;
-	moodycamel::ConcurrentQueue<std::string*> deallocAlns;
+	moodycamel::ConcurrentQueue<ReadOutput*> outputAlns;
+	moodycamel::ConcurrentQueue<ReadOutput*> deallocAlns;
 	moodycamel::ConcurrentQueue<std::shared_ptr<FastQ>> readFastqsQueue;
+	moodycamel::ConcurrentQueue<ReadWindow> windowQueue;
+	SecondPassQueues secondPass;
+	//the second pass starts once every thread has finished the first, by then all of its reads are queued
+	size_t firstPassThreadsRunning = params.numThreads;
+	std::mutex firstPassMutex;
+	std::condition_variable firstPassFinished;
+	auto firstPassEnd = std::chrono::system_clock::now();
+	std::atomic<bool> secondPassQueued { true };
 	std::atomic<bool> readStreamingFinished { false };
 	std::atomic<bool> allThreadsDone { false };
 	std::atomic<bool> allWriteDone { false };
@@ -512,19 +964,91 @@ void alignReads(AlignerParams params)
 		tokens.emplace_back(outputAlns);
 	}
 
+	std::vector<NumaPlacement::NumaNode> numaNodes;
+	std::vector<std::unique_ptr<AlignmentGraph>> graphReplicas;
+	if (params.numaPinThreads)
+	{
+		numaNodes = NumaPlacement::GetNumaNodes();
+		if (numaNodes.size() == 0)
+		{
+			std::cerr << "Could not read the NUMA topology, threads are not pinned" << std::endl;
+		}
+		else
+		{
+			std::cout << "Pin threads to " << numaNodes.size() << " NUMA nodes" << std::endl;
+		}
+	}
+	if (params.numaReplicateGraph && numaNodes.size() > 1)
+	{
+		std::vector<bool> nodeUsed;
+		nodeUsed.resize(numaNodes.size(), false);
+		for (size_t i = 0; i < params.numThreads; i++)
+		{
+			nodeUsed[NumaPlacement::NodeForThread(i, params.numThreads, numaNodes.size())] = true;
+		}
+		std::cout << "Replicate the graph per NUMA node" << std::endl;
+		graphReplicas.resize(numaNodes.size());
+		std::vector<std::thread> replicators;
+		for (size_t i = 0; i < numaNodes.size(); i++)
+		{
+			if (!nodeUsed[i]) continue;
+			//copy from a thread running on the node so first-touch places the pages there
+			replicators.emplace_back([&numaNodes, &graphReplicas, &alignmentGraph, &params, i]()
+			{
+				NumaPlacement::PinCurrentThread(numaNodes[i]);
+				graphReplicas[i] = std::make_unique<AlignmentGraph>(alignmentGraph);
+				if (params.hugePages) graphReplicas[i]->MoveToHugePages();
+			});
+		}
+		for (size_t i = 0; i < replicators.size(); i++)
+		{
+			replicators[i].join();
+		}
+		//every thread uses a replica, the original isn't needed anymore
+		alignmentGraph = AlignmentGraph {};
+	}
+
 	std::cout << "Align" << std::endl;
 	AlignmentStats stats;
+	AlignmentStats secondPassStats;
+	std::vector<size_t> bpPerThread;
+	bpPerThread.resize(params.numThreads, 0);
+	auto alignStart = std::chrono::system_clock::now();
 	std::thread fastqThread { [files=params.fastqFiles, &readFastqsQueue, &readStreamingFinished]() { readFastqs(files, readFastqsQueue, readStreamingFinished); } };
-	std::thread writerThread { [file=params.outputAlignmentFile, &outputAlns, &deallocAlns, &allThreadsDone, &allWriteDone, verboseMode=params.verboseMode, outputJSON=params.outputJSON]() { consumeVGsAndWrite(file, outputAlns, deallocAlns, allThreadsDone, allWriteDone, verboseMode, outputJSON); } };
+	std::thread writerThread { [file=params.outputAlignmentFile, correctedFile=params.correctedOutFile, clippedFile=params.correctedClippedOutFile, &outputAlns, &deallocAlns, &allThreadsDone, &allWriteDone, verboseMode=params.verboseMode, outputJSON=params.outputJSON, writeReadIndex=params.writeReadIndex]() { consumeVGsAndWrite(file, correctedFile, clippedFile, outputAlns, deallocAlns, allThreadsDone, allWriteDone, verboseMode, outputJSON, writeReadIndex); } };
 	for (size_t i = 0; i < params.numThreads; i++)
 	{
-		threads.emplace_back([&alignmentGraph, &readFastqsQueue, &readStreamingFinished, i, seeder, params, &outputAlns, &tokens, &deallocAlns, &stats]() { runComponentMappings(alignmentGraph, readFastqsQueue, readStreamingFinished, i, seeder, params, outputAlns, tokens[i], deallocAlns, stats); });
+		threads.emplace_back([&alignmentGraph, &graphReplicas, &numaNodes, &readFastqsQueue, &readStreamingFinished, &windowQueue, &secondPass, &firstPassThreadsRunning, &firstPassMutex, &firstPassFinished, &firstPassEnd, &secondPassQueued, i, seeder, params, firstPassParams, &outputAlns, &tokens, &deallocAlns, &stats, &secondPassStats, &bpPerThread]()
+		{
+			const AlignmentGraph* graph = &alignmentGraph;
+			if (numaNodes.size() > 0)
+			{
+				//pin before runComponentMappings allocates the per-thread state so it is first-touched on the local node
+				size_t node = NumaPlacement::NodeForThread(i, params.numThreads, numaNodes.size());
+				NumaPlacement::PinCurrentThread(numaNodes[node]);
+				if (graphReplicas.size() > 0) graph = graphReplicas[node].get();
+			}
+			runComponentMappings(*graph, readFastqsQueue, readStreamingFinished, windowQueue, params.twoPass ? &secondPass : nullptr, i, seeder, firstPassParams, outputAlns, tokens[i], deallocAlns, stats, bpPerThread[i]);
+			if (!params.twoPass) return;
+			{
+				std::unique_lock<std::mutex> lock { firstPassMutex };
+				firstPassThreadsRunning -= 1;
+				if (firstPassThreadsRunning == 0)
+				{
+					firstPassEnd = std::chrono::system_clock::now();
+					firstPassFinished.notify_all();
+				}
+				firstPassFinished.wait(lock, [&firstPassThreadsRunning]() { return firstPassThreadsRunning == 0; });
+			}
+			runComponentMappings(*graph, secondPass.reads, secondPassQueued, secondPass.windows, nullptr, i, seeder, params, outputAlns, tokens[i], deallocAlns, secondPassStats, bpPerThread[i]);
+		});
 	}
 
 	for (size_t i = 0; i < params.numThreads; i++)
 	{
 		threads[i].join();
 	}
+	auto alignEnd = std::chrono::system_clock::now();
 	assertSetRead("Postprocessing", "No seed");
 
 	allThreadsDone = true;
@@ -534,20 +1058,68 @@ void alignReads(AlignerParams params)
 
 	if (mummerseeder != nullptr) delete mummerseeder;
 
-	std::string* dealloc;
+	ReadOutput* dealloc;
 	while (deallocAlns.try_dequeue(dealloc))
 	{
 		delete dealloc;
 	}
 
+	//the second pass reads are already counted as input reads and for their seeds in the first pass
+	stats.seedsExtended += secondPassStats.seedsExtended;
+	stats.seedLoopsStopped += secondPassStats.seedLoopsStopped;
+	stats.seedsDropped += secondPassStats.seedsDropped;
+	stats.readsWithAnAlignment += secondPassStats.readsWithAnAlignment;
+	stats.alignments += secondPassStats.alignments;
+	stats.fullLengthAlignments += secondPassStats.fullLengthAlignments;
+	stats.bpInAlignments += secondPassStats.bpInAlignments;
+	stats.bpInFullAlignments += secondPassStats.bpInFullAlignments;
+	if (secondPassStats.assertionBroke) stats.assertionBroke = true;
+
 	std::cout << "Alignment finished" << std::endl;
 	std::cout << "Input reads: " << stats.reads << " (" << stats.bpInReads << "bp)" << std::endl;
 	std::cout << "Seeds found: " << stats.seedsFound << std::endl;
 	std::cout << "Seeds extended: " << stats.seedsExtended << std::endl;
+	if (params.seedStopCoverage > 0)
+	{
+		std::cout << "Reads whose seed extension stopped at full coverage: " << stats.seedLoopsStopped << " (" << stats.seedsDropped << " seeds dropped)" << std::endl;
+	}
 	std::cout << "Reads with a seed: " << stats.readsWithASeed << " (" << stats.bpInReadsWithASeed << "bp)" << std::endl;
 	std::cout << "Reads with an alignment: " << stats.readsWithAnAlignment << std::endl;
 	std::cout << "Output alignments: " << stats.alignments << " (" << stats.bpInAlignments << "bp)" << std::endl;
 	std::cout << "Output end-to-end alignments: " << stats.fullLengthAlignments << " (" << stats.bpInFullAlignments << "bp)" << std::endl;
+	if (params.localSubgraph)
+	{
+		std::cout << "Average local subgraph size: " << (stats.readsWithASeed > 0 ? stats.localSubgraphNodes / stats.readsWithASeed : 0) << " nodes" << std::endl;
+	}
+	if (params.windowLength > 0)
+	{
+		std::cout << "Reads split into windows: " << stats.splitReads << " (" << stats.windows << " windows)" << std::endl;
+	}
+	if (params.twoPass)
+	{
+		std::cout << "Reads aligned again in the second pass: " << stats.deferredReads << " (" << stats.bpInDeferredReads << "bp), " << secondPassStats.readsWithAnAlignment << " with an alignment" << std::endl;
+		size_t firstPassTime = std::chrono::duration_cast<std::chrono::milliseconds>(firstPassEnd - alignStart).count();
+		size_t secondPassTime = std::chrono::duration_cast<std::chrono::milliseconds>(alignEnd - firstPassEnd).count();
+		std::cout << "First pass wall time: " << firstPassTime << "ms (" << (firstPassTime > 0 ? stats.bpInReads * 1000 / firstPassTime : 0) << "bp/s), second pass wall time: " << secondPassTime << "ms (" << (secondPassTime > 0 ? stats.bpInDeferredReads * 1000 / secondPassTime : 0) << "bp/s)" << std::endl;
+	}
+	size_t alignTime = std::chrono::duration_cast<std::chrono::milliseconds>(alignEnd - alignStart).count();
+	std::cout << "Alignment wall time: " << alignTime << "ms (" << (alignTime > 0 ? stats.bpInReads * 1000 / alignTime : 0) << "bp/s with " << params.numThreads << " threads)" << std::endl;
+	if (params.hugePages)
+	{
+		std::cout << "Huge page backed: " << HugePages::HugePageBackedBytes() / 1024 / 1024 << "MB of " << HugePages::AdvisedBytes() / 1024 / 1024 << "MB advised" << std::endl;
+	}
+	for (size_t node = 0; node < numaNodes.size(); node++)
+	{
+		size_t nodeThreads = 0;
+		size_t nodeBp = 0;
+		for (size_t i = 0; i < params.numThreads; i++)
+		{
+			if (NumaPlacement::NodeForThread(i, params.numThreads, numaNodes.size()) != node) continue;
+			nodeThreads += 1;
+			nodeBp += bpPerThread[i];
+		}
+		std::cout << "NUMA node " << numaNodes[node].id << ": " << nodeThreads << " threads, " << nodeBp << "bp (" << (alignTime > 0 && nodeThreads > 0 ? nodeBp * 1000 / alignTime / nodeThreads : 0) << "bp/s per thread)" << std::endl;
+	}
 	if (stats.assertionBroke)
 	{
 		std::cout << "Alignment broke with some reads. Look at stderr output." << std::endl;
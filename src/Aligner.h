@@ -23,11 +23,28 @@ struct AlignerParams
 	size_t mxmLength;
 	size_t mumCount;
 	size_t memCount;
+	bool memEdgeSpanning;
 	bool outputAllAlns;
 	std::string seederCachePrefix;
 	bool forceGlobal;
 	bool outputJSON;
 	bool preciseClipping;
+	bool numaPinThreads;
+	bool numaReplicateGraph;
+	bool hugePages;
+	std::string outOfCoreGraphFile;
+	bool writeReadIndex;
+	std::string correctedOutFile;
+	std::string correctedClippedOutFile;
+	size_t prefetchDistance;
+	bool localSubgraph;
+	size_t localSubgraphMargin;
+	size_t windowLength;
+	size_t windowOverlap;
+	bool twoPass;
+	size_t firstPassTangleEffort;
+	double seedStopCoverage;
+	double seedStopIdentity;
 };
 
 void alignReads(AlignerParams params);
@@ -45,12 +45,21 @@ int main(int argc, char** argv)
 		("verbose", "print progress messages")
 		("all-alignments", "return all alignments instead of the best non-overlapping alignments")
 		("try-all-seeds", "extend all seeds instead of a reasonable looking subset")
+		("seed-stop-coverage", boost::program_options::value<double>(), "stop extending seeds once the selected alignments cover this fraction of the read (float) (0 to extend all seeds)")
+		("seed-stop-identity", boost::program_options::value<double>(), "minimum identity of the alignments counted for --seed-stop-coverage (float)")
 		("global-alignment", "force the read to be aligned end-to-end even if the alignment score is poor")
+		("corrected-out", boost::program_options::value<std::string>(), "write the reads corrected with the graph sequences of their alignments, same output as ExtractCorrectedReads (.fasta)")
+		("corrected-clipped-out", boost::program_options::value<std::string>(), "write the graph sequences of the alignments, same output as ExtractPathSequence (.fasta)")
+		("read-index", "also write a read name index of the output to alignments-out.gai, for LookupGamReads (.gam only)")
+		("numa", "pin the aligner threads to NUMA nodes and allocate their working memory on the local node")
+		("numa-replicate-graph", "keep a copy of the graph on each NUMA node (implies --numa, uses more memory)")
+		("out-of-core-graph", boost::program_options::value<std::string>(), "store the processed graph to a file and map it from the disk instead of keeping it in memory, or reuse the file if it exists (filename)")
 	;
 	boost::program_options::options_description seeding("Seeding");
 	seeding.add_options()
 		("seeds-mum-count", boost::program_options::value<size_t>(), "arg longest maximal unique matches fully contained in a node (int) (-1 for all)")
 		("seeds-mem-count", boost::program_options::value<size_t>(), "arg longest maximal exact matches fully contained in a node (int) (-1 for all)")
+		("seeds-mem-edge-spanning", "extend the MEMs over edges so matches spanning several nodes are found as one seed")
 		("seeds-mxm-length", boost::program_options::value<size_t>(), "minimum length for maximal unique / exact matches (int)")
 		("seeds-mxm-cache-prefix", boost::program_options::value<std::string>(), "store the mum/mem seeding index to the disk for reuse, or reuse it if it exists (filename prefix)")
 		("seeds-file,s", boost::program_options::value<std::vector<std::string>>()->multitoken(), "external seeds (.gam)")
@@ -62,6 +71,14 @@ int main(int argc, char** argv)
 		("ramp-bandwidth,B", boost::program_options::value<size_t>(), "ramp bandwidth (int)")
 		("tangle-effort,C", boost::program_options::value<size_t>(), "tangle effort limit, higher results in slower but more accurate alignments (int) (-1 for unlimited)")
 		("high-memory", "use slightly less CPU but a lot more memory")
+		("huge-pages", "back the graph and the seeding index with transparent huge pages")
+		("local-subgraph", "align each read to a small subgraph extracted around its seeds instead of the whole graph")
+		("local-subgraph-margin", boost::program_options::value<size_t>(), "the local subgraph contains nodes within the read length plus arg bp of a seed (int)")
+		("prefetch-distance", boost::program_options::value<size_t>(), "prefetch the graph and DP data of the node arg steps ahead in the calculation queue (int) (0 for no prefetching)")
+		("window-length", boost::program_options::value<size_t>(), "split reads longer than arg bp into overlapping windows which are aligned in parallel and stitched together (int) (0 for no splitting)")
+		("window-overlap", boost::program_options::value<size_t>(), "overlap between consecutive windows (int)")
+		("two-pass", "align all reads first without the ramp and with a low tangle effort, then align the reads which didn't align end to end again with the normal settings")
+		("first-pass-tangle-effort", boost::program_options::value<size_t>(), "tangle effort of the first pass (int)")
 	;
 	boost::program_options::options_description hidden("hidden");
 	hidden.add_options()
@@ -112,11 +129,28 @@ int main(int argc, char** argv)
 	params.mxmLength = 20;
 	params.mumCount = 0;
 	params.memCount = 0;
+	params.memEdgeSpanning = false;
 	params.seederCachePrefix = "";
 	params.outputAllAlns = false;
 	params.forceGlobal = false;
 	params.outputJSON = false;
 	params.preciseClipping = false;
+	params.numaPinThreads = false;
+	params.numaReplicateGraph = false;
+	params.hugePages = false;
+	params.outOfCoreGraphFile = "";
+	params.writeReadIndex = false;
+	params.correctedOutFile = "";
+	params.correctedClippedOutFile = "";
+	params.prefetchDistance = 0;
+	params.localSubgraph = false;
+	params.localSubgraphMargin = 1000;
+	params.windowLength = 0;
+	params.windowOverlap = 10000;
+	params.twoPass = false;
+	params.firstPassTangleEffort = 1000;
+	params.seedStopCoverage = 0;
+	params.seedStopIdentity = 0.9;
 
 	if (vm.count("graph")) params.graphFile = vm["graph"].as<std::string>();
 	if (vm.count("reads")) params.fastqFiles = vm["reads"].as<std::vector<std::string>>();
@@ -127,12 +161,25 @@ int main(int argc, char** argv)
 	if (vm.count("seeds-file")) params.seedFiles = vm["seeds-file"].as<std::vector<std::string>>();
 	if (vm.count("seeds-mxm-length")) params.mxmLength = vm["seeds-mxm-length"].as<size_t>();
 	if (vm.count("seeds-mem-count")) params.memCount = vm["seeds-mem-count"].as<size_t>();
+	if (vm.count("seeds-mem-edge-spanning")) params.memEdgeSpanning = true;
 	if (vm.count("seeds-mum-count")) params.mumCount = vm["seeds-mum-count"].as<size_t>();
 	if (vm.count("seeds-mxm-cache-prefix")) params.seederCachePrefix = vm["seeds-mxm-cache-prefix"].as<std::string>();
+	if (vm.count("corrected-out")) params.correctedOutFile = vm["corrected-out"].as<std::string>();
+	if (vm.count("corrected-clipped-out")) params.correctedClippedOutFile = vm["corrected-clipped-out"].as<std::string>();
+	if (vm.count("out-of-core-graph")) params.outOfCoreGraphFile = vm["out-of-core-graph"].as<std::string>();
 	if (vm.count("seeds-first-full-rows")) params.dynamicRowStart = vm["seeds-first-full-rows"].as<int>();
 
 	if (vm.count("ramp-bandwidth")) params.rampBandwidth = vm["ramp-bandwidth"].as<size_t>();
 	if (vm.count("tangle-effort")) params.maxCellsPerSlice = vm["tangle-effort"].as<size_t>();
+	if (vm.count("local-subgraph")) params.localSubgraph = true;
+	if (vm.count("local-subgraph-margin")) params.localSubgraphMargin = vm["local-subgraph-margin"].as<size_t>();
+	if (vm.count("prefetch-distance")) params.prefetchDistance = vm["prefetch-distance"].as<size_t>();
+	if (vm.count("window-length")) params.windowLength = vm["window-length"].as<size_t>();
+	if (vm.count("window-overlap")) params.windowOverlap = vm["window-overlap"].as<size_t>();
+	if (vm.count("two-pass")) params.twoPass = true;
+	if (vm.count("seed-stop-coverage")) params.seedStopCoverage = vm["seed-stop-coverage"].as<double>();
+	if (vm.count("seed-stop-identity")) params.seedStopIdentity = vm["seed-stop-identity"].as<double>();
+	if (vm.count("first-pass-tangle-effort")) params.firstPassTangleEffort = vm["first-pass-tangle-effort"].as<size_t>();
 	if (vm.count("all-alignments"))
 	{
 		params.outputAllAlns = true;
@@ -143,6 +190,14 @@ int main(int argc, char** argv)
 	if (vm.count("high-memory")) params.highMemory = true;
 	if (vm.count("global-alignment")) params.forceGlobal = true;
 	if (vm.count("precise-clipping")) params.preciseClipping = true;
+	if (vm.count("huge-pages")) params.hugePages = true;
+	if (vm.count("read-index")) params.writeReadIndex = true;
+	if (vm.count("numa")) params.numaPinThreads = true;
+	if (vm.count("numa-replicate-graph"))
+	{
+		params.numaPinThreads = true;
+		params.numaReplicateGraph = true;
+	}
 
 	bool paramError = false;
 
@@ -156,9 +211,14 @@ int main(int argc, char** argv)
 		std::cerr << "read file must be given" << std::endl;
 		paramError = true;
 	}
-	if (params.outputAlignmentFile == "")
+	if (params.outputAlignmentFile == "" && params.correctedOutFile == "" && params.correctedClippedOutFile == "")
+	{
+		std::cerr << "alignments-out, corrected-out or corrected-clipped-out must be given" << std::endl;
+		paramError = true;
+	}
+	if (params.outputAlignmentFile == "" && params.writeReadIndex)
 	{
-		std::cerr << "alignments-out must be given" << std::endl;
+		std::cerr << "read index needs alignments-out" << std::endl;
 		paramError = true;
 	}
 	if (params.dynamicRowStart % 64 != 0)
@@ -193,6 +253,36 @@ int main(int argc, char** argv)
 		std::cerr << "mum/mem minimum length must be >= 2" << std::endl;
 		paramError = true;
 	}
+	if (params.memEdgeSpanning && params.memCount == 0)
+	{
+		std::cerr << "edge-spanning seeds need MEM seeding, use seeds-mem-count" << std::endl;
+		paramError = true;
+	}
+	if (params.localSubgraph && params.dynamicRowStart != 0)
+	{
+		std::cerr << "local subgraphs need seeds, can't be used with seeds-first-full-rows" << std::endl;
+		paramError = true;
+	}
+	if (params.windowLength != 0 && params.windowOverlap >= params.windowLength)
+	{
+		std::cerr << "window overlap must be smaller than the window length" << std::endl;
+		paramError = true;
+	}
+	if (params.windowLength != 0 && params.dynamicRowStart != 0)
+	{
+		std::cerr << "windows need seeds, can't be used with seeds-first-full-rows" << std::endl;
+		paramError = true;
+	}
+	if (params.seedStopCoverage < 0 || params.seedStopCoverage > 1)
+	{
+		std::cerr << "seed stop coverage must be between 0 and 1" << std::endl;
+		paramError = true;
+	}
+	if (params.seedStopIdentity < 0 || params.seedStopIdentity > 1)
+	{
+		std::cerr << "seed stop identity must be between 0 and 1" << std::endl;
+		paramError = true;
+	}
 	int pickedSeedingMethods = ((params.dynamicRowStart != 0) ? 1 : 0) + ((params.seedFiles.size() > 0) ? 1 : 0) + ((params.mumCount != 0) ? 1 : 0) + ((params.memCount != 0) ? 1 : 0);
 	if (pickedSeedingMethods == 0)
 	{
@@ -214,6 +304,11 @@ int main(int argc, char** argv)
 	if (params.outputAlignmentFile.size() >= 5 && params.outputAlignmentFile.substr(params.outputAlignmentFile.size()-5) == ".json")
 	{
 		params.outputJSON = true;
+		if (params.writeReadIndex)
+		{
+			std::cerr << "read index can only be written for .gam output" << std::endl;
+			std::exit(1);
+		}
 	}
 
 	omp_set_num_threads(params.numThreads);
@@ -2,18 +2,94 @@
 #include <limits>
 #include <algorithm>
 #include <queue>
+#include <unordered_set>
+#include <fstream>
+#include <cstring>
+#include <sys/stat.h>
 #include "AlignmentGraph.h"
 #include "CommonUtils.h"
 #include "ThreadReadAssertion.h"
+#include "HugePages.h"
+
+namespace
+{
+	int forwardNodeId(int nodeId)
+	{
+		return nodeId % 2 == 0 ? nodeId : nodeId - 1;
+	}
+
+	//reverse complement of the 32 bases packed in a chunk. the complement is 3-x for the encoding A0 C1 G2 T3
+	size_t reverseComplementChunk(size_t chunk)
+	{
+		chunk = ~chunk;
+		chunk = ((chunk >> 2) & 0x3333333333333333ull) | ((chunk & 0x3333333333333333ull) << 2);
+		chunk = ((chunk >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((chunk & 0x0F0F0F0F0F0F0F0Full) << 4);
+		return __builtin_bswap64(chunk);
+	}
+
+	size_t reverseBits(size_t bits)
+	{
+		bits = ((bits >> 1) & 0x5555555555555555ull) | ((bits & 0x5555555555555555ull) << 1);
+		bits = ((bits >> 2) & 0x3333333333333333ull) | ((bits & 0x3333333333333333ull) << 2);
+		bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((bits & 0x0F0F0F0F0F0F0F0Full) << 4);
+		return __builtin_bswap64(bits);
+	}
+
+	std::vector<size_t> renumber(const std::vector<size_t>& vec, const std::vector<size_t>& renumbering)
+	{
+		std::vector<size_t> result;
+		result.reserve(vec.size());
+		for (size_t i = 0; i < vec.size(); i++)
+		{
+			assert(vec[i] < renumbering.size());
+			result.push_back(renumbering[vec[i]]);
+		}
+		return result;
+	}
+
+	//the neighbors a reverse node would get from the opposite neighbors of its forward node, renumbered to the pairs
+	std::vector<size_t> mirrorNeighbors(const std::vector<size_t>& forwardNeighbors, const std::vector<size_t>& renumbering)
+	{
+		std::vector<size_t> result = renumber(forwardNeighbors, renumbering);
+		for (auto& neighbor : result)
+		{
+			neighbor ^= 1;
+		}
+		return result;
+	}
+
+	bool sameNeighbors(std::vector<size_t> left, std::vector<size_t> right)
+	{
+		std::sort(left.begin(), left.end());
+		std::sort(right.begin(), right.end());
+		return left == right;
+	}
+
+	template <typename T>
+	std::vector<T> reorder(const std::vector<T>& vec, const std::vector<size_t>& renumbering)
+	{
+		assert(vec.size() == renumbering.size());
+		std::vector<T> result;
+		result.resize(vec.size());
+		for (size_t i = 0; i < vec.size(); i++)
+		{
+			result[renumbering[i]] = vec[i];
+		}
+		return result;
+	}
+}
 
 AlignmentGraph::AlignmentGraph() :
 nodeLength(),
 nodeLookup(),
 nodeIDs(),
 inNeighbors(),
+reverseEdgesStored(false),
 nodeSequences(),
 ambiguousNodeSequences(),
+componentCount(0),
 firstAmbiguous(std::numeric_limits<size_t>::max()),
+maxEdgeOverlap(0),
 finalized(false)
 {
 }
@@ -25,9 +101,8 @@ void AlignmentGraph::ReserveNodes(size_t numNodes, size_t numSplitNodes)
 	nodeLookup.reserve(numNodes);
 	nodeIDs.reserve(numSplitNodes);
 	nodeLength.reserve(numSplitNodes);
-	inNeighbors.reserve(numSplitNodes);
-	outNeighbors.reserve(numSplitNodes);
-	reverse.reserve(numSplitNodes);
+	inNeighbors.lists.reserve(numSplitNodes);
+	outNeighbors.lists.reserve(numSplitNodes);
 	nodeOffset.reserve(numSplitNodes);
 }
 
@@ -47,10 +122,14 @@ void AlignmentGraph::AddNode(int nodeId, const std::string& sequence, const std:
 	{
 		if (breakpoints[breakpoint] == breakpoints[breakpoint-1]) continue;
 		assert(breakpoints[breakpoint] > breakpoints[breakpoint-1]);
-		for (size_t offset = breakpoints[breakpoint-1]; offset < breakpoints[breakpoint]; offset += SPLIT_NODE_SIZE)
+		size_t intervalSize = breakpoints[breakpoint] - breakpoints[breakpoint-1];
+		size_t size;
+		for (size_t offset = breakpoints[breakpoint-1]; offset < breakpoints[breakpoint]; offset += size)
 		{
-			size_t size = SPLIT_NODE_SIZE;
+			size = SPLIT_NODE_SIZE;
 			if (breakpoints[breakpoint] - offset < size) size = breakpoints[breakpoint] - offset;
+			//reverse nodes have the short piece first so their pieces are the reverse complements of the forward node's pieces
+			if (reverseNode && offset == breakpoints[breakpoint-1] && intervalSize % SPLIT_NODE_SIZE != 0) size = intervalSize % SPLIT_NODE_SIZE;
 			assert(size > 0);
 			AddNode(nodeId, offset, sequence.substr(offset, size), reverseNode);
 			if (offset > 0)
@@ -61,8 +140,8 @@ void AlignmentGraph::AddNode(int nodeId, const std::string& sequence, const std:
 				assert(nodeOffset.size() == outNeighbors.size());
 				assert(nodeIDs[outNeighbors.size()-2] == nodeIDs[outNeighbors.size()-1]);
 				assert(nodeOffset[outNeighbors.size()-2] + nodeLength[outNeighbors.size()-2] == nodeOffset[outNeighbors.size()-1]);
-				outNeighbors[outNeighbors.size()-2].push_back(outNeighbors.size()-1);
-				inNeighbors[inNeighbors.size()-1].push_back(inNeighbors.size()-2);
+				outNeighbors.lists[outNeighbors.size()-2].push_back(outNeighbors.size()-1);
+				inNeighbors.lists[inNeighbors.size()-1].push_back(inNeighbors.size()-2);
 			}
 		}
 	}
@@ -77,9 +156,8 @@ void AlignmentGraph::AddNode(int nodeId, int offset, const std::string& sequence
 	nodeLookup[nodeId].push_back(nodeLength.size());
 	nodeLength.push_back(sequence.size());
 	nodeIDs.push_back(nodeId);
-	inNeighbors.emplace_back();
-	outNeighbors.emplace_back();
-	reverse.push_back(reverseNode);
+	inNeighbors.lists.emplace_back();
+	outNeighbors.lists.emplace_back();
 	nodeOffset.push_back(offset);
 	NodeChunkSequence normalSeq;
 	for (size_t i = 0; i < CHUNKS_IN_NODE; i++)
@@ -229,9 +307,10 @@ void AlignmentGraph::AddEdgeNodeId(int node_id_from, int node_id_to, size_t star
 		}
 	}
 	assert(to != std::numeric_limits<size_t>::max());
+	maxEdgeOverlap = std::max(maxEdgeOverlap, startOffset);
 	//don't add double edges
-	if (std::find(inNeighbors[to].begin(), inNeighbors[to].end(), from) == inNeighbors[to].end()) inNeighbors[to].push_back(from);
-	if (std::find(outNeighbors[from].begin(), outNeighbors[from].end(), to) == outNeighbors[from].end()) outNeighbors[from].push_back(to);
+	if (std::find(inNeighbors.lists[to].begin(), inNeighbors.lists[to].end(), from) == inNeighbors.lists[to].end()) inNeighbors.lists[to].push_back(from);
+	if (std::find(outNeighbors.lists[from].begin(), outNeighbors.lists[from].end(), to) == outNeighbors.lists[from].end()) outNeighbors.lists[from].push_back(to);
 }
 
 void AlignmentGraph::Finalize(int wordSize, bool doComponents)
@@ -239,37 +318,39 @@ void AlignmentGraph::Finalize(int wordSize, bool doComponents)
 	assert(nodeSequences.size() + ambiguousNodeSequences.size() == nodeLength.size());
 	assert(inNeighbors.size() == nodeLength.size());
 	assert(outNeighbors.size() == nodeLength.size());
-	assert(reverse.size() == nodeLength.size());
 	assert(nodeIDs.size() == nodeLength.size());
-	RenumberAmbiguousToEnd();
+	FoldStrands();
 	ambiguousNodes.clear();
 	findLinearizable();
-	std::cout << nodeLookup.size() << " original nodes" << std::endl;
-	std::cout << nodeLength.size() << " split nodes" << std::endl;
-	std::cout << ambiguousNodeSequences.size() << " ambiguous split nodes" << std::endl;
+	std::cout << nodeLookup.size() * 2 << " original nodes" << std::endl;
+	std::cout << NodeSize() << " split nodes" << std::endl;
+	std::cout << ambiguousNodeSequences.size() * 2 << " ambiguous split nodes" << std::endl;
 	finalized = true;
 	int specialNodes = 0;
 	size_t edges = 0;
-	for (size_t i = 0; i < inNeighbors.size(); i++)
+	for (size_t i = 0; i < NodeSize(); i++)
 	{
-		inNeighbors[i].shrink_to_fit();
-		outNeighbors[i].shrink_to_fit();
-		if (inNeighbors[i].size() >= 2) specialNodes++;
-		edges += inNeighbors[i].size();
+		if (InNeighbors(i).size() >= 2) specialNodes++;
+		edges += InNeighbors(i).size();
 	}
 	std::cout << edges << " edges" << std::endl;
 	std::cout << specialNodes << " nodes with in-degree >= 2" << std::endl;
 	assert(nodeSequences.size() + ambiguousNodeSequences.size() == nodeLength.size());
 	assert(inNeighbors.size() == nodeLength.size());
 	assert(outNeighbors.size() == nodeLength.size());
-	assert(reverse.size() == nodeLength.size());
 	assert(nodeIDs.size() == nodeLength.size());
 	assert(nodeOffset.size() == nodeLength.size());
 	nodeLength.shrink_to_fit();
+	nodeOffset.shrink_to_fit();
 	nodeIDs.shrink_to_fit();
-	inNeighbors.shrink_to_fit();
-	outNeighbors.shrink_to_fit();
-	reverse.shrink_to_fit();
+	inNeighbors.Flatten();
+	outNeighbors.Flatten();
+	if (reverseEdgesStored)
+	{
+		std::cout << "edge overlaps, reverse strand edges stored separately" << std::endl;
+		reverseInNeighbors.Flatten();
+		reverseOutNeighbors.Flatten();
+	}
 	nodeSequences.shrink_to_fit();
 	ambiguousNodeSequences.shrink_to_fit();
 	if (doComponents)
@@ -288,35 +369,203 @@ void AlignmentGraph::Finalize(int wordSize, bool doComponents)
 #endif
 }
 
+//pairs each split node with its reverse complement piece and keeps only the forward node's data.
+//the pairs are numbered in the order of the forward nodes, ambiguous pairs at the end
+void AlignmentGraph::FoldStrands()
+{
+	assert(nodeSequences.size() + ambiguousNodeSequences.size() == nodeLength.size());
+	assert(ambiguousNodes.size() == nodeLength.size());
+	assert(firstAmbiguous == std::numeric_limits<size_t>::max());
+	assert(!finalized);
+	size_t numNodes = nodeLength.size();
+	std::vector<size_t> mirror;
+	mirror.resize(numNodes, std::numeric_limits<size_t>::max());
+	for (const auto& pair : nodeLookup)
+	{
+		if (pair.first != forwardNodeId(pair.first)) continue;
+		auto reverse = nodeLookup.find(pair.first + 1);
+		if (reverse == nodeLookup.end() || reverse->second.size() != pair.second.size())
+		{
+			throw CommonUtils::InvalidGraphException("The reverse complement of a node is missing or split at different positions");
+		}
+		size_t originalSize = originalNodeSize.at(pair.first);
+		for (size_t i = 0; i < pair.second.size(); i++)
+		{
+			size_t forward = pair.second[i];
+			size_t backward = reverse->second[pair.second.size()-1-i];
+			if (nodeLength[forward] != nodeLength[backward] || nodeOffset[backward] != originalSize - nodeOffset[forward] - nodeLength[forward] || ambiguousNodes[forward] != ambiguousNodes[backward])
+			{
+				throw CommonUtils::InvalidGraphException("The reverse complement of a node is missing or split at different positions");
+			}
+			mirror[forward] = backward;
+			mirror[backward] = forward;
+		}
+	}
+	size_t normalPairs = 0;
+	for (size_t i = 0; i < numNodes; i++)
+	{
+		if (mirror[i] == std::numeric_limits<size_t>::max()) throw CommonUtils::InvalidGraphException("The reverse complement of a node is missing or split at different positions");
+		if (nodeIDs[i] == forwardNodeId(nodeIDs[i]) && !ambiguousNodes[i]) normalPairs++;
+	}
+	assert(numNodes % 2 == 0);
+	size_t numPairs = numNodes / 2;
+	std::vector<size_t> sequenceIndex;
+	sequenceIndex.reserve(numNodes);
+	size_t normalIndex = 0;
+	size_t ambiguousIndex = 0;
+	for (size_t i = 0; i < numNodes; i++)
+	{
+		sequenceIndex.push_back(ambiguousNodes[i] ? ambiguousIndex++ : normalIndex++);
+	}
+	std::vector<size_t> renumbering;
+	renumbering.resize(numNodes, std::numeric_limits<size_t>::max());
+	std::vector<size_t> forwardNode;
+	forwardNode.resize(numPairs, std::numeric_limits<size_t>::max());
+	size_t nextNormal = 0;
+	size_t nextAmbiguous = normalPairs;
+	for (size_t i = 0; i < numNodes; i++)
+	{
+		if (nodeIDs[i] != forwardNodeId(nodeIDs[i])) continue;
+		size_t pair = ambiguousNodes[i] ? nextAmbiguous++ : nextNormal++;
+		renumbering[i] = pair * 2;
+		renumbering[mirror[i]] = pair * 2 + 1;
+		forwardNode[pair] = i;
+	}
+	assert(nextNormal == normalPairs);
+	assert(nextAmbiguous == numPairs);
+	firstAmbiguous = normalPairs * 2;
+	//the reverse nodes' edges can be derived only if every edge's mirror is also an edge
+	reverseEdgesStored = false;
+	for (size_t pair = 0; pair < numPairs && !reverseEdgesStored; pair++)
+	{
+		size_t i = forwardNode[pair];
+		if (!sameNeighbors(renumber(inNeighbors.lists[mirror[i]], renumbering), mirrorNeighbors(outNeighbors.lists[i], renumbering))) reverseEdgesStored = true;
+		if (!sameNeighbors(renumber(outNeighbors.lists[mirror[i]], renumbering), mirrorNeighbors(inNeighbors.lists[i], renumbering))) reverseEdgesStored = true;
+	}
+
+	std::vector<size_t> newLength;
+	std::vector<size_t> newOffset;
+	std::vector<int> newIDs;
+	std::vector<std::vector<size_t>> newIn;
+	std::vector<std::vector<size_t>> newOut;
+	std::vector<std::vector<size_t>> newReverseIn;
+	std::vector<std::vector<size_t>> newReverseOut;
+	std::vector<NodeChunkSequence> newSequences;
+	std::vector<AmbiguousChunkSequence> newAmbiguousSequences;
+	newLength.reserve(numPairs);
+	newOffset.reserve(numPairs);
+	newIDs.reserve(numPairs);
+	newIn.reserve(numPairs);
+	newOut.reserve(numPairs);
+	newSequences.reserve(normalPairs);
+	newAmbiguousSequences.reserve(numPairs - normalPairs);
+	for (size_t pair = 0; pair < numPairs; pair++)
+	{
+		size_t i = forwardNode[pair];
+		newLength.push_back(nodeLength[i]);
+		newOffset.push_back(nodeOffset[i]);
+		newIDs.push_back(nodeIDs[i]);
+		newIn.push_back(renumber(inNeighbors.lists[i], renumbering));
+		newOut.push_back(renumber(outNeighbors.lists[i], renumbering));
+		if (reverseEdgesStored)
+		{
+			newReverseIn.push_back(renumber(inNeighbors.lists[mirror[i]], renumbering));
+			newReverseOut.push_back(renumber(outNeighbors.lists[mirror[i]], renumbering));
+		}
+		if (ambiguousNodes[i])
+		{
+			newAmbiguousSequences.push_back(ambiguousNodeSequences[sequenceIndex[i]]);
+		}
+		else
+		{
+			newSequences.push_back(nodeSequences[sequenceIndex[i]]);
+		}
+	}
+	std::swap(nodeLength, newLength);
+	std::swap(nodeOffset, newOffset);
+	std::swap(nodeIDs, newIDs);
+	std::swap(inNeighbors.lists, newIn);
+	std::swap(outNeighbors.lists, newOut);
+	std::swap(reverseInNeighbors.lists, newReverseIn);
+	std::swap(reverseOutNeighbors.lists, newReverseOut);
+	std::swap(nodeSequences.Vector(), newSequences);
+	std::swap(ambiguousNodeSequences.Vector(), newAmbiguousSequences);
+#ifdef EXTRACORRECTNESSASSERTIONS
+	//the derived reverse nodes must match the ones that were built
+	for (size_t pair = 0; pair < numPairs; pair++)
+	{
+		size_t backward = mirror[forwardNode[pair]];
+		assert(sameNeighbors(renumber(newIn[backward], renumbering), std::vector<size_t>(InNeighbors(pair * 2 + 1).begin(), InNeighbors(pair * 2 + 1).end())));
+		assert(sameNeighbors(renumber(newOut[backward], renumbering), std::vector<size_t>(OutNeighbors(pair * 2 + 1).begin(), OutNeighbors(pair * 2 + 1).end())));
+		if (pair * 2 < firstAmbiguous)
+		{
+			auto chunks = NodeChunks(pair * 2 + 1);
+			for (size_t i = 0; i < CHUNKS_IN_NODE; i++)
+			{
+				assert(chunks[i] == newSequences[sequenceIndex[backward]][i]);
+			}
+		}
+		else
+		{
+			auto chunks = AmbiguousNodeChunks(pair * 2 + 1);
+			assert(chunks.A == newAmbiguousSequences[sequenceIndex[backward]].A);
+			assert(chunks.C == newAmbiguousSequences[sequenceIndex[backward]].C);
+			assert(chunks.G == newAmbiguousSequences[sequenceIndex[backward]].G);
+			assert(chunks.T == newAmbiguousSequences[sequenceIndex[backward]].T);
+		}
+	}
+#endif
+
+	std::unordered_map<int, std::vector<size_t>> newLookup;
+	for (const auto& pair : nodeLookup)
+	{
+		if (pair.first != forwardNodeId(pair.first)) continue;
+		auto& pairs = newLookup[pair.first];
+		for (auto node : pair.second)
+		{
+			pairs.push_back(renumbering[node] / 2);
+		}
+	}
+	std::swap(nodeLookup, newLookup);
+	for (auto iter = originalNodeSize.begin(); iter != originalNodeSize.end();)
+	{
+		if (iter->first != forwardNodeId(iter->first)) iter = originalNodeSize.erase(iter); else ++iter;
+	}
+	for (auto iter = originalNodeName.begin(); iter != originalNodeName.end();)
+	{
+		if (iter->first != forwardNodeId(iter->first)) iter = originalNodeName.erase(iter); else ++iter;
+	}
+}
+
 void AlignmentGraph::findLinearizable()
 {
-	linearizable.resize(nodeLength.size(), false);
+	linearizable.resize(NodeSize(), false);
 	std::vector<bool> checked;
-	checked.resize(nodeLength.size(), false);
+	checked.resize(NodeSize(), false);
 	std::vector<size_t> stack;
 	std::vector<bool> onStack;
-	onStack.resize(nodeLength.size(), false);
-	for (size_t node = 0; node < nodeLength.size(); node++)
+	onStack.resize(NodeSize(), false);
+	for (size_t node = 0; node < NodeSize(); node++)
 	{
 		if (checked[node]) continue;
-		if (inNeighbors[node].size() != 1)
+		if (InNeighbors(node).size() != 1)
 		{
 			checked[node] = true;
 			continue;
 		}
 		checked[node] = true;
-		assert(inNeighbors[node].size() == 1);
+		assert(InNeighbors(node).size() == 1);
 		assert(stack.size() == 0);
 		stack.push_back(node);
 		onStack[node] = true;
 		while (true)
 		{
-			assert(stack.size() <= nodeLength.size());
-			if (inNeighbors[stack.back()].size() != 1)
+			assert(stack.size() <= NodeSize());
+			if (InNeighbors(stack.back()).size() != 1)
 			{
 				for (size_t i = 0; i < stack.size()-1; i++)
 				{
-					assert(inNeighbors[stack[i]].size() == 1);
+					assert(InNeighbors(stack[i]).size() == 1);
 					checked[stack[i]] = true;
 					linearizable[stack[i]] = true;
 					onStack[stack[i]] = false;
@@ -327,12 +576,12 @@ void AlignmentGraph::findLinearizable()
 				stack.clear();
 				break;
 			}
-			assert(inNeighbors[stack.back()].size() == 1);
+			assert(InNeighbors(stack.back()).size() == 1);
 			if (checked[stack.back()])
 			{
 				for (size_t i = 0; i < stack.size()-1; i++)
 				{
-					assert(inNeighbors[stack[i]].size() == 1);
+					assert(InNeighbors(stack[i]).size() == 1);
 					checked[stack[i]] = true;
 					linearizable[stack[i]] = true;
 					onStack[stack[i]] = false;
@@ -343,8 +592,8 @@ void AlignmentGraph::findLinearizable()
 				stack.clear();
 				break;
 			}
-			assert(inNeighbors[stack.back()].size() == 1);
-			auto neighbor = inNeighbors[stack.back()][0];
+			assert(InNeighbors(stack.back()).size() == 1);
+			auto neighbor = InNeighbors(stack.back())[0];
 			if (neighbor == node)
 			{
 				for (size_t i = 0; i < stack.size(); i++)
@@ -359,7 +608,7 @@ void AlignmentGraph::findLinearizable()
 			if (onStack[neighbor])
 			{
 				assert(neighbor != node);
-				size_t i = stack.size();
+				size_t i = stack.size()-1;
 				for (; i > 0; i--)
 				{
 					if (stack[i] == neighbor) break;
@@ -376,7 +625,7 @@ void AlignmentGraph::findLinearizable()
 				stack.clear();
 				break;
 			}
-			stack.push_back(inNeighbors[stack.back()][0]);
+			stack.push_back(InNeighbors(stack.back())[0]);
 			onStack[stack.back()] = true;
 		}
 	}
@@ -387,28 +636,83 @@ void AlignmentGraph::findLinearizable()
 #endif
 size_t AlignmentGraph::NodeLength(size_t index) const
 {
-	return nodeLength[index];
+	return nodeLength[index >> 1];
+}
+
+int AlignmentGraph::NodeID(size_t node) const
+{
+	return nodeIDs[node >> 1] + (node & 1);
+}
+
+size_t AlignmentGraph::NodeOffset(size_t node) const
+{
+	size_t pair = node >> 1;
+	if ((node & 1) == 0) return nodeOffset[pair];
+	return originalNodeSize.at(nodeIDs[pair]) - nodeOffset[pair] - nodeLength[pair];
+}
+
+size_t AlignmentGraph::OriginalNodeSize(int nodeId) const
+{
+	return originalNodeSize.at(forwardNodeId(nodeId));
+}
+
+size_t AlignmentGraph::ComponentNumber(size_t node) const
+{
+	size_t pair = node >> 1;
+	if ((node & 1) == 0) return componentNumber[pair];
+	return componentCount - 1 - componentNumber[pair];
+}
+
+size_t AlignmentGraph::GetReverseNode(size_t node) const
+{
+	return node ^ 1;
+}
+
+void AlignmentGraph::PrefetchNode(size_t node) const
+{
+	size_t pair = node >> 1;
+	if (node < firstAmbiguous)
+	{
+		__builtin_prefetch(nodeSequences.data() + pair);
+	}
+	else
+	{
+		__builtin_prefetch(ambiguousNodeSequences.data() + pair - firstAmbiguous / 2);
+	}
+	//only the list start, reading it to prefetch the neighbors would stall the caller
+	if ((node & 1) && reverseEdgesStored)
+	{
+		reverseOutNeighbors.prefetch(pair);
+	}
+	else if (node & 1)
+	{
+		inNeighbors.prefetch(pair);
+	}
+	else
+	{
+		outNeighbors.prefetch(pair);
+	}
 }
 
 char AlignmentGraph::NodeSequences(size_t node, size_t pos) const
 {
-	assert(pos < nodeLength[node]);
+	assert(pos < NodeLength(node));
 	if (node < firstAmbiguous)
 	{
-		assert(node < nodeSequences.size());
+		auto chunks = NodeChunks(node);
 		size_t chunk = pos / BP_IN_CHUNK;
 		size_t offset = (pos % BP_IN_CHUNK) * 2;
-		return "ACGT"[(nodeSequences[node][chunk] >> offset) & 3];
+		return "ACGT"[(chunks[chunk] >> offset) & 3];
 	}
 	else
 	{
 		assert(node >= firstAmbiguous);
-		assert(node - firstAmbiguous < ambiguousNodeSequences.size());
 		assert(pos < sizeof(size_t) * 8);
-		bool A = (ambiguousNodeSequences[node - firstAmbiguous].A >> pos) & 1;
-		bool C = (ambiguousNodeSequences[node - firstAmbiguous].C >> pos) & 1;
-		bool G = (ambiguousNodeSequences[node - firstAmbiguous].G >> pos) & 1;
-		bool T = (ambiguousNodeSequences[node - firstAmbiguous].T >> pos) & 1;
+		auto chunks = AmbiguousNodeChunks(node);
+		bool A = (chunks.A >> pos) & 1;
+		bool C = (chunks.C >> pos) & 1;
+		bool G = (chunks.G >> pos) & 1;
+		bool T = (chunks.T >> pos) & 1;
 		assert(A + C + G + T >= 1);
 		assert(A + C + G + T <= 4);
 		if ( A && !C && !G && !T) return 'A';
@@ -431,13 +735,38 @@ char AlignmentGraph::NodeSequences(size_t node, size_t pos) const
 	}
 }
 
+//the reverse node's sequence is the reverse complement of the forward node's packed sequence
 #ifdef NDEBUG
 	__attribute__((always_inline))
 #endif
 AlignmentGraph::NodeChunkSequence AlignmentGraph::NodeChunks(size_t index) const
 {
-	assert(index < nodeSequences.size());
-	return nodeSequences[index];
+	static_assert(CHUNKS_IN_NODE == 2, "reverse complement assumes two chunks per node");
+	size_t pair = index >> 1;
+	assert(pair < nodeSequences.size());
+	if ((index & 1) == 0) return nodeSequences[pair];
+	NodeChunkSequence forward = nodeSequences[pair];
+	//reversing all 64 bases puts the node's bases at the top, shift them down to the start
+	size_t low = reverseComplementChunk(forward[1]);
+	size_t high = reverseComplementChunk(forward[0]);
+	size_t shift = (SPLIT_NODE_SIZE - nodeLength[pair]) * 2;
+	NodeChunkSequence result;
+	if (shift == 0)
+	{
+		result[0] = low;
+		result[1] = high;
+	}
+	else if (shift < 64)
+	{
+		result[0] = (low >> shift) | (high << (64 - shift));
+		result[1] = high >> shift;
+	}
+	else
+	{
+		result[0] = high >> (shift - 64);
+		result[1] = 0;
+	}
+	return result;
 }
 
 #ifdef NDEBUG
@@ -446,13 +775,22 @@ AlignmentGraph::NodeChunkSequence AlignmentGraph::NodeChunks(size_t index) const
 AlignmentGraph::AmbiguousChunkSequence AlignmentGraph::AmbiguousNodeChunks(size_t index) const
 {
 	assert(index >= firstAmbiguous);
-	assert(index - firstAmbiguous < ambiguousNodeSequences.size());
-	return ambiguousNodeSequences[index - firstAmbiguous];
+	size_t pair = index >> 1;
+	assert(pair - firstAmbiguous / 2 < ambiguousNodeSequences.size());
+	AmbiguousChunkSequence forward = ambiguousNodeSequences[pair - firstAmbiguous / 2];
+	if ((index & 1) == 0) return forward;
+	size_t shift = SPLIT_NODE_SIZE - nodeLength[pair];
+	AmbiguousChunkSequence result;
+	result.A = reverseBits(forward.T) >> shift;
+	result.C = reverseBits(forward.G) >> shift;
+	result.G = reverseBits(forward.C) >> shift;
+	result.T = reverseBits(forward.A) >> shift;
+	return result;
 }
 
 size_t AlignmentGraph::NodeSize() const
 {
-	return nodeLength.size();
+	return nodeLength.size() * 2;
 }
 
 class NodeWithDistance
@@ -470,26 +808,156 @@ public:
 
 size_t AlignmentGraph::GetUnitigNode(int nodeId, size_t offset) const
 {
-	const auto& nodes = nodeLookup.at(nodeId);
-	assert(nodes.size() > 0);
+	//the pieces are stored in the forward node's offsets
+	int forwardId = forwardNodeId(nodeId);
+	size_t originalSize = originalNodeSize.at(forwardId);
+	assert(offset < originalSize);
+	if (nodeId != forwardId) offset = originalSize - 1 - offset;
+	const auto& pairs = nodeLookup.at(forwardId);
+	assert(pairs.size() > 0);
 	//guess the index
-	size_t index = nodes.size() * ((double)offset / (double)originalNodeSize.at(nodeId));
-	if (index >= nodes.size()) index = nodes.size()-1;
+	size_t index = pairs.size() * ((double)offset / (double)originalSize);
+	if (index >= pairs.size()) index = pairs.size()-1;
 	//go to the exact index
-	while (index < nodes.size()-1 && (nodeOffset[nodes[index]] + NodeLength(nodes[index]) <= offset)) index++;
-	while (index > 0 && (nodeOffset[nodes[index]] > offset)) index--;
-	assert(index != nodes.size());
-	size_t result = nodes[index];
-	assert(nodeOffset[result] <= offset);
-	assert(nodeOffset[result] + NodeLength(result) > offset);
+	while (index < pairs.size()-1 && (nodeOffset[pairs[index]] + nodeLength[pairs[index]] <= offset)) index++;
+	while (index > 0 && (nodeOffset[pairs[index]] > offset)) index--;
+	assert(index != pairs.size());
+	size_t pair = pairs[index];
+	assert(nodeOffset[pair] <= offset);
+	assert(nodeOffset[pair] + nodeLength[pair] > offset);
+	return pair * 2 + (nodeId != forwardId ? 1 : 0);
+}
+
+AlignmentGraph AlignmentGraph::GetLocalSubgraph(const std::vector<std::pair<int, size_t>>& positions, size_t maxDistance) const
+{
+	assert(finalized);
+	std::unordered_map<size_t, size_t> distance;
+	std::priority_queue<NodeWithDistance, std::vector<NodeWithDistance>, std::greater<NodeWithDistance>> queue;
+	for (auto pos : positions)
+	{
+		queue.emplace(GetUnitigNode(pos.first, pos.second), true, 0);
+	}
+	while (queue.size() > 0)
+	{
+		auto top = queue.top();
+		queue.pop();
+		if (top.distance > maxDistance) break;
+		auto found = distance.find(top.node);
+		if (found != distance.end() && found->second <= top.distance) continue;
+		distance[top.node] = top.distance;
+		for (auto neighbor : OutNeighbors(top.node))
+		{
+			queue.emplace(neighbor, true, top.distance + NodeLength(top.node));
+		}
+		for (auto neighbor : InNeighbors(top.node))
+		{
+			queue.emplace(neighbor, true, top.distance + NodeLength(neighbor));
+		}
+	}
+	//whole original nodes with both strands, so the backwards part of a seed can be aligned
+	std::unordered_set<int> originalNodes;
+	for (auto pair : distance)
+	{
+		originalNodes.insert(nodeIDs[pair.first >> 1]);
+	}
+	std::vector<size_t> included;
+	for (auto nodeId : originalNodes)
+	{
+		auto found = nodeLookup.find(nodeId);
+		assert(found != nodeLookup.end());
+		included.insert(included.end(), found->second.begin(), found->second.end());
+	}
+	//keeps the ambiguous nodes at the end and the original locality
+	std::sort(included.begin(), included.end());
+	return GetSubgraph(included);
+}
+
+AlignmentGraph AlignmentGraph::GetSubgraph(const std::vector<size_t>& pairs) const
+{
+	assert(finalized);
+	std::unordered_map<size_t, size_t> pairMapping;
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		assert(i == 0 || pairs[i] > pairs[i-1]);
+		pairMapping[pairs[i]] = i;
+	}
+	AlignmentGraph result;
+	result.ReserveNodes(pairs.size(), pairs.size());
+	result.inNeighbors.lists.resize(pairs.size());
+	result.outNeighbors.lists.resize(pairs.size());
+	result.reverseEdgesStored = reverseEdgesStored;
+	if (reverseEdgesStored)
+	{
+		result.reverseInNeighbors.lists.resize(pairs.size());
+		result.reverseOutNeighbors.lists.resize(pairs.size());
+	}
+	result.firstAmbiguous = pairs.size() * 2;
+	result.maxEdgeOverlap = maxEdgeOverlap;
+	const NeighborLists* oldLists[4] { &inNeighbors, &outNeighbors, &reverseInNeighbors, &reverseOutNeighbors };
+	NeighborLists* newLists[4] { &result.inNeighbors, &result.outNeighbors, &result.reverseInNeighbors, &result.reverseOutNeighbors };
+	size_t listCount = reverseEdgesStored ? 4 : 2;
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		size_t old = pairs[i];
+		assert(old < nodeLength.size());
+		result.nodeLength.push_back(nodeLength[old]);
+		result.nodeOffset.push_back(nodeOffset[old]);
+		result.nodeIDs.push_back(nodeIDs[old]);
+		result.nodeLookup[nodeIDs[old]].push_back(i);
+		if (old * 2 < firstAmbiguous)
+		{
+			//ambiguous nodes must be mapped after all non-ambiguous nodes
+			assert(result.ambiguousNodeSequences.size() == 0);
+			result.nodeSequences.push_back(nodeSequences[old]);
+		}
+		else
+		{
+			if (result.firstAmbiguous == pairs.size() * 2) result.firstAmbiguous = i * 2;
+			result.ambiguousNodeSequences.push_back(ambiguousNodeSequences[old - firstAmbiguous / 2]);
+		}
+		for (size_t list = 0; list < listCount; list++)
+		{
+			for (auto neighbor : oldLists[list]->Get(old, 0))
+			{
+				auto found = pairMapping.find(neighbor >> 1);
+				if (found == pairMapping.end()) continue;
+				newLists[list]->lists[i].push_back(found->second * 2 + (neighbor & 1));
+			}
+		}
+	}
+	for (auto& pair : result.nodeLookup)
+	{
+		std::sort(pair.second.begin(), pair.second.end(), [&result](size_t left, size_t right) { return result.nodeOffset[left] < result.nodeOffset[right]; });
+		result.originalNodeSize[pair.first] = originalNodeSize.at(pair.first);
+		auto name = originalNodeName.find(pair.first);
+		if (name != originalNodeName.end()) result.originalNodeName[pair.first] = name->second;
+#ifndef NDEBUG
+		size_t foundSize = 0;
+		for (auto node : pair.second)
+		{
+			foundSize += result.nodeLength[node];
+		}
+		//partial original nodes would break the position lookups
+		assert(foundSize == result.originalNodeSize[pair.first]);
+#endif
+	}
+	result.inNeighbors.Flatten();
+	result.outNeighbors.Flatten();
+	if (reverseEdgesStored)
+	{
+		result.reverseInNeighbors.Flatten();
+		result.reverseOutNeighbors.Flatten();
+	}
+	result.finalized = true;
+	result.findLinearizable();
+	if (componentNumber.size() > 0) result.doComponentOrder();
 	return result;
 }
 
 std::pair<int, size_t> AlignmentGraph::GetReversePosition(int nodeId, size_t offset) const
 {
-	assert(nodeLookup.count(nodeId) == 1);
-	const auto& nodes = nodeLookup.at(nodeId);
-	size_t originalSize = originalNodeSize.at(nodeId);
+	assert(nodeLookup.count(forwardNodeId(nodeId)) == 1);
+	size_t originalSize = OriginalNodeSize(nodeId);
 	assert(offset < originalSize);
 	size_t newOffset = originalSize - offset - 1;
 	assert(newOffset < originalSize);
@@ -524,123 +992,32 @@ bool AlignmentGraph::MatrixPosition::operator!=(const AlignmentGraph::MatrixPosi
 
 std::string AlignmentGraph::OriginalNodeName(int nodeId) const
 {
-	auto found = originalNodeName.find(nodeId);
+	auto found = originalNodeName.find(forwardNodeId(nodeId));
 	if (found == originalNodeName.end()) return "";
 	return found->second;
 }
 
-std::vector<size_t> renumber(const std::vector<size_t>& vec, const std::vector<size_t>& renumbering)
-{
-	std::vector<size_t> result;
-	result.reserve(vec.size());
-	for (size_t i = 0; i < vec.size(); i++)
-	{
-		assert(vec[i] < renumbering.size());
-		result.push_back(renumbering[vec[i]]);
-	}
-	return result;
-}
-
-template <typename T>
-std::vector<T> reorder(const std::vector<T>& vec, const std::vector<size_t>& renumbering)
+std::string AlignmentGraph::OriginalNodeSequence(int nodeId, size_t offset, size_t length) const
 {
-	assert(vec.size() == renumbering.size());
-	std::vector<T> result;
-	result.resize(vec.size());
-	for (size_t i = 0; i < vec.size(); i++)
+	size_t end = std::min(offset + length, OriginalNodeSize(nodeId));
+	std::string result;
+	result.reserve(end > offset ? end - offset : 0);
+	size_t pos = offset;
+	while (pos < end)
 	{
-		result[renumbering[i]] = vec[i];
+		size_t node = GetUnitigNode(nodeId, pos);
+		size_t nodeEnd = std::min(end, NodeOffset(node) + NodeLength(node));
+		for (; pos < nodeEnd; pos++)
+		{
+			result += NodeSequences(node, pos - NodeOffset(node));
+		}
 	}
 	return result;
 }
 
-void AlignmentGraph::RenumberAmbiguousToEnd()
+size_t AlignmentGraph::MaxEdgeOverlap() const
 {
-	assert(nodeSequences.size() + ambiguousNodeSequences.size() == nodeLength.size());
-	assert(inNeighbors.size() == nodeLength.size());
-	assert(outNeighbors.size() == nodeLength.size());
-	assert(reverse.size() == nodeLength.size());
-	assert(nodeIDs.size() == nodeLength.size());
-	assert(ambiguousNodes.size() == nodeLength.size());
-	assert(firstAmbiguous == std::numeric_limits<size_t>::max());
-	assert(!finalized);
-	std::vector<size_t> renumbering;
-	renumbering.reserve(ambiguousNodes.size());
-	size_t nonAmbiguousCount = 0;
-	size_t ambiguousCount = 0;
-	for (size_t i = 0; i < ambiguousNodes.size(); i++)
-	{
-		if (!ambiguousNodes[i])
-		{
-			renumbering.push_back(nonAmbiguousCount);
-			nonAmbiguousCount++;
-		}
-		else
-		{
-			assert(ambiguousCount < ambiguousNodes.size());
-			assert(ambiguousNodes.size()-1-ambiguousCount >= nonAmbiguousCount);
-			renumbering.push_back(ambiguousNodes.size()-1-ambiguousCount);
-			ambiguousCount++;
-		}
-	}
-	assert(renumbering.size() == ambiguousNodes.size());
-	assert(nonAmbiguousCount + ambiguousCount == ambiguousNodes.size());
-	assert(ambiguousCount == ambiguousNodeSequences.size());
-	assert(nonAmbiguousCount == nodeSequences.size());
-	firstAmbiguous = nonAmbiguousCount;
-
-	if (ambiguousCount == 0) return;
-
-	//the ambiguous nodes were added in the reverse order, reverse the sequence containers too
-	std::reverse(ambiguousNodeSequences.begin(), ambiguousNodeSequences.end());
-
-	nodeLength = reorder(nodeLength, renumbering);
-	nodeOffset = reorder(nodeOffset, renumbering);
-	nodeIDs = reorder(nodeIDs, renumbering);
-	inNeighbors = reorder(inNeighbors, renumbering);
-	outNeighbors = reorder(outNeighbors, renumbering);
-	reverse = reorder(reverse, renumbering);
-	for (auto& pair : nodeLookup)
-	{
-		pair.second = renumber(pair.second, renumbering);
-	}
-	assert(inNeighbors.size() == outNeighbors.size());
-	for (size_t i = 0; i < inNeighbors.size(); i++)
-	{
-		inNeighbors[i] = renumber(inNeighbors[i], renumbering);
-		outNeighbors[i] = renumber(outNeighbors[i], renumbering);
-	}
-
-#ifndef NDEBUG
-	assert(inNeighbors.size() == outNeighbors.size());
-	for (size_t i = 0; i < inNeighbors.size(); i++)
-	{
-		for (auto neighbor : inNeighbors[i])
-		{
-			assert(std::find(outNeighbors[neighbor].begin(), outNeighbors[neighbor].end(), i) != outNeighbors[neighbor].end());
-		}
-		for (auto neighbor : outNeighbors[i])
-		{
-			assert(std::find(inNeighbors[neighbor].begin(), inNeighbors[neighbor].end(), i) != inNeighbors[neighbor].end());
-		}
-	}
-	for (auto pair : nodeLookup)
-	{
-		size_t foundSize = 0;
-		std::set<size_t> offsets;
-		size_t lastOffset = 0;
-		for (auto node : pair.second)
-		{
-			assert(offsets.count(nodeOffset[node]) == 0);
-			assert(offsets.size() == 0 || nodeOffset[node] > lastOffset);
-			lastOffset = nodeOffset[node];
-			offsets.insert(nodeOffset[node]);
-			assert(nodeIDs[node] == pair.first);
-			foundSize += nodeLength[node];
-		}
-		assert(foundSize == originalNodeSize[pair.first]);
-	}
-#endif
+	return maxEdgeOverlap;
 }
 
 void AlignmentGraph::doComponentOrder()
@@ -651,21 +1028,24 @@ void AlignmentGraph::doComponentOrder()
 	std::vector<size_t> lowlink;
 	std::vector<bool> onStack;
 	std::vector<size_t> stack;
-	index.resize(nodeLength.size(), std::numeric_limits<size_t>::max());
-	lowlink.resize(nodeLength.size(), std::numeric_limits<size_t>::max());
-	onStack.resize(nodeLength.size(), false);
+	//the components of the strands are found over all nodes and folded to the pairs at the end
+	std::vector<size_t> nodeComponent;
+	const size_t nodeCount = NodeSize();
+	index.resize(nodeCount, std::numeric_limits<size_t>::max());
+	lowlink.resize(nodeCount, std::numeric_limits<size_t>::max());
+	onStack.resize(nodeCount, false);
 	size_t checknode = 0;
 	size_t nextComponent = 0;
-	componentNumber.resize(nodeLength.size(), std::numeric_limits<size_t>::max());
+	nodeComponent.resize(nodeCount, std::numeric_limits<size_t>::max());
 	while (true)
 	{
 		if (callStack.size() == 0)
 		{
-			while (checknode < nodeLength.size() && index[checknode] != std::numeric_limits<size_t>::max())
+			while (checknode < nodeCount && index[checknode] != std::numeric_limits<size_t>::max())
 			{
 				checknode++;
 			}
-			if (checknode == nodeLength.size()) break;
+			if (checknode == nodeCount) break;
 			callStack.emplace_back(checknode, 0, 0);
 			checknode++;
 		}
@@ -689,9 +1069,9 @@ void AlignmentGraph::doComponentOrder()
 				[[fallthrough]];
 			startloop:
 			case 1:
-				if (neighborI >= outNeighbors[v].size()) goto endloop;
-				assert(neighborI < outNeighbors[v].size());
-				w = outNeighbors[v][neighborI];
+				if (neighborI >= OutNeighbors(v).size()) goto endloop;
+				assert(neighborI < OutNeighbors(v).size());
+				w = OutNeighbors(v)[neighborI];
 				if (index[w] == std::numeric_limits<size_t>::max())
 				{
 					assert(lowlink[w] == std::numeric_limits<size_t>::max());
@@ -712,8 +1092,8 @@ void AlignmentGraph::doComponentOrder()
 					goto startloop;
 				}
 			case 2:
-				assert(neighborI < outNeighbors[v].size());
-				w = outNeighbors[v][neighborI];
+				assert(neighborI < OutNeighbors(v).size());
+				w = OutNeighbors(v)[neighborI];
 				assert(index[w] != std::numeric_limits<size_t>::max());
 				assert(lowlink[w] != std::numeric_limits<size_t>::max());
 				lowlink[v] = std::min(lowlink[v], lowlink[w]);
@@ -728,25 +1108,46 @@ void AlignmentGraph::doComponentOrder()
 						w = stack.back();
 						stack.pop_back();
 						onStack[w] = false;
-						componentNumber[w] = nextComponent;
+						nodeComponent[w] = nextComponent;
 					} while (w != v);
 					nextComponent++;
 				}
 		}
 	}
 	assert(stack.size() == 0);
-	for (size_t i = 0; i < componentNumber.size(); i++)
+	for (size_t i = 0; i < nodeComponent.size(); i++)
 	{
-		assert(componentNumber[i] != std::numeric_limits<size_t>::max());
-		assert(componentNumber[i] <= nextComponent-1);
-		componentNumber[i] = nextComponent-1-componentNumber[i];
+		assert(nodeComponent[i] != std::numeric_limits<size_t>::max());
+		assert(nodeComponent[i] <= nextComponent-1);
+		nodeComponent[i] = nextComponent-1-nodeComponent[i];
 	}
-#ifdef EXTRACORRECTNESSASSERTIONS
+	//an edge u->v has the mirror edge v'->u', so t(u)-t(u') <= t(v)-t(v') for the topological order t.
+	//ranking these differences gives an order where the reverse node's component is count-1-component,
+	//strongly connected nodes have equal differences so cycles stay in one component
+	std::vector<int64_t> differences;
+	differences.reserve(nodeCount);
 	for (size_t i = 0; i < nodeLength.size(); i++)
 	{
-		for (auto neighbor : outNeighbors[i])
+		int64_t difference = (int64_t)nodeComponent[i * 2] - (int64_t)nodeComponent[i * 2 + 1];
+		differences.push_back(difference);
+		differences.push_back(-difference);
+	}
+	std::sort(differences.begin(), differences.end());
+	differences.erase(std::unique(differences.begin(), differences.end()), differences.end());
+	componentCount = differences.size();
+	componentNumber.resize(nodeLength.size());
+	for (size_t i = 0; i < nodeLength.size(); i++)
+	{
+		int64_t difference = (int64_t)nodeComponent[i * 2] - (int64_t)nodeComponent[i * 2 + 1];
+		componentNumber[i] = std::lower_bound(differences.begin(), differences.end(), difference) - differences.begin();
+	}
+#ifdef EXTRACORRECTNESSASSERTIONS
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		assert(ComponentNumber(i) + ComponentNumber(i ^ 1) == componentCount - 1);
+		for (auto neighbor : OutNeighbors(i))
 		{
-			assert(componentNumber[neighbor] >= componentNumber[i]);
+			assert(ComponentNumber(neighbor) >= ComponentNumber(i));
 		}
 	}
 #endif
@@ -754,5 +1155,477 @@ void AlignmentGraph::doComponentOrder()
 
 size_t AlignmentGraph::ComponentSize() const
 {
-	return componentNumber.size();
+	return componentNumber.size() * 2;
+}
+
+void AlignmentGraph::MoveToHugePages()
+{
+	assert(finalized);
+	HugePages::MoveToHugePages(nodeLength);
+	HugePages::MoveToHugePages(nodeOffset);
+	HugePages::MoveToHugePages(nodeIDs);
+	HugePages::MoveToHugePages(componentNumber);
+	//mapped arrays are in the page cache and can't be moved
+	if (nodeSequences.IsMapped()) return;
+	HugePages::MoveToHugePages(nodeSequences.Vector());
+	HugePages::MoveToHugePages(ambiguousNodeSequences.Vector());
+	HugePages::MoveToHugePages(inNeighbors.starts.Vector());
+	HugePages::MoveToHugePages(inNeighbors.targets.Vector());
+	HugePages::MoveToHugePages(outNeighbors.starts.Vector());
+	HugePages::MoveToHugePages(outNeighbors.targets.Vector());
+	HugePages::MoveToHugePages(reverseInNeighbors.starts.Vector());
+	HugePages::MoveToHugePages(reverseInNeighbors.targets.Vector());
+	HugePages::MoveToHugePages(reverseOutNeighbors.starts.Vector());
+	HugePages::MoveToHugePages(reverseOutNeighbors.targets.Vector());
+}
+
+AlignmentGraph::NeighborLists::NeighborLists() :
+lists(),
+starts(),
+targets(),
+flat(false)
+{
+}
+
+size_t AlignmentGraph::NeighborLists::size() const
+{
+	if (!flat) return lists.size();
+	assert(starts.size() > 0);
+	return starts.size()-1;
+}
+
+void AlignmentGraph::NeighborLists::prefetch(size_t pair) const
+{
+	if (!flat)
+	{
+		__builtin_prefetch(lists.data() + pair);
+		return;
+	}
+	__builtin_prefetch(starts.data() + pair);
+}
+
+void AlignmentGraph::NeighborLists::Flatten()
+{
+	assert(!flat);
+	size_t totalSize = 0;
+	for (const auto& list : lists)
+	{
+		totalSize += list.size();
+	}
+	std::vector<size_t>& startVec = starts.Vector();
+	std::vector<size_t>& targetVec = targets.Vector();
+	startVec.clear();
+	targetVec.clear();
+	startVec.reserve(lists.size()+1);
+	targetVec.reserve(totalSize);
+	for (const auto& list : lists)
+	{
+		startVec.push_back(targetVec.size());
+		targetVec.insert(targetVec.end(), list.begin(), list.end());
+	}
+	startVec.push_back(targetVec.size());
+	std::vector<std::vector<size_t>> empty;
+	std::swap(lists, empty);
+	flat = true;
+}
+
+namespace
+{
+	const char graphFileMagic[8] = { 'G', 'A', 'G', 'R', 'A', 'P', 'H', '5' };
+
+	void writePadding(std::ofstream& file)
+	{
+		//every array starts at a multiple of 8 bytes so the mapped arrays are aligned
+		static const char zeros[8] = { 0 };
+		size_t pos = file.tellp();
+		if (pos % 8 != 0) file.write(zeros, 8 - pos % 8);
+	}
+
+	void writeNumber(std::ofstream& file, uint64_t value)
+	{
+		file.write((const char*)&value, sizeof(value));
+	}
+
+	template <typename T>
+	void writeArray(std::ofstream& file, const T* data, size_t count)
+	{
+		writeNumber(file, count);
+		file.write((const char*)data, count * sizeof(T));
+		writePadding(file);
+	}
+
+	void writeBoolArray(std::ofstream& file, const std::vector<bool>& vec)
+	{
+		std::vector<char> bytes { vec.begin(), vec.end() };
+		writeArray(file, bytes.data(), bytes.size());
+	}
+
+	class MappedReader
+	{
+	public:
+		MappedReader(const MappedFile& file) :
+		file(file),
+		pos(0)
+		{
+		}
+		uint64_t ReadNumber()
+		{
+			check(sizeof(uint64_t));
+			uint64_t result;
+			memcpy(&result, file.data() + pos, sizeof(result));
+			pos += sizeof(result);
+			return result;
+		}
+		void Skip(size_t bytes)
+		{
+			check(bytes);
+			pos += bytes;
+		}
+		//returns the byte offset of the array and skips over it
+		size_t SkipArray(size_t elementSize, size_t& count)
+		{
+			count = ReadNumber();
+			check(count * elementSize);
+			size_t result = pos;
+			pos += count * elementSize;
+			pos = (pos + 7) / 8 * 8;
+			return result;
+		}
+		template <typename T>
+		std::vector<T> ReadArray()
+		{
+			size_t count;
+			size_t start = SkipArray(sizeof(T), count);
+			std::vector<T> result;
+			result.resize(count);
+			if (count > 0) memcpy(result.data(), file.data() + start, count * sizeof(T));
+			return result;
+		}
+		std::vector<bool> ReadBoolArray()
+		{
+			auto bytes = ReadArray<char>();
+			return std::vector<bool> { bytes.begin(), bytes.end() };
+		}
+		std::string ReadString()
+		{
+			auto chars = ReadArray<char>();
+			return std::string { chars.begin(), chars.end() };
+		}
+		template <typename T>
+		void MapArray(FileBackedArray<T>& target, std::shared_ptr<const MappedFile> mapping)
+		{
+			size_t count;
+			size_t start = SkipArray(sizeof(T), count);
+			target.Map(mapping, start, count);
+		}
+	private:
+		void check(size_t bytes)
+		{
+			if (pos + bytes > file.size()) throw CommonUtils::InvalidGraphException("Truncated graph file");
+		}
+		const MappedFile& file;
+		size_t pos;
+	};
+}
+
+AlignmentGraph::SourceStamp AlignmentGraph::StampSource(const std::string& sourceFile, bool withHash)
+{
+	struct stat info;
+	if (stat(sourceFile.c_str(), &info) != 0) throw CommonUtils::InvalidGraphException(("Could not open " + sourceFile).c_str());
+	SourceStamp result { (uint64_t)info.st_size, (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec, 0 };
+	if (withHash && info.st_size > 0)
+	{
+		MappedFile source { sourceFile };
+		//FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			hash ^= (unsigned char)source.data()[i];
+			hash *= 1099511628211ull;
+		}
+		result.hash = hash;
+	}
+	return result;
+}
+
+bool AlignmentGraph::BuiltFromSource(const std::string& filename, const std::string& sourceFile)
+{
+	SourceStamp stored;
+	try
+	{
+		MappedFile mapping { filename };
+		if (mapping.size() < sizeof(graphFileMagic) || memcmp(mapping.data(), graphFileMagic, sizeof(graphFileMagic)) != 0) return false;
+		MappedReader reader { mapping };
+		reader.Skip(sizeof(graphFileMagic));
+		stored.size = reader.ReadNumber();
+		stored.modified = (int64_t)reader.ReadNumber();
+		stored.hash = reader.ReadNumber();
+	}
+	catch (const std::runtime_error&)
+	{
+		return false;
+	}
+	SourceStamp current = StampSource(sourceFile, false);
+	if (current.size != stored.size) return false;
+	if (current.modified == stored.modified) return true;
+	return StampSource(sourceFile, true).hash == stored.hash;
+}
+
+void AlignmentGraph::SaveToFile(const std::string& filename, const SourceStamp& source) const
+{
+	assert(finalized);
+	assert(inNeighbors.flat);
+	assert(outNeighbors.flat);
+	std::ofstream file { filename, std::ios::binary };
+	if (!file.good()) throw CommonUtils::InvalidGraphException(("Could not write graph to " + filename).c_str());
+	file.write(graphFileMagic, sizeof(graphFileMagic));
+	writeNumber(file, source.size);
+	writeNumber(file, (uint64_t)source.modified);
+	writeNumber(file, source.hash);
+	writeNumber(file, nodeLength.size());
+	writeNumber(file, firstAmbiguous);
+	writeNumber(file, maxEdgeOverlap);
+	writeNumber(file, componentCount);
+	writeNumber(file, reverseEdgesStored ? 1 : 0);
+	//the big arrays first, these are mapped
+	writeArray(file, nodeSequences.data(), nodeSequences.size());
+	writeArray(file, ambiguousNodeSequences.data(), ambiguousNodeSequences.size());
+	writeArray(file, inNeighbors.starts.data(), inNeighbors.starts.size());
+	writeArray(file, inNeighbors.targets.data(), inNeighbors.targets.size());
+	writeArray(file, outNeighbors.starts.data(), outNeighbors.starts.size());
+	writeArray(file, outNeighbors.targets.data(), outNeighbors.targets.size());
+	if (reverseEdgesStored)
+	{
+		writeArray(file, reverseInNeighbors.starts.data(), reverseInNeighbors.starts.size());
+		writeArray(file, reverseInNeighbors.targets.data(), reverseInNeighbors.targets.size());
+		writeArray(file, reverseOutNeighbors.starts.data(), reverseOutNeighbors.starts.size());
+		writeArray(file, reverseOutNeighbors.targets.data(), reverseOutNeighbors.targets.size());
+	}
+	//then the ones which are read into memory
+	writeArray(file, nodeLength.data(), nodeLength.size());
+	writeArray(file, nodeOffset.data(), nodeOffset.size());
+	writeArray(file, nodeIDs.data(), nodeIDs.size());
+	writeBoolArray(file, linearizable);
+	writeArray(file, componentNumber.data(), componentNumber.size());
+	writeNumber(file, originalNodeSize.size());
+	for (auto pair : originalNodeSize)
+	{
+		writeNumber(file, (int64_t)pair.first);
+		writeNumber(file, pair.second);
+		auto name = originalNodeName.find(pair.first);
+		std::string nameStr = name == originalNodeName.end() ? "" : name->second;
+		writeArray(file, nameStr.data(), nameStr.size());
+	}
+	if (!file.good()) throw CommonUtils::InvalidGraphException(("Could not write graph to " + filename).c_str());
+}
+
+AlignmentGraph AlignmentGraph::LoadMapped(const std::string& filename, bool doComponents)
+{
+	std::shared_ptr<const MappedFile> mapping;
+	try
+	{
+		mapping = std::make_shared<const MappedFile>(filename);
+	}
+	catch (const std::runtime_error& e)
+	{
+		throw CommonUtils::InvalidGraphException(e.what());
+	}
+	if (mapping->size() < sizeof(graphFileMagic) || memcmp(mapping->data(), graphFileMagic, sizeof(graphFileMagic) - 1) != 0)
+	{
+		throw CommonUtils::InvalidGraphException(("Not a GraphAligner graph file: " + filename).c_str());
+	}
+	//the last byte of the magic is the format version
+	if (memcmp(mapping->data(), graphFileMagic, sizeof(graphFileMagic)) != 0)
+	{
+		throw CommonUtils::InvalidGraphException(("Graph file from a different version, delete it so it is regenerated: " + filename).c_str());
+	}
+	MappedReader reader { *mapping };
+	reader.Skip(sizeof(graphFileMagic));
+	//source stamp, checked by BuiltFromSource
+	reader.Skip(3 * sizeof(uint64_t));
+	AlignmentGraph result;
+	size_t pairCount = reader.ReadNumber();
+	result.firstAmbiguous = reader.ReadNumber();
+	result.maxEdgeOverlap = reader.ReadNumber();
+	result.componentCount = reader.ReadNumber();
+	result.reverseEdgesStored = reader.ReadNumber() != 0;
+	reader.MapArray(result.nodeSequences, mapping);
+	reader.MapArray(result.ambiguousNodeSequences, mapping);
+	reader.MapArray(result.inNeighbors.starts, mapping);
+	reader.MapArray(result.inNeighbors.targets, mapping);
+	reader.MapArray(result.outNeighbors.starts, mapping);
+	reader.MapArray(result.outNeighbors.targets, mapping);
+	result.inNeighbors.flat = true;
+	result.outNeighbors.flat = true;
+	if (result.reverseEdgesStored)
+	{
+		reader.MapArray(result.reverseInNeighbors.starts, mapping);
+		reader.MapArray(result.reverseInNeighbors.targets, mapping);
+		reader.MapArray(result.reverseOutNeighbors.starts, mapping);
+		reader.MapArray(result.reverseOutNeighbors.targets, mapping);
+		result.reverseInNeighbors.flat = true;
+		result.reverseOutNeighbors.flat = true;
+	}
+	result.nodeLength = reader.ReadArray<size_t>();
+	result.nodeOffset = reader.ReadArray<size_t>();
+	result.nodeIDs = reader.ReadArray<int>();
+	result.linearizable = reader.ReadBoolArray();
+	result.componentNumber = reader.ReadArray<size_t>();
+	size_t originalNodeCount = reader.ReadNumber();
+	for (size_t i = 0; i < originalNodeCount; i++)
+	{
+		int nodeId = (int64_t)reader.ReadNumber();
+		result.originalNodeSize[nodeId] = reader.ReadNumber();
+		std::string name = reader.ReadString();
+		if (name.size() > 0) result.originalNodeName[nodeId] = name;
+	}
+	if (result.nodeLength.size() != pairCount
+		|| result.nodeOffset.size() != pairCount
+		|| result.nodeIDs.size() != pairCount
+		|| result.linearizable.size() != pairCount * 2
+		|| result.nodeSequences.size() + result.ambiguousNodeSequences.size() != pairCount
+		|| result.inNeighbors.size() != pairCount
+		|| result.outNeighbors.size() != pairCount
+		|| (result.reverseEdgesStored && (result.reverseInNeighbors.size() != pairCount || result.reverseOutNeighbors.size() != pairCount))
+		|| result.firstAmbiguous != result.nodeSequences.size() * 2
+		|| (result.componentNumber.size() != 0 && result.componentNumber.size() != pairCount))
+	{
+		throw CommonUtils::InvalidGraphException(("Corrupted graph file: " + filename).c_str());
+	}
+	for (size_t i = 0; i < pairCount; i++)
+	{
+		result.nodeLookup[result.nodeIDs[i]].push_back(i);
+	}
+	for (auto& pair : result.nodeLookup)
+	{
+		std::sort(pair.second.begin(), pair.second.end(), [&result](size_t left, size_t right) { return result.nodeOffset[left] < result.nodeOffset[right]; });
+	}
+	result.finalized = true;
+	std::cout << result.nodeLookup.size() * 2 << " original nodes" << std::endl;
+	std::cout << result.NodeSize() << " split nodes" << std::endl;
+	std::cout << result.ambiguousNodeSequences.size() * 2 << " ambiguous split nodes" << std::endl;
+	if (doComponents && result.componentNumber.size() == 0)
+	{
+		std::cout << "use component ordering" << std::endl;
+		result.doComponentOrder();
+	}
+	if (!doComponents)
+	{
+		result.componentNumber.clear();
+		result.componentCount = 0;
+	}
+	return result;
+}
+
+void AlignmentGraph::RenumberForLocality()
+{
+	assert(finalized);
+	assert(!nodeSequences.IsMapped());
+	//breadth-first over both edge directions of the pairs. the ambiguous pairs must stay at the end so they are ordered separately
+	const size_t pairCount = nodeLength.size();
+	const size_t firstAmbiguousPair = firstAmbiguous / 2;
+	std::vector<size_t> renumbering;
+	renumbering.resize(pairCount, std::numeric_limits<size_t>::max());
+	std::vector<bool> visited;
+	visited.resize(pairCount, false);
+	size_t nextNonAmbiguous = 0;
+	size_t nextAmbiguous = firstAmbiguousPair;
+	std::vector<size_t> queue;
+	for (size_t start = 0; start < pairCount; start++)
+	{
+		if (visited[start]) continue;
+		queue.clear();
+		queue.push_back(start);
+		visited[start] = true;
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			size_t pair = queue[i];
+			if (pair < firstAmbiguousPair)
+			{
+				renumbering[pair] = nextNonAmbiguous;
+				nextNonAmbiguous++;
+			}
+			else
+			{
+				renumbering[pair] = nextAmbiguous;
+				nextAmbiguous++;
+			}
+			for (auto neighbor : outNeighbors.Get(pair, 0))
+			{
+				if (visited[neighbor >> 1]) continue;
+				visited[neighbor >> 1] = true;
+				queue.push_back(neighbor >> 1);
+			}
+			for (auto neighbor : inNeighbors.Get(pair, 0))
+			{
+				if (visited[neighbor >> 1]) continue;
+				visited[neighbor >> 1] = true;
+				queue.push_back(neighbor >> 1);
+			}
+			if (!reverseEdgesStored) continue;
+			for (auto neighbor : reverseOutNeighbors.Get(pair, 0))
+			{
+				if (visited[neighbor >> 1]) continue;
+				visited[neighbor >> 1] = true;
+				queue.push_back(neighbor >> 1);
+			}
+			for (auto neighbor : reverseInNeighbors.Get(pair, 0))
+			{
+				if (visited[neighbor >> 1]) continue;
+				visited[neighbor >> 1] = true;
+				queue.push_back(neighbor >> 1);
+			}
+		}
+	}
+	assert(nextNonAmbiguous == firstAmbiguousPair);
+	assert(nextAmbiguous == pairCount);
+
+	std::vector<NodeChunkSequence> newSequences;
+	newSequences.resize(nodeSequences.size());
+	for (size_t i = 0; i < nodeSequences.size(); i++)
+	{
+		newSequences[renumbering[i]] = nodeSequences[i];
+	}
+	std::swap(nodeSequences.Vector(), newSequences);
+	std::vector<AmbiguousChunkSequence> newAmbiguousSequences;
+	newAmbiguousSequences.resize(ambiguousNodeSequences.size());
+	for (size_t i = 0; i < ambiguousNodeSequences.size(); i++)
+	{
+		newAmbiguousSequences[renumbering[firstAmbiguousPair + i] - firstAmbiguousPair] = ambiguousNodeSequences[i];
+	}
+	std::swap(ambiguousNodeSequences.Vector(), newAmbiguousSequences);
+
+	std::vector<size_t> nodeRenumbering;
+	nodeRenumbering.resize(pairCount * 2);
+	for (size_t i = 0; i < pairCount; i++)
+	{
+		nodeRenumbering[i * 2] = renumbering[i] * 2;
+		nodeRenumbering[i * 2 + 1] = renumbering[i] * 2 + 1;
+	}
+	nodeLength = reorder(nodeLength, renumbering);
+	nodeOffset = reorder(nodeOffset, renumbering);
+	nodeIDs = reorder(nodeIDs, renumbering);
+	linearizable = reorder(linearizable, nodeRenumbering);
+	if (componentNumber.size() > 0) componentNumber = reorder(componentNumber, renumbering);
+	for (auto& pair : nodeLookup)
+	{
+		pair.second = renumber(pair.second, renumbering);
+	}
+	NeighborLists* lists[4] { &inNeighbors, &outNeighbors, &reverseInNeighbors, &reverseOutNeighbors };
+	for (size_t list = 0; list < (reverseEdgesStored ? 4 : 2); list++)
+	{
+		NeighborLists* neighbors = lists[list];
+		std::vector<std::vector<size_t>> newLists;
+		newLists.resize(pairCount);
+		for (size_t i = 0; i < pairCount; i++)
+		{
+			for (auto neighbor : neighbors->Get(i, 0))
+			{
+				newLists[renumbering[i]].push_back(nodeRenumbering[neighbor]);
+			}
+		}
+		neighbors->lists = std::move(newLists);
+		neighbors->flat = false;
+		neighbors->Flatten();
+	}
 }
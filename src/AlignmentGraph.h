@@ -6,7 +6,10 @@
 #include <set>
 #include <unordered_map>
 #include <tuple>
+#include <iterator>
+#include <cstddef>
 #include "ThreadReadAssertion.h"
+#include "MappedFile.h"
 
 
 class AlignmentGraph
@@ -75,6 +78,66 @@ public:
 		size_t seqPos;
 	};
 
+	//adjacency lists of the forward strand nodes, indexed by strand pair. built as separate vectors and flattened into one array at Finalize, which can also be mapped from a file
+	class NeighborLists
+	{
+	public:
+		//the targets xored with flip, which turns the stored neighbors of a forward node into the mirrored neighbors of its reverse complement
+		class Range
+		{
+		public:
+			class Iterator
+			{
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type = size_t;
+				using difference_type = std::ptrdiff_t;
+				using pointer = const size_t*;
+				using reference = size_t;
+				Iterator(const size_t* pos, size_t flip) : pos(pos), flip(flip) {}
+				size_t operator*() const { return *pos ^ flip; }
+				Iterator& operator++() { ++pos; return *this; }
+				Iterator operator++(int) { Iterator result = *this; ++pos; return result; }
+				bool operator==(const Iterator& other) const { return pos == other.pos; }
+				bool operator!=(const Iterator& other) const { return pos != other.pos; }
+			private:
+				const size_t* pos;
+				size_t flip;
+			};
+			Range(const size_t* start, const size_t* stop, size_t flip) : start(start), stop(stop), flip(flip) {}
+			Iterator begin() const { return Iterator { start, flip }; }
+			Iterator end() const { return Iterator { stop, flip }; }
+			size_t size() const { return stop - start; }
+			size_t operator[](size_t index) const { assert(index < size()); return start[index] ^ flip; }
+		private:
+			const size_t* start;
+			const size_t* stop;
+			size_t flip;
+		};
+		NeighborLists();
+#ifdef NDEBUG
+		__attribute__((always_inline))
+#endif
+		Range Get(size_t pair, size_t flip) const
+		{
+			if (!flat)
+			{
+				assert(pair < lists.size());
+				return Range { lists[pair].data(), lists[pair].data() + lists[pair].size(), flip };
+			}
+			assert(pair+1 < starts.size());
+			return Range { targets.data() + starts[pair], targets.data() + starts[pair+1], flip };
+		}
+		size_t size() const;
+		void prefetch(size_t pair) const;
+		void Flatten();
+		//only before flattening
+		std::vector<std::vector<size_t>> lists;
+		FileBackedArray<size_t> starts;
+		FileBackedArray<size_t> targets;
+		bool flat;
+	};
+
 	class SeedHit
 	{
 	public:
@@ -88,11 +151,36 @@ public:
 	void AddNode(int nodeId, const std::string& sequence, const std::string& name, bool reverseNode, const std::vector<size_t>& breakpoints);
 	void AddEdgeNodeId(int node_id_from, int node_id_to, size_t startOffset);
 	void Finalize(int wordSize, bool doComponents);
-	AlignmentGraph GetSubgraph(const std::unordered_map<size_t, size_t>& nodeMapping) const;
+	//positions are (digraph node id, offset). the subgraph contains whole original nodes and their reverse complements
+	AlignmentGraph GetLocalSubgraph(const std::vector<std::pair<int, size_t>>& positions, size_t maxDistance) const;
 	std::pair<int, size_t> GetReversePosition(int nodeId, size_t offset) const;
 	size_t GetReverseNode(size_t node) const;
 	size_t NodeSize() const;
 	size_t NodeLength(size_t nodeIndex) const;
+	//digraph node id of the split node
+	int NodeID(size_t node) const;
+	//offset of the split node in its digraph node
+	size_t NodeOffset(size_t node) const;
+	size_t OriginalNodeSize(int nodeId) const;
+	size_t ComponentNumber(size_t node) const;
+	void PrefetchNode(size_t node) const;
+#ifdef NDEBUG
+	__attribute__((always_inline))
+#endif
+	NeighborLists::Range InNeighbors(size_t node) const
+	{
+		//in-neighbors of a reverse node are the mirrored out-neighbors of its forward node
+		if (node & 1) return reverseEdgesStored ? reverseInNeighbors.Get(node >> 1, 0) : outNeighbors.Get(node >> 1, 1);
+		return inNeighbors.Get(node >> 1, 0);
+	}
+#ifdef NDEBUG
+	__attribute__((always_inline))
+#endif
+	NeighborLists::Range OutNeighbors(size_t node) const
+	{
+		if (node & 1) return reverseEdgesStored ? reverseOutNeighbors.Get(node >> 1, 0) : inNeighbors.Get(node >> 1, 1);
+		return outNeighbors.Get(node >> 1, 0);
+	}
 	char NodeSequences(size_t node, size_t offset) const;
 	NodeChunkSequence NodeChunks(size_t node) const;
 	AmbiguousChunkSequence AmbiguousNodeChunks(size_t node) const;
@@ -100,28 +188,68 @@ public:
 	// size_t MinDistance(size_t pos, const std::vector<size_t>& targets) const;
 	// std::set<size_t> ProjectForward(const std::set<size_t>& startpositions, size_t amount) const;
 	std::string OriginalNodeName(int nodeId) const;
+	//nodeId is the digraph node id, the sequence is clipped to the node end
+	std::string OriginalNodeSequence(int nodeId, size_t offset, size_t length) const;
+	//longest sequence overlap of any edge in the original graph
+	size_t MaxEdgeOverlap() const;
 	size_t ComponentSize() const;
+	void MoveToHugePages();
+	//identifies the input graph file a graph file was built from
+	struct SourceStamp
+	{
+		uint64_t size;
+		//nanoseconds
+		int64_t modified;
+		uint64_t hash;
+	};
+	//the content hash reads the whole file so it is only calculated when withHash is set
+	static SourceStamp StampSource(const std::string& sourceFile, bool withHash);
+	//flat binary file which can be mapped with LoadMapped instead of building the graph again
+	void SaveToFile(const std::string& filename, const SourceStamp& source) const;
+	//true if the graph file is of this version and was built from the source file as it is now.
+	//a changed modification time alone, eg. from copying, falls back to comparing the content hash
+	static bool BuiltFromSource(const std::string& filename, const std::string& sourceFile);
+	static AlignmentGraph LoadMapped(const std::string& filename, bool doComponents);
+	//renumbers the split nodes in breadth-first order so that nearby nodes are nearby in memory
+	void RenumberForLocality();
 
 private:
 	void findLinearizable();
 	void AddNode(int nodeId, int offset, const std::string& sequence, bool reverseNode);
-	void RenumberAmbiguousToEnd();
+	void FoldStrands();
+	//pairs are whole original nodes in increasing order
+	AlignmentGraph GetSubgraph(const std::vector<size_t>& pairs) const;
 	void doComponentOrder();
+	//the two strands of the graph are stored once. after Finalize the split nodes come in strand pairs,
+	//node 2*i is a piece of a forward digraph node and node 2*i+1 is its reverse complement piece,
+	//and the arrays below are indexed by the pair i. the reverse node's sequence, edges and position are derived from the forward node.
+	//while building the arrays are indexed by the split node
 	std::vector<size_t> nodeLength;
+	//forward digraph node id -> pairs in offset order
 	std::unordered_map<int, std::vector<size_t>> nodeLookup;
+	//keyed by the forward digraph node id after Finalize
 	std::unordered_map<int, size_t> originalNodeSize;
 	std::unordered_map<int, std::string> originalNodeName;
 	std::vector<size_t> nodeOffset;
 	std::vector<int> nodeIDs;
-	std::vector<std::vector<size_t>> inNeighbors;
-	std::vector<std::vector<size_t>> outNeighbors;
-	std::vector<bool> reverse;
+	NeighborLists inNeighbors;
+	NeighborLists outNeighbors;
+	//an edge with an overlap enters its target after the overlap, so its mirror would leave the source before the overlap,
+	//which is not an edge of the original graph. graphs where some edge's mirror isn't an edge store the reverse nodes' neighbors here
+	NeighborLists reverseInNeighbors;
+	NeighborLists reverseOutNeighbors;
+	bool reverseEdgesStored;
+	//indexed by the split node
 	std::vector<bool> linearizable;
-	std::vector<NodeChunkSequence> nodeSequences;
-	std::vector<AmbiguousChunkSequence> ambiguousNodeSequences;
+	FileBackedArray<NodeChunkSequence> nodeSequences;
+	FileBackedArray<AmbiguousChunkSequence> ambiguousNodeSequences;
 	std::vector<bool> ambiguousNodes;
+	//the reverse node's component is componentCount-1 minus the forward node's component
 	std::vector<size_t> componentNumber;
+	size_t componentCount;
+	//split node index, always even
 	size_t firstAmbiguous;
+	size_t maxEdgeOverlap;
 	bool finalized;
 
 	template <typename LengthType, typename ScoreType, typename Word>
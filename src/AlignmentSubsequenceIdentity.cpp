@@ -2,23 +2,15 @@
 #include <algorithm>
 #include <iostream>
 #include <tuple>
+#include <mutex>
+#include <functional>
 #include "CommonUtils.h"
+#include "GamReader.h"
+#include "Threading.h"
 #include "GfaGraph.h"
 #include "fastqloader.h"
 
 
-namespace std 
-{
-	template <> 
-	struct hash<std::pair<size_t, size_t>>
-	{
-		size_t operator()(const std::pair<size_t, size_t>& x) const
-		{
-			return hash<size_t>()(x.first) ^ hash<size_t>()(x.second);
-		}
-	};
-}
-
 struct Node
 {
 	int nodeId;
@@ -66,102 +58,150 @@ Alignment reverse(const Alignment& old)
 	return result;
 }
 
-double getAlignmentIdentity(const Alignment& read, const Alignment& transcript, const std::unordered_map<std::string, size_t>& readLengths)
+//longest common subsequence of the paths weighted by node lengths, divided by the read length.
+//buffer is reused between calls to avoid allocating the DP rows
+double getAlignmentIdentity(const Alignment& read, const Alignment& transcript, size_t readLength, std::vector<size_t>& buffer)
 {
-	std::vector<std::vector<size_t>> matchLen;
-	matchLen.resize(read.path.size()+1);
-	for (size_t i = 0; i < read.path.size()+1; i++)
-	{
-		matchLen[i].resize(transcript.path.size()+1, 0);
-	}
+	buffer.assign((transcript.path.size()+1) * 2, 0);
+	size_t* previous = buffer.data();
+	size_t* current = buffer.data() + transcript.path.size()+1;
 	size_t maxMatch = 0;
 	for (size_t i = 0; i < read.path.size(); i++)
 	{
+		current[0] = 0;
 		for (size_t j = 0; j < transcript.path.size(); j++)
 		{
-			matchLen[i+1][j+1] = std::max(matchLen[i+1][j], matchLen[i][j+1]);
+			current[j+1] = std::max(current[j], previous[j+1]);
 			if (read.path[i] == transcript.path[j])
 			{
-				matchLen[i+1][j+1] = std::max(matchLen[i+1][j+1], matchLen[i][j] + std::min(read.length[i], transcript.length[j]));
+				current[j+1] = std::max(current[j+1], previous[j] + std::min(read.length[i], transcript.length[j]));
 			}
 			else
 			{
-				matchLen[i+1][j+1] = std::max(matchLen[i+1][j+1], matchLen[i][j]);
+				current[j+1] = std::max(current[j+1], previous[j]);
 			}
-			maxMatch = std::max(maxMatch, matchLen[i+1][j+1]);
+			maxMatch = std::max(maxMatch, current[j+1]);
 		}
+		std::swap(previous, current);
 	}
-	assert(maxMatch >= 0);
-	assert(readLengths.count(read.name) == 1);
-	assert(maxMatch <= readLengths.at(read.name));
-	return (double)maxMatch / (double)readLengths.at(read.name);
+	assert(maxMatch <= readLength);
+	return (double)maxMatch / (double)readLength;
 }
 
 int main(int argc, char** argv)
 {
-	std::string transcriptFile { argv[1] };
-	std::string readAlignmentFile { argv[2] };
-	std::string readFastaFile { argv[3] };
-
-	std::unordered_map<std::string, size_t> readLengths;
+	//usage: AlignmentSubsequenceIdentity transcripts.gam reads.gam reads.fasta [-t threads] [--min-shared-nodes n]
+	//only transcripts which share at least n distinct nodes with the read are compared to it
+	std::vector<std::string> positional;
+	size_t numThreads = Threading::DefaultThreads();
+	size_t minSharedNodes = 1;
+	for (int i = 1; i < argc; i++)
 	{
-		auto reads = loadFastqFromFile(readFastaFile);
-		for (auto read : reads)
+		std::string arg { argv[i] };
+		if (arg == "-t" && i+1 < argc)
 		{
-			readLengths[read.seq_id] = read.sequence.size();
+			numThreads = std::stoi(argv[i+1]);
+			i++;
 		}
+		else if (arg == "--min-shared-nodes" && i+1 < argc)
+		{
+			minSharedNodes = std::max(1, std::stoi(argv[i+1]));
+			i++;
+		}
+		else
+		{
+			positional.push_back(arg);
+		}
+	}
+	if (positional.size() != 3)
+	{
+		std::cerr << "usage: AlignmentSubsequenceIdentity transcripts.gam reads.gam reads.fasta [-t threads] [--min-shared-nodes n]" << std::endl;
+		return 1;
 	}
+	std::string transcriptFile { positional[0] };
+	std::string readAlignmentFile { positional[1] };
+	std::string readFastaFile { positional[2] };
+
+	std::unordered_map<std::string, size_t> readLengths;
+	FastQ::streamFastqFromFile(readFastaFile, false, [&readLengths](FastQ& read)
+	{
+		readLengths[read.seq_id] = read.sequence.size();
+	});
 
 	std::vector<Alignment> transcripts;
-	std::vector<Alignment> reads;
 	{
-		auto vgtranscripts = CommonUtils::LoadVGAlignments(transcriptFile);
-		for (auto vg : vgtranscripts)
-		{
+		std::function<void(vg::Alignment&)> lambda = [&transcripts](vg::Alignment& vg) {
 			transcripts.push_back(convertVGtoAlignment(vg));
-		}
-	}
-	{
-		auto vgreads = CommonUtils::LoadVGAlignments(readAlignmentFile);
-		for (auto vg : vgreads)
-		{
-			reads.push_back(convertVGtoAlignment(vg));
-		}
+		};
+		GamReader::ForEachOrdered(transcriptFile, numThreads, lambda);
 	}
 
+	//each transcript is listed once per node even if it crosses the node several times
 	std::unordered_map<int, std::vector<size_t>> transcriptsCrossingNode;
 	for (size_t i = 0; i < transcripts.size(); i++)
 	{
-		for (int j = 0; j < transcripts[i].path.size(); j++)
+		for (size_t j = 0; j < transcripts[i].path.size(); j++)
 		{
-			transcriptsCrossingNode[transcripts[i].path[j].nodeId].push_back(i);
+			auto& crossing = transcriptsCrossingNode[transcripts[i].path[j].nodeId];
+			if (crossing.size() == 0 || crossing.back() != i) crossing.push_back(i);
 		}
 	}
 
-	std::unordered_map<std::pair<size_t, size_t>, double> readTranscriptBestPair;
+	//per thread: shared node count per transcript, the transcripts whose count is nonzero, and the DP buffer
+	std::vector<std::vector<size_t>> sharedNodes;
+	std::vector<std::vector<size_t>> touchedTranscripts;
+	std::vector<std::vector<size_t>> dpBuffer;
+	sharedNodes.resize(numThreads);
+	touchedTranscripts.resize(numThreads);
+	dpBuffer.resize(numThreads);
+	std::mutex outputMutex;
 
-	for (size_t readi = 0; readi < reads.size(); readi++)
+	std::function<void(vg::Alignment&, size_t)> lambda = [&](vg::Alignment& vg, size_t thread)
 	{
-		auto read = reads[readi];
-		std::set<size_t> possibleTranscripts;
+		Alignment read = convertVGtoAlignment(vg);
+		auto& counts = sharedNodes[thread];
+		auto& touched = touchedTranscripts[thread];
+		if (counts.size() != transcripts.size()) counts.resize(transcripts.size(), 0);
+		std::vector<int> readNodes;
 		for (size_t i = 0; i < read.path.size(); i++)
 		{
-			possibleTranscripts.insert(transcriptsCrossingNode[read.path[i].nodeId].begin(), transcriptsCrossingNode[read.path[i].nodeId].end());
+			readNodes.push_back(read.path[i].nodeId);
+		}
+		std::sort(readNodes.begin(), readNodes.end());
+		readNodes.erase(std::unique(readNodes.begin(), readNodes.end()), readNodes.end());
+		for (auto node : readNodes)
+		{
+			auto found = transcriptsCrossingNode.find(node);
+			if (found == transcriptsCrossingNode.end()) continue;
+			for (auto transcript : found->second)
+			{
+				if (counts[transcript] == 0) touched.push_back(transcript);
+				counts[transcript] += 1;
+			}
 		}
+		std::sort(touched.begin(), touched.end());
+		size_t readLength = readLengths.at(read.name);
 		auto reverseread = reverse(read);
-		for (auto i : possibleTranscripts)
+		std::stringstream output;
+		for (auto i : touched)
 		{
-			auto identityFw = getAlignmentIdentity(read, transcripts[i], readLengths);
-			auto identityBw = getAlignmentIdentity(reverseread, transcripts[i], readLengths);
+			bool candidate = counts[i] >= minSharedNodes;
+			counts[i] = 0;
+			if (!candidate) continue;
+			auto identityFw = getAlignmentIdentity(read, transcripts[i], readLength, dpBuffer[thread]);
+			auto identityBw = getAlignmentIdentity(reverseread, transcripts[i], readLength, dpBuffer[thread]);
 			auto bigger = std::max(identityFw, identityBw);
-			if (bigger > 0 && (readTranscriptBestPair.count(std::make_pair(readi, i)) == 0 || readTranscriptBestPair[std::make_pair(readi, i)] < bigger))
+			if (bigger > 0)
 			{
-				readTranscriptBestPair[std::make_pair(readi, i)] = bigger;
+				output << read.name << "\t" << transcripts[i].name << "\t" << bigger << "\n";
 			}
 		}
-	}
-	for (auto mapping : readTranscriptBestPair)
-	{
-		std::cout << reads[mapping.first.first].name << "\t" << transcripts[mapping.first.second].name << "\t" << mapping.second << std::endl;
-	}
+		touched.clear();
+		if (output.tellp() > 0)
+		{
+			std::lock_guard<std::mutex> guard { outputMutex };
+			std::cout << output.str();
+		}
+	};
+	GamReader::ForEachParallel(readAlignmentFile, numThreads, lambda);
 }
@@ -66,6 +66,14 @@ public:
 	{
 		return numItems;
 	}
+	//target of the item which will be popped after lookahead pops if nothing is inserted before that, or max if unknown
+	size_t peekTarget(size_t lookahead) const
+	{
+		if (activeQueues.size() == 0) return std::numeric_limits<size_t>::max();
+		const std::vector<T>& queue = queues[activeQueues.top()];
+		if (lookahead >= queue.size()) return std::numeric_limits<size_t>::max();
+		return getId(queue[queue.size() - 1 - lookahead]);
+	}
 	void insert(size_t component, int score, const T& item)
 	{
 		assert(false);
@@ -2,6 +2,7 @@
 #include <sstream>
 #include <cassert>
 #include <unordered_map>
+#include <algorithm>
 #include "CommonUtils.h"
 #include "vg.pb.h"
 #include "fastqloader.h"
@@ -236,14 +237,21 @@ AlignmentGraph DirectedGraph::BuildFromGFA(const GfaGraph& graph, bool tryDAG)
 		}
 		std::string name = graph.OriginalNodeName(node.first);
 		auto nodes = ConvertGFANodeToNodes(node.first, node.second, name);
+		//the strands are stored as mirrored pieces so both need the breakpoints of both
 		std::vector<size_t> breakpointsFw = breakpoints[node.first * 2];
-		std::vector<size_t> breakpointsBw = breakpoints[node.first * 2 + 1];
+		for (auto breakpoint : breakpoints[node.first * 2 + 1])
+		{
+			breakpointsFw.push_back(node.second.size() - breakpoint);
+		}
 		breakpointsFw.push_back(0);
 		breakpointsFw.push_back(node.second.size());
-		breakpointsBw.push_back(0);
-		breakpointsBw.push_back(node.second.size());
 		std::sort(breakpointsFw.begin(), breakpointsFw.end());
-		std::sort(breakpointsBw.begin(), breakpointsBw.end());
+		breakpointsFw.erase(std::unique(breakpointsFw.begin(), breakpointsFw.end()), breakpointsFw.end());
+		std::vector<size_t> breakpointsBw;
+		for (size_t i = breakpointsFw.size(); i > 0; i--)
+		{
+			breakpointsBw.push_back(node.second.size() - breakpointsFw[i-1]);
+		}
 		result.AddNode(nodes.first.nodeId, nodes.first.sequence, nodes.first.name, !nodes.first.rightEnd, breakpointsFw);
 		result.AddNode(nodes.second.nodeId, nodes.second.sequence, nodes.second.name, !nodes.second.rightEnd, breakpointsBw);
 	}
@@ -1,142 +1,306 @@
-#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <tuple>
 #include "vg.pb.h"
 #include "stream.hpp"
-#include "GfaGraph.h"
+#include "DenseGfa.h"
+#include "CommonUtils.h"
+#include "Threading.h"
 #include "fastqloader.h"
 
-void bruteForceAddPaths(const GfaGraph& graph, std::vector<std::vector<std::pair<int, size_t>>>& result, int node, size_t offset, size_t label, size_t length, size_t k)
+//k-mers are packed two bits per base into 64 bits
+static constexpr size_t MaxK = 31;
+//nodes per chunk when building the index
+static constexpr size_t ChunkSize = 10000;
+//seeds written at once
+static constexpr size_t SeedBatchSize = 100000;
+
+//position of the k-mer's last base
+struct KmerHit
+{
+	uint64_t kmer;
+	uint32_t side;
+	uint32_t offset;
+	bool operator<(const KmerHit& other) const
+	{
+		return std::tie(kmer, side, offset) < std::tie(other.kmer, other.side, other.offset);
+	}
+};
+
+int baseCode(char c)
 {
-	label <<= 2;
-	switch(graph.nodes.at(node)[offset])
+	switch(c)
 	{
 		case 'A':
 		case 'a':
-			label += 0;
-			break;
+			return 0;
 		case 'C':
 		case 'c':
-			label += 1;
-			break;
+			return 1;
 		case 'G':
 		case 'g':
-			label += 2;
-			break;
+			return 2;
 		case 'T':
 		case 't':
-			label += 3;
-			break;
+			return 3;
 		default:
-			assert(false);
+			return -1;
 	}
-	if (length == k - 1)
+}
+
+//the k-mers starting on the forward strand of every node, continuing over edges when the k-mer doesn't fit in the node.
+//a hit is at the last base of the k-mer, which is on a reverse strand if the path enters a node backwards.
+//k-mers with non-ACGT bases are left out.
+//hits are split into buckets by a hash of the k-mer and sorted inside the buckets
+class KmerIndex
+{
+public:
+	KmerIndex(const DenseGfa& graph, size_t k, size_t numThreads) :
+	graph(graph),
+	k(k),
+	mask(((uint64_t)1 << (2 * k)) - 1),
+	numBuckets(numThreads * 16),
+	bucketStart(),
+	hits()
 	{
-		assert(label < result.size());
-		result[label].emplace_back(node, offset);
-		return;
+		size_t numChunks = (graph.NumNodes() + ChunkSize - 1) / ChunkSize;
+		std::vector<std::vector<KmerHit>> chunkHits;
+		std::vector<std::vector<size_t>> chunkBucketCounts;
+		chunkHits.resize(numChunks);
+		chunkBucketCounts.resize(numChunks);
+		Threading::ParallelFor(numChunks, numThreads, [this, &chunkHits, &chunkBucketCounts](size_t chunk, size_t thread)
+		{
+			for (size_t node = chunk * ChunkSize; node < (chunk + 1) * ChunkSize && node < this->graph.NumNodes(); node++)
+			{
+				addNodeHits(node, chunkHits[chunk]);
+			}
+			chunkBucketCounts[chunk].resize(numBuckets, 0);
+			for (auto hit : chunkHits[chunk])
+			{
+				chunkBucketCounts[chunk][bucket(hit.kmer)] += 1;
+			}
+		});
+		//each chunk writes into its own ranges of the buckets
+		bucketStart.resize(numBuckets + 1, 0);
+		std::vector<std::vector<size_t>> chunkBucketPos;
+		chunkBucketPos.resize(numChunks);
+		for (size_t i = 0; i < numBuckets; i++)
+		{
+			size_t pos = bucketStart[i];
+			for (size_t chunk = 0; chunk < numChunks; chunk++)
+			{
+				if (i == 0) chunkBucketPos[chunk].resize(numBuckets);
+				chunkBucketPos[chunk][i] = pos;
+				pos += chunkBucketCounts[chunk][i];
+			}
+			bucketStart[i+1] = pos;
+		}
+		hits.resize(bucketStart.back());
+		Threading::ParallelFor(numChunks, numThreads, [this, &chunkHits, &chunkBucketPos](size_t chunk, size_t thread)
+		{
+			for (auto hit : chunkHits[chunk])
+			{
+				hits[chunkBucketPos[chunk][bucket(hit.kmer)]++] = hit;
+			}
+			std::vector<KmerHit> empty;
+			std::swap(chunkHits[chunk], empty);
+		});
+		Threading::ParallelFor(numBuckets, numThreads, [this](size_t i, size_t thread)
+		{
+			std::sort(hits.begin() + bucketStart[i], hits.begin() + bucketStart[i+1]);
+		});
+	}
+	std::pair<std::vector<KmerHit>::const_iterator, std::vector<KmerHit>::const_iterator> Find(uint64_t kmer) const
+	{
+		size_t i = bucket(kmer);
+		return std::equal_range(hits.begin() + bucketStart[i], hits.begin() + bucketStart[i+1], KmerHit { kmer, 0, 0 }, [](const KmerHit& left, const KmerHit& right) { return left.kmer < right.kmer; });
+	}
+	size_t Size() const
+	{
+		return hits.size();
 	}
-	if (offset < graph.nodes.at(node).size() - 1)
+private:
+	size_t bucket(uint64_t kmer) const
 	{
-		bruteForceAddPaths(graph, result, node, offset+1, label, length+1, k);
+		return std::hash<uint64_t>{}(kmer * 0x9E3779B97F4A7C15ull) % numBuckets;
 	}
-	else
+	void addNodeHits(size_t node, std::vector<KmerHit>& result) const
 	{
-		if (graph.edges.count(NodePos{node, true}) == 1)
+		size_t side = node * 2;
+		size_t length = graph.SequenceLength(node);
+		//k-mers inside the node
+		uint64_t kmer = 0;
+		size_t valid = 0;
+		for (size_t i = 0; i < length; i++)
 		{
-			for (auto edge : graph.edges.at(NodePos{node, true}))
+			int code = baseCode(graph.Base(side, i));
+			if (code == -1)
 			{
-				bruteForceAddPaths(graph, result, edge.id, graph.edgeOverlap, label, length+1, k);
+				valid = 0;
+				kmer = 0;
+				continue;
 			}
+			kmer = ((kmer << 2) + code) & mask;
+			valid += 1;
+			if (valid >= k) result.push_back(KmerHit { kmer, (uint32_t)side, (uint32_t)i });
+		}
+		//k-mers continuing over edges
+		for (size_t start = length >= k ? length - k + 1 : 0; start < length; start++)
+		{
+			kmer = 0;
+			bool invalid = false;
+			for (size_t i = start; i < length; i++)
+			{
+				int code = baseCode(graph.Base(side, i));
+				if (code == -1)
+				{
+					invalid = true;
+					break;
+				}
+				kmer = (kmer << 2) + code;
+			}
+			if (invalid) continue;
+			addPathHits(side, kmer, k - (length - start), result);
 		}
 	}
-}
-
-std::vector<std::vector<std::pair<int, size_t>>> buildBruteForcePathIndex(const GfaGraph& graph, const int k)
-{
-	std::vector<std::vector<std::pair<int, size_t>>> result;
-	result.resize(pow(4, k));
-	for (auto node : graph.nodes)
+	//depth first over the out-edges until the k-mer is complete
+	void addPathHits(size_t side, uint64_t prefix, size_t remaining, std::vector<KmerHit>& result) const
 	{
-		for (size_t i = 0; i < node.second.size(); i++)
+		std::vector<std::tuple<size_t, uint64_t, size_t>> stack;
+		for (size_t i = 0; i < graph.OutDegree(side); i++)
 		{
-			bruteForceAddPaths(graph, result, node.first, i, 0, 0, k);
+			stack.emplace_back(graph.OutEdge(side, i), prefix, remaining);
+		}
+		while (stack.size() > 0)
+		{
+			size_t pos = std::get<0>(stack.back());
+			uint64_t kmer = std::get<1>(stack.back());
+			size_t left = std::get<2>(stack.back());
+			stack.pop_back();
+			size_t length = graph.SequenceLength(pos / 2);
+			size_t offset = graph.EdgeOverlap();
+			bool invalid = false;
+			while (left > 0 && offset < length)
+			{
+				int code = baseCode(graph.Base(pos, offset));
+				if (code == -1)
+				{
+					invalid = true;
+					break;
+				}
+				kmer = (kmer << 2) + code;
+				left -= 1;
+				offset += 1;
+			}
+			if (invalid) continue;
+			if (left == 0)
+			{
+				result.push_back(KmerHit { kmer, (uint32_t)pos, (uint32_t)(offset - 1) });
+				continue;
+			}
+			for (size_t i = 0; i < graph.OutDegree(pos); i++)
+			{
+				stack.emplace_back(graph.OutEdge(pos, i), kmer, left);
+			}
 		}
 	}
-	return result;
-}
+	const DenseGfa& graph;
+	size_t k;
+	uint64_t mask;
+	size_t numBuckets;
+	std::vector<size_t> bucketStart;
+	std::vector<KmerHit> hits;
+};
 
 int main(int argc, char** argv)
 {
 	std::string graphFile { argv[1] };
 	std::string readFile { argv[2] };
-	int k = std::stoi(argv[3]);
+	size_t k = std::stoi(argv[3]);
 	std::string outputSeedFile { argv[4] };
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc > 5) numThreads = std::stoi(argv[5]);
+	if (k < 1 || k > MaxK)
+	{
+		std::cerr << "k must be between 1 and " << MaxK << std::endl;
+		return 1;
+	}
 
 	std::cerr << "load graph" << std::endl;
-	auto graph = GfaGraph::LoadFromFile(graphFile);
-	std::cerr << "build index" << std::endl;
-	auto index = buildBruteForcePathIndex(graph, k);
-
-	std::cerr << "load reads" << std::endl;
-	auto reads = loadFastqFromFile(readFile);
-	std::vector<std::pair<std::string, size_t>> readLabels;
-	readLabels.reserve(reads.size());
-	std::vector<vg::Alignment> seeds;
-	size_t numSeeds = 0;
-	std::cerr << "count seeds" << std::endl;
-	for (auto read : reads)
+	std::ifstream graphStream { graphFile };
+	try
 	{
-		if (read.sequence.size() < k) continue;
-		size_t label = 0;
-		for (int i = 0; i < k; i++)
+		auto graph = DenseGfa::LoadFromStream(graphStream);
+		//node ids are the GFA names if they are all integers like in GfaGraph, otherwise the dense ids with the names in the positions
+		std::vector<int> nodeIds;
+		bool integerIds = true;
+		for (size_t i = 0; i < graph.NumNodes() && integerIds; i++)
 		{
-			label <<= 2;
-			switch(read.sequence[i])
+			std::string name = graph.NodeName(i);
+			char* end;
+			long id = strtol(name.c_str(), &end, 10);
+			if (*end)
 			{
-				case 'A':
-				case 'a':
-					label += 0;
-					break;
-				case 'C':
-				case 'c':
-					label += 1;
-					break;
-				case 'T':
-				case 't':
-					label += 2;
-					break;
-				case 'G':
-				case 'g':
-					label += 3;
-					break;
-				default:
-					break;
+				integerIds = false;
+				break;
 			}
+			nodeIds.push_back(id);
 		}
-		readLabels.emplace_back(read.seq_id, label);
-		numSeeds += index[label].size();
-	}
-	std::cerr << numSeeds << " seeds" << std::endl;
-	seeds.reserve(numSeeds);
-	std::cerr << "get seeds" << std::endl;
-	for (auto pair : readLabels)
-	{
-		for (auto pos : index[pair.second])
+		if (!integerIds)
 		{
-			vg::Alignment seed;
-			seed.set_name(pair.first);
-			auto mapping = seed.mutable_path()->add_mapping();
-			auto edit = mapping->add_edit();
-			edit->set_from_length(k);
-			edit->set_to_length(k);
-			mapping->mutable_position()->set_node_id(pos.first);
-			mapping->mutable_position()->set_offset(pos.second);
-			seeds.push_back(seed);
-			seed.set_query_position(k-1);
+			nodeIds.clear();
+			for (size_t i = 0; i < graph.NumNodes(); i++)
+			{
+				nodeIds.push_back(i);
+			}
 		}
-	}
 
-	std::cerr << "write seeds" << std::endl;
-	std::ofstream outFile { outputSeedFile, std::ios::binary };
-	stream::write_buffered(outFile, seeds, 0);
+		std::cerr << "build index" << std::endl;
+		KmerIndex index { graph, k, numThreads };
+		std::cerr << index.Size() << " k-mers in the graph" << std::endl;
+
+		std::cerr << "get seeds" << std::endl;
+		std::ofstream outFile { outputSeedFile, std::ios::binary };
+		std::vector<vg::Alignment> seeds;
+		size_t numSeeds = 0;
+		FastQ::streamFastqFromFile(readFile, false, [&](FastQ& read)
+		{
+			if (read.sequence.size() < k) return;
+			uint64_t label = 0;
+			for (size_t i = 0; i < k; i++)
+			{
+				int code = baseCode(read.sequence[i]);
+				if (code == -1) return;
+				label = (label << 2) + code;
+			}
+			auto found = index.Find(label);
+			for (auto pos = found.first; pos != found.second; ++pos)
+			{
+				vg::Alignment seed;
+				seed.set_name(read.seq_id);
+				seed.set_query_position(k-1);
+				auto mapping = seed.mutable_path()->add_mapping();
+				auto edit = mapping->add_edit();
+				edit->set_from_length(k);
+				edit->set_to_length(k);
+				mapping->mutable_position()->set_node_id(nodeIds[pos->side / 2]);
+				if (!integerIds) mapping->mutable_position()->set_name(graph.NodeName(pos->side / 2));
+				mapping->mutable_position()->set_offset(pos->offset);
+				mapping->mutable_position()->set_is_reverse(pos->side % 2 == 1);
+				seeds.push_back(seed);
+				numSeeds += 1;
+			}
+			stream::write_buffered(outFile, seeds, SeedBatchSize);
+		});
+		if (seeds.size() > 0) stream::write_buffered(outFile, seeds, 0);
+		std::cerr << numSeeds << " seeds" << std::endl;
+	}
+	catch (const CommonUtils::InvalidGraphException& e)
+	{
+		std::cerr << "Error in the graph: " << e.what() << std::endl;
+		return 1;
+	}
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "CommonUtils.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "Threading.h"
 
 namespace CommonUtils
 {
@@ -90,11 +92,10 @@ namespace CommonUtils
 	std::vector<vg::Alignment> LoadVGAlignments(std::string filename)
 	{
 		std::vector<vg::Alignment> result;
-		std::ifstream graphfile { filename, std::ios::in | std::ios::binary };
 		std::function<void(vg::Alignment&)> lambda = [&result](vg::Alignment& g) {
-			result.push_back(g);
+			result.emplace_back(std::move(g));
 		};
-		stream::for_each(graphfile, lambda);
+		GamReader::ForEachOrdered(filename, Threading::DefaultThreads(), lambda);
 		return result;
 	}
 
@@ -178,6 +179,66 @@ namespace CommonUtils
 	}
 	}
 
+	std::string ToUpper(std::string seq)
+	{
+		for (auto& c : seq)
+		{
+			c = toupper(c);
+		}
+		return seq;
+	}
+
+	std::string ToLower(std::string seq)
+	{
+		for (auto& c : seq)
+		{
+			c = tolower(c);
+		}
+		return seq;
+	}
+
+	size_t getLongestOverlap(const std::string& left, const std::string& right, size_t maxOverlap)
+	{
+		if (left.size() < maxOverlap) maxOverlap = left.size();
+		if (right.size() < maxOverlap) maxOverlap = right.size();
+		for (size_t i = maxOverlap; i > 0; i--)
+		{
+			bool match = true;
+			for (size_t a = 0; a < i && match; a++)
+			{
+				if (left[left.size() - maxOverlap + a] != right[a]) match = false;
+			}
+			if (match) return i;
+		}
+		return 0;
+	}
+
+	std::string GetCorrectedSequence(const std::string& readSequence, std::vector<PartialAlignment> p, size_t maxOverlap)
+	{
+		if (p.size() == 0) return ToLower(readSequence);
+		std::sort(p.begin(), p.end(), [](const PartialAlignment& left, const PartialAlignment& right) { return left.start < right.start; });
+		std::string correctedSequence;
+		if (p[0].start > 0)
+		{
+			correctedSequence = ToLower(readSequence.substr(0, p[0].start));
+		}
+		for (size_t i = 0; i < p.size(); i++)
+		{
+			assert(i == 0 || p[i].start > p[i-1].start);
+			if (i > 0 && p[i].start < p[i-1].end)
+			{
+				size_t overlap = getLongestOverlap(correctedSequence, p[i].seq, maxOverlap);
+				correctedSequence += ToUpper(p[i].seq.substr(overlap));
+			}
+			else
+			{
+				if (i > 0 && p[i].start > p[i-1].end) correctedSequence += ToLower(readSequence.substr(p[i-1].end, p[i].start - p[i-1].end));
+				correctedSequence += ToUpper(p[i].seq);
+			}
+		}
+		return correctedSequence;
+	}
+
 }
 
 BufferedWriter::BufferedWriter() : stream(nullptr) {};
@@ -46,6 +46,17 @@ namespace CommonUtils
 	}
 	std::vector<vg::Alignment> SelectAlignments(std::vector<vg::Alignment> alns, size_t maxnum);
 	std::vector<vg::Alignment*> SelectAlignments(std::vector<vg::Alignment*> alns, size_t maxnum);
+	std::string ToUpper(std::string seq);
+	std::string ToLower(std::string seq);
+	//the graph sequence of one alignment, start and end are read positions
+	struct PartialAlignment
+	{
+		size_t start;
+		size_t end;
+		std::string seq;
+	};
+	//aligned parts replaced with the graph sequence in uppercase, unaligned parts in lowercase
+	std::string GetCorrectedSequence(const std::string& readSequence, std::vector<PartialAlignment> partials, size_t maxOverlap);
 }
 
 class BufferedWriter : std::ostream
@@ -2,6 +2,7 @@
 #define ComponentPriorityQueue_h
 
 #include <queue>
+#include <algorithm>
 #include <sparsehash/dense_hash_map>
 #include "ThreadReadAssertion.h"
 
@@ -17,19 +18,29 @@ class ComponentPriorityQueue
 		bool operator<(const PrioritizedItem& other) const { return component < other.component || (component == other.component && score < other.score); }
 		bool operator>(const PrioritizedItem& other) const { return component > other.component || (component == other.component && score > other.score); }
 	};
+	class PeekablePriorityQueue : public std::priority_queue<PrioritizedItem, std::vector<PrioritizedItem>, std::greater<PrioritizedItem>>
+	{
+	public:
+		const PrioritizedItem& at(size_t index) const
+		{
+			return this->c[index];
+		}
+	};
 public:
 	constexpr bool IsComponentPriorityQueue() { return true; }
 	ComponentPriorityQueue(size_t maxNode) :
 	activeQueues(),
 	active(),
-	extras()
+	extras(),
+	peekCandidates()
 	{
 		initialize(maxNode);
 	}
 	ComponentPriorityQueue() :
 	activeQueues(),
 	active(),
-	extras()
+	extras(),
+	peekCandidates()
 	{
 	}
 	template <bool Sparse = SparseStorage>
@@ -76,6 +87,28 @@ public:
 	{
 		return activeQueues.size();
 	}
+	//target of the item which will be popped after lookahead pops if nothing is inserted before that, or max if there is none
+	//the heap array is only partially sorted, so walk the heap from the root in pop order. the next item is always a child of an item already walked over
+	size_t peekTarget(size_t lookahead) const
+	{
+		if (lookahead >= activeQueues.size()) return std::numeric_limits<size_t>::max();
+		if (lookahead == 0) return activeQueues.at(0).index;
+		auto popsLater = [this](size_t left, size_t right) { return activeQueues.at(left) > activeQueues.at(right); };
+		peekCandidates.clear();
+		peekCandidates.push_back(0);
+		for (size_t i = 0; i < lookahead; i++)
+		{
+			std::pop_heap(peekCandidates.begin(), peekCandidates.end(), popsLater);
+			size_t walked = peekCandidates.back();
+			peekCandidates.pop_back();
+			for (size_t child = walked * 2 + 1; child <= walked * 2 + 2 && child < activeQueues.size(); child++)
+			{
+				peekCandidates.push_back(child);
+				std::push_heap(peekCandidates.begin(), peekCandidates.end(), popsLater);
+			}
+		}
+		return activeQueues.at(peekCandidates.front()).index;
+	}
 	void insert(size_t component, const T& item)
 	{
 		assert(false);
@@ -154,9 +187,11 @@ private:
 	{
 		return item.target;
 	}
-	std::priority_queue<PrioritizedItem, std::vector<PrioritizedItem>, std::greater<PrioritizedItem>> activeQueues;
+	PeekablePriorityQueue activeQueues;
 	std::vector<bool> active;
 	typename std::conditional<SparseStorage, google::dense_hash_map<size_t, std::vector<T>>, std::vector<std::vector<T>>>::type extras;
+	//scratch space of peekTarget
+	mutable std::vector<size_t> peekCandidates;
 };
 
 #endif
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include "DenseGfa.h"
+#include "CommonUtils.h"
+
+constexpr size_t DenseGfa::Missing;
+
+DenseGfa::DenseGfa() :
+edgeOverlap(0)
+{
+}
+
+//splits a line into whitespace separated fields
+std::vector<DenseGfa::TextRange> DenseGfa::getFields(TextRange line, size_t maxFields) const
+{
+	std::vector<TextRange> result;
+	size_t pos = line.start;
+	size_t end = line.start + line.length;
+	while (pos < end && result.size() < maxFields)
+	{
+		while (pos < end && (text[pos] == '\t' || text[pos] == ' ' || text[pos] == '\r')) pos++;
+		if (pos == end) break;
+		size_t fieldStart = pos;
+		while (pos < end && text[pos] != '\t' && text[pos] != ' ' && text[pos] != '\r') pos++;
+		result.push_back(TextRange { fieldStart, pos - fieldStart });
+	}
+	return result;
+}
+
+//overlap field of an edge line, either <number>M or * for an unspecified overlap which is taken as no overlap
+size_t DenseGfa::parseOverlap(TextRange field) const
+{
+	if (field.length == 1 && text[field.start] == '*') return 0;
+	if (text[field.start] == '-') throw CommonUtils::InvalidGraphException { "Edge overlap cannot be negative. Fix the graph" };
+	size_t result = 0;
+	size_t pos = 0;
+	while (pos < field.length && text[field.start + pos] >= '0' && text[field.start + pos] <= '9')
+	{
+		result = result * 10 + (text[field.start + pos] - '0');
+		pos++;
+	}
+	if (pos == 0 || (pos < field.length && (pos + 1 != field.length || text[field.start + pos] != 'M')))
+	{
+		throw CommonUtils::InvalidGraphException { ("Edge overlaps must be <number>M or *, got " + text.substr(field.start, field.length)).c_str() };
+	}
+	return result;
+}
+
+DenseGfa DenseGfa::LoadFromStream(std::istream& stream)
+{
+	DenseGfa result;
+	//read line by line and keep only the node and edge lines. paths, walks and headers can be larger than the graph itself
+	std::vector<TextRange> lines;
+	std::string line;
+	while (std::getline(stream, line))
+	{
+		if (line.size() == 0 || (line[0] != 'S' && line[0] != 'L')) continue;
+		lines.push_back(TextRange { result.text.size(), line.size() });
+		result.text += line;
+	}
+	result.text.shrink_to_fit();
+	std::unordered_map<std::string, size_t> nameMapping;
+	for (auto line : lines)
+	{
+		if (result.text[line.start] != 'S') continue;
+		auto fields = result.getFields(line, 3);
+		if (fields.size() < 3) throw CommonUtils::InvalidGraphException { ("Invalid node line: " + result.text.substr(line.start, line.length)).c_str() };
+		nameMapping[result.text.substr(fields[1].start, fields[1].length)] = result.nodeLines.size();
+		result.nodeLines.push_back(line);
+		result.nodeNames.push_back(fields[1]);
+		result.nodeSequences.push_back(fields[2]);
+	}
+	bool overlapSet = false;
+	//(from, to) sides for both orientations of each edge
+	std::vector<std::pair<size_t, size_t>> edges;
+	for (auto line : lines)
+	{
+		if (result.text[line.start] != 'L') continue;
+		auto fields = result.getFields(line, 6);
+		if (fields.size() < 6) throw CommonUtils::InvalidGraphException { ("Invalid edge line: " + result.text.substr(line.start, line.length)).c_str() };
+		std::string fromName = result.text.substr(fields[1].start, fields[1].length);
+		std::string toName = result.text.substr(fields[3].start, fields[3].length);
+		bool fromForward = result.text[fields[2].start] == '+';
+		bool toForward = result.text[fields[4].start] == '+';
+		size_t overlap = result.parseOverlap(fields[5]);
+		if (overlapSet && overlap != result.edgeOverlap) throw CommonUtils::InvalidGraphException { "Varying edge overlaps are not allowed" };
+		result.edgeOverlap = overlap;
+		overlapSet = true;
+		auto from = nameMapping.find(fromName);
+		auto to = nameMapping.find(toName);
+		result.edgeLines.push_back(line);
+		if (from == nameMapping.end() || to == nameMapping.end())
+		{
+			std::cerr << "WARNING: The graph has an edge between non-existant node(s) " << fromName << (fromForward ? "+" : "-") << " and " << toName << (toForward ? "+" : "-") << std::endl;
+			result.edgeLineNodes.emplace_back(Missing, Missing);
+			continue;
+		}
+		result.edgeLineNodes.emplace_back(from->second, to->second);
+		size_t source = from->second * 2 + (fromForward ? 0 : 1);
+		size_t target = to->second * 2 + (toForward ? 0 : 1);
+		edges.emplace_back(source, target);
+		edges.emplace_back(target ^ 1, source ^ 1);
+	}
+	//an edge and its reverse are often both listed, keep each once
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	result.edgeStart.resize(result.NumSides() + 1, 0);
+	result.edgeTargets.reserve(edges.size());
+	for (auto edge : edges)
+	{
+		result.edgeStart[edge.first + 1] += 1;
+		result.edgeTargets.push_back(edge.second);
+	}
+	for (size_t i = 1; i < result.edgeStart.size(); i++)
+	{
+		result.edgeStart[i] += result.edgeStart[i-1];
+	}
+	return result;
+}
+
+size_t DenseGfa::NumNodes() const
+{
+	return nodeLines.size();
+}
+
+size_t DenseGfa::NumSides() const
+{
+	return nodeLines.size() * 2;
+}
+
+size_t DenseGfa::OutDegree(size_t side) const
+{
+	return edgeStart[side+1] - edgeStart[side];
+}
+
+size_t DenseGfa::OutEdge(size_t side, size_t index) const
+{
+	return edgeTargets[edgeStart[side] + index];
+}
+
+size_t DenseGfa::EdgeOverlap() const
+{
+	return edgeOverlap;
+}
+
+size_t DenseGfa::SequenceLength(size_t node) const
+{
+	return nodeSequences[node].length;
+}
+
+std::string DenseGfa::Sequence(size_t side) const
+{
+	auto range = nodeSequences[side / 2];
+	std::string result = text.substr(range.start, range.length);
+	if (side % 2 == 1) result = CommonUtils::ReverseComplement(result);
+	return result;
+}
+
+char DenseGfa::Base(size_t side, size_t offset) const
+{
+	auto range = nodeSequences[side / 2];
+	if (side % 2 == 0) return text[range.start + offset];
+	return CommonUtils::Complement(text[range.start + range.length - 1 - offset]);
+}
+
+std::string DenseGfa::NodeName(size_t node) const
+{
+	return text.substr(nodeNames[node].start, nodeNames[node].length);
+}
+
+size_t DenseGfa::NumEdgeLines() const
+{
+	return edgeLines.size();
+}
+
+std::pair<size_t, size_t> DenseGfa::EdgeLineNodes(size_t edgeLine) const
+{
+	return edgeLineNodes[edgeLine];
+}
+
+void DenseGfa::WriteNodeLine(std::ostream& stream, size_t node) const
+{
+	stream.write(text.data() + nodeLines[node].start, nodeLines[node].length);
+	stream << '\n';
+}
+
+void DenseGfa::WriteEdgeLine(std::ostream& stream, size_t edgeLine) const
+{
+	stream.write(text.data() + edgeLines[edgeLine].start, edgeLines[edgeLine].length);
+	stream << '\n';
+}
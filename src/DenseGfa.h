@@ -0,0 +1,56 @@
+#ifndef DenseGfa_h
+#define DenseGfa_h
+
+#include <istream>
+#include <ostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+//compact GFA graph for the command line tools, read straight from the GFA text without building a GfaGraph.
+//the file is read line by line and only the text of the node and edge lines is kept, as offsets into one buffer so they can be written back unchanged.
+//node i has the dense side ids 2*i (forward) and 2*i+1 (reverse), side^1 is the reverse of side.
+//out-edges of sides are in CSR form, both orientations of every edge line, without duplicates.
+class DenseGfa
+{
+public:
+	static constexpr size_t Missing = std::numeric_limits<size_t>::max();
+	//throws CommonUtils::InvalidGraphException on varying, negative or unparseable overlaps. * overlaps are 0
+	static DenseGfa LoadFromStream(std::istream& stream);
+	size_t NumNodes() const;
+	size_t NumSides() const;
+	size_t OutDegree(size_t side) const;
+	size_t OutEdge(size_t side, size_t index) const;
+	size_t EdgeOverlap() const;
+	size_t SequenceLength(size_t node) const;
+	//sequence of the side, reverse complemented for reverse sides
+	std::string Sequence(size_t side) const;
+	//one base of the side's sequence without copying it
+	char Base(size_t side, size_t offset) const;
+	std::string NodeName(size_t node) const;
+	size_t NumEdgeLines() const;
+	//nodes of the edge line's ends, Missing if the line refers to a non-existant node
+	std::pair<size_t, size_t> EdgeLineNodes(size_t edgeLine) const;
+	void WriteNodeLine(std::ostream& stream, size_t node) const;
+	void WriteEdgeLine(std::ostream& stream, size_t edgeLine) const;
+private:
+	struct TextRange
+	{
+		size_t start;
+		size_t length;
+	};
+	DenseGfa();
+	std::vector<TextRange> getFields(TextRange line, size_t maxFields) const;
+	size_t parseOverlap(TextRange field) const;
+	std::string text;
+	std::vector<TextRange> nodeLines;
+	std::vector<TextRange> nodeNames;
+	std::vector<TextRange> nodeSequences;
+	std::vector<TextRange> edgeLines;
+	std::vector<std::pair<size_t, size_t>> edgeLineNodes;
+	std::vector<size_t> edgeStart;
+	std::vector<size_t> edgeTargets;
+	size_t edgeOverlap;
+};
+
+#endif
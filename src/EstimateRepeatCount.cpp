@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -6,22 +8,47 @@
 #include <unordered_set>
 #include "CommonUtils.h"
 #include "GfaGraph.h"
+#include "GamReader.h"
+#include "Threading.h"
+
+struct ReadCounts
+{
+	std::string name;
+	std::unordered_map<size_t, size_t> counts;
+};
 
 int main(int argc, char** argv)
 {
 	std::string ingraphfilename {argv[1]};
 	std::string inalignmentfilename {argv[2]};
 	std::string outfilename {argv[3]};
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc > 4) numThreads = std::stoi(argv[4]);
 
-	std::cerr << "load graph" << std::endl;
-	auto graph = GfaGraph::LoadFromFile(ingraphfilename);
-	std::cerr << "process graph" << std::endl;
-	std::unordered_map<int, std::unordered_map<std::string, size_t>> baseCounts;
-	std::unordered_map<int, std::vector<int>> outNeighbors;
-	std::unordered_map<int, std::vector<int>> leftInneighbors;
-	std::unordered_map<int, std::vector<int>> rightInneighbors;
-	std::unordered_map<int, size_t> counts;
+	//nodes are numbered densely in id order, the graph itself is not kept
+	std::vector<int> nodeIds;
+	std::unordered_map<int, size_t> denseId;
+	std::vector<std::vector<size_t>> outNeighbors;
+	std::vector<std::vector<size_t>> leftInneighbors;
+	std::vector<std::vector<size_t>> rightInneighbors;
+	std::vector<size_t> counts;
 	{
+		std::cerr << "load graph" << std::endl;
+		auto graph = GfaGraph::LoadFromFile(ingraphfilename);
+		std::cerr << "process graph" << std::endl;
+		for (const auto& node : graph.nodes)
+		{
+			nodeIds.push_back(node.first);
+		}
+		std::sort(nodeIds.begin(), nodeIds.end());
+		for (size_t i = 0; i < nodeIds.size(); i++)
+		{
+			denseId[nodeIds[i]] = i;
+		}
+		outNeighbors.resize(nodeIds.size());
+		leftInneighbors.resize(nodeIds.size());
+		rightInneighbors.resize(nodeIds.size());
+		counts.resize(nodeIds.size(), 0);
 		std::unordered_map<NodePos, std::unordered_set<NodePos>> edges;
 		for (auto edge : graph.edges)
 		{
@@ -31,102 +58,209 @@ int main(int argc, char** argv)
 				edges[NodePos{target.id, !target.end}].insert(NodePos{edge.first.id, !edge.first.end});
 			}
 		}
-		for (auto node : graph.nodes)
+		for (size_t node = 0; node < nodeIds.size(); node++)
 		{
-			NodePos end {node.first, true};
-			if (edges.count(end) == 1 && edges[end].size() == 1)
+			for (bool end : { true, false })
 			{
-				outNeighbors[node.first].push_back(edges[end].begin()->id);
-				if (edges[end].begin()->end)
+				NodePos pos { nodeIds[node], end };
+				auto found = edges.find(pos);
+				if (found == edges.end()) continue;
+				if (found->second.size() == 1)
 				{
-					rightInneighbors[edges[end].begin()->id].push_back(node.first);
-				}
-				else
-				{
-					leftInneighbors[edges[end].begin()->id].push_back(node.first);
+					size_t neighbor = denseId.at(found->second.begin()->id);
+					outNeighbors[node].push_back(neighbor);
+					if (found->second.begin()->end)
+					{
+						rightInneighbors[neighbor].push_back(node);
+					}
+					else
+					{
+						leftInneighbors[neighbor].push_back(node);
+					}
 				}
+				counts[node] = std::max(counts[node], found->second.size());
 			}
-			NodePos start {node.first, false};
-			if (edges.count(start) == 1 && edges[start].size() == 1)
+		}
+	}
+
+	std::cerr << "count alignments" << std::endl;
+	//a read's alignments are consecutive in GraphAligner output, so the per-read count of a node is summed over a run of alignments with the same name.
+	//the max over reads is shared by all threads, and each read's counts are kept in a small map of the nodes it touches
+	std::vector<std::atomic<size_t>> maxCounts(nodeIds.size());
+	for (size_t node = 0; node < nodeIds.size(); node++)
+	{
+		maxCounts[node] = counts[node];
+	}
+	auto addMaxCounts = [&maxCounts](const std::unordered_map<size_t, size_t>& readCounts)
+	{
+		for (auto pair : readCounts)
+		{
+			size_t old = maxCounts[pair.first];
+			while (old < pair.second && !maxCounts[pair.first].compare_exchange_weak(old, pair.second));
+		}
+	};
+	//name hashes of the finished runs. a name which has several runs is not consecutive in the file
+	std::vector<std::vector<uint64_t>> finishedNames(numThreads);
+	auto finishRead = [&addMaxCounts, &finishedNames](const ReadCounts& read, size_t thread)
+	{
+		if (read.name.size() == 0 && read.counts.size() == 0) return;
+		finishedNames[thread].push_back(std::hash<std::string>{}(read.name));
+		addMaxCounts(read.counts);
+	};
+	//the alignments of one read can be split over several gzip members, or over the parts of a member which is too large to decompress at once.
+	//the first and last read of each part are kept and joined with the neighboring parts in file order
+	std::vector<ReadCounts> firstRead;
+	std::vector<ReadCounts> lastRead;
+	ReadCounts pending;
+	GamReader::BlockReader reader { inalignmentfilename, numThreads };
+	std::vector<std::string> members;
+	while (reader.NextBatch(members))
+	{
+		firstRead.clear();
+		lastRead.clear();
+		firstRead.resize(members.size());
+		lastRead.resize(members.size());
+		Threading::ParallelFor(members.size(), numThreads, [&](size_t index, size_t thread)
+		{
+			ReadCounts current;
+			bool seenFirst = false;
+			GamReader::ParseMember<vg::Alignment>(members[index], [&](vg::Alignment& aln)
 			{
-				outNeighbors[node.first].push_back(edges[start].begin()->id);
-				if (edges[start].begin()->end)
+				if (aln.name() != current.name && (current.name.size() > 0 || current.counts.size() > 0))
 				{
-					rightInneighbors[edges[start].begin()->id].push_back(node.first);
+					if (!seenFirst)
+					{
+						firstRead[index] = std::move(current);
+						seenFirst = true;
+					}
+					else
+					{
+						finishRead(current, thread);
+					}
+					current = ReadCounts {};
 				}
-				else
+				current.name = aln.name();
+				for (int i = 0; i < aln.path().mapping_size(); i++)
 				{
-					leftInneighbors[edges[start].begin()->id].push_back(node.first);
+					auto found = denseId.find(aln.path().mapping(i).position().node_id());
+					if (found == denseId.end()) continue;
+					current.counts[found->second] += 1;
 				}
+			});
+			if (!seenFirst)
+			{
+				firstRead[index] = std::move(current);
+			}
+			else
+			{
+				lastRead[index] = std::move(current);
+			}
+		});
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			//empty part
+			if (firstRead[i].name.size() == 0 && firstRead[i].counts.size() == 0) continue;
+			if (firstRead[i].name == pending.name)
+			{
+				for (auto pair : firstRead[i].counts)
+				{
+					pending.counts[pair.first] += pair.second;
+				}
+			}
+			else
+			{
+				finishRead(pending, 0);
+				pending = std::move(firstRead[i]);
+			}
+			//a part with only one read has no separate last read
+			if (lastRead[i].name.size() > 0 || lastRead[i].counts.size() > 0)
+			{
+				finishRead(pending, 0);
+				pending = std::move(lastRead[i]);
 			}
-			if (edges.count(start) == 1) counts[node.first] = std::max(counts[node.first], edges[start].size());
-			if (edges.count(end) == 1) counts[node.first] = std::max(counts[node.first], edges[end].size());
 		}
 	}
-
-	std::cerr << "load alignment" << std::endl;
-	auto alignments = CommonUtils::LoadVGAlignments(inalignmentfilename);
-	for (auto aln : alignments)
+	finishRead(pending, 0);
+	//each run of a read which is not consecutive was counted as a separate read, which can only be too low.
+	//count those reads again grouped by name, and keep the max
+	std::unordered_set<uint64_t> repeatedNames;
 	{
-		for (size_t i = 0; i < aln.path().mapping_size(); i++)
+		std::vector<uint64_t> names;
+		for (auto& threadNames : finishedNames)
+		{
+			names.insert(names.end(), threadNames.begin(), threadNames.end());
+			std::vector<uint64_t> empty;
+			std::swap(threadNames, empty);
+		}
+		std::sort(names.begin(), names.end());
+		for (size_t i = 1; i < names.size(); i++)
 		{
-			baseCounts[aln.path().mapping(i).position().node_id()][aln.name()] += 1;
+			if (names[i] == names[i-1]) repeatedNames.insert(names[i]);
 		}
 	}
-	std::cerr << "init counts" << std::endl;
-	for (auto pair : baseCounts)
+	if (repeatedNames.size() > 0)
 	{
-		for (auto count : pair.second)
+		std::cerr << "alignments of " << repeatedNames.size() << " reads are not consecutive, count them again grouped by name" << std::endl;
+		std::unordered_map<std::string, std::unordered_map<size_t, size_t>> repeatedCounts;
+		std::function<void(vg::Alignment&)> lambda = [&denseId, &repeatedNames, &repeatedCounts](vg::Alignment& aln)
+		{
+			if (repeatedNames.count(std::hash<std::string>{}(aln.name())) == 0) return;
+			auto& readCounts = repeatedCounts[aln.name()];
+			for (int i = 0; i < aln.path().mapping_size(); i++)
+			{
+				auto found = denseId.find(aln.path().mapping(i).position().node_id());
+				if (found == denseId.end()) continue;
+				readCounts[found->second] += 1;
+			}
+		};
+		GamReader::ForEachOrdered(inalignmentfilename, numThreads, lambda);
+		for (const auto& pair : repeatedCounts)
 		{
-			counts[pair.first] = std::max(counts[pair.first], count.second);
+			addMaxCounts(pair.second);
 		}
 	}
+	std::cerr << "init counts" << std::endl;
+	for (size_t node = 0; node < nodeIds.size(); node++)
+	{
+		counts[node] = maxCounts[node];
+	}
 
 	std::cerr << "iterate" << std::endl;
-	std::vector<int> updateQueue;
-	updateQueue.reserve(graph.nodes.size());
-	for (const auto& node : graph.nodes)
+	std::vector<size_t> updateQueue;
+	updateQueue.reserve(nodeIds.size());
+	for (size_t node = 0; node < nodeIds.size(); node++)
 	{
-		updateQueue.push_back(node.first);
+		updateQueue.push_back(node);
 	}
 	std::cerr << "numnodes " << updateQueue.size() << std::endl;
 	size_t iterated = 0;
-	int maxcount = 0;
+	size_t maxcount = 0;
 	while (updateQueue.size() > 0)
 	{
 		auto node = updateQueue.back();
 		updateQueue.pop_back();
 		iterated++;
 		if (iterated % 1000000 == 0) std::cerr << "iterated " << iterated << std::endl;
-		int leftCountShouldBe = 0;
-		if (leftInneighbors.count(node) == 1)
+		size_t leftCountShouldBe = 0;
+		for (auto neighbor : leftInneighbors[node])
 		{
-			for (auto neighbor : leftInneighbors.at(node))
-			{
-				leftCountShouldBe += counts[neighbor];
-			}
+			leftCountShouldBe += counts[neighbor];
 		}
-		int rightCountShouldBe = 0;
-		if (rightInneighbors.count(node) == 1)
+		size_t rightCountShouldBe = 0;
+		for (auto neighbor : rightInneighbors[node])
 		{
-			for (auto neighbor : rightInneighbors.at(node))
-			{
-				rightCountShouldBe += counts[neighbor];
-			}
+			rightCountShouldBe += counts[neighbor];
 		}
 		if (counts[node] >= leftCountShouldBe && counts[node] >= rightCountShouldBe) continue;
 		counts[node] = std::max(leftCountShouldBe, rightCountShouldBe);
 		if (counts[node] > maxcount)
 		{
 			maxcount = counts[node];
-			std::cerr << "node " << node << " iter " << iterated << " maxcount " << maxcount << std::endl;
+			std::cerr << "node " << nodeIds[node] << " iter " << iterated << " maxcount " << maxcount << std::endl;
 		}
-		if (outNeighbors.count(node) == 1)
+		for (auto neighbor : outNeighbors[node])
 		{
-			for (auto neighbor : outNeighbors.at(node))
-			{
-				updateQueue.push_back(neighbor);
-			}
+			updateQueue.push_back(neighbor);
 		}
 	}
 	std::cerr << "iteration done with " << iterated << std::endl;
@@ -135,15 +269,9 @@ int main(int argc, char** argv)
 	std::ofstream out {outfilename};
 	out << "node,_minalntoporepeatcount";
 	out << std::endl;
-	std::vector<int> nodevec;
-	for (const auto& node : graph.nodes)
-	{
-		nodevec.push_back(node.first);
-	}
-	std::sort(nodevec.begin(), nodevec.end());
-	for (auto node : nodevec)
+	for (size_t node = 0; node < nodeIds.size(); node++)
 	{
-		out << node;
+		out << nodeIds[node];
 		out << "," << counts[node];
 		out << std::endl;
 	}
@@ -4,38 +4,21 @@
 #include <fstream>
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "GfaGraph.h"
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "Threading.h"
 #include "CommonUtils.h"
 #include "fastqloader.h"
 
-std::string toupper(std::string seq)
-{
-	for (auto& c : seq)
-	{
-		c = toupper(c);
-	}
-	return seq;
-}
+using CommonUtils::PartialAlignment;
 
-std::string tolower(std::string seq)
-{
-	for (auto& c : seq)
-	{
-		c = tolower(c);
-	}
-	return seq;
-}
-
-struct PartialAlignment
-{
-	size_t start;
-	size_t end;
-	std::string seq;
-};
-
-void addPartial(const std::unordered_map<int, int>& ids, std::unordered_map<std::string, std::vector<PartialAlignment>>& partials, std::function<std::string(int)> seqGetter, const vg::Alignment& v)
+PartialAlignment getPartial(const std::unordered_map<int, int>& ids, std::function<std::string(int)> seqGetter, const vg::Alignment& v)
 {
 	PartialAlignment result;
 	result.start = v.query_position();
@@ -61,7 +44,12 @@ void addPartial(const std::unordered_map<int, int>& ids, std::unordered_map<std:
 		sequence = sequence.substr(0, len);
 		result.seq += sequence;
 	}
-	partials[v.name()].push_back(result);
+	return result;
+}
+
+void addPartial(const std::unordered_map<int, int>& ids, std::unordered_map<std::string, std::vector<PartialAlignment>>& partials, std::function<std::string(int)> seqGetter, const vg::Alignment& v)
+{
+	partials[v.name()].push_back(getPartial(ids, seqGetter, v));
 }
 
 void addPartial(const vg::Graph& g, const std::unordered_map<int, int>& ids, const vg::Alignment& v, std::unordered_map<std::string, std::vector<PartialAlignment>>& partials)
@@ -74,20 +62,9 @@ void addPartial(const GfaGraph& g, const std::unordered_map<int, int>& ids, cons
 	addPartial(ids, partials, [&g](int id) {return g.nodes.at(id);}, v);
 }
 
-size_t getLongestOverlap(const std::string& left, const std::string& right, size_t maxOverlap)
+std::string getCorrectedSequence(const FastQ& read, std::vector<PartialAlignment> p, size_t maxOverlap)
 {
-	if (left.size() < maxOverlap) maxOverlap = left.size();
-	if (right.size() < maxOverlap) maxOverlap = right.size();
-	for (size_t i = maxOverlap; i > 0; i--)
-	{
-		bool match = true;
-		for (size_t a = 0; a < i && match; a++)
-		{
-			if (left[left.size() - maxOverlap + a] != right[a]) match = false;
-		}
-		if (match) return i;
-	}
-	return 0;
+	return CommonUtils::GetCorrectedSequence(read.sequence, std::move(p), maxOverlap);
 }
 
 void mergePartials(const std::unordered_map<std::string, std::vector<PartialAlignment>>& partials, const std::vector<FastQ>& reads, size_t maxOverlap)
@@ -96,45 +73,362 @@ void mergePartials(const std::unordered_map<std::string, std::vector<PartialAlig
 	{
 		if (partials.count(read.seq_id) == 0)
 		{
-			std::cout << ">" << read.seq_id << std::endl << tolower(read.sequence) << std::endl;
+			std::cout << ">" << read.seq_id << std::endl << CommonUtils::ToLower(read.sequence) << std::endl;
 			continue;
 		}
-		auto p = partials.at(read.seq_id);
-		std::sort(p.begin(), p.end(), [](const PartialAlignment& left, const PartialAlignment& right) { return left.start < right.start; });
-		std::string correctedSequence;
-		if (p[0].start > 0)
+		std::cout << ">" << read.seq_id << std::endl << getCorrectedSequence(read, partials.at(read.seq_id), maxOverlap) << std::endl;
+	}
+}
+
+struct CorrectionJob
+{
+	FastQ read;
+	std::vector<vg::Alignment> alignments;
+};
+
+//one read's alignments. the alignments of a read are consecutive in the GAM
+struct AlignmentGroup
+{
+	std::string readName;
+	std::vector<vg::Alignment> alignments;
+};
+
+//bounded queue, producers wait while it's full and consumers wait while it's empty
+template <typename T>
+class BlockingQueue
+{
+public:
+	BlockingQueue(size_t maxSize) :
+	maxSize(maxSize),
+	items(),
+	closed(false)
+	{
+	}
+	void push(T item)
+	{
+		std::unique_lock<std::mutex> lock { mutex };
+		notFull.wait(lock, [this]() { return items.size() < maxSize; });
+		items.push_back(item);
+		notEmpty.notify_one();
+	}
+	//returns false once the queue is closed and empty
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock { mutex };
+		notEmpty.wait(lock, [this]() { return items.size() > 0 || closed; });
+		if (items.size() == 0) return false;
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+	void close()
+	{
+		std::lock_guard<std::mutex> guard { mutex };
+		closed = true;
+		notEmpty.notify_all();
+	}
+private:
+	size_t maxSize;
+	std::deque<T> items;
+	bool closed;
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+//the reads and the alignment groups share one lock so the merging thread can wait on whichever input it is ready to take
+struct CorrectionInputs
+{
+	CorrectionInputs(size_t maxSize) :
+	maxSize(maxSize),
+	reads(),
+	groups(),
+	readsDone(false),
+	alignmentsDone(false)
+	{
+	}
+	template <typename T>
+	void push(std::deque<T*>& queue, T* item)
+	{
+		std::unique_lock<std::mutex> lock { mutex };
+		changed.wait(lock, [this, &queue]() { return queue.size() < maxSize; });
+		queue.push_back(item);
+		changed.notify_all();
+	}
+	void finish(bool& done)
+	{
+		std::lock_guard<std::mutex> guard { mutex };
+		done = true;
+		changed.notify_all();
+	}
+	size_t maxSize;
+	std::deque<FastQ*> reads;
+	std::deque<AlignmentGroup*> groups;
+	bool readsDone;
+	bool alignmentsDone;
+	std::mutex mutex;
+	std::condition_variable changed;
+};
+
+//streams the reads and a read-grouped GAM at the same time and corrects each read once both its sequence and its alignments have been seen.
+//if the GAM is also in the same order as the reads, reads without alignments are written as soon as a later read is matched.
+//otherwise they are kept until the end of the GAM
+void streamCorrectedReads(const std::string& alnFile, const std::vector<std::string>& readFiles, const std::unordered_map<int, int>& ids, std::function<std::string(int)> seqGetter, size_t maxOverlap, size_t numThreads, bool readOrdered)
+{
+	//how far one input may run ahead of the other before it is paused
+	const size_t maxImbalance = 10000;
+	CorrectionInputs inputs { 1000 };
+	BlockingQueue<CorrectionJob*> jobQueue { 1000 };
+	std::mutex outputMutex;
+	size_t readsWithoutAlignments = 0;
+	size_t alignmentsWithoutRead = 0;
+
+	std::thread readThread { [&readFiles, &inputs]()
+	{
+		for (const auto& file : readFiles)
 		{
-			correctedSequence = tolower(read.sequence.substr(0, p[0].start));
+			FastQ::streamFastqFromFile(file, false, [&inputs](FastQ& read)
+			{
+				FastQ* ptr = new FastQ;
+				std::swap(*ptr, read);
+				inputs.push(inputs.reads, ptr);
+			});
 		}
-		assert(p.size() > 0);
-		for (size_t i = 0; i < p.size(); i++)
+		inputs.finish(inputs.readsDone);
+	}};
+	std::thread alignmentThread { [&alnFile, &inputs]()
+	{
+		AlignmentGroup* current = nullptr;
+		std::function<void(vg::Alignment&)> lambda = [&inputs, &current](vg::Alignment& aln)
 		{
-			assert(i == 0 || p[i].start > p[i-1].start);
-			if (i > 0 && p[i].start < p[i-1].end)
+			if (current != nullptr && current->readName != aln.name())
 			{
-				size_t overlap = getLongestOverlap(correctedSequence, p[i].seq, maxOverlap);
-				correctedSequence += toupper(p[i].seq.substr(overlap));
+				inputs.push(inputs.groups, current);
+				current = nullptr;
+			}
+			if (current == nullptr)
+			{
+				current = new AlignmentGroup;
+				current->readName = aln.name();
+			}
+			current->alignments.emplace_back(std::move(aln));
+		};
+		GamReader::ForEachOrdered(alnFile, 2, lambda);
+		if (current != nullptr) inputs.push(inputs.groups, current);
+		inputs.finish(inputs.alignmentsDone);
+	}};
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < numThreads; i++)
+	{
+		workers.emplace_back([&jobQueue, &outputMutex, &ids, &seqGetter, maxOverlap]()
+		{
+			CorrectionJob* job;
+			while (jobQueue.pop(job))
+			{
+				std::vector<PartialAlignment> partials;
+				for (const auto& aln : job->alignments)
+				{
+					partials.push_back(getPartial(ids, seqGetter, aln));
+				}
+				std::string corrected = getCorrectedSequence(job->read, std::move(partials), maxOverlap);
+				{
+					std::lock_guard<std::mutex> guard { outputMutex };
+					std::cout << ">" << job->read.seq_id << "\n" << corrected << "\n";
+				}
+				delete job;
+			}
+		});
+	}
+
+	std::unordered_map<std::string, FastQ*> pendingReads;
+	std::deque<std::string> pendingReadOrder;
+	std::unordered_map<std::string, AlignmentGroup*> pendingGroups;
+	auto dispatch = [&jobQueue](FastQ* read, AlignmentGroup* group)
+	{
+		CorrectionJob* job = new CorrectionJob;
+		std::swap(job->read, *read);
+		if (group != nullptr) std::swap(job->alignments, group->alignments);
+		delete read;
+		delete group;
+		jobQueue.push(job);
+	};
+	auto flushUnalignedBefore = [&pendingReads, &pendingReadOrder, &dispatch, &readsWithoutAlignments](const std::string& matched)
+	{
+		while (pendingReadOrder.size() > 0)
+		{
+			std::string name = pendingReadOrder.front();
+			pendingReadOrder.pop_front();
+			if (name == matched) break;
+			auto found = pendingReads.find(name);
+			if (found == pendingReads.end()) continue;
+			dispatch(found->second, nullptr);
+			pendingReads.erase(found);
+			readsWithoutAlignments++;
+		}
+	};
+	while (true)
+	{
+		FastQ* read = nullptr;
+		AlignmentGroup* group = nullptr;
+		{
+			std::unique_lock<std::mutex> lock { inputs.mutex };
+			bool canTakeRead = false;
+			bool canTakeGroup = false;
+			inputs.changed.wait(lock, [&]()
+			{
+				canTakeRead = inputs.reads.size() > 0 && (pendingReads.size() <= pendingGroups.size() + maxImbalance || inputs.alignmentsDone);
+				canTakeGroup = inputs.groups.size() > 0 && (pendingGroups.size() <= pendingReads.size() + maxImbalance || inputs.readsDone);
+				return canTakeRead || canTakeGroup || (inputs.readsDone && inputs.alignmentsDone && inputs.reads.size() == 0 && inputs.groups.size() == 0);
+			});
+			if (canTakeRead)
+			{
+				read = inputs.reads.front();
+				inputs.reads.pop_front();
+			}
+			if (canTakeGroup)
+			{
+				group = inputs.groups.front();
+				inputs.groups.pop_front();
+			}
+			if (read == nullptr && group == nullptr) break;
+			inputs.changed.notify_all();
+		}
+		if (read != nullptr)
+		{
+			auto found = pendingGroups.find(read->seq_id);
+			if (found != pendingGroups.end())
+			{
+				std::string name = read->seq_id;
+				dispatch(read, found->second);
+				pendingGroups.erase(found);
+				//all earlier alignments have been seen already, so the pending reads have none
+				if (readOrdered) flushUnalignedBefore(name);
+			}
+			else
+			{
+				if (readOrdered) pendingReadOrder.push_back(read->seq_id);
+				pendingReads[read->seq_id] = read;
+			}
+		}
+		if (group != nullptr)
+		{
+			auto found = pendingReads.find(group->readName);
+			if (found != pendingReads.end())
+			{
+				std::string name = group->readName;
+				dispatch(found->second, group);
+				pendingReads.erase(found);
+				if (readOrdered) flushUnalignedBefore(name);
 			}
 			else
 			{
-				if (i > 0 && p[i].start > p[i-1].end) correctedSequence += tolower(read.sequence.substr(p[i-1].end, p[i].start - p[i-1].end));
-				correctedSequence += toupper(p[i].seq);
+				auto old = pendingGroups.find(group->readName);
+				if (old != pendingGroups.end())
+				{
+					//not grouped by read, merge
+					old->second->alignments.insert(old->second->alignments.end(), std::make_move_iterator(group->alignments.begin()), std::make_move_iterator(group->alignments.end()));
+					delete group;
+				}
+				else
+				{
+					pendingGroups[group->readName] = group;
+				}
 			}
 		}
-		std::cout << ">" << read.seq_id << std::endl << correctedSequence << std::endl;
 	}
+	for (auto pair : pendingReads)
+	{
+		dispatch(pair.second, nullptr);
+		readsWithoutAlignments++;
+	}
+	for (auto pair : pendingGroups)
+	{
+		alignmentsWithoutRead++;
+		delete pair.second;
+	}
+	jobQueue.close();
+	readThread.join();
+	alignmentThread.join();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	std::cout << std::flush;
+	std::cerr << readsWithoutAlignments << " reads without alignments" << std::endl;
+	if (alignmentsWithoutRead > 0) std::cerr << alignmentsWithoutRead << " reads in the alignments are not in the read files" << std::endl;
 }
 
 int main(int argc, char** argv)
 {
-	std::string graphfilename {argv[1]};
-	std::string alnfilename { argv[2] };
-	std::string readfilename { argv[3] };
+	//usage: ExtractCorrectedReads graph alignments.gam reads [reads...] [--stream] [--read-ordered] [-t threads]
+	//--stream corrects each read as soon as its alignments are read instead of loading everything first. the output order is then arbitrary
+	//--read-ordered (implies --stream) tells that the alignments are in the same order as the reads, eg. from a single threaded GraphAligner run
+	std::vector<std::string> positional;
+	bool streaming = false;
+	bool readOrdered = false;
+	size_t numThreads = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg { argv[i] };
+		if (arg == "--stream")
+		{
+			streaming = true;
+		}
+		else if (arg == "--read-ordered")
+		{
+			streaming = true;
+			readOrdered = true;
+		}
+		else if (arg == "-t" && i+1 < argc)
+		{
+			numThreads = std::stoi(argv[i+1]);
+			i++;
+		}
+		else
+		{
+			positional.push_back(arg);
+		}
+	}
+	if (positional.size() < 3)
+	{
+		std::cerr << "usage: ExtractCorrectedReads graph alignments.gam reads [reads...] [--stream] [--read-ordered] [-t threads]" << std::endl;
+		return 1;
+	}
+	std::string graphfilename { positional[0] };
+	std::string alnfilename { positional[1] };
+	std::vector<std::string> readfilenames { positional.begin() + 2, positional.end() };
 	//output in stdout
-	auto reads = loadFastqFromFile(readfilename);
-	for (int i = 4; i < argc; i++)
+
+	if (streaming)
+	{
+		if (graphfilename.substr(graphfilename.size()-3) == ".vg")
+		{
+			vg::Graph graph = CommonUtils::LoadVGGraph(graphfilename);
+			std::unordered_map<int, int> ids;
+			for (int i = 0; i < graph.node_size(); i++)
+			{
+				ids[graph.node(i).id()] = i;
+			}
+			streamCorrectedReads(alnfilename, readfilenames, ids, [&graph](int id) {return graph.node(id).sequence();}, 0, numThreads, readOrdered);
+		}
+		else if (graphfilename.substr(graphfilename.size() - 4) == ".gfa")
+		{
+			GfaGraph graph = GfaGraph::LoadFromFile(graphfilename);
+			std::unordered_map<int, int> ids;
+			for (auto node : graph.nodes)
+			{
+				ids[node.first] = node.first;
+			}
+			streamCorrectedReads(alnfilename, readfilenames, ids, [&graph](int id) {return graph.nodes.at(id);}, graph.edgeOverlap, numThreads, readOrdered);
+		}
+		return 0;
+	}
+
+	std::vector<FastQ> reads;
+	for (const auto& file : readfilenames)
 	{
-		auto extrareads = loadFastqFromFile(argv[i]);
+		auto extrareads = loadFastqFromFile(file);
 		reads.insert(reads.end(), extrareads.begin(), extrareads.end());
 	}
 
@@ -143,23 +437,22 @@ int main(int argc, char** argv)
 	std::unordered_map<std::string, std::vector<PartialAlignment>> partials;
 	if (graphfilename.substr(graphfilename.size()-3) == ".vg")
 	{
-		vg::Graph graph = CommonUtils::LoadVGGraph(argv[1]);
+		vg::Graph graph = CommonUtils::LoadVGGraph(graphfilename);
 		std::unordered_map<int, int> ids;
 		for (int i = 0; i < graph.node_size(); i++)
 		{
 			ids[graph.node(i).id()] = i;
 		}
 		{
-			std::ifstream alnfile { argv[2], std::ios::in | std::ios::binary };
 			std::function<void(vg::Alignment&)> lambda = [&graph, &ids, &partials](vg::Alignment& aln) {
 				addPartial(graph, ids, aln, partials);
 			};
-			stream::for_each(alnfile, lambda);
+			GamReader::ForEachOrdered(alnfilename, Threading::DefaultThreads(), lambda);
 		}
 	}
 	else if (graphfilename.substr(graphfilename.size() - 4) == ".gfa")
 	{
-		GfaGraph graph = GfaGraph::LoadFromFile(argv[1]);
+		GfaGraph graph = GfaGraph::LoadFromFile(graphfilename);
 		maxOverlap = graph.edgeOverlap;
 		std::unordered_map<int, int> ids;
 		for (auto node : graph.nodes)
@@ -167,11 +460,10 @@ int main(int argc, char** argv)
 			ids[node.first] = node.first;
 		}
 		{
-			std::ifstream alnfile { argv[2], std::ios::in | std::ios::binary };
 			std::function<void(vg::Alignment&)> lambda = [&graph, &ids, &partials](vg::Alignment& aln) {
 				addPartial(graph, ids, aln, partials);
 			};
-			stream::for_each(alnfile, lambda);
+			GamReader::ForEachOrdered(alnfilename, Threading::DefaultThreads(), lambda);
 		}
 	}
 
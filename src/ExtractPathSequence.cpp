@@ -7,6 +7,8 @@
 #include "GfaGraph.h"
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "Threading.h"
 #include "CommonUtils.h"
 
 void printPath(const std::unordered_map<int, int>& ids, std::function<std::string(int)> seqGetter, const vg::Alignment& v)
@@ -58,12 +60,11 @@ int main(int argc, char** argv)
 			ids[graph.node(i).id()] = i;
 		}
 		{
-			std::ifstream graphfile { argv[2], std::ios::in | std::ios::binary };
 			std::function<void(vg::Alignment&)> lambda = [&graph, &ids](vg::Alignment& g) {
 				std::cerr << g.name() << std::endl;
 				printPath(graph, ids, g);
 			};
-			stream::for_each(graphfile, lambda);
+			GamReader::ForEachOrdered(alnfilename, Threading::DefaultThreads(), lambda);
 		}
 	}
 	else if (graphfilename.substr(graphfilename.size() - 4) == ".gfa")
@@ -74,12 +75,11 @@ int main(int argc, char** argv)
 			ids[node.first] = node.first;
 		}
 		{
-			std::ifstream graphfile { argv[2], std::ios::in | std::ios::binary };
 			std::function<void(vg::Alignment&)> lambda = [&graph, &ids](vg::Alignment& g) {
 				std::cerr << g.name() << std::endl;
 				printPath(graph, ids, g);
 			};
-			stream::for_each(graphfile, lambda);
+			GamReader::ForEachOrdered(alnfilename, Threading::DefaultThreads(), lambda);
 		}
 	}
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <iostream>
@@ -14,6 +16,10 @@
 #include "GraphAlignerWrapper.h"
 #include "ThreadReadAssertion.h"
 #include "MummerSeeder.h"
+#include "Threading.h"
+
+//read seeds are found once in the whole graph and moved into each fusion graph. reads without a seed in either gene of a pair are aligned without seeds
+static constexpr size_t AlignmentBandwidth = 1000;
 
 struct FusionAlignment
 {
@@ -81,7 +87,8 @@ GfaGraph getNonfusionGraph(std::string gene, const GfaGraph& graph, const std::u
 	return graph.GetSubgraph(geneBelongers.at(gene));
 }
 
-GfaGraph getFusionGraph(std::string leftGene, std::string rightGene, const GfaGraph& graph, const std::unordered_map<std::string, std::unordered_set<int>>& geneBelongers)
+//copyStart: the fusion graph node of the first base of each copy of the original nodes
+GfaGraph getFusionGraph(std::string leftGene, std::string rightGene, const GfaGraph& graph, const std::unordered_map<std::string, std::unordered_set<int>>& geneBelongers, std::unordered_map<int, std::vector<int>>& copyStart)
 {
 	assert(geneBelongers.count(leftGene) == 1);
 	assert(geneBelongers.count(rightGene) == 1);
@@ -110,6 +117,7 @@ GfaGraph getFusionGraph(std::string leftGene, std::string rightGene, const GfaGr
 			for (auto node : geneBelongers.at(leftGene))
 			{
 				nodeStart[node] = nextNodeId;
+				copyStart[node].push_back(nextNodeId);
 				auto seq = graph.nodes.at(node);
 				for (size_t i = 0; i < seq.size(); i++)
 				{
@@ -143,6 +151,7 @@ GfaGraph getFusionGraph(std::string leftGene, std::string rightGene, const GfaGr
 			for (auto node : geneBelongers.at(rightGene))
 			{
 				nodeStart[node] = nextNodeId;
+				copyStart[node].push_back(nextNodeId);
 				auto seq = graph.nodes.at(node);
 				for (size_t i = 0; i < seq.size(); i++)
 				{
@@ -191,40 +200,135 @@ std::string getCorrected(const vg::Alignment& aln, const GfaGraph& graph)
 	return result;
 }
 
-void addBestAlnsOnePair(std::unordered_map<std::string, FusionAlignment>& bestAlns, std::string leftGene, std::string rightGene, const GfaGraph& fusiongraph, const std::vector<FastQ>& reads, double maxScoreFraction, int minFusionLen)
+//aligner state of one thread, reused over the pair graphs. pairs are processed biggest first so it's allocated once for the largest graph
+class ReusableState
+{
+public:
+	ReusableState() :
+	state(),
+	nodeSize(0),
+	componentSize(0)
+	{}
+	GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState& get(const AlignmentGraph& graph)
+	{
+		if (state == nullptr || graph.NodeSize() > nodeSize || graph.ComponentSize() > componentSize)
+		{
+			state = nullptr;
+			state = std::make_unique<GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState>(graph, AlignmentBandwidth, true);
+			nodeSize = graph.NodeSize();
+			componentSize = graph.ComponentSize();
+		}
+		return *state;
+	}
+private:
+	std::unique_ptr<GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState> state;
+	size_t nodeSize;
+	size_t componentSize;
+};
+
+std::vector<std::vector<SeedHit>> getReadSeeds(const GfaGraph& graph, const std::vector<FastQ>& reads, size_t maxSeedsPerRead, size_t minSeedLength, size_t numThreads)
+{
+	std::vector<std::vector<SeedHit>> result;
+	result.resize(reads.size());
+	if (maxSeedsPerRead == 0) return result;
+	MummerSeeder seeder { graph, "", false };
+	Threading::ParallelFor(reads.size(), numThreads, [&seeder, &reads, &result, maxSeedsPerRead, minSeedLength](size_t index, size_t thread)
+	{
+		result[index] = seeder.getMemSeeds(reads[index].sequence, maxSeedsPerRead, minSeedLength);
+	});
+	return result;
+}
+
+//the longest seed in each gene. seeds are sorted longest first
+std::vector<SeedHit> longestSeedPerGene(const std::vector<SeedHit>& seeds, const std::unordered_set<int>& leftNodes, const std::unordered_set<int>& rightNodes)
+{
+	std::vector<SeedHit> result;
+	bool leftFound = false;
+	bool rightFound = false;
+	for (auto seed : seeds)
+	{
+		if (!leftFound && leftNodes.count(seed.nodeID) == 1)
+		{
+			result.push_back(seed);
+			leftFound = true;
+		}
+		else if (!rightFound && rightNodes.count(seed.nodeID) == 1)
+		{
+			result.push_back(seed);
+			rightFound = true;
+		}
+		if (leftFound && rightFound) break;
+	}
+	return result;
+}
+
+//each base is a separate node in the fusion graph, and each original node is in several copies
+std::vector<SeedHit> projectToFusionGraph(const std::vector<SeedHit>& seeds, const std::unordered_map<int, std::vector<int>>& copyStart, const GfaGraph& graph)
+{
+	std::vector<SeedHit> result;
+	for (auto seed : seeds)
+	{
+		size_t nodeLength = graph.nodes.at(seed.nodeID).size();
+		size_t base = seed.reverse ? nodeLength - 1 - seed.nodeOffset : seed.nodeOffset;
+		for (auto start : copyStart.at(seed.nodeID))
+		{
+			result.emplace_back(start + base, 0, seed.seqPos, seed.matchLen, seed.reverse);
+		}
+	}
+	return result;
+}
+
+void addBestAlnsOnePair(std::unordered_map<std::string, FusionAlignment>& bestAlns, std::string leftGene, std::string rightGene, const GfaGraph& fusiongraph, const std::vector<size_t>& readIndices, const std::vector<std::vector<SeedHit>>& seedsPerRead, const std::vector<FastQ>& allReads, double maxScoreFraction, int minFusionLen, ReusableState& state)
 {
 	auto alignmentGraph = DirectedGraph::BuildFromGFA(fusiongraph, true);
-	GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState reusableState { alignmentGraph, 1000, true };
-	for (auto read : reads)
+	auto& reusableState = state.get(alignmentGraph);
+	for (size_t index = 0; index < readIndices.size(); index++)
 	{
+		const auto& read = allReads[readIndices[index]];
 		try
 		{
-			auto alignments = AlignOneWay(alignmentGraph, read.seq_id, read.sequence, 1000, 1000, true, reusableState, true, true, false);
-			replaceDigraphNodeIdsWithOriginalNodeIds(*alignments.alignments[0].alignment, alignmentGraph);
-			if (alignments.alignments[0].alignment->score() > read.sequence.size() * maxScoreFraction) continue;
+			AlignmentResult alignments;
+			if (seedsPerRead[index].size() > 0)
+			{
+				alignments = AlignOneWay(alignmentGraph, read.seq_id, read.sequence, AlignmentBandwidth, AlignmentBandwidth, std::numeric_limits<size_t>::max(), true, false, seedsPerRead[index], reusableState, true, true, false, 0, 0, 0);
+			}
+			else
+			{
+				//the seed limit can drop all of a gene's seeds, so the pair is still tried with the full dynamic programming
+				alignments = AlignOneWay(alignmentGraph, read.seq_id, read.sequence, AlignmentBandwidth, AlignmentBandwidth, true, reusableState, true, true, false, 0);
+			}
+			if (alignments.alignments.size() == 0) continue;
+			size_t bestIndex = 0;
+			for (size_t j = 1; j < alignments.alignments.size(); j++)
+			{
+				if (alignments.alignments[j].alignment->score() < alignments.alignments[bestIndex].alignment->score()) bestIndex = j;
+			}
+			auto alignment = alignments.alignments[bestIndex].alignment;
+			replaceDigraphNodeIdsWithOriginalNodeIds(*alignment, alignmentGraph);
+			if (alignment->score() > read.sequence.size() * maxScoreFraction) continue;
 			int leftAlnSize = 0;
 			int rightAlnSize = 0;
 			bool crossedDummy = false;
-			for (int i = 0; i < alignments.alignments[0].alignment->path().mapping_size(); i++)
+			for (int i = 0; i < alignment->path().mapping_size(); i++)
 			{
-				if (alignments.alignments[0].alignment->path().mapping(i).position().name().substr(0, 12) == "DUMMY_MIDDLE")
+				if (alignment->path().mapping(i).position().name().substr(0, 12) == "DUMMY_MIDDLE")
 				{
 					crossedDummy = true;
 					continue;
 				}
 				if (!crossedDummy)
 				{
-					leftAlnSize += alignments.alignments[0].alignment->path().mapping(i).edit(0).to_length();
+					leftAlnSize += alignment->path().mapping(i).edit(0).to_length();
 				}
 				else
 				{
-					rightAlnSize += alignments.alignments[0].alignment->path().mapping(i).edit(0).to_length();
+					rightAlnSize += alignment->path().mapping(i).edit(0).to_length();
 				}
 			}
 			if (leftAlnSize < minFusionLen || rightAlnSize < minFusionLen) continue;
-			if (bestAlns.count(read.seq_id) == 0 || alignments.alignments[0].alignment->score() < bestAlns.at(read.seq_id).alignment->score())
+			if (bestAlns.count(read.seq_id) == 0 || alignment->score() < bestAlns.at(read.seq_id).alignment->score())
 			{
-				bestAlns[read.seq_id] = FusionAlignment { alignments.alignments[0].alignment, leftGene, rightGene, 0, getCorrected(*alignments.alignments[0].alignment, fusiongraph) };
+				bestAlns[read.seq_id] = FusionAlignment { alignment, leftGene, rightGene, 0, getCorrected(*alignment, fusiongraph) };
 			}
 		}
 		catch (ThreadReadAssertion::AssertionFailure& e)
@@ -234,18 +338,40 @@ void addBestAlnsOnePair(std::unordered_map<std::string, FusionAlignment>& bestAl
 	}
 }
 
-std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::string, std::string>>& putativeFusions, const std::unordered_map<std::string, std::vector<size_t>>& hasSeeds, const GfaGraph& graph, const std::unordered_map<std::string, std::unordered_set<int>>& geneBelongers, const std::vector<FastQ>& allReads, double maxScoreFraction, int minFusionLen, int fusionPenalty, size_t numThreads, std::unordered_map<std::string, std::unordered_set<size_t>> readsInNonfusionGraph)
+size_t geneSize(const std::string& gene, const GfaGraph& graph, const std::unordered_map<std::string, std::unordered_set<int>>& geneBelongers)
+{
+	size_t result = 0;
+	for (auto node : geneBelongers.at(gene))
+	{
+		result += graph.nodes.at(node).size();
+	}
+	return result;
+}
+
+std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::string, std::string>>& putativeFusions, const std::unordered_map<std::string, std::vector<size_t>>& hasSeeds, const GfaGraph& graph, const std::unordered_map<std::string, std::unordered_set<int>>& geneBelongers, const std::vector<FastQ>& allReads, const std::vector<std::vector<SeedHit>>& readSeeds, double maxScoreFraction, int minFusionLen, int fusionPenalty, size_t numThreads, std::unordered_map<std::string, std::unordered_set<size_t>> readsInNonfusionGraph)
 {
 	std::cerr << "get fusions" << std::endl;
 	std::vector<std::thread> threads;
 	size_t nextPair = 0;
 	std::mutex nextPairMutex;
 	std::vector<std::unordered_map<std::string, FusionAlignment>> bestFusionAlnsPerThread;
+	std::vector<ReusableState> statePerThread;
 	std::mutex readsInNonfusionGraphMutex;
 	bestFusionAlnsPerThread.resize(numThreads);
+	statePerThread.resize(numThreads);
+	std::vector<size_t> pairOrder;
+	{
+		std::vector<size_t> pairSize;
+		for (size_t i = 0; i < putativeFusions.size(); i++)
+		{
+			pairOrder.push_back(i);
+			pairSize.push_back(geneSize(putativeFusions[i].first, graph, geneBelongers) + geneSize(putativeFusions[i].second, graph, geneBelongers));
+		}
+		std::stable_sort(pairOrder.begin(), pairOrder.end(), [&pairSize](size_t left, size_t right) { return pairSize[left] > pairSize[right]; });
+	}
 	for (size_t thread = 0; thread < numThreads; thread++)
 	{
-		threads.emplace_back([&putativeFusions, &readsInNonfusionGraph, &readsInNonfusionGraphMutex, &bestFusionAlnsPerThread, &allReads, thread, maxScoreFraction, minFusionLen, &nextPair, &graph, &geneBelongers, &hasSeeds, &nextPairMutex]()
+		threads.emplace_back([&putativeFusions, &pairOrder, &readsInNonfusionGraph, &readsInNonfusionGraphMutex, &bestFusionAlnsPerThread, &statePerThread, &allReads, &readSeeds, thread, maxScoreFraction, minFusionLen, &nextPair, &graph, &geneBelongers, &hasSeeds, &nextPairMutex]()
 		{
 			while (true)
 			{
@@ -253,12 +379,13 @@ std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::
 				{
 					std::lock_guard<std::mutex> lock { nextPairMutex };
 					if (nextPair == putativeFusions.size()) break;
-					i = nextPair;
+					i = pairOrder[nextPair];
 					std::cerr << "fusion " << nextPair << "/" << putativeFusions.size() << std::endl;
 					nextPair += 1;
 				}
 				assert(putativeFusions[i].first != putativeFusions[i].second);
-				auto fusiongraph = getFusionGraph(putativeFusions[i].first, putativeFusions[i].second, graph, geneBelongers);
+				std::unordered_map<int, std::vector<int>> copyStart;
+				auto fusiongraph = getFusionGraph(putativeFusions[i].first, putativeFusions[i].second, graph, geneBelongers, copyStart);
 				std::unordered_set<size_t> readsHere;
 				// if (hasSeeds.count(putativeFusions[i].first) == 0) continue;
 				// if (hasSeeds.count(putativeFusions[i].second) == 0) continue;
@@ -272,12 +399,14 @@ std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::
 					readsInNonfusionGraph[putativeFusions[i].first].insert(readsHere.begin(), readsHere.end());
 					readsInNonfusionGraph[putativeFusions[i].second].insert(readsHere.begin(), readsHere.end());
 				}
-				std::vector<FastQ> reads;
-				for (auto index : readsHere)
+				std::vector<size_t> reads { readsHere.begin(), readsHere.end() };
+				std::vector<std::vector<SeedHit>> seeds;
+				for (auto index : reads)
 				{
-					reads.push_back(allReads[index]);
+					auto geneSeeds = longestSeedPerGene(readSeeds[index], geneBelongers.at(putativeFusions[i].first), geneBelongers.at(putativeFusions[i].second));
+					seeds.push_back(projectToFusionGraph(geneSeeds, copyStart, graph));
 				}
-				addBestAlnsOnePair(bestFusionAlnsPerThread[thread], putativeFusions[i].first, putativeFusions[i].second, fusiongraph, reads, maxScoreFraction, minFusionLen);
+				addBestAlnsOnePair(bestFusionAlnsPerThread[thread], putativeFusions[i].first, putativeFusions[i].second, fusiongraph, reads, seeds, allReads, maxScoreFraction, minFusionLen, statePerThread[thread]);
 			}
 		});
 	}
@@ -307,9 +436,17 @@ std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::
 	{
 		fusionGenes.push_back(pair.first);
 	}
+	{
+		std::unordered_map<std::string, size_t> sizes;
+		for (const auto& gene : fusionGenes)
+		{
+			sizes[gene] = geneSize(gene, graph, geneBelongers);
+		}
+		std::stable_sort(fusionGenes.begin(), fusionGenes.end(), [&sizes](const std::string& left, const std::string& right) { return sizes.at(left) > sizes.at(right); });
+	}
 	for (size_t thread = 0; thread < numThreads; thread++)
 	{
-		threads.emplace_back([&fusionGenes, &bestNonfusionAlnsPerThread, &allReads, thread, maxScoreFraction, minFusionLen, &nextPair, &graph, &geneBelongers, &readsInNonfusionGraph, &nextPairMutex]()
+		threads.emplace_back([&fusionGenes, &bestNonfusionAlnsPerThread, &statePerThread, &allReads, &readSeeds, thread, maxScoreFraction, minFusionLen, &nextPair, &graph, &geneBelongers, &readsInNonfusionGraph, &nextPairMutex]()
 		{
 			while (true)
 			{
@@ -323,12 +460,14 @@ std::vector<FusionAlignment> getBestAlignments(const std::vector<std::pair<std::
 				}
 				auto nonfusiongraph = getNonfusionGraph(fusionGenes[i], graph, geneBelongers);
 				assert(readsInNonfusionGraph.count(fusionGenes[i]) == 1);
-				std::vector<FastQ> reads;
-				for (auto index : readsInNonfusionGraph.at(fusionGenes[i]))
+				std::vector<size_t> reads { readsInNonfusionGraph.at(fusionGenes[i]).begin(), readsInNonfusionGraph.at(fusionGenes[i]).end() };
+				//the nonfusion graph keeps the original node ids, seeds are used as they are
+				std::vector<std::vector<SeedHit>> seeds;
+				for (auto index : reads)
 				{
-					reads.push_back(allReads[index]);
+					seeds.push_back(longestSeedPerGene(readSeeds[index], geneBelongers.at(fusionGenes[i]), geneBelongers.at(fusionGenes[i])));
 				}
-				addBestAlnsOnePair(bestNonfusionAlnsPerThread[thread], fusionGenes[i], fusionGenes[i], nonfusiongraph, reads, 1, 0);
+				addBestAlnsOnePair(bestNonfusionAlnsPerThread[thread], fusionGenes[i], fusionGenes[i], nonfusiongraph, reads, seeds, allReads, 1, 0, statePerThread[thread]);
 			}
 		});
 	}
@@ -477,7 +616,7 @@ std::unordered_map<std::string, std::unordered_set<size_t>> getExtraGeneMatches(
 		fakeGraph.nodes[nameMapping.size()] = transcript.sequence();
 		nameMapping.push_back(geneFromTranscript(transcript.name()));
 	}
-	auto seeder = MummerSeeder(fakeGraph, "");
+	auto seeder = MummerSeeder(fakeGraph, "", false);
 	std::unordered_map<std::string, std::unordered_set<size_t>> result;
 	for (size_t i = 0; i < reads.size(); i++)
 	{
@@ -506,6 +645,11 @@ int main(int argc, char** argv)
 	int numThreads = std::stoi(argv[10]);
 	std::string resultFusionFile { argv[11] };
 	std::string correctedReadsFile { argv[12] };
+	//optional: seeds kept per read (0 aligns every read without seeds) and minimum seed length
+	size_t maxSeedsPerRead = 50;
+	size_t minSeedLength = 20;
+	if (argc > 13) maxSeedsPerRead = std::stoi(argv[13]);
+	if (argc > 14) minSeedLength = std::stoi(argv[14]);
 
 	std::cerr << "load graph" << std::endl;
 	auto graph = GfaGraph::LoadFromFile(graphFile);
@@ -521,8 +665,10 @@ int main(int argc, char** argv)
 	auto geneBelongers = getGeneBelongers(transcripts, graph);
 	std::cerr << "get extra gene-matches" << std::endl;
 	auto extraGeneMatches = getExtraGeneMatches(transcripts, reads);
+	std::cerr << "get read seeds" << std::endl;
+	auto readSeeds = getReadSeeds(graph, reads, maxSeedsPerRead, minSeedLength, numThreads);
 	std::cerr << "get alns" << std::endl;
-	auto bestAlns = getBestAlignments(putativeFusions, hasSeeds, graph, geneBelongers, reads, maxScoreFraction, minFusionLen, fusionPenalty, numThreads, extraGeneMatches);
+	auto bestAlns = getBestAlignments(putativeFusions, hasSeeds, graph, geneBelongers, reads, readSeeds, maxScoreFraction, minFusionLen, fusionPenalty, numThreads, extraGeneMatches);
 	std::cerr << "write fusions" << std::endl;
 	writeFusions(bestAlns, resultFusionFile);
 	std::cerr << "write corrected reads" << std::endl;
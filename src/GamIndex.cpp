@@ -0,0 +1,124 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include "GamIndex.h"
+#include "vg.pb.h"
+
+//file layout: magic, GAM file size, entry count, entries as (hash, offset) pairs of uint64
+static const char indexMagic[8] = { 'G', 'A', 'M', 'I', 'D', 'X', '1', 0 };
+static constexpr size_t headerSize = sizeof(indexMagic) + 2 * sizeof(uint64_t);
+
+GamIndex::GamIndex(const std::string& gamFile, const std::string& indexFile) :
+gam(nullptr),
+index(new MappedFile { indexFile }),
+entries(nullptr),
+numEntries(0)
+{
+	if (index->size() < headerSize || memcmp(index->data(), indexMagic, sizeof(indexMagic)) != 0)
+	{
+		throw std::runtime_error("Not a GAM index: " + indexFile);
+	}
+	uint64_t gamSize;
+	memcpy(&gamSize, index->data() + sizeof(indexMagic), sizeof(uint64_t));
+	memcpy(&numEntries, index->data() + sizeof(indexMagic) + sizeof(uint64_t), sizeof(uint64_t));
+	if (index->size() != headerSize + numEntries * 2 * sizeof(uint64_t)) throw std::runtime_error("Truncated GAM index: " + indexFile);
+	entries = reinterpret_cast<const uint64_t*>(index->data() + headerSize);
+	struct stat info;
+	if (stat(gamFile.c_str(), &info) != 0) throw std::runtime_error("Could not open " + gamFile);
+	if ((uint64_t)info.st_size != gamSize) throw std::runtime_error("GAM index " + indexFile + " is out of date, rebuild it");
+	if (gamSize > 0) gam.reset(new MappedFile { gamFile });
+}
+
+size_t GamIndex::NumEntries() const
+{
+	return numEntries;
+}
+
+uint64_t GamIndex::NameHash(const std::string& readName)
+{
+	//FNV-1a
+	uint64_t result = 14695981039346656037ull;
+	for (auto c : readName)
+	{
+		result ^= (unsigned char)c;
+		result *= 1099511628211ull;
+	}
+	return result;
+}
+
+std::string GamIndex::DefaultIndexFile(const std::string& gamFile)
+{
+	return gamFile + ".gai";
+}
+
+std::vector<uint64_t> GamIndex::memberOffsets(uint64_t hash) const
+{
+	std::vector<uint64_t> result;
+	size_t low = 0;
+	size_t high = numEntries;
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+		if (entries[mid * 2] < hash)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	for (size_t i = low; i < numEntries && entries[i * 2] == hash; i++)
+	{
+		result.push_back(entries[i * 2 + 1]);
+	}
+	return result;
+}
+
+void GamIndex::Write(const std::string& indexFile, std::vector<std::pair<uint64_t, uint64_t>> entries, uint64_t gamSize)
+{
+	std::sort(entries.begin(), entries.end());
+	//a member with several alignments of the same read is listed once
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+	std::ofstream file { indexFile, std::ios::binary };
+	if (!file.good()) throw std::runtime_error("Could not write " + indexFile);
+	uint64_t count = entries.size();
+	file.write(indexMagic, sizeof(indexMagic));
+	file.write((const char*)&gamSize, sizeof(gamSize));
+	file.write((const char*)&count, sizeof(count));
+	for (auto entry : entries)
+	{
+		file.write((const char*)&entry.first, sizeof(entry.first));
+		file.write((const char*)&entry.second, sizeof(entry.second));
+	}
+	if (!file.good()) throw std::runtime_error("Could not write " + indexFile);
+}
+
+void GamIndex::Build(const std::string& gamFile, const std::string& indexFile, size_t numThreads)
+{
+	std::vector<std::pair<uint64_t, uint64_t>> entries;
+	std::mutex entryMutex;
+	GamReader::BlockReader reader { gamFile, numThreads };
+	std::vector<std::string> members;
+	std::vector<size_t> memberOffsets;
+	while (reader.NextBatch(members, memberOffsets))
+	{
+		//lookups parse a single member, which needs every member to start a chunk of messages
+		if (reader.ChunksCrossMembers()) throw std::runtime_error(gamFile + " has chunks of messages split between gzip members and can't be indexed by member");
+		Threading::ParallelFor(members.size(), numThreads, [&members, &memberOffsets, &entries, &entryMutex](size_t index, size_t thread)
+		{
+			std::vector<std::pair<uint64_t, uint64_t>> memberEntries;
+			GamReader::ParseMember<vg::Alignment>(members[index], [&memberEntries, &memberOffsets, index](vg::Alignment& aln)
+			{
+				memberEntries.emplace_back(NameHash(aln.name()), memberOffsets[index]);
+			});
+			std::lock_guard<std::mutex> guard { entryMutex };
+			entries.insert(entries.end(), memberEntries.begin(), memberEntries.end());
+		});
+	}
+	struct stat info;
+	if (stat(gamFile.c_str(), &info) != 0) throw std::runtime_error("Could not open " + gamFile);
+	Write(indexFile, std::move(entries), info.st_size);
+}
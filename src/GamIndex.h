@@ -0,0 +1,52 @@
+#ifndef GamIndex_h
+#define GamIndex_h
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "GamReader.h"
+
+//index from read names to the gzip members of a GAM file containing their alignments.
+//the index only stores 64-bit name hashes and member offsets, sorted by hash. lookups decompress the members and filter by the actual name
+class GamIndex
+{
+public:
+	GamIndex(const std::string& gamFile, const std::string& indexFile);
+	//alignments whose name is readName, in file order
+	template <typename T>
+	std::vector<T> Lookup(const std::string& readName) const
+	{
+		std::vector<T> result;
+		for (auto offset : memberOffsets(NameHash(readName)))
+		{
+			std::string member;
+			size_t compressedSize;
+			if (!GamReader::InflateMember(gam->data() + offset, gam->size() - offset, member, compressedSize))
+			{
+				throw std::runtime_error("Corrupted gzip member at byte " + std::to_string(offset) + ", the index might be out of date");
+			}
+			GamReader::ParseMember<T>(member, [&result, &readName](T& object)
+			{
+				if (object.name() == readName) result.emplace_back(std::move(object));
+			});
+		}
+		return result;
+	}
+	size_t NumEntries() const;
+	static uint64_t NameHash(const std::string& readName);
+	static std::string DefaultIndexFile(const std::string& gamFile);
+	//entries are (name hash, member offset). gamSize is used to detect an outdated index
+	static void Write(const std::string& indexFile, std::vector<std::pair<uint64_t, uint64_t>> entries, uint64_t gamSize);
+	//indexes an existing GAM file
+	static void Build(const std::string& gamFile, const std::string& indexFile, size_t numThreads);
+private:
+	std::vector<uint64_t> memberOffsets(uint64_t hash) const;
+	std::unique_ptr<MappedFile> gam;
+	std::unique_ptr<MappedFile> index;
+	const uint64_t* entries;
+	size_t numEntries;
+};
+
+#endif
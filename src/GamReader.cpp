@@ -0,0 +1,352 @@
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include "GamReader.h"
+
+namespace GamReader
+{
+	//compressed bytes per thread in one batch
+	static constexpr size_t BatchBytesPerThread = 4 * 1024 * 1024;
+	//members which decompress to more than this are streamed in parts
+	static constexpr size_t MaxMemberBytes = 64 * 1024 * 1024;
+
+	enum class InflateResult
+	{
+		Done,
+		Invalid,
+		TooLarge
+	};
+
+	struct MemberStream
+	{
+		MemberStream(const char* data, size_t available, size_t start) :
+		data(data),
+		available(available),
+		start(start),
+		fed(0),
+		ended(false),
+		buffer()
+		{
+			memset(&zstream, 0, sizeof(zstream));
+			if (inflateInit2(&zstream, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("Could not initialize zlib");
+		}
+		~MemberStream()
+		{
+			inflateEnd(&zstream);
+		}
+		//decompresses until the buffer has at least size bytes or the member ends
+		void Fill(size_t size)
+		{
+			char out[65536];
+			while (!ended && buffer.size() < size)
+			{
+				if (zstream.avail_in == 0)
+				{
+					if (fed == available) throw std::runtime_error("Truncated gzip member at byte " + std::to_string(start));
+					size_t feed = std::min(available - fed, (size_t)std::numeric_limits<uInt>::max());
+					zstream.next_in = (Bytef*)(data + fed);
+					zstream.avail_in = feed;
+					fed += feed;
+				}
+				zstream.next_out = (Bytef*)out;
+				zstream.avail_out = sizeof(out);
+				int status = inflate(&zstream, Z_NO_FLUSH);
+				if (status != Z_OK && status != Z_STREAM_END) throw std::runtime_error("Corrupted gzip member at byte " + std::to_string(start));
+				buffer.append(out, sizeof(out) - zstream.avail_out);
+				if (status == Z_STREAM_END) ended = true;
+			}
+		}
+		size_t CompressedSize() const
+		{
+			return fed - zstream.avail_in;
+		}
+		const char* data;
+		size_t available;
+		size_t start;
+		size_t fed;
+		bool ended;
+		z_stream zstream;
+		//decompressed bytes which are not yet returned
+		std::string buffer;
+	};
+
+	//walks the complete messages at the start of data, continuing a chunk which has messagesLeftInChunk messages left.
+	//calls callback(start, end) for every message including its size. returns where the incomplete count or message at the end starts
+	template <typename F>
+	size_t walkMessages(const std::string& data, uint64_t& messagesLeftInChunk, F callback)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+		size_t size = data.size();
+		size_t parsed = 0;
+		while (parsed < size)
+		{
+			if (messagesLeftInChunk == 0)
+			{
+				::google::protobuf::io::CodedInputStream coded { bytes + parsed, (int)std::min(size - parsed, (size_t)16) };
+				uint64_t count;
+				if (!coded.ReadVarint64((::google::protobuf::uint64*)&count))
+				{
+					if (size - parsed >= 10) throw std::runtime_error("Corrupted message count in gzip member");
+					break;
+				}
+				messagesLeftInChunk = count;
+				parsed += coded.CurrentPosition();
+				continue;
+			}
+			::google::protobuf::io::CodedInputStream coded { bytes + parsed, (int)std::min(size - parsed, (size_t)8) };
+			uint32_t msgSize;
+			if (!coded.ReadVarint32(&msgSize))
+			{
+				if (size - parsed >= 8) throw std::runtime_error("Corrupted message size in gzip member");
+				break;
+			}
+			size_t messageEnd = parsed + coded.CurrentPosition() + msgSize;
+			if (messageEnd > size) break;
+			callback(parsed, messageEnd);
+			messagesLeftInChunk -= 1;
+			parsed = messageEnd;
+		}
+		return parsed;
+	}
+
+	void appendVarint(std::string& target, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			target.push_back((char)((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+		target.push_back((char)value);
+	}
+
+	bool isMemberStart(const char* data, size_t available)
+	{
+		//magic bytes + deflate + no reserved flags
+		if (available < 18) return false;
+		return (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b && data[2] == 8 && (data[3] & 0xe0) == 0;
+	}
+
+	InflateResult inflateMember(const char* data, size_t available, std::string& result, size_t& compressedSize, size_t maxSize)
+	{
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		//gzip header, one member only
+		if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) return InflateResult::Invalid;
+		char buffer[65536];
+		size_t fed = 0;
+		int status = Z_OK;
+		while (status != Z_STREAM_END)
+		{
+			if (stream.avail_in == 0)
+			{
+				if (fed == available) break;
+				size_t feed = std::min(available - fed, (size_t)std::numeric_limits<uInt>::max());
+				stream.next_in = (Bytef*)(data + fed);
+				stream.avail_in = feed;
+				fed += feed;
+			}
+			stream.next_out = (Bytef*)buffer;
+			stream.avail_out = sizeof(buffer);
+			status = inflate(&stream, Z_NO_FLUSH);
+			if (status != Z_OK && status != Z_STREAM_END) break;
+			result.append(buffer, sizeof(buffer) - stream.avail_out);
+			if (result.size() > maxSize)
+			{
+				inflateEnd(&stream);
+				return InflateResult::TooLarge;
+			}
+		}
+		compressedSize = fed - stream.avail_in;
+		inflateEnd(&stream);
+		return status == Z_STREAM_END ? InflateResult::Done : InflateResult::Invalid;
+	}
+
+	bool InflateMember(const char* data, size_t available, std::string& result, size_t& compressedSize)
+	{
+		return inflateMember(data, available, result, compressedSize, std::numeric_limits<size_t>::max()) == InflateResult::Done;
+	}
+
+	BlockReader::BlockReader(const std::string& filename, size_t numThreads) :
+	file(nullptr),
+	pos(0),
+	numThreads(std::max(numThreads, (size_t)1)),
+	carry(),
+	messagesLeftInChunk(0),
+	chunksCrossMembers(false)
+	{
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0) throw std::runtime_error("Could not open " + filename);
+		//an empty file has no members
+		if (info.st_size == 0) return;
+		file.reset(new MappedFile { filename });
+		if (!isMemberStart(file->data(), file->size())) throw std::runtime_error("Not a gzip file: " + filename);
+	}
+
+	BlockReader::~BlockReader()
+	{
+	}
+
+	size_t BlockReader::NumThreads() const
+	{
+		return numThreads;
+	}
+
+	bool BlockReader::ChunksCrossMembers() const
+	{
+		return chunksCrossMembers;
+	}
+
+	bool BlockReader::NextBatch(std::vector<std::string>& members)
+	{
+		std::vector<size_t> memberOffsets;
+		return NextBatch(members, memberOffsets);
+	}
+
+	bool BlockReader::NextBatch(std::vector<std::string>& members, std::vector<size_t>& memberOffsets)
+	{
+		members.clear();
+		memberOffsets.clear();
+		if (stream != nullptr) return nextStreamedBatch(members, memberOffsets);
+		if (file == nullptr || pos == file->size())
+		{
+			if (carry.size() > 0 || messagesLeftInChunk > 0) throw std::runtime_error("Truncated message at the end of the file");
+			return false;
+		}
+		const char* data = file->data();
+		size_t size = file->size();
+		size_t windowEnd = std::min(size, pos + BatchBytesPerThread * numThreads);
+		std::vector<size_t> candidates;
+		candidates.push_back(pos);
+		for (const char* found = (const char*)memchr(data + pos + 1, 0x1f, windowEnd - pos - 1); found != nullptr; found = (const char*)memchr(found + 1, 0x1f, data + windowEnd - found - 1))
+		{
+			size_t offset = found - data;
+			if (isMemberStart(found, size - offset)) candidates.push_back(offset);
+		}
+		std::vector<std::string> decompressed;
+		std::vector<size_t> memberEnd;
+		std::vector<char> tooLarge;
+		decompressed.resize(candidates.size());
+		memberEnd.resize(candidates.size(), 0);
+		tooLarge.resize(candidates.size(), false);
+		Threading::ParallelFor(candidates.size(), numThreads, [&candidates, &decompressed, &memberEnd, &tooLarge, data, size](size_t index, size_t thread)
+		{
+			size_t compressedSize = 0;
+			InflateResult result = inflateMember(data + candidates[index], size - candidates[index], decompressed[index], compressedSize, MaxMemberBytes);
+			if (result == InflateResult::Done)
+			{
+				memberEnd[index] = candidates[index] + compressedSize;
+			}
+			else
+			{
+				tooLarge[index] = result == InflateResult::TooLarge;
+				std::string empty;
+				std::swap(decompressed[index], empty);
+			}
+		});
+		//chain the real members starting from the known member at pos
+		size_t candidate = 0;
+		while (pos < windowEnd)
+		{
+			while (candidate < candidates.size() && candidates[candidate] < pos) candidate++;
+			if (candidate < candidates.size() && candidates[candidate] == pos && tooLarge[candidate])
+			{
+				stream.reset(new MemberStream { data + pos, size - pos, pos });
+				break;
+			}
+			if (candidate == candidates.size() || candidates[candidate] != pos || memberEnd[candidate] == 0)
+			{
+				throw std::runtime_error("Corrupted gzip member at byte " + std::to_string(pos));
+			}
+			members.emplace_back(std::move(decompressed[candidate]));
+			memberOffsets.push_back(pos);
+			pos = memberEnd[candidate];
+		}
+		moveIncompleteEnds(members);
+		if (members.size() == 0) return NextBatch(members, memberOffsets);
+		return true;
+	}
+
+	void BlockReader::moveIncompleteEnds(std::vector<std::string>& members)
+	{
+		//members written by GraphAligner and vg end at a chunk end, check them in parallel and only rebuild the ones which don't
+		std::vector<char> wholeChunks;
+		wholeChunks.resize(members.size(), false);
+		Threading::ParallelFor(members.size(), numThreads, [&members, &wholeChunks](size_t index, size_t thread)
+		{
+			uint64_t messagesLeft = 0;
+			wholeChunks[index] = walkMessages(members[index], messagesLeft, [](size_t start, size_t end) {}) == members[index].size() && messagesLeft == 0;
+		});
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			if (carry.size() == 0 && messagesLeftInChunk == 0 && wholeChunks[i]) continue;
+			chunksCrossMembers = chunksCrossMembers || carry.size() > 0 || messagesLeftInChunk > 0;
+			std::string data = std::move(carry);
+			data += members[i];
+			//the complete messages become one chunk, whatever chunks they came from
+			std::string messages;
+			uint64_t messageCount = 0;
+			size_t parsed = walkMessages(data, messagesLeftInChunk, [&data, &messages, &messageCount](size_t start, size_t end)
+			{
+				messages.append(data, start, end - start);
+				messageCount += 1;
+			});
+			carry = data.substr(parsed);
+			members[i].clear();
+			if (messageCount == 0) continue;
+			appendVarint(members[i], messageCount);
+			members[i] += messages;
+		}
+	}
+
+	bool BlockReader::nextStreamedBatch(std::vector<std::string>& members, std::vector<size_t>& memberOffsets)
+	{
+		assert(stream != nullptr);
+		size_t wanted = BatchBytesPerThread * numThreads;
+		//the member continues a chunk of the previous member
+		if (stream->fed == 0 && (carry.size() > 0 || messagesLeftInChunk > 0))
+		{
+			chunksCrossMembers = true;
+			stream->buffer.insert(0, carry);
+			carry.clear();
+		}
+		while (members.size() == 0)
+		{
+			//a single message can be larger than a batch, so always decompress more than what is left over from last time
+			stream->Fill(stream->buffer.size() + wanted);
+			std::string part;
+			uint64_t partMessages = 0;
+			auto finishPart = [&part, &partMessages, &members, &memberOffsets, this]()
+			{
+				if (partMessages == 0) return;
+				std::string framed;
+				appendVarint(framed, partMessages);
+				framed += part;
+				members.emplace_back(std::move(framed));
+				memberOffsets.push_back(stream->start);
+				part.clear();
+				partMessages = 0;
+			};
+			size_t parsed = walkMessages(stream->buffer, messagesLeftInChunk, [&part, &partMessages, &finishPart, this](size_t start, size_t end)
+			{
+				part.append(stream->buffer, start, end - start);
+				partMessages += 1;
+				if (part.size() >= BatchBytesPerThread) finishPart();
+			});
+			finishPart();
+			stream->buffer.erase(0, parsed);
+			if (stream->ended)
+			{
+				//an incomplete message continues in the next member
+				std::swap(carry, stream->buffer);
+				pos = stream->start + stream->CompressedSize();
+				stream.reset();
+				if (members.size() == 0) return NextBatch(members, memberOffsets);
+				return true;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef GamReader_h
+#define GamReader_h
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "google/protobuf/io/coded_stream.h"
+#include "MappedFile.h"
+#include "Threading.h"
+
+//parallel reader for gzipped protobuf streams (.gam, .vg).
+//GraphAligner writes every read as a separate gzip member, so the members can be found and decompressed independently.
+//member starts are found by scanning for the gzip magic bytes and decompressing from every candidate in parallel,
+//false candidates inside the compressed data fail to decompress or fail the gzip crc and are dropped when the members are chained together.
+//a member too large to decompress at once, eg. a whole file written as one member by vg, is decompressed sequentially in parts
+//which are cut at message boundaries, so it doesn't have to fit in memory and its messages are still parsed in parallel.
+//a chunk of messages can also continue from one member into the next, eg. in BGZF files. the incomplete end of such a member is
+//moved to the start of the next one, so the returned members always hold whole messages.
+namespace GamReader
+{
+	struct MemberStream;
+
+	//decompresses one gzip member starting at data. returns false if it's not a valid member
+	bool InflateMember(const char* data, size_t available, std::string& result, size_t& compressedSize);
+
+	//decompresses the gzip members of a file in batches
+	class BlockReader
+	{
+	public:
+		BlockReader(const std::string& filename, size_t numThreads);
+		~BlockReader();
+		//decompressed members of the next part of the file in file order. returns false at the end of the file.
+		//the parts of a streamed member are returned as separate members with the same offset
+		bool NextBatch(std::vector<std::string>& members);
+		//also the byte offsets of the members in the file
+		bool NextBatch(std::vector<std::string>& members, std::vector<size_t>& memberOffsets);
+		size_t NumThreads() const;
+		//true if a chunk of messages so far continued from one member into the next. such members can't be parsed alone from their offsets
+		bool ChunksCrossMembers() const;
+	private:
+		bool nextStreamedBatch(std::vector<std::string>& members, std::vector<size_t>& memberOffsets);
+		void moveIncompleteEnds(std::vector<std::string>& members);
+		std::unique_ptr<MappedFile> file;
+		size_t pos;
+		size_t numThreads;
+		std::unique_ptr<MemberStream> stream;
+		//the incomplete end of the previous member, and how many messages of its last chunk were not read yet
+		std::string carry;
+		uint64_t messagesLeftInChunk;
+		bool chunksCrossMembers;
+	};
+
+	//one member contains one or more chunks of: varint64 count, count * (varint32 size, message)
+	template <typename T, typename F>
+	void ParseMember(const std::string& member, F callback)
+	{
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(member.data());
+		size_t pos = 0;
+		while (pos < member.size())
+		{
+			uint64_t count = 0;
+			{
+				::google::protobuf::io::CodedInputStream coded { data + pos, (int)std::min(member.size() - pos, (size_t)16) };
+				if (!coded.ReadVarint64((::google::protobuf::uint64*)&count)) throw std::runtime_error("Corrupted message count in gzip member");
+				pos += coded.CurrentPosition();
+			}
+			for (uint64_t i = 0; i < count; i++)
+			{
+				uint32_t msgSize = 0;
+				{
+					::google::protobuf::io::CodedInputStream coded { data + pos, (int)std::min(member.size() - pos, (size_t)8) };
+					if (!coded.ReadVarint32(&msgSize)) throw std::runtime_error("Corrupted message size in gzip member");
+					pos += coded.CurrentPosition();
+				}
+				if (pos + msgSize > member.size()) throw std::runtime_error("Truncated message in gzip member");
+				if (msgSize > 0)
+				{
+					T object;
+					if (!object.ParseFromArray(data + pos, msgSize)) throw std::runtime_error("Corrupted message in gzip member");
+					callback(object);
+				}
+				pos += msgSize;
+			}
+		}
+	}
+
+	//calls the callback from numThreads threads in no particular order. thread is in [0, numThreads)
+	template <typename T>
+	void ForEachParallel(const std::string& filename, size_t numThreads, std::function<void(T&, size_t thread)> callback)
+	{
+		BlockReader reader { filename, numThreads };
+		std::vector<std::string> members;
+		while (reader.NextBatch(members))
+		{
+			Threading::ParallelFor(members.size(), numThreads, [&members, &callback](size_t index, size_t thread)
+			{
+				ParseMember<T>(members[index], [&callback, thread](T& object) { callback(object, thread); });
+			});
+		}
+	}
+
+	//calls the callback from the calling thread in file order. the next batch is decompressed and parsed in the background meanwhile
+	template <typename T>
+	void ForEachOrdered(const std::string& filename, size_t numThreads, std::function<void(T&)> callback)
+	{
+		BlockReader reader { filename, numThreads };
+		auto parseBatch = [&reader, numThreads]()
+		{
+			std::vector<std::string> members;
+			std::vector<std::vector<T>> result;
+			if (!reader.NextBatch(members)) return result;
+			result.resize(members.size());
+			Threading::ParallelFor(members.size(), numThreads, [&members, &result](size_t index, size_t thread)
+			{
+				ParseMember<T>(members[index], [&result, index](T& object) { result[index].emplace_back(std::move(object)); });
+				std::string empty;
+				std::swap(members[index], empty);
+			});
+			return result;
+		};
+		auto next = std::async(std::launch::async, parseBatch);
+		while (true)
+		{
+			std::vector<std::vector<T>> batch = next.get();
+			if (batch.size() == 0) break;
+			next = std::async(std::launch::async, parseBatch);
+			for (auto& member : batch)
+			{
+				for (auto& object : member)
+				{
+					callback(object);
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,210 @@
+//checks that GamReader reads GAM files whose chunks of messages are split between gzip members.
+//the alignments are serialized as chunks of: varint64 count, count * (varint32 size, message), like vg and GraphAligner write them,
+//and the bytes are cut into gzip members at random places, including inside counts, sizes and messages.
+//every alignment must be read exactly once and ForEachOrdered must return them in file order
+//usage: GamReaderTest [seed]
+
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "GamReader.h"
+#include "vg.pb.h"
+
+void appendVarint(std::string& target, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		target.push_back((char)((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	target.push_back((char)value);
+}
+
+std::string gzipMember(const std::string& data)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, 1, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("Could not initialize zlib");
+	std::string result;
+	result.resize(deflateBound(&stream, data.size()));
+	stream.next_in = (Bytef*)data.data();
+	stream.avail_in = data.size();
+	stream.next_out = (Bytef*)&result[0];
+	stream.avail_out = result.size();
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END) throw std::runtime_error("Could not compress");
+	result.resize(stream.total_out);
+	deflateEnd(&stream);
+	return result;
+}
+
+std::vector<vg::Alignment> makeAlignments(std::mt19937& rand, size_t count, size_t maxLength, bool lowComplexity)
+{
+	std::vector<vg::Alignment> result;
+	for (size_t i = 0; i < count; i++)
+	{
+		vg::Alignment aln;
+		aln.set_name("read" + std::to_string(i));
+		size_t length = rand() % maxLength;
+		std::string sequence;
+		sequence.reserve(length);
+		for (size_t j = 0; j < length; j++)
+		{
+			sequence += lowComplexity ? "ACGT"[(j / 1000) % 4] : "ACGT"[rand() % 4];
+		}
+		aln.set_sequence(sequence);
+		aln.set_score(rand() % 1000);
+		result.push_back(aln);
+	}
+	return result;
+}
+
+//uncompressed stream of the alignments in chunks of random sizes
+std::string serialize(std::mt19937& rand, const std::vector<vg::Alignment>& alignments)
+{
+	std::string result;
+	size_t pos = 0;
+	while (pos < alignments.size())
+	{
+		size_t count = std::min(alignments.size() - pos, (size_t)(1 + rand() % 5));
+		appendVarint(result, count);
+		for (size_t i = pos; i < pos + count; i++)
+		{
+			std::string message;
+			alignments[i].SerializeToString(&message);
+			appendVarint(result, message.size());
+			result += message;
+		}
+		pos += count;
+	}
+	return result;
+}
+
+//the stream cut into members at the given places, or at random places if there are none
+void writeMembers(std::mt19937& rand, const std::string& filename, const std::string& data, std::vector<size_t> cuts, size_t numRandomCuts)
+{
+	for (size_t i = 0; i < numRandomCuts; i++)
+	{
+		cuts.push_back(1 + rand() % (data.size() - 1));
+	}
+	cuts.push_back(0);
+	cuts.push_back(data.size());
+	std::sort(cuts.begin(), cuts.end());
+	cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+	std::ofstream file { filename, std::ios::binary };
+	for (size_t i = 1; i < cuts.size(); i++)
+	{
+		file << gzipMember(data.substr(cuts[i-1], cuts[i] - cuts[i-1]));
+	}
+}
+
+bool sameAlignments(const std::string& name, const std::vector<vg::Alignment>& expected, const std::vector<vg::Alignment>& actual)
+{
+	if (expected.size() != actual.size())
+	{
+		std::cerr << name << ": " << actual.size() << " alignments instead of " << expected.size() << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		if (expected[i].name() != actual[i].name() || expected[i].sequence() != actual[i].sequence() || expected[i].score() != actual[i].score())
+		{
+			std::cerr << name << ": alignment " << i << " is " << actual[i].name() << " instead of " << expected[i].name() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool checkFile(const std::string& name, const std::string& filename, const std::vector<vg::Alignment>& expected, size_t numThreads)
+{
+	bool valid = true;
+	std::vector<vg::Alignment> ordered;
+	GamReader::ForEachOrdered<vg::Alignment>(filename, numThreads, [&ordered](vg::Alignment& aln) { ordered.push_back(aln); });
+	valid = sameAlignments(name + " ordered", expected, ordered) && valid;
+	std::vector<std::vector<vg::Alignment>> perThread;
+	perThread.resize(numThreads);
+	GamReader::ForEachParallel<vg::Alignment>(filename, numThreads, [&perThread](vg::Alignment& aln, size_t thread) { perThread[thread].push_back(aln); });
+	std::vector<vg::Alignment> parallel;
+	for (const auto& alns : perThread)
+	{
+		parallel.insert(parallel.end(), alns.begin(), alns.end());
+	}
+	std::sort(parallel.begin(), parallel.end(), [](const vg::Alignment& left, const vg::Alignment& right) { return std::stoull(left.name().substr(4)) < std::stoull(right.name().substr(4)); });
+	valid = sameAlignments(name + " parallel", expected, parallel) && valid;
+	return valid;
+}
+
+int main(int argc, char** argv)
+{
+	size_t seed = 1;
+	if (argc > 1) seed = std::stoull(argv[1]);
+	std::mt19937 rand { (unsigned int)seed };
+	char filenameTemplate[] = "/tmp/GamReaderTestXXXXXX";
+	int fd = mkstemp(filenameTemplate);
+	if (fd == -1)
+	{
+		std::cerr << "Could not create a temporary file" << std::endl;
+		return 1;
+	}
+	close(fd);
+	std::string filename { filenameTemplate };
+	size_t failures = 0;
+	size_t checks = 0;
+
+	//small files which fit in one batch, cut in many places
+	for (size_t round = 0; round < 200; round++)
+	{
+		checks += 1;
+		auto alignments = makeAlignments(rand, 1 + rand() % 50, 300, false);
+		std::string data = serialize(rand, alignments);
+		writeMembers(rand, filename, data, {}, rand() % 20);
+		if (!checkFile("round " + std::to_string(round), filename, alignments, 1 + rand() % 4)) failures += 1;
+	}
+
+	//incompressible sequences, the members are decompressed in several batches and chunks continue from one batch into the next
+	{
+		checks += 1;
+		auto alignments = makeAlignments(rand, 400, 100000, false);
+		std::string data = serialize(rand, alignments);
+		writeMembers(rand, filename, data, {}, 300);
+		if (!checkFile("several batches", filename, alignments, 2)) failures += 1;
+	}
+
+	//a member too large to decompress at once, which continues a chunk of the previous member and ends in the middle of a message
+	{
+		checks += 1;
+		auto alignments = makeAlignments(rand, 200, 1000000, true);
+		std::string data = serialize(rand, alignments);
+		writeMembers(rand, filename, data, { data.size() / 100 + 7, data.size() - data.size() / 100 - 7 }, 0);
+		if (!checkFile("streamed member", filename, alignments, 4)) failures += 1;
+	}
+
+	//a file which ends in the middle of a message is an error
+	{
+		checks += 1;
+		auto alignments = makeAlignments(rand, 10, 300, false);
+		std::string data = serialize(rand, alignments);
+		data.resize(data.size() - 5);
+		writeMembers(rand, filename, data, {}, 3);
+		try
+		{
+			GamReader::ForEachOrdered<vg::Alignment>(filename, 2, [](vg::Alignment& aln) {});
+			std::cerr << "truncated file: no error" << std::endl;
+			failures += 1;
+		}
+		catch (const std::runtime_error& e)
+		{
+		}
+	}
+
+	std::remove(filename.c_str());
+	std::cerr << checks << " checks, " << failures << " failures" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -96,6 +96,12 @@ public:
 			auto item = getAlignmentFromSeed(seq_id, sequence, seedHits[i], reusableState);
 			if (item.alignmentFailed()) continue;
 			result.alignments.push_back(item);
+			if (params.seedStopCoverage > 0 && i+1 < seedHits.size() && readCovered(result.alignments, sequence.size()))
+			{
+				result.seedsDropped = seedHits.size() - i - 1;
+				logger << seq_id << " alignments cover the read, drop the remaining " << result.seedsDropped << " seeds" << BufferedWriter::Flush;
+				break;
+			}
 		}
 		assertSetRead(seq_id, "No seed");
 
@@ -104,6 +110,28 @@ public:
 
 private:
 
+	//the selected alignments with a high enough identity cover enough of the read
+	bool readCovered(const std::vector<AlignmentResult::AlignmentItem>& alignments, size_t readLength) const
+	{
+		auto selected = CommonUtils::SelectAlignments(alignments, std::numeric_limits<size_t>::max(), [](const AlignmentResult::AlignmentItem& aln) { return aln.alignment.get(); });
+		std::vector<std::pair<size_t, size_t>> intervals;
+		for (const auto& aln : selected)
+		{
+			if (aln.alignment->identity() < params.seedStopIdentity) continue;
+			intervals.emplace_back(aln.alignmentStart, aln.alignmentEnd);
+		}
+		std::sort(intervals.begin(), intervals.end());
+		size_t covered = 0;
+		size_t coveredUntil = 0;
+		for (auto interval : intervals)
+		{
+			if (interval.second <= coveredUntil) continue;
+			covered += interval.second - std::max(interval.first, coveredUntil);
+			coveredUntil = interval.second;
+		}
+		return covered >= params.seedStopCoverage * readLength;
+	}
+
 	OnewayTrace getBacktraceFullStart(const std::string& sequence, AlignerGraphsizedState& reusableState) const
 	{
 		return bvAligner.getBacktraceFullStart(sequence, params.forceGlobal, reusableState);
@@ -145,12 +173,12 @@ private:
 		if (!result.backward.failed())
 		{
 			auto reversePos = params.graph.GetReversePosition(forwardNodeId, seedHit.nodeOffset);
-			assert(result.backward.trace.back().DPposition.seqPos == (size_t)-1 && params.graph.nodeIDs[result.backward.trace.back().DPposition.node] == backwardNodeId && params.graph.nodeOffset[result.backward.trace.back().DPposition.node] + result.backward.trace.back().DPposition.nodeOffset == reversePos.second);
+			assert(result.backward.trace.back().DPposition.seqPos == (size_t)-1 && params.graph.NodeID(result.backward.trace.back().DPposition.node) == backwardNodeId && params.graph.NodeOffset(result.backward.trace.back().DPposition.node) + result.backward.trace.back().DPposition.nodeOffset == reversePos.second);
 			std::reverse(result.backward.trace.begin(), result.backward.trace.end());
 		}
 		if (!result.forward.failed())
 		{
-			assert(result.forward.trace.back().DPposition.seqPos == (size_t)-1 && params.graph.nodeIDs[result.forward.trace.back().DPposition.node] == forwardNodeId && params.graph.nodeOffset[result.forward.trace.back().DPposition.node] + result.forward.trace.back().DPposition.nodeOffset == seedHit.nodeOffset);
+			assert(result.forward.trace.back().DPposition.seqPos == (size_t)-1 && params.graph.NodeID(result.forward.trace.back().DPposition.node) == forwardNodeId && params.graph.NodeOffset(result.forward.trace.back().DPposition.node) + result.forward.trace.back().DPposition.nodeOffset == seedHit.nodeOffset);
 			std::reverse(result.forward.trace.begin(), result.forward.trace.end());
 		}
 		return result;
@@ -163,8 +191,8 @@ private:
 		{
 			trace[i].DPposition.seqPos += start;
 			auto nodeIndex = trace[i].DPposition.node;
-			trace[i].DPposition.node = params.graph.nodeIDs[nodeIndex];
-			trace[i].DPposition.nodeOffset += params.graph.nodeOffset[nodeIndex];
+			trace[i].DPposition.node = params.graph.NodeID(nodeIndex);
+			trace[i].DPposition.nodeOffset += params.graph.NodeOffset(nodeIndex);
 			assert(trace[i].DPposition.seqPos < sequence.size());
 			assert(i == 0 || trace[i].sequenceCharacter == sequence[trace[i].DPposition.seqPos]);
 		}
@@ -179,9 +207,9 @@ private:
 		{
 			assert(trace[i].DPposition.seqPos <= end || trace[i].DPposition.seqPos == (size_t)-1);
 			trace[i].DPposition.seqPos = end - trace[i].DPposition.seqPos;
-			size_t offset = params.graph.nodeOffset[trace[i].DPposition.node] + trace[i].DPposition.nodeOffset;
-			auto reversePos = params.graph.GetReversePosition(params.graph.nodeIDs[trace[i].DPposition.node], offset);
-			assert(reversePos.second < params.graph.originalNodeSize.at(params.graph.nodeIDs[trace[i].DPposition.node]));
+			size_t offset = params.graph.NodeOffset(trace[i].DPposition.node) + trace[i].DPposition.nodeOffset;
+			auto reversePos = params.graph.GetReversePosition(params.graph.NodeID(trace[i].DPposition.node), offset);
+			assert(reversePos.second < params.graph.OriginalNodeSize(params.graph.NodeID(trace[i].DPposition.node)));
 			trace[i].DPposition.node = reversePos.first;
 			trace[i].DPposition.nodeOffset = reversePos.second;
 			assert(trace[i].DPposition.seqPos < sequence.size());
@@ -293,7 +321,7 @@ private:
 				continue;
 			}
 			assert(oldNodeIndex != newNodeIndex);
-			assert(std::find(params.graph.outNeighbors[oldpos.node].begin(), params.graph.outNeighbors[oldpos.node].end(), newpos.node) != params.graph.outNeighbors[oldpos.node].end());
+			assert(std::find(params.graph.OutNeighbors(oldpos.node).begin(), params.graph.OutNeighbors(oldpos.node).end(), newpos.node) != params.graph.OutNeighbors(oldpos.node).end());
 			assert(newpos.seqPos == oldpos.seqPos || newpos.seqPos == oldpos.seqPos+1);
 			assert(oldpos.nodeOffset == params.graph.NodeLength(oldNodeIndex)-1);
 			assert(newpos.nodeOffset == 0);
@@ -113,13 +113,40 @@ private:
 			return result;
 		}
 	};
+	//finished slice in the table, only read by the traceback
+	class PackedDPSlice
+	{
+	public:
+		PackedDPSlice(const DPSlice& slice) :
+		minScore(slice.minScore),
+		minScoreNode(slice.minScoreNode),
+		minScoreNodeOffset(slice.minScoreNodeOffset),
+		maxExactEndposScore(slice.maxExactEndposScore),
+		maxExactEndposNode(slice.maxExactEndposNode),
+		scores(slice.scores),
+		correctness(slice.correctness),
+		j(slice.j),
+		bandwidth(slice.bandwidth),
+		scoresNotValid(slice.scoresNotValid)
+		{}
+		ScoreType minScore;
+		LengthType minScoreNode;
+		LengthType minScoreNodeOffset;
+		ScoreType maxExactEndposScore;
+		LengthType maxExactEndposNode;
+		PackedNodeSlice<LengthType, ScoreType, Word> scores;
+		AlignmentCorrectnessEstimationState correctness;
+		LengthType j;
+		size_t bandwidth;
+		bool scoresNotValid;
+	};
 	class DPTable
 	{
 	public:
 		DPTable() :
 		slices()
 		{}
-		std::vector<DPSlice> slices;
+		std::vector<PackedDPSlice> slices;
 	};
 public:
 
@@ -213,9 +240,10 @@ public:
 		for (size_t i = 0; i < result.trace.size(); i++)
 		{
 			result.trace[i].DPposition.seqPos += 1;
+			//the start slice is the first character, a trace can delete graph characters there before continuing
+			if (result.trace[i].DPposition.seqPos == 0) result.trace[i].sequenceCharacter = originalSequence[0];
 		}
 		std::reverse(result.trace.begin(), result.trace.end());
-		result.trace[0].sequenceCharacter = originalSequence[0];
 		assert(result.trace[0].DPposition.seqPos == 0);
 		return result;
 	}
@@ -357,6 +385,11 @@ private:
 					continue;
 				}
 				auto crossing = pickBacktraceVerticalCrossing(slice.slices[currentSlice].scores, slice.slices[currentSlice-1].scores, nodeSlices, slice.slices[currentSlice].j, currentNode, result.trace.back().DPposition, sequence, slice.slices[currentSlice].minScore + slice.slices[currentSlice].bandwidth, slice.slices[currentSlice].scoresNotValid, slice.slices[currentSlice-1].minScore + slice.slices[currentSlice-1].bandwidth, slice.slices[currentSlice-1].scoresNotValid);
+				//the crossing may first walk left along the slice edge, every deleted character on the way belongs in the trace
+				for (size_t offset = result.trace.back().DPposition.nodeOffset - 1; offset > crossing.first.first.nodeOffset; offset--)
+				{
+					result.trace.emplace_back(MatrixPosition {currentNode, offset, result.trace.back().DPposition.seqPos}, false, sequence, params.graph);
+				}
 				if (crossing.first.first != result.trace.back().DPposition) result.trace.emplace_back(crossing.first.first, crossing.first.second, sequence, params.graph);
 				assert(crossing.second.first != result.trace.back().DPposition);
 				result.trace.emplace_back(crossing.second.first, crossing.second.second, sequence, params.graph);
@@ -366,6 +399,11 @@ private:
 			{
 				assert(result.trace.back().DPposition.seqPos % WordConfiguration<Word>::WordSize != 0);
 				auto crossing = pickBacktraceHorizontalCrossing(slice.slices[currentSlice].scores, slice.slices[currentSlice-1].scores, slice.slices[currentSlice].j, currentNode, result.trace.back().DPposition, sequence, slice.slices[currentSlice].minScore + slice.slices[currentSlice].bandwidth, slice.slices[currentSlice].scoresNotValid, slice.slices[currentSlice-1].minScore + slice.slices[currentSlice-1].bandwidth, slice.slices[currentSlice-1].scoresNotValid);
+				//same for inserted characters when the crossing walks up along the node start
+				for (size_t seqPos = result.trace.back().DPposition.seqPos - 1; seqPos > crossing.first.first.seqPos; seqPos--)
+				{
+					result.trace.emplace_back(MatrixPosition {currentNode, 0, seqPos}, false, sequence, params.graph);
+				}
 				if (crossing.first.first != result.trace.back().DPposition) result.trace.emplace_back(crossing.first.first, crossing.first.second, sequence, params.graph);
 				assert(crossing.second.first != result.trace.back().DPposition);
 				result.trace.emplace_back(crossing.second.first, crossing.second.second, sequence, params.graph);
@@ -403,7 +441,7 @@ private:
 			if (result.trace.back().DPposition.nodeOffset == 0 && beforeSliceScores[result.trace.back().DPposition.nodeOffset] != 0)
 			{
 				bool found = false;
-				for (auto neighbor : params.graph.inNeighbors[result.trace.back().DPposition.node])
+				for (auto neighbor : params.graph.InNeighbors(result.trace.back().DPposition.node))
 				{
 					if (slice.slices[0].scores.hasNode(neighbor) && slice.slices[0].scores.node(neighbor).endSlice.getScoreBeforeStart() == beforeSliceScores[result.trace.back().DPposition.nodeOffset] - 1)
 					{
@@ -471,7 +509,7 @@ private:
 		return result;
 	}
 
-	std::pair<std::pair<MatrixPosition, bool>, std::pair<MatrixPosition, bool>> pickBacktraceHorizontalCrossing(const NodeSlice<LengthType, ScoreType, Word, false>& current, const NodeSlice<LengthType, ScoreType, Word, false>& previous, size_t j, LengthType node, MatrixPosition pos, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
+	std::pair<std::pair<MatrixPosition, bool>, std::pair<MatrixPosition, bool>> pickBacktraceHorizontalCrossing(const PackedNodeSlice<LengthType, ScoreType, Word>& current, const PackedNodeSlice<LengthType, ScoreType, Word>& previous, size_t j, LengthType node, MatrixPosition pos, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
 	{
 		assert(current.hasNode(node));
 		auto startSlice = current.node(node).startSlice;
@@ -494,7 +532,7 @@ private:
 			ScoreType smallestFound = startSlice.getValue(offset-1);
 			MatrixPosition smallestPos { node, 0, pos.seqPos-1 };
 			bool nodeChange = false;
-			for (auto neighbor : params.graph.inNeighbors[node])
+			for (auto neighbor : params.graph.InNeighbors(node))
 			{
 				if (current.hasNode(neighbor))
 				{
@@ -516,7 +554,7 @@ private:
 			assert(smallestPos != pos);
 			return std::make_pair(std::make_pair(pos, false), std::make_pair(smallestPos, nodeChange));
 		}
-		for (auto neighbor : params.graph.inNeighbors[node])
+		for (auto neighbor : params.graph.InNeighbors(node))
 		{
 			if (current.hasNode(neighbor))
 			{
@@ -537,7 +575,7 @@ private:
 		return std::make_pair(std::make_pair(MatrixPosition {0, 0, 0}, false), std::make_pair(MatrixPosition {0, 0, 0}, false));
 	}
 
-	std::pair<std::pair<MatrixPosition, bool>, std::pair<MatrixPosition, bool>> pickBacktraceVerticalCrossing(const NodeSlice<LengthType, ScoreType, Word, false>& current, const NodeSlice<LengthType, ScoreType, Word, false>& previous, const std::vector<WordSlice> nodeScores, size_t j, LengthType node, MatrixPosition pos, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
+	std::pair<std::pair<MatrixPosition, bool>, std::pair<MatrixPosition, bool>> pickBacktraceVerticalCrossing(const PackedNodeSlice<LengthType, ScoreType, Word>& current, const PackedNodeSlice<LengthType, ScoreType, Word>& previous, const std::vector<WordSlice> nodeScores, size_t j, LengthType node, MatrixPosition pos, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
 	{
 		assert(pos.nodeOffset > 0);
 		assert(pos.nodeOffset < nodeScores.size());
@@ -582,7 +620,7 @@ private:
 		return std::make_pair(std::make_pair(pos, false), std::make_pair(MatrixPosition{pos.node, pos.nodeOffset - 1, pos.seqPos-1}, false));
 	}
 
-	std::pair<MatrixPosition, bool> pickBacktraceCorner(const NodeSlice<LengthType, ScoreType, Word, false>& current, const NodeSlice<LengthType, ScoreType, Word, false>& previous, LengthType node, size_t j, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
+	std::pair<MatrixPosition, bool> pickBacktraceCorner(const PackedNodeSlice<LengthType, ScoreType, Word>& current, const PackedNodeSlice<LengthType, ScoreType, Word>& previous, LengthType node, size_t j, const std::string& sequence, ScoreType quitScore, bool scoresNotValid, ScoreType previousQuitScore, bool previousScoresNotValid) const
 	{
 		ScoreType scoreHere = current.node(node).startSlice.getValue(0);
 		if (scoresNotValid || scoreHere > quitScore)
@@ -599,7 +637,7 @@ private:
 				smallestPos = MatrixPosition { node, 0, j-1 };
 				nodeChange = false;
 			}
-			for (auto neighbor : params.graph.inNeighbors[node])
+			for (auto neighbor : params.graph.InNeighbors(node))
 			{
 				if (previous.hasNode(neighbor))
 				{
@@ -636,7 +674,7 @@ private:
 		}
 		MatrixPosition bestInvalidBacktrace { (size_t)-1, (size_t)-1, (size_t)-1 };
 		ScoreType bestInvalidBacktraceScore = scoreHere+1;
-		for (auto neighbor : params.graph.inNeighbors[node])
+		for (auto neighbor : params.graph.InNeighbors(node))
 		{
 			if (current.hasNode(neighbor))
 			{
@@ -900,7 +938,7 @@ private:
 
 		if (slice.exists)
 		{
-			if (hasSkipless && params.graph.inNeighbors[i].size() == 1 && previousBand[params.graph.inNeighbors[i][0]])
+			if (hasSkipless && params.graph.InNeighbors(i).size() == 1 && previousBand[params.graph.InNeighbors(i)[0]])
 			{
 				if (ws.scoreEnd > slice.startSlice.scoreEnd)
 				{
@@ -1119,7 +1157,7 @@ private:
 			{
 				foundMinScore = std::min(foundMinScore, previousSlice.node(node).startSlice.scoreEnd+1);
 			}
-			for (auto neighbor : params.graph.inNeighbors[node])
+			for (auto neighbor : params.graph.InNeighbors(node))
 			{
 				if (currentSlice.hasNode(neighbor) && currentSlice.node(neighbor).exists)
 				{
@@ -1143,7 +1181,7 @@ private:
 				eq = Common::characterMatch(sequence[j+i], params.graph.NodeSequences(node, 0));
 				if (eq) hasMatch = true;
 				ScoreType foundMinScore = pair.second.startSlice.getValue(i-1)+1;
-				for (auto neighbor : params.graph.inNeighbors[node])
+				for (auto neighbor : params.graph.InNeighbors(node))
 				{
 					if (!currentSlice.hasNode(neighbor)) continue;
 					if (!currentSlice.node(neighbor).exists) continue;
@@ -1159,6 +1197,16 @@ private:
 	}
 #endif
 
+	template <bool HasVectorMap, bool PreviousHasVectorMap>
+	void prefetchNode(size_t node, const NodeSlice<LengthType, ScoreType, Word, HasVectorMap>& currentSlice, const NodeSlice<LengthType, ScoreType, Word, PreviousHasVectorMap>& previousSlice, const std::vector<bool>& previousBand) const
+	{
+		if (node == std::numeric_limits<size_t>::max()) return;
+		assert(node < params.graph.NodeSize());
+		params.graph.PrefetchNode(node);
+		currentSlice.prefetch(node);
+		if (previousBand[node]) previousSlice.prefetch(node);
+	}
+
 	template <bool HasVectorMap, bool PreviousHasVectorMap, typename PriorityQueue>
 	NodeCalculationResult calculateSlice(const std::string& sequence, size_t j, NodeSlice<LengthType, ScoreType, Word, HasVectorMap>& currentSlice, const NodeSlice<LengthType, ScoreType, Word, PreviousHasVectorMap>& previousSlice, std::vector<bool>& currentBand, const std::vector<bool>& previousBand, PriorityQueue& calculableQueue, ScoreType previousQuitScore, int bandwidth, ScoreType previousMinScore) const
 	{
@@ -1197,7 +1245,7 @@ private:
 				WordSlice startSlice = getSourceSliceFromScore(node.second.startSlice.scoreEnd);
 				if (calculableQueue.IsComponentPriorityQueue())
 				{
-					calculableQueue.insert(params.graph.componentNumber[node.first], node.second.minScore, EdgeWithPriority { node.first, node.second.minScore - previousMinScore, startSlice, true });
+					calculableQueue.insert(params.graph.ComponentNumber(node.first), node.second.minScore, EdgeWithPriority { node.first, node.second.minScore - previousMinScore, startSlice, true });
 				}
 				else
 				{
@@ -1213,7 +1261,7 @@ private:
 				if (node.second.minScore > previousQuitScore) continue;
 				if (params.graph.linearizable[node.first])
 				{
-					auto neighbor = params.graph.inNeighbors[node.first][0];
+					auto neighbor = params.graph.InNeighbors(node.first)[0];
 				 	if (previousBand[neighbor] && previousSlice.node(neighbor).endSlice.scoreEnd < previousQuitScore && previousSlice.node(neighbor).minScore < previousQuitScore)
 				 	{
 				 		//linear area, no need to add the later node into the queue 
@@ -1224,7 +1272,7 @@ private:
 				WordSlice startSlice = getSourceSliceFromScore(node.second.startSlice.scoreEnd);
 				if (calculableQueue.IsComponentPriorityQueue())
 				{
-					calculableQueue.insert(params.graph.componentNumber[node.first], node.second.minScore, EdgeWithPriority { node.first, node.second.minScore - previousMinScore, startSlice, true });
+					calculableQueue.insert(params.graph.ComponentNumber(node.first), node.second.minScore, EdgeWithPriority { node.first, node.second.minScore - previousMinScore, startSlice, true });
 				}
 				else
 				{
@@ -1248,6 +1296,10 @@ private:
 				continue;
 			}
 			auto i = pair.target;
+			if (params.prefetchDistance > 0)
+			{
+				prefetchNode(calculableQueue.peekTarget(params.prefetchDistance), currentSlice, previousSlice, previousBand);
+			}
 			if (!currentBand[i])
 			{
 				assert(!currentSlice.hasNode(i));
@@ -1326,11 +1378,11 @@ private:
 				assert(newEndMinScore != std::numeric_limits<ScoreType>::max());
 				if (newEndMinScore <= currentMinScoreAtEndRow + bandwidth)
 				{
-					for (auto neighbor : params.graph.outNeighbors[i])
+					for (auto neighbor : params.graph.OutNeighbors(i))
 					{
 						if (calculableQueue.IsComponentPriorityQueue())
 						{
-							calculableQueue.insert(params.graph.componentNumber[neighbor], newEndMinScore, EdgeWithPriority { neighbor, newEndMinScore - previousMinScore, newEnd, false });
+							calculableQueue.insert(params.graph.ComponentNumber(neighbor), newEndMinScore, EdgeWithPriority { neighbor, newEndMinScore - previousMinScore, newEnd, false });
 						}
 						else
 						{
@@ -1553,7 +1605,7 @@ private:
 		debugLastRowMinScore = 0;
 #endif
 		DPSlice lastSlice = initialSlice;
-		result.slices.push_back(initialSlice);
+		result.slices.emplace_back(initialSlice);
 		assert(lastSlice.correctness.CurrentlyCorrect());
 		DPSlice rampSlice = lastSlice;
 		size_t rampRedoIndex = -1;
@@ -1681,7 +1733,7 @@ private:
 			std::cerr << std::endl;
 #endif
 
-			result.slices.push_back(newSlice.getMapSlice());
+			result.slices.emplace_back(newSlice);
 			for (auto node : lastSlice.scores)
 			{
 				assert(reusableState.previousBand[node.first]);
@@ -1740,11 +1792,11 @@ private:
 		result.bandwidth = 1;
 		result.minScore = 0;
 		result.scores.addEmptyNodeMap(1);
-		assert(offset < params.graph.originalNodeSize.at(bigraphNodeId));
+		assert(offset < params.graph.OriginalNodeSize(bigraphNodeId));
 		size_t nodeIndex = params.graph.GetUnitigNode(bigraphNodeId, offset);
-		assert(params.graph.nodeOffset[nodeIndex] <= offset);
-		assert(params.graph.nodeOffset[nodeIndex] + params.graph.NodeLength(nodeIndex) > offset);
-		size_t offsetInNode = offset - params.graph.nodeOffset[nodeIndex];
+		assert(params.graph.NodeOffset(nodeIndex) <= offset);
+		assert(params.graph.NodeOffset(nodeIndex) + params.graph.NodeLength(nodeIndex) > offset);
+		size_t offsetInNode = offset - params.graph.NodeOffset(nodeIndex);
 		assert(offsetInNode < params.graph.NodeLength(nodeIndex));
 		result.scores.addNodeToMap(nodeIndex);
 		result.minScoreNode = nodeIndex;
@@ -1,6 +1,9 @@
 #ifndef GraphAlignerCommon_h
 #define GraphAlignerCommon_h
 
+#include <array>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "AlignmentGraph.h"
 #include "ArrayPriorityQueue.h"
@@ -50,6 +53,11 @@ public:
 	{
 	public:
 		AlignerGraphsizedState(const AlignmentGraph& graph, size_t maxBandwidth, bool lowMemory) :
+		AlignerGraphsizedState(graph.NodeSize(), graph.ComponentSize(), maxBandwidth, lowMemory)
+		{
+		}
+		//for reusing one state with several graphs which have at most nodeSize nodes and componentSize components
+		AlignerGraphsizedState(size_t nodeSize, size_t componentSize, size_t maxBandwidth, bool lowMemory) :
 		sparseComponentQueue(),
 		sparseCalculableQueue(),
 		denseComponentQueue(),
@@ -61,18 +69,18 @@ public:
 		{
 			if (!lowMemory)
 			{
-				evenNodesliceMap.resize(graph.NodeSize(), {});
-				oddNodesliceMap.resize(graph.NodeSize(), {});
-				denseComponentQueue.initialize(graph.ComponentSize());
-				denseCalculableQueue.initialize(WordConfiguration<Word>::WordSize * (WordConfiguration<Word>::WordSize + maxBandwidth + 1) + maxBandwidth + 1, graph.NodeSize());
+				evenNodesliceMap.resize(nodeSize, {});
+				oddNodesliceMap.resize(nodeSize, {});
+				denseComponentQueue.initialize(componentSize);
+				denseCalculableQueue.initialize(WordConfiguration<Word>::WordSize * (WordConfiguration<Word>::WordSize + maxBandwidth + 1) + maxBandwidth + 1, nodeSize);
 			}
 			else
 			{
-				sparseComponentQueue.initialize(graph.ComponentSize());
-				sparseCalculableQueue.initialize(WordConfiguration<Word>::WordSize * (WordConfiguration<Word>::WordSize + maxBandwidth + 1) + maxBandwidth + 1, graph.NodeSize());
+				sparseComponentQueue.initialize(componentSize);
+				sparseCalculableQueue.initialize(WordConfiguration<Word>::WordSize * (WordConfiguration<Word>::WordSize + maxBandwidth + 1) + maxBandwidth + 1, nodeSize);
 			}
-			currentBand.resize(graph.NodeSize(), false);
-			previousBand.resize(graph.NodeSize(), false);
+			currentBand.resize(nodeSize, false);
+			previousBand.resize(nodeSize, false);
 		}
 		void clear()
 		{
@@ -98,7 +106,7 @@ public:
 	class Params
 	{
 	public:
-		Params(LengthType initialBandwidth, LengthType rampBandwidth, const AlignmentGraph& graph, size_t maxCellsPerSlice, bool quietMode, bool sloppyOptimizations, bool lowMemory, bool forceGlobal, bool preciseClipping) :
+		Params(LengthType initialBandwidth, LengthType rampBandwidth, const AlignmentGraph& graph, size_t maxCellsPerSlice, bool quietMode, bool sloppyOptimizations, bool lowMemory, bool forceGlobal, bool preciseClipping, size_t prefetchDistance, double seedStopCoverage, double seedStopIdentity) :
 		initialBandwidth(initialBandwidth),
 		rampBandwidth(rampBandwidth),
 		graph(graph),
@@ -107,7 +115,10 @@ public:
 		sloppyOptimizations(sloppyOptimizations),
 		lowMemory(lowMemory),
 		forceGlobal(forceGlobal),
-		preciseClipping(preciseClipping)
+		preciseClipping(preciseClipping),
+		prefetchDistance(prefetchDistance),
+		seedStopCoverage(seedStopCoverage),
+		seedStopIdentity(seedStopIdentity)
 		{
 		}
 		const LengthType initialBandwidth;
@@ -119,6 +130,10 @@ public:
 		const bool lowMemory;
 		const bool forceGlobal;
 		const bool preciseClipping;
+		const size_t prefetchDistance;
+		//stop extending seeds once alignments with at least seedStopIdentity cover this fraction of the read. 0 extends all seeds
+		const double seedStopCoverage;
+		const double seedStopIdentity;
 	};
 	struct TraceItem
 	{
@@ -177,87 +192,41 @@ public:
 #endif
 	static bool characterMatch(char sequenceCharacter, char graphCharacter)
 	{
-		return (ambiguousMatch(sequenceCharacter, 'A') && ambiguousMatch(graphCharacter, 'A'))
-		|| (ambiguousMatch(sequenceCharacter, 'C') && ambiguousMatch(graphCharacter, 'C'))
-		|| (ambiguousMatch(sequenceCharacter, 'G') && ambiguousMatch(graphCharacter, 'G'))
-		|| (ambiguousMatch(sequenceCharacter, 'T') && ambiguousMatch(graphCharacter, 'T'));
+		return (baseMask(sequenceCharacter) & baseMask(graphCharacter)) != 0;
 	}
+	//bits 1, 2, 4, 8 for A, C, G, T which the IUPAC character can stand for
 #ifdef NDEBUG
 	__attribute__((always_inline))
 #endif
-	static bool ambiguousMatch(char ambiguousChar, char exactChar)
+	static uint8_t baseMask(char character)
+	{
+		static const std::array<uint8_t, 256> masks = getBaseMasks();
+		uint8_t result = masks[(unsigned char)character];
+		if (result == 0)
+		{
+			assert(false);
+			std::abort();
+		}
+		return result;
+	}
+private:
+	static std::array<uint8_t, 256> getBaseMasks()
 	{
-		assert(exactChar == 'A' || exactChar == 'T' || exactChar == 'C' || exactChar == 'G');
-		switch(ambiguousChar)
+		std::array<uint8_t, 256> result;
+		result.fill(0);
+		std::vector<std::pair<std::string, uint8_t>> characters {
+			{"Aa", 1}, {"Cc", 2}, {"Gg", 4}, {"TtUu", 8}, {"Nn", 15},
+			{"Rr", 1 | 4}, {"Yy", 2 | 8}, {"Kk", 4 | 8}, {"Mm", 1 | 2}, {"Ss", 2 | 4}, {"Ww", 1 | 8},
+			{"Bb", 2 | 4 | 8}, {"Dd", 1 | 4 | 8}, {"Hh", 1 | 2 | 8}, {"Vv", 1 | 2 | 4}
+		};
+		for (auto pair : characters)
 		{
-			case 'A':
-			case 'a':
-				return exactChar == 'A';
-			break;
-			case 'u':
-			case 'U':
-			case 'T':
-			case 't':
-				return exactChar == 'T';
-			break;
-			case 'C':
-			case 'c':
-				return exactChar == 'C';
-			break;
-			case 'G':
-			case 'g':
-				return exactChar == 'G';
-			break;
-			case 'N':
-			case 'n':
-				return true;
-			break;
-			case 'R':
-			case 'r':
-				return exactChar == 'A' || exactChar == 'G';
-			break;
-			case 'Y':
-			case 'y':
-				return exactChar == 'C' || exactChar == 'T';
-			break;
-			case 'K':
-			case 'k':
-				return exactChar == 'G' || exactChar == 'T';
-			break;
-			case 'M':
-			case 'm':
-				return exactChar == 'C' || exactChar == 'A';
-			break;
-			case 'S':
-			case 's':
-				return exactChar == 'C' || exactChar == 'G';
-			break;
-			case 'W':
-			case 'w':
-				return exactChar == 'A' || exactChar == 'T';
-			break;
-			case 'B':
-			case 'b':
-				return exactChar == 'C' || exactChar == 'G' || exactChar == 'T';
-			break;
-			case 'D':
-			case 'd':
-				return exactChar == 'A' || exactChar == 'G' || exactChar == 'T';
-			break;
-			case 'H':
-			case 'h':
-				return exactChar == 'A' || exactChar == 'C' || exactChar == 'T';
-			break;
-			case 'V':
-			case 'v':
-				return exactChar == 'A' || exactChar == 'C' || exactChar == 'G';
-			break;
-			default:
-				assert(false);
-				std::abort();
-				return false;
-			break;
+			for (auto c : pair.first)
+			{
+				result[(unsigned char)c] = pair.second;
+			}
 		}
+		return result;
 	}
 };
 
@@ -0,0 +1,86 @@
+#include <sys/mman.h>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include "HugePages.h"
+
+namespace HugePages
+{
+	void Advise(const void* start, size_t bytes)
+	{
+		uintptr_t rangeStart = (reinterpret_cast<uintptr_t>(start) + HugePageSize - 1) / HugePageSize * HugePageSize;
+		uintptr_t rangeEnd = (reinterpret_cast<uintptr_t>(start) + bytes) / HugePageSize * HugePageSize;
+		if (rangeEnd <= rangeStart) return;
+		madvise(reinterpret_cast<void*>(rangeStart), rangeEnd - rangeStart, MADV_HUGEPAGE);
+	}
+
+	bool TransparentHugePagesEnabled()
+	{
+		std::ifstream file { "/sys/kernel/mm/transparent_hugepage/enabled" };
+		if (!file.good()) return false;
+		std::string line;
+		std::getline(file, line);
+		//selected mode is in brackets, eg "always [madvise] never"
+		return line.find("[never]") == std::string::npos;
+	}
+
+	//the kernel splits the mappings at the advised ranges and flags them with "hg" in VmFlags, so freed memory drops out of the counts by itself.
+	//calls the callback with the size and the huge page backed bytes of each advised mapping
+	template <typename F>
+	void forEachAdvisedMapping(F callback)
+	{
+		std::ifstream smaps { "/proc/self/smaps" };
+		uintptr_t mappingStart = 0;
+		uintptr_t mappingEnd = 0;
+		size_t hugeBytes = 0;
+		std::string line;
+		while (std::getline(smaps, line))
+		{
+			if (line.size() == 0) continue;
+			if (line.compare(0, 15, "AnonHugePages: ") == 0)
+			{
+				std::stringstream str { line.substr(15) };
+				size_t kb = 0;
+				str >> kb;
+				hugeBytes = kb * 1024;
+				continue;
+			}
+			//VmFlags is the last line of a mapping's entry
+			if (line.compare(0, 9, "VmFlags: ") == 0)
+			{
+				std::stringstream str { line.substr(9) };
+				std::string flag;
+				while (str >> flag)
+				{
+					if (flag == "hg")
+					{
+						callback(mappingEnd - mappingStart, hugeBytes);
+						break;
+					}
+				}
+				continue;
+			}
+			//mapping header lines look like "7f0000000000-7f0000200000 rw-p ..."
+			size_t dash = line.find('-');
+			size_t space = line.find(' ');
+			if (dash == std::string::npos || space == std::string::npos || dash > space || line.find(':') < dash) continue;
+			mappingStart = std::stoull(line.substr(0, dash), nullptr, 16);
+			mappingEnd = std::stoull(line.substr(dash+1, space-dash-1), nullptr, 16);
+			hugeBytes = 0;
+		}
+	}
+
+	size_t AdvisedBytes()
+	{
+		size_t result = 0;
+		forEachAdvisedMapping([&result](size_t bytes, size_t hugeBytes) { result += bytes; });
+		return result;
+	}
+
+	size_t HugePageBackedBytes()
+	{
+		size_t result = 0;
+		forEachAdvisedMapping([&result](size_t bytes, size_t hugeBytes) { result += hugeBytes; });
+		return result;
+	}
+}
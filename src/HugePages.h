@@ -0,0 +1,32 @@
+#ifndef HugePages_h
+#define HugePages_h
+
+#include <vector>
+#include <string>
+#include <iterator>
+
+//transparent huge page backing for large read-only arrays
+namespace HugePages
+{
+	static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+	//marks the huge page aligned part of the range with MADV_HUGEPAGE. already faulted pages are only collapsed later by khugepaged
+	void Advise(const void* start, size_t bytes);
+	bool TransparentHugePagesEnabled();
+	//size of the currently mapped memory which is advised
+	size_t AdvisedBytes();
+	//AnonHugePages from /proc/self/smaps of the currently mapped advised memory
+	size_t HugePageBackedBytes();
+	//reallocates into fresh untouched memory and advises it before copying, so the pages fault in as huge pages
+	template <typename T>
+	void MoveToHugePages(std::vector<T>& vec)
+	{
+		if (vec.size() * sizeof(T) < HugePageSize) return;
+		std::vector<T> moved;
+		moved.reserve(vec.size());
+		Advise(moved.data(), moved.capacity() * sizeof(T));
+		moved.insert(moved.end(), std::make_move_iterator(vec.begin()), std::make_move_iterator(vec.end()));
+		std::swap(vec, moved);
+	}
+}
+
+#endif
@@ -0,0 +1,22 @@
+#include <iostream>
+#include <string>
+#include "GamIndex.h"
+#include "Threading.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "usage: IndexGam alignments.gam [threads]" << std::endl;
+		std::cerr << "writes the read name index to alignments.gam.gai" << std::endl;
+		return 1;
+	}
+	std::string gamFile { argv[1] };
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc >= 3) numThreads = std::stoi(argv[2]);
+
+	std::string indexFile = GamIndex::DefaultIndexFile(gamFile);
+	GamIndex::Build(gamFile, indexFile, numThreads);
+	GamIndex index { gamFile, indexFile };
+	std::cerr << index.NumEntries() << " index entries written to " << indexFile << std::endl;
+}
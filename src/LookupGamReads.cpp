@@ -0,0 +1,50 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "vg.pb.h"
+#include "stream.hpp"
+#include "GamIndex.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "usage: LookupGamReads alignments.gam out.gam readname [readname...]" << std::endl;
+		std::cerr << "use - as the read name to read the names from stdin, one per line. requires alignments.gam.gai, see IndexGam" << std::endl;
+		return 1;
+	}
+	std::string gamFile { argv[1] };
+	std::string outFile { argv[2] };
+	std::vector<std::string> readNames;
+	for (int i = 3; i < argc; i++)
+	{
+		std::string name { argv[i] };
+		if (name == "-")
+		{
+			std::string line;
+			while (std::getline(std::cin, line))
+			{
+				if (line.size() > 0) readNames.push_back(line);
+			}
+			continue;
+		}
+		readNames.push_back(name);
+	}
+
+	GamIndex index { gamFile, GamIndex::DefaultIndexFile(gamFile) };
+	std::ofstream out { outFile, std::ios::out | std::ios::binary };
+	size_t found = 0;
+	for (const auto& name : readNames)
+	{
+		auto alns = index.Lookup<vg::Alignment>(name);
+		if (alns.size() == 0)
+		{
+			std::cerr << "no alignments for " << name << std::endl;
+			continue;
+		}
+		found += alns.size();
+		stream::write_buffered(out, alns, 0);
+	}
+	std::cerr << found << " alignments written" << std::endl;
+}
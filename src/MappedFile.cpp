@@ -0,0 +1,46 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string& filename) :
+ptr(nullptr),
+length(0)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) throw std::runtime_error("Could not open " + filename);
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("Could not read the size of " + filename);
+	}
+	length = info.st_size;
+	if (length == 0)
+	{
+		close(fd);
+		throw std::runtime_error("Empty file " + filename);
+	}
+	void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+	//the mapping keeps its own reference to the file
+	close(fd);
+	if (mapped == MAP_FAILED) throw std::runtime_error("Could not mmap " + filename);
+	ptr = (const char*)mapped;
+}
+
+MappedFile::~MappedFile()
+{
+	if (ptr != nullptr) munmap((void*)ptr, length);
+}
+
+const char* MappedFile::data() const
+{
+	return ptr;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
@@ -0,0 +1,104 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ThreadReadAssertion.h"
+
+//read-only mmap of a whole file. pages are loaded when touched and can be evicted by the kernel under memory pressure
+class MappedFile
+{
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile();
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	const char* data() const;
+	size_t size() const;
+private:
+	const char* ptr;
+	size_t length;
+};
+
+//array which is either an ordinary vector or a read-only view into a mapped file
+template <typename T>
+class FileBackedArray
+{
+public:
+	FileBackedArray() :
+	vec(),
+	mapping(nullptr),
+	mapped(nullptr),
+	mappedSize(0)
+	{
+	}
+	void Map(std::shared_ptr<const MappedFile> file, size_t byteOffset, size_t count)
+	{
+		assert(byteOffset + count * sizeof(T) <= file->size());
+		assert(byteOffset % alignof(T) == 0);
+		std::vector<T> empty;
+		std::swap(vec, empty);
+		mapping = file;
+		mapped = reinterpret_cast<const T*>(file->data() + byteOffset);
+		mappedSize = count;
+	}
+	bool IsMapped() const
+	{
+		return mapping != nullptr;
+	}
+	//only while not mapped
+	std::vector<T>& Vector()
+	{
+		assert(!IsMapped());
+		return vec;
+	}
+#ifdef NDEBUG
+	__attribute__((always_inline))
+#endif
+	const T& operator[](size_t index) const
+	{
+		assert(index < size());
+		return data()[index];
+	}
+	const T* data() const
+	{
+		return IsMapped() ? mapped : vec.data();
+	}
+	size_t size() const
+	{
+		return IsMapped() ? mappedSize : vec.size();
+	}
+	const T* begin() const
+	{
+		return data();
+	}
+	const T* end() const
+	{
+		return data() + size();
+	}
+	template <typename... Args>
+	void emplace_back(Args&&... args)
+	{
+		Vector().emplace_back(std::forward<Args>(args)...);
+	}
+	void push_back(const T& item)
+	{
+		Vector().push_back(item);
+	}
+	void reserve(size_t count)
+	{
+		Vector().reserve(count);
+	}
+	void shrink_to_fit()
+	{
+		if (!IsMapped()) vec.shrink_to_fit();
+	}
+private:
+	std::vector<T> vec;
+	std::shared_ptr<const MappedFile> mapping;
+	const T* mapped;
+	size_t mappedSize;
+};
+
+#endif
@@ -1,9 +1,14 @@
 #include <iostream>
+#include <unordered_map>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/vector.hpp>
 #include "CommonUtils.h"
 #include "MummerSeeder.h"
+#include "HugePages.h"
+
+//edge-spanning seeding looks at this many times more MEMs than it returns
+static constexpr size_t EdgeSpanningCandidateFactor = 4;
 
 char lowercaseRef(char c)
 {
@@ -31,6 +36,23 @@ char lowercaseRef(char c)
 	return std::numeric_limits<char>::max();
 }
 
+char complementRef(char c)
+{
+	switch(c)
+	{
+		case 'a':
+			return 't';
+		case 'c':
+			return 'g';
+		case 'g':
+			return 'c';
+		case 't':
+			return 'a';
+		default:
+			return '`';
+	}
+}
+
 char lowercaseSeq(char c)
 {
 	switch(c)
@@ -62,7 +84,7 @@ bool fileExists(const std::string& fileName)
 	return file.good();
 }
 
-MummerSeeder::MummerSeeder(const GfaGraph& graph, const std::string& cachePrefix)
+MummerSeeder::MummerSeeder(const GfaGraph& graph, const std::string& cachePrefix, bool edgeSpanning)
 {
 	if (cachePrefix.size() > 0 && fileExists(cachePrefix + ".aux"))
 	{
@@ -73,9 +95,10 @@ MummerSeeder::MummerSeeder(const GfaGraph& graph, const std::string& cachePrefix
 		initTree(graph);
 		if (cachePrefix.size() > 0) saveTo(cachePrefix);
 	}
+	if (edgeSpanning) initEdges(graph);
 }
 
-MummerSeeder::MummerSeeder(const vg::Graph& graph, const std::string& cachePrefix)
+MummerSeeder::MummerSeeder(const vg::Graph& graph, const std::string& cachePrefix, bool edgeSpanning)
 {
 	if (cachePrefix.size() > 0 && fileExists(cachePrefix + ".aux"))
 	{
@@ -86,6 +109,7 @@ MummerSeeder::MummerSeeder(const vg::Graph& graph, const std::string& cachePrefi
 		initTree(graph);
 		if (cachePrefix.size() > 0) saveTo(cachePrefix);
 	}
+	if (edgeSpanning) initEdges(graph);
 }
 
 void MummerSeeder::initTree(const GfaGraph& graph)
@@ -124,6 +148,84 @@ void MummerSeeder::initTree(const vg::Graph& graph)
 	matcher = std::make_unique<mummer::mummer::sparseSA>(mummer::mummer::sparseSA::create_auto(seq.c_str(), seq.size(), 0, true));
 }
 
+void MummerSeeder::initEdges(const GfaGraph& graph)
+{
+	std::unordered_map<int, size_t> nodeIndex;
+	for (size_t i = 0; i < nodeIDs.size(); i++)
+	{
+		nodeIndex[nodeIDs[i]] = i;
+	}
+	std::vector<std::tuple<size_t, size_t, size_t>> edges;
+	for (auto edge : graph.edges)
+	{
+		if (nodeIndex.count(edge.first.id) == 0) continue;
+		size_t from = nodeIndex.at(edge.first.id) * 2 + (edge.first.end ? 0 : 1);
+		for (auto target : edge.second)
+		{
+			if (nodeIndex.count(target.id) == 0) continue;
+			size_t to = nodeIndex.at(target.id) * 2 + (target.end ? 0 : 1);
+			size_t overlap = graph.edgeOverlap;
+			if (graph.varyingOverlaps.count(std::make_pair(edge.first, target)) == 1) overlap = graph.varyingOverlaps.at(std::make_pair(edge.first, target));
+			edges.emplace_back(from, to, overlap);
+		}
+	}
+	buildEdges(edges);
+}
+
+void MummerSeeder::initEdges(const vg::Graph& graph)
+{
+	std::unordered_map<int, size_t> nodeIndex;
+	for (size_t i = 0; i < nodeIDs.size(); i++)
+	{
+		nodeIndex[nodeIDs[i]] = i;
+	}
+	std::vector<std::tuple<size_t, size_t, size_t>> edges;
+	for (int i = 0; i < graph.edge_size(); i++)
+	{
+		if (nodeIndex.count(graph.edge(i).from()) == 0 || nodeIndex.count(graph.edge(i).to()) == 0) continue;
+		size_t from = nodeIndex.at(graph.edge(i).from()) * 2 + (graph.edge(i).from_start() ? 1 : 0);
+		size_t to = nodeIndex.at(graph.edge(i).to()) * 2 + (graph.edge(i).to_end() ? 1 : 0);
+		edges.emplace_back(from, to, graph.edge(i).overlap());
+	}
+	buildEdges(edges);
+}
+
+//edges as (from side, to side, overlap), the reverse of every edge is added here
+void MummerSeeder::buildEdges(std::vector<std::tuple<size_t, size_t, size_t>>& edges)
+{
+	size_t numEdges = edges.size();
+	for (size_t i = 0; i < numEdges; i++)
+	{
+		edges.emplace_back(std::get<1>(edges[i]) ^ 1, std::get<0>(edges[i]) ^ 1, std::get<2>(edges[i]));
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	edgeStart.resize(nodeIDs.size() * 2 + 1, 0);
+	edgeTargets.reserve(edges.size());
+	edgeOverlaps.reserve(edges.size());
+	for (auto edge : edges)
+	{
+		edgeStart[std::get<0>(edge) + 1] += 1;
+		edgeTargets.push_back(std::get<1>(edge));
+		edgeOverlaps.push_back(std::get<2>(edge));
+	}
+	for (size_t i = 1; i < edgeStart.size(); i++)
+	{
+		edgeStart[i] += edgeStart[i-1];
+	}
+}
+
+void MummerSeeder::AdviseHugePages()
+{
+	//the matcher refers to seq so it can't be reallocated, advise in place and let khugepaged collapse it
+	HugePages::Advise(seq.data(), seq.size());
+	HugePages::MoveToHugePages(nodePositions);
+	HugePages::MoveToHugePages(nodeIDs);
+	HugePages::MoveToHugePages(edgeStart);
+	HugePages::MoveToHugePages(edgeTargets);
+	HugePages::MoveToHugePages(edgeOverlaps);
+}
+
 size_t MummerSeeder::getNodeIndex(size_t indexPos) const
 {
 	assert(indexPos < nodePositions.back());
@@ -236,6 +338,66 @@ std::vector<SeedHit> MummerSeeder::getMemSeeds(std::string sequence, size_t maxC
 	{
 		sequence[i] = lowercaseSeq(sequence[i]);
 	}
+	std::vector<mummer::mummer::match_t> MEMs;
+	std::vector<mummer::mummer::match_t> bwMEMs;
+	getMemMatches(sequence, maxCount, minLen, MEMs, bwMEMs);
+	auto seeds = matchesToSeeds(sequence.size(), MEMs, bwMEMs);
+	assert(seeds.size() <= maxCount);
+	std::sort(seeds.begin(), seeds.end(), [](const SeedHit& left, const SeedHit& right) { return left.matchLen > right.matchLen; });
+	return seeds;
+}
+
+std::vector<SeedHit> MummerSeeder::getEdgeSpanningMemSeeds(std::string sequence, size_t maxCount, size_t minLen) const
+{
+	assert(edgeStart.size() == nodeIDs.size() * 2 + 1);
+	for (size_t i = 0; i < sequence.size(); i++)
+	{
+		sequence[i] = lowercaseSeq(sequence[i]);
+	}
+	//pieces of the same match in neighboring nodes extend into the same seed, so look at more pieces than needed
+	size_t candidateCount = maxCount;
+	if (candidateCount < std::numeric_limits<size_t>::max() / EdgeSpanningCandidateFactor) candidateCount *= EdgeSpanningCandidateFactor;
+	else candidateCount = std::numeric_limits<size_t>::max();
+	std::vector<mummer::mummer::match_t> MEMs;
+	std::vector<mummer::mummer::match_t> bwMEMs;
+	getMemMatches(sequence, candidateCount, minLen, MEMs, bwMEMs);
+	std::vector<OrientedMatch> matches;
+	matches.reserve(MEMs.size() + bwMEMs.size());
+	for (auto match : MEMs)
+	{
+		auto index = getNodeIndex(match.ref);
+		matches.push_back(OrientedMatch { index * 2, match.ref - nodePositions[index], (size_t)match.query, (size_t)match.len });
+	}
+	for (auto match : bwMEMs)
+	{
+		auto index = getNodeIndex(match.ref);
+		size_t nodeOffset = nodeLength(index) - (match.ref - nodePositions[index]) - match.len;
+		size_t seqPos = sequence.size() - match.query - match.len;
+		matches.push_back(OrientedMatch { index * 2 + 1, nodeOffset, seqPos, (size_t)match.len });
+	}
+	for (auto& match : matches)
+	{
+		//right first, extendRight assumes the match is inside one node
+		extendRight(sequence, match);
+		extendLeft(sequence, match);
+	}
+	std::sort(matches.begin(), matches.end(), [](const OrientedMatch& left, const OrientedMatch& right)
+	{
+		return std::make_tuple(left.side, left.offset, left.seqPos, right.length) < std::make_tuple(right.side, right.offset, right.seqPos, left.length);
+	});
+	std::vector<SeedHit> seeds;
+	for (size_t i = 0; i < matches.size(); i++)
+	{
+		if (i > 0 && matches[i].side == matches[i-1].side && matches[i].offset == matches[i-1].offset && matches[i].seqPos == matches[i-1].seqPos) continue;
+		seeds.emplace_back(nodeIDs[matches[i].side / 2], matches[i].offset, matches[i].seqPos, matches[i].length, matches[i].side % 2 == 1);
+	}
+	std::sort(seeds.begin(), seeds.end(), [](const SeedHit& left, const SeedHit& right) { return left.matchLen > right.matchLen; });
+	if (seeds.size() > maxCount) seeds.erase(seeds.begin() + maxCount, seeds.end());
+	return seeds;
+}
+
+void MummerSeeder::getMemMatches(std::string sequence, size_t maxCount, size_t minLen, std::vector<mummer::mummer::match_t>& fwmatches, std::vector<mummer::mummer::match_t>& bwmatches) const
+{
 	assert(matcher != nullptr);
 	std::priority_queue<MatchWithOrientation, std::vector<MatchWithOrientation>, std::greater<MatchWithOrientation>> matches;
 	matcher->findMEM_each(sequence, minLen, false, [&matches, maxCount](const mummer::mummer::match_t& match)
@@ -265,24 +427,18 @@ std::vector<SeedHit> MummerSeeder::getMemSeeds(std::string sequence, size_t maxC
 			matches.emplace(match, true);
 		}
 	});
-	std::vector<mummer::mummer::match_t> MAMs;
-	std::vector<mummer::mummer::match_t> bwMAMs;
 	while (matches.size() > 0)
 	{
 		if (matches.top().reverse)
 		{
-			bwMAMs.push_back(matches.top().match);
+			bwmatches.push_back(matches.top().match);
 		}
 		else
 		{
-			MAMs.push_back(matches.top().match);
+			fwmatches.push_back(matches.top().match);
 		}
 		matches.pop();
 	}
-	auto seeds = matchesToSeeds(sequence.size(), MAMs, bwMAMs);
-	assert(seeds.size() <= maxCount);
-	std::sort(seeds.begin(), seeds.end(), [](const SeedHit& left, const SeedHit& right) { return left.matchLen > right.matchLen; });
-	return seeds;
 }
 
 std::vector<SeedHit> MummerSeeder::matchesToSeeds(size_t seqLen, const std::vector<mummer::mummer::match_t>& fwmatches, const std::vector<mummer::mummer::match_t>& bwmatches) const
@@ -325,6 +481,75 @@ size_t MummerSeeder::nodeLength(size_t indexPos) const
 	return nodePositions[indexPos+1] - nodePositions[indexPos] - 1;
 }
 
+char MummerSeeder::indexBase(size_t side, size_t offset) const
+{
+	size_t index = side / 2;
+	assert(offset < nodeLength(index));
+	if (side % 2 == 0) return seq[nodePositions[index] + offset];
+	return complementRef(seq[nodePositions[index] + nodeLength(index) - 1 - offset]);
+}
+
+//follows the edges out of the match's last node while the read continues to match, taking the out-neighbor with the longest match
+void MummerSeeder::extendRight(const std::string& sequence, OrientedMatch& match) const
+{
+	size_t endSide = match.side;
+	size_t endOffset = match.offset + match.length;
+	while (endOffset == nodeLength(endSide / 2) && match.seqPos + match.length < sequence.size())
+	{
+		size_t bestLength = 0;
+		size_t bestSide = 0;
+		size_t bestEnd = 0;
+		for (size_t i = edgeStart[endSide]; i < edgeStart[endSide+1]; i++)
+		{
+			size_t target = edgeTargets[i];
+			size_t offset = edgeOverlaps[i];
+			size_t length = 0;
+			while (offset + length < nodeLength(target / 2) && match.seqPos + match.length + length < sequence.size() && indexBase(target, offset + length) == sequence[match.seqPos + match.length + length]) length++;
+			if (length > bestLength)
+			{
+				bestLength = length;
+				bestSide = target;
+				bestEnd = offset + length;
+			}
+		}
+		if (bestLength == 0) break;
+		match.length += bestLength;
+		endSide = bestSide;
+		endOffset = bestEnd;
+	}
+}
+
+//same as extendRight but backwards into the in-neighbors, moving the start of the match
+void MummerSeeder::extendLeft(const std::string& sequence, OrientedMatch& match) const
+{
+	while (match.offset == 0 && match.seqPos > 0)
+	{
+		size_t bestLength = 0;
+		size_t bestSide = 0;
+		size_t bestStart = 0;
+		//in-neighbors of a side are the reverses of the out-neighbors of its reverse
+		for (size_t i = edgeStart[match.side ^ 1]; i < edgeStart[(match.side ^ 1)+1]; i++)
+		{
+			size_t source = edgeTargets[i] ^ 1;
+			if (edgeOverlaps[i] > nodeLength(source / 2)) continue;
+			size_t start = nodeLength(source / 2) - edgeOverlaps[i];
+			size_t length = 0;
+			while (length < start && length < match.seqPos && indexBase(source, start - 1 - length) == sequence[match.seqPos - 1 - length]) length++;
+			if (length > bestLength)
+			{
+				bestLength = length;
+				bestSide = source;
+				bestStart = start - length;
+			}
+		}
+		if (bestLength == 0) break;
+		match.side = bestSide;
+		match.offset = bestStart;
+		match.seqPos -= bestLength;
+		match.length += bestLength;
+	}
+}
+
 void MummerSeeder::revcompInPlace(std::string& seq) const
 {
 	std::reverse(seq.begin(), seq.end());
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <tuple>
 #include <mummer/sparseSA.hpp>
 #include <mummer/fasta.hpp>
 #include "GfaGraph.h"
@@ -12,15 +13,33 @@
 class MummerSeeder
 {
 public:
-	MummerSeeder(const GfaGraph& graph, const std::string& cachePrefix);
-	MummerSeeder(const vg::Graph& graph, const std::string& cachePrefix);
+	//the edges are only needed for the edge-spanning seeds
+	MummerSeeder(const GfaGraph& graph, const std::string& cachePrefix, bool edgeSpanning);
+	MummerSeeder(const vg::Graph& graph, const std::string& cachePrefix, bool edgeSpanning);
 	std::vector<SeedHit> getMemSeeds(std::string sequence, size_t maxCount, size_t minLen) const;
 	std::vector<SeedHit> getMumSeeds(std::string sequence, size_t maxCount, size_t minLen) const;
+	//MEMs inside nodes extended over the edges, so matches spanning several short nodes are found as one seed
+	std::vector<SeedHit> getEdgeSpanningMemSeeds(std::string sequence, size_t maxCount, size_t minLen) const;
+	void AdviseHugePages();
 private:
+	struct OrientedMatch
+	{
+		size_t side;
+		size_t offset;
+		size_t seqPos;
+		size_t length;
+	};
+	void getMemMatches(std::string sequence, size_t maxCount, size_t minLen, std::vector<mummer::mummer::match_t>& fwmatches, std::vector<mummer::mummer::match_t>& bwmatches) const;
 	std::vector<SeedHit> matchesToSeeds(size_t seqLen, const std::vector<mummer::mummer::match_t>& fwmatches, const std::vector<mummer::mummer::match_t>& bwmatches) const;
 	void revcompInPlace(std::string& seq) const;
 	size_t getNodeIndex(size_t indexPos) const;
 	size_t nodeLength(size_t indexPos) const;
+	char indexBase(size_t side, size_t offset) const;
+	void extendRight(const std::string& sequence, OrientedMatch& match) const;
+	void extendLeft(const std::string& sequence, OrientedMatch& match) const;
+	void initEdges(const GfaGraph& graph);
+	void initEdges(const vg::Graph& graph);
+	void buildEdges(std::vector<std::tuple<size_t, size_t, size_t>>& edges);
 	void initTree(const GfaGraph& graph);
 	void initTree(const vg::Graph& graph);
 	void saveTo(const std::string& cachePrefix) const;
@@ -29,6 +48,10 @@ private:
 	std::unique_ptr<mummer::mummer::sparseSA> matcher;
 	std::vector<size_t> nodePositions;
 	std::vector<int> nodeIDs;
+	//out-edges of the oriented nodes in CSR form, side index*2 is forward and index*2+1 reverse. not cached, built from the graph for edge-spanning seeds only
+	std::vector<size_t> edgeStart;
+	std::vector<size_t> edgeTargets;
+	std::vector<size_t> edgeOverlaps;
 };
 
 #endif
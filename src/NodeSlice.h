@@ -1,6 +1,8 @@
 #ifndef NodeSlice_h
 #define NodeSlice_h
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <limits>
 #include <unordered_map>
@@ -286,6 +288,20 @@ public:
 		return found->second;
 	}
 	template <bool HasVectorMap = UseVectorMap>
+	typename std::enable_if<HasVectorMap>::type prefetch(size_t nodeIndex) const
+	{
+		assert(vectorMap != nullptr);
+		assert(nodeIndex < vectorMap->size());
+		const char* item = (const char*)(vectorMap->data() + nodeIndex);
+		__builtin_prefetch(item);
+		__builtin_prefetch(item + sizeof(NodeSliceMapItem) - 1);
+	}
+	template <bool HasVectorMap = UseVectorMap>
+	typename std::enable_if<!HasVectorMap>::type prefetch(size_t nodeIndex) const
+	{
+		//the bucket can't be located without doing the lookup
+	}
+	template <bool HasVectorMap = UseVectorMap>
 	typename std::enable_if<HasVectorMap, bool>::type hasNode(size_t nodeIndex) const
 	{
 		assert(vectorMap != nullptr);
@@ -427,4 +443,166 @@ private:
 	friend class NodeSlice<LengthType, ScoreType, Word, true>;
 };
 
+//read-only copy of a finished slice for the traceback table.
+//nodes are sorted by index and found with a binary search.
+//scores are stored as 16-bit offsets from the smallest score in the slice, offsets which don't fit are kept separately.
+//the bitvector words are stored only if they are nonzero, the flags tell which ones are there.
+template <typename LengthType, typename ScoreType, typename Word>
+class PackedNodeSlice
+{
+public:
+	using MapItem = NodeSliceMapItemStruct<LengthType, ScoreType, Word>;
+	PackedNodeSlice() :
+	scoreBase(0)
+	{
+	}
+	PackedNodeSlice(const NodeSlice<LengthType, ScoreType, Word, false>& slice) :
+	scoreBase(std::numeric_limits<ScoreType>::max())
+	{
+		std::vector<std::pair<size_t, MapItem>> sorted;
+		sorted.reserve(slice.size());
+		for (auto item : slice)
+		{
+			sorted.push_back(item);
+			scoreBase = std::min(scoreBase, item.second.minScore);
+			scoreBase = std::min(scoreBase, item.second.startSlice.scoreEnd);
+			scoreBase = std::min(scoreBase, item.second.endSlice.scoreEnd);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<size_t, MapItem>& left, const std::pair<size_t, MapItem>& right) { return left.first < right.first; });
+		nodes.reserve(sorted.size());
+		items.reserve(sorted.size());
+		blockWordStart.reserve((sorted.size() + BlockSize - 1) / BlockSize);
+		for (size_t i = 0; i < sorted.size(); i++)
+		{
+			if (i % BlockSize == 0) blockWordStart.push_back(words.size());
+			const MapItem& item = sorted[i].second;
+			PackedItem packed;
+			packed.minScore = packScore(i, 0, item.minScore);
+			packed.startScore = packScore(i, 1, item.startSlice.scoreEnd);
+			packed.endScore = packScore(i, 2, item.endSlice.scoreEnd);
+			packed.flags = item.exists ? 1 : 0;
+			packed.wordOffset = words.size() - blockWordStart.back();
+			Word itemWords[NUM_WORDS];
+			getWords(item, itemWords);
+			for (size_t j = 0; j < NUM_WORDS; j++)
+			{
+				if (itemWords[j] == 0) continue;
+				packed.flags |= 2 << j;
+				words.push_back(itemWords[j]);
+			}
+			nodes.push_back(sorted[i].first);
+			items.push_back(packed);
+#ifdef SLICEVERBOSE
+			firstSlicesCalcedWhenCalced.push_back(item.firstSlicesCalcedWhenCalced);
+			slicesCalcedWhenCalced.push_back(item.slicesCalcedWhenCalced);
+#endif
+		}
+		words.shrink_to_fit();
+		overflowScores.shrink_to_fit();
+	}
+	bool hasNode(size_t nodeIndex) const
+	{
+		size_t index = find(nodeIndex);
+		return index != nodes.size() && (items[index].flags & 1);
+	}
+	MapItem node(size_t nodeIndex) const
+	{
+		size_t index = find(nodeIndex);
+		assert(index != nodes.size());
+		const PackedItem& packed = items[index];
+		MapItem result;
+		result.minScore = unpackScore(index, 0, packed.minScore);
+		result.exists = packed.flags & 1;
+		Word itemWords[NUM_WORDS];
+		size_t wordIndex = blockWordStart[index / BlockSize] + packed.wordOffset;
+		for (size_t j = 0; j < NUM_WORDS; j++)
+		{
+			itemWords[j] = 0;
+			if (packed.flags & (2 << j))
+			{
+				itemWords[j] = words[wordIndex];
+				wordIndex++;
+			}
+		}
+		result.startSlice = { itemWords[0], itemWords[1], unpackScore(index, 1, packed.startScore) };
+		result.endSlice = { itemWords[2], itemWords[3], unpackScore(index, 2, packed.endScore) };
+		for (size_t i = 0; i < MapItem::NUM_CHUNKS; i++)
+		{
+			result.HP[i] = itemWords[4 + i];
+			result.HN[i] = itemWords[4 + MapItem::NUM_CHUNKS + i];
+		}
+#ifdef SLICEVERBOSE
+		result.firstSlicesCalcedWhenCalced = firstSlicesCalcedWhenCalced[index];
+		result.slicesCalcedWhenCalced = slicesCalcedWhenCalced[index];
+#endif
+		return result;
+	}
+	size_t size() const
+	{
+		return nodes.size();
+	}
+private:
+	//start VP, start VN, end VP, end VN, HP chunks, HN chunks
+	static constexpr size_t NUM_WORDS = 4 + 2 * MapItem::NUM_CHUNKS;
+	//word positions are 16-bit offsets from the start of each block of nodes
+	static constexpr size_t BlockSize = 1024;
+	static_assert(BlockSize * NUM_WORDS <= std::numeric_limits<uint16_t>::max(), "word offsets don't fit in 16 bits");
+	static_assert(NUM_WORDS + 1 <= 16, "flags don't fit in 16 bits");
+	static constexpr uint16_t OverflowScore = std::numeric_limits<uint16_t>::max();
+	struct PackedItem
+	{
+		uint16_t minScore;
+		uint16_t startScore;
+		uint16_t endScore;
+		uint16_t wordOffset;
+		//lowest bit is existence, the rest tell which words are nonzero
+		uint16_t flags;
+	};
+	static void getWords(const MapItem& item, Word* result)
+	{
+		result[0] = item.startSlice.VP;
+		result[1] = item.startSlice.VN;
+		result[2] = item.endSlice.VP;
+		result[3] = item.endSlice.VN;
+		for (size_t i = 0; i < MapItem::NUM_CHUNKS; i++)
+		{
+			result[4 + i] = item.HP[i];
+			result[4 + MapItem::NUM_CHUNKS + i] = item.HN[i];
+		}
+	}
+	size_t find(size_t nodeIndex) const
+	{
+		auto found = std::lower_bound(nodes.begin(), nodes.end(), nodeIndex);
+		if (found == nodes.end() || *found != nodeIndex) return nodes.size();
+		return found - nodes.begin();
+	}
+	uint16_t packScore(size_t index, size_t field, ScoreType score)
+	{
+		int64_t diff = (int64_t)score - (int64_t)scoreBase;
+		assert(diff >= 0);
+		if (diff < OverflowScore) return diff;
+		overflowScores.emplace_back(index * 3 + field, score);
+		return OverflowScore;
+	}
+	ScoreType unpackScore(size_t index, size_t field, uint16_t packed) const
+	{
+		if (packed != OverflowScore) return scoreBase + packed;
+		auto found = std::lower_bound(overflowScores.begin(), overflowScores.end(), std::make_pair(index * 3 + field, std::numeric_limits<ScoreType>::min()));
+		assert(found != overflowScores.end());
+		assert(found->first == index * 3 + field);
+		return found->second;
+	}
+	ScoreType scoreBase;
+	std::vector<size_t> nodes;
+	std::vector<PackedItem> items;
+	std::vector<size_t> blockWordStart;
+	std::vector<Word> words;
+	//(index * 3 + field, score) for the scores too far from the base, in order
+	std::vector<std::pair<size_t, ScoreType>> overflowScores;
+#ifdef SLICEVERBOSE
+	std::vector<size_t> firstSlicesCalcedWhenCalced;
+	std::vector<size_t> slicesCalcedWhenCalced;
+#endif
+};
+
 #endif
\ No newline at end of file
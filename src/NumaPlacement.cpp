@@ -0,0 +1,88 @@
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include "NumaPlacement.h"
+
+namespace NumaPlacement
+{
+	std::vector<int> ParseCpuList(const std::string& list)
+	{
+		//format is eg "0-3,8-11,16"
+		std::vector<int> result;
+		std::stringstream str { list };
+		std::string range;
+		while (std::getline(str, range, ','))
+		{
+			if (range.size() == 0 || range[0] == '\n') continue;
+			size_t dash = range.find('-');
+			try
+			{
+				if (dash == std::string::npos)
+				{
+					result.push_back(std::stoi(range));
+				}
+				else
+				{
+					int start = std::stoi(range.substr(0, dash));
+					int end = std::stoi(range.substr(dash+1));
+					for (int i = start; i <= end; i++)
+					{
+						result.push_back(i);
+					}
+				}
+			}
+			catch (const std::logic_error& e)
+			{
+				return std::vector<int>{};
+			}
+		}
+		return result;
+	}
+
+	std::vector<NumaNode> GetNumaNodes()
+	{
+		std::vector<NumaNode> result;
+		std::ifstream onlineFile { "/sys/devices/system/node/online" };
+		if (!onlineFile.good()) return result;
+		std::string online;
+		std::getline(onlineFile, online);
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return result;
+		for (auto nodeId : ParseCpuList(online))
+		{
+			std::ifstream cpuFile { "/sys/devices/system/node/node" + std::to_string(nodeId) + "/cpulist" };
+			if (!cpuFile.good()) continue;
+			std::string cpulist;
+			std::getline(cpuFile, cpulist);
+			NumaNode node;
+			node.id = nodeId;
+			for (auto cpu : ParseCpuList(cpulist))
+			{
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+			}
+			//memory-only nodes and nodes excluded by taskset / cgroups
+			if (node.cpus.size() == 0) continue;
+			result.push_back(node);
+		}
+		return result;
+	}
+
+	size_t NodeForThread(size_t threadnum, size_t numThreads, size_t numNodes)
+	{
+		if (numNodes <= 1) return 0;
+		return threadnum * numNodes / numThreads;
+	}
+
+	bool PinCurrentThread(const NumaNode& node)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto cpu : node.cpus)
+		{
+			CPU_SET(cpu, &set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+	}
+}
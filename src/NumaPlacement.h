@@ -0,0 +1,24 @@
+#ifndef NumaPlacement_h
+#define NumaPlacement_h
+
+#include <string>
+#include <vector>
+
+//thread placement without libnuma. topology is read from sysfs and memory placement relies on first-touch,
+//so per-node data must be allocated and written by a thread which has already been pinned to that node
+namespace NumaPlacement
+{
+	struct NumaNode
+	{
+		int id;
+		std::vector<int> cpus;
+	};
+	//nodes which have at least one cpu the process is allowed to run on. empty if the topology can't be read
+	std::vector<NumaNode> GetNumaNodes();
+	//assigns consecutive blocks of threads to the same node, balanced over the nodes
+	size_t NodeForThread(size_t threadnum, size_t numThreads, size_t numNodes);
+	bool PinCurrentThread(const NumaNode& node);
+	std::vector<int> ParseCpuList(const std::string& list);
+}
+
+#endif
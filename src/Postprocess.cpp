@@ -1,167 +1,255 @@
-#include <unordered_set>
-#include <vector>
-#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
 #include <unordered_map>
 #include <fstream>
-#include <concurrentqueue.h> //https://github.com/cameron314/concurrentqueue
+#include <vector>
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "Threading.h"
 #include "fastqloader.h"
 #include "CommonUtils.h"
 
-std::atomic<bool> readingDone;
-std::atomic<bool> splittingDone;
-std::vector<vg::Alignment*> cleanup;
+//read groups selected in parallel at once
+static constexpr size_t GroupBatchSize = 10000;
 
 size_t allAlnsCount = 0;
 size_t selectedAlnCount = 0;
 size_t fullLengthAlnCount = 0;
 size_t readsWithAnAlnCount = 0;
+size_t readCount = 0;
 size_t bpInReads = 0;
 size_t bpInSelected = 0;
 size_t bpInFull = 0;
 
-std::unordered_map<std::string, size_t> getReadLengths(std::string readFile)
+//read lengths sorted by name hash. the names are kept in one buffer to tell apart reads whose hashes collide, the sequences are not kept
+class ReadLengthIndex
 {
-	std::unordered_map<std::string, size_t> result;
-	auto reads = loadFastqFromFile(readFile);
-	for (auto read : reads)
+public:
+	ReadLengthIndex(const std::string& readFile)
 	{
-		result[read.seq_id] = read.sequence.size();
+		FastQ::streamFastqFromFile(readFile, false, [this](FastQ& read)
+		{
+			entries.push_back(Entry { hash(read.seq_id), read.sequence.size(), names.size(), read.seq_id.size(), false });
+			names += read.seq_id;
+			readCount += 1;
+			bpInReads += read.sequence.size();
+		});
+		std::sort(entries.begin(), entries.end(), [](const Entry& left, const Entry& right) { return left.hash < right.hash; });
 	}
-	return result;
-}
-
-void loadAlignments(std::string filename, moodycamel::ConcurrentQueue<vg::Alignment*>& output)
-{
-	vg::Alignment* current[100];
-	size_t countCurrent = 0;
-	std::ifstream alnFile { filename, std::ios::in | std::ios::binary };
-	std::function<void(vg::Alignment&)> lambda = [&cleanup, &output, &current, &countCurrent](vg::Alignment& g) {
-		vg::Alignment* ptr = new vg::Alignment;
-		*ptr = g;
-		cleanup.push_back(ptr);
-		current[countCurrent] = ptr;
-		countCurrent++;
-		if (countCurrent == 100)
+	size_t Length(const std::string& readName) const
+	{
+		return find(readName).length;
+	}
+	//returns false if the read was already marked
+	bool Mark(const std::string& readName)
+	{
+		Entry& entry = find(readName);
+		if (entry.seen) return false;
+		entry.seen = true;
+		return true;
+	}
+private:
+	struct Entry
+	{
+		uint64_t hash;
+		size_t length;
+		size_t nameStart;
+		size_t nameLength;
+		bool seen;
+	};
+	static uint64_t hash(const std::string& readName)
+	{
+		return std::hash<std::string>{}(readName);
+	}
+	const Entry& find(const std::string& readName) const
+	{
+		uint64_t h = hash(readName);
+		auto found = std::lower_bound(entries.begin(), entries.end(), h, [](const Entry& entry, uint64_t h) { return entry.hash < h; });
+		for (; found != entries.end() && found->hash == h; ++found)
 		{
-			output.enqueue_bulk(current, 100);
-			countCurrent = 0;
+			if (found->nameLength == readName.size() && names.compare(found->nameStart, found->nameLength, readName) == 0) return *found;
 		}
-	};
-	stream::for_each(alnFile, lambda);
-	if (countCurrent > 0)
+		throw std::runtime_error("Read " + readName + " is not in the read file");
+	}
+	Entry& find(const std::string& readName)
 	{
-		output.enqueue_bulk(current, countCurrent);
+		return const_cast<Entry&>(static_cast<const ReadLengthIndex*>(this)->find(readName));
 	}
+	std::vector<Entry> entries;
+	std::string names;
+};
 
-	readingDone = true;
-}
-
-void splitAlignmentsIntoSelectedAndFullLength(const std::unordered_map<std::string, size_t>& readLengths, moodycamel::ConcurrentQueue<vg::Alignment*>& inputAlns, moodycamel::ConcurrentQueue<vg::Alignment*>& outputSelected, moodycamel::ConcurrentQueue<vg::Alignment*>& outputFullLength)
+//selects the alignments of a batch of reads in parallel and writes them in the batch order
+void selectAndWrite(std::vector<std::vector<vg::Alignment>>& groups, const ReadLengthIndex& readLengths, size_t numThreads, std::ofstream& selectedOut, std::ofstream& fullLengthOut)
 {
-	vg::Alignment* alns[100] {};
-
-	std::unordered_map<std::string, std::vector<vg::Alignment*>> alnsPerRead;
-	while (true)
+	std::vector<std::vector<vg::Alignment*>> selected;
+	std::vector<size_t> readLength;
+	selected.resize(groups.size());
+	readLength.resize(groups.size());
+	Threading::ParallelFor(groups.size(), numThreads, [&groups, &selected, &readLength, &readLengths](size_t index, size_t thread)
 	{
-		size_t gotAlns = inputAlns.try_dequeue_bulk(alns, 100);
-		if (gotAlns == 0)
-		{
-			if (readingDone) break;
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-			continue;
-		}
-		for (size_t i = 0; i < gotAlns; i++)
+		std::vector<vg::Alignment*> alns;
+		for (auto& aln : groups[index])
 		{
-			alnsPerRead[alns[i]->name()].push_back(alns[i]);
+			alns.push_back(&aln);
 		}
-	}
-
-	for (auto pair : alnsPerRead)
+		selected[index] = CommonUtils::SelectAlignments(alns, std::numeric_limits<size_t>::max());
+		readLength[index] = readLengths.Length(groups[index][0].name());
+	});
+	std::vector<vg::Alignment*> selectedAlns;
+	std::vector<vg::Alignment*> fullLengthAlns;
+	for (size_t i = 0; i < groups.size(); i++)
 	{
-		auto selected = CommonUtils::SelectAlignments(pair.second, std::numeric_limits<size_t>::max());
-		outputSelected.enqueue_bulk(selected.data(), selected.size());
-		allAlnsCount += pair.second.size();
-		selectedAlnCount += selected.size();
-		for (auto ptr : selected)
+		allAlnsCount += groups[i].size();
+		selectedAlnCount += selected[i].size();
+		for (auto ptr : selected[i])
 		{
 			bpInSelected += ptr->sequence().size();
 		}
-		if (selected[0]->sequence().size() >= readLengths.at(pair.first) - 1)
+		selectedAlns.insert(selectedAlns.end(), selected[i].begin(), selected[i].end());
+		if (selected[i][0]->sequence().size() >= readLength[i] - 1)
 		{
-			outputFullLength.enqueue(selected[0]);
-			bpInFull += selected[0]->sequence().size();
+			fullLengthAlns.push_back(selected[i][0]);
+			bpInFull += selected[i][0]->sequence().size();
 			fullLengthAlnCount += 1;
 		}
 	}
-
-	readsWithAnAlnCount = alnsPerRead.size();
-
-	splittingDone = true;
+	readsWithAnAlnCount += groups.size();
+	if (selectedAlns.size() > 0) stream::write_buffered_ptr(selectedOut, selectedAlns, 0);
+	if (fullLengthAlns.size() > 0) stream::write_buffered_ptr(fullLengthOut, fullLengthAlns, 0);
+	groups.clear();
 }
 
-void writeAlignments(std::string filename, moodycamel::ConcurrentQueue<vg::Alignment*>& inputAlns)
+struct NotConsecutiveException
 {
-	std::ofstream outfile { filename,  std::ios::out | std::ios::binary };
+	std::string readName;
+};
 
-	std::vector<vg::Alignment*> alns;
-	alns.resize(1000, nullptr);
-
-	while (true)
+//alignments of a read are consecutive in the file, eg. GraphAligner output. only one batch of reads is in memory at once.
+//returns false without finishing if they are not
+bool processReadOrdered(const std::string& alnFile, ReadLengthIndex& readLengths, size_t numThreads, std::ofstream& selectedOut, std::ofstream& fullLengthOut)
+{
+	std::vector<std::vector<vg::Alignment>> groups;
+	std::function<void(vg::Alignment&)> lambda = [&groups, &readLengths, numThreads, &selectedOut, &fullLengthOut](vg::Alignment& aln)
 	{
-		alns.resize(1000);
-		size_t gotAlns = inputAlns.try_dequeue_bulk(alns.data(), 1000);
-		if (gotAlns == 0)
+		if (groups.size() > 0 && groups.back()[0].name() == aln.name())
 		{
-			if (splittingDone) break;
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
-			continue;
+			groups.back().emplace_back(std::move(aln));
+			return;
 		}
-		alns.resize(gotAlns);
-		stream::write_buffered_ptr(outfile, alns, 0);
+		if (!readLengths.Mark(aln.name()))
+		{
+			throw NotConsecutiveException { aln.name() };
+		}
+		if (groups.size() == GroupBatchSize)
+		{
+			//the last group might still continue in the next alignment, keep it
+			std::vector<vg::Alignment> last = std::move(groups.back());
+			groups.pop_back();
+			selectAndWrite(groups, readLengths, numThreads, selectedOut, fullLengthOut);
+			groups.emplace_back(std::move(last));
+		}
+		groups.emplace_back();
+		groups.back().emplace_back(std::move(aln));
+	};
+	try
+	{
+		GamReader::ForEachOrdered(alnFile, numThreads, lambda);
+	}
+	catch (const NotConsecutiveException& e)
+	{
+		std::cerr << "Alignments of read " << e.readName << " are not consecutive, group the alignments in memory instead" << std::endl;
+		return false;
 	}
+	selectAndWrite(groups, readLengths, numThreads, selectedOut, fullLengthOut);
+	return true;
 }
 
-int main(int argc, char** argv)
+//alignments in any order, all are kept in memory
+void processUnordered(const std::string& alnFile, const ReadLengthIndex& readLengths, size_t numThreads, std::ofstream& selectedOut, std::ofstream& fullLengthOut)
 {
-	std::string rawAlnFile { argv[1] };
-	std::string readsFile { argv[2] };
-	std::string outputSelectedAlnFile { argv[3] };
-	std::string outputFullLengthAlnFile { argv[4] };
-	std::string outputSummaryFile { argv[5] };
-
-	readingDone = false;
-	splittingDone = false;
-
-	auto readLengths = getReadLengths(readsFile);
+	std::unordered_map<std::string, std::vector<vg::Alignment>> alnsPerRead;
+	std::function<void(vg::Alignment&)> lambda = [&alnsPerRead](vg::Alignment& aln)
+	{
+		std::string name = aln.name();
+		alnsPerRead[name].emplace_back(std::move(aln));
+	};
+	GamReader::ForEachOrdered(alnFile, numThreads, lambda);
+	std::vector<std::vector<vg::Alignment>> groups;
+	for (auto& pair : alnsPerRead)
+	{
+		groups.emplace_back(std::move(pair.second));
+		if (groups.size() == GroupBatchSize) selectAndWrite(groups, readLengths, numThreads, selectedOut, fullLengthOut);
+	}
+	selectAndWrite(groups, readLengths, numThreads, selectedOut, fullLengthOut);
+}
 
-	moodycamel::ConcurrentQueue<vg::Alignment*> readToSplitting;
-	moodycamel::ConcurrentQueue<vg::Alignment*> splitToSelected;
-	moodycamel::ConcurrentQueue<vg::Alignment*> splitToFullLength;
+int main(int argc, char** argv)
+{
+	//usage: Postprocess alignments.gam reads selected.gam fulllength.gam summary.txt [-t threads] [--unordered]
+	//if the alignments of a read are not consecutive in the input, all alignments are grouped in memory.
+	//--unordered does that from the start instead of first trying the consecutive grouping
+	std::vector<std::string> positional;
+	size_t numThreads = Threading::DefaultThreads();
+	bool unordered = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg { argv[i] };
+		if (arg == "--unordered")
+		{
+			unordered = true;
+		}
+		else if (arg == "-t" && i+1 < argc)
+		{
+			numThreads = std::stoi(argv[i+1]);
+			i++;
+		}
+		else
+		{
+			positional.push_back(arg);
+		}
+	}
+	if (positional.size() != 5)
+	{
+		std::cerr << "usage: Postprocess alignments.gam reads selected.gam fulllength.gam summary.txt [-t threads] [--unordered]" << std::endl;
+		return 1;
+	}
+	std::string rawAlnFile { positional[0] };
+	std::string readsFile { positional[1] };
+	std::string outputSelectedAlnFile { positional[2] };
+	std::string outputFullLengthAlnFile { positional[3] };
+	std::string outputSummaryFile { positional[4] };
 
-	std::thread readThread {[&rawAlnFile, &readToSplitting](){loadAlignments(rawAlnFile, readToSplitting);}};
-	std::thread splitter {[&readToSplitting, &splitToSelected, &splitToFullLength, &readLengths](){splitAlignmentsIntoSelectedAndFullLength(readLengths, readToSplitting, splitToSelected, splitToFullLength);}};
-	std::thread selectedWriter {[&splitToSelected, &outputSelectedAlnFile](){writeAlignments(outputSelectedAlnFile, splitToSelected);}};
-	std::thread fullLengthWriter {[&splitToFullLength, &outputFullLengthAlnFile](){writeAlignments(outputFullLengthAlnFile, splitToFullLength);}};
+	ReadLengthIndex readLengths { readsFile };
 
-	readThread.join();
-	splitter.join();
-	selectedWriter.join();
-	fullLengthWriter.join();
+	std::ofstream selectedOut { outputSelectedAlnFile, std::ios::out | std::ios::binary };
+	std::ofstream fullLengthOut { outputFullLengthAlnFile, std::ios::out | std::ios::binary };
 
-	for (auto aln : cleanup)
+	if (!unordered && !processReadOrdered(rawAlnFile, readLengths, numThreads, selectedOut, fullLengthOut))
 	{
-		delete aln;
+		//start over, some groups have already been written
+		unordered = true;
+		allAlnsCount = 0;
+		selectedAlnCount = 0;
+		fullLengthAlnCount = 0;
+		readsWithAnAlnCount = 0;
+		bpInSelected = 0;
+		bpInFull = 0;
+		selectedOut.close();
+		fullLengthOut.close();
+		selectedOut.open(outputSelectedAlnFile, std::ios::out | std::ios::binary | std::ios::trunc);
+		fullLengthOut.open(outputFullLengthAlnFile, std::ios::out | std::ios::binary | std::ios::trunc);
 	}
-
-	for (auto pair : readLengths)
+	if (unordered)
 	{
-		bpInReads += pair.second;
+		processUnordered(rawAlnFile, readLengths, numThreads, selectedOut, fullLengthOut);
 	}
 
 	std::ofstream summary {outputSummaryFile};
-	summary << readLengths.size() << "\tnumber of reads" << std::endl;
+	summary << readCount << "\tnumber of reads" << std::endl;
 	summary << selectedAlnCount << "\tnumber of selected alignments" << std::endl;
 	summary << fullLengthAlnCount << "\tnumber of full length alignments" << std::endl;
 	summary << readsWithAnAlnCount << "\treads with an alignment" << std::endl;
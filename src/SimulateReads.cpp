@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <random>
@@ -6,35 +7,70 @@
 #include "vg.pb.h"
 #include "stream.hpp"
 #include "GfaGraph.h"
+#include "Threading.h"
 
-std::default_random_engine generator;
-std::uniform_real_distribution<double> distribution(0.0,1.0);
+//reads simulated in parallel at once, then written in order
+static constexpr size_t ReadBatchSize = 10000;
 
-std::string introduceErrors(std::string real, double substitutionErrorRate, double insertionErrorRate, double deletionErrorRate)
+//out edges of one side of the nodes as (target node, target forward) in CSR form
+struct EdgeList
+{
+	std::vector<size_t> start;
+	std::vector<std::pair<size_t, bool>> targets;
+	EdgeList(const std::vector<std::vector<std::pair<size_t, bool>>>& lists)
+	{
+		start.push_back(0);
+		for (const auto& list : lists)
+		{
+			targets.insert(targets.end(), list.begin(), list.end());
+			start.push_back(targets.size());
+		}
+	}
+	size_t size(size_t node) const
+	{
+		return start[node+1] - start[node];
+	}
+	std::pair<size_t, bool> get(size_t node, size_t index) const
+	{
+		return targets[start[node] + index];
+	}
+};
+
+size_t randomIndex(std::mt19937_64& rng, size_t count)
+{
+	return std::uniform_int_distribution<size_t>(0, count-1)(rng);
+}
+
+double randomReal(std::mt19937_64& rng)
+{
+	return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+std::string introduceErrors(std::string real, double substitutionErrorRate, double insertionErrorRate, double deletionErrorRate, std::mt19937_64& rng)
 {
 	std::string result;
 	for (size_t i = 0; i < real.size(); i++)
 	{
-		if (distribution(generator) < deletionErrorRate)
+		if (randomReal(rng) < deletionErrorRate)
 		{
 		}
 		else
 		{
-			if (distribution(generator) < substitutionErrorRate)
+			if (randomReal(rng) < substitutionErrorRate)
 			{
-				result += "ATCG"[rand() % 4];
+				result += "ATCG"[randomIndex(rng, 4)];
 			}
 			else
 			{
 				result += real[i];
 			}
 		}
-		if (distribution(generator) < insertionErrorRate / 10.0)
+		if (randomReal(rng) < insertionErrorRate / 10.0)
 		{
-			int length = rand() % 20;
+			int length = randomIndex(rng, 20);
 			for (int j = 0; j < length; j++)
 			{
-				result += "ATCG"[rand() % 4];
+				result += "ATCG"[randomIndex(rng, 4)];
 			}
 		}
 	}
@@ -47,20 +83,27 @@ bool is_file_exist(std::string fileName)
 	return infile.good();
 }
 
-std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std::vector<std::string>& nodeSequences, const std::vector<int>& nodeIds, int overlap, int length, double substitutionErrorRate, double insertionErrorRate, double deletionErrorRate, const std::map<size_t, std::vector<std::pair<size_t, bool>>>& outEdgesRight, const std::map<size_t, std::vector<std::pair<size_t, bool>>>& outEdgesLeft)
+struct SimulatedRead
+{
+	vg::Alignment truth;
+	std::string sequence;
+	vg::Alignment seed;
+};
+
+//returns false if the walk hits a dead end before the read is long enough
+bool tryWalk(const std::vector<std::string>& nodeSequences, const std::vector<int>& nodeIds, int overlap, int length, const EdgeList& outEdgesRight, const EdgeList& outEdgesLeft, std::mt19937_64& rng, std::vector<std::pair<int, bool>>& realNodes, std::vector<size_t>& nodelens, std::string& realsequence, int& startNode, bool& startReverse, int& startPos)
 {
 	bool reverse = false;
-	if (distribution(generator) < 0.5) reverse = true;
+	if (randomReal(rng) < 0.5) reverse = true;
 
-	std::vector<std::pair<int, bool>> realNodes;
-	std::vector<size_t> nodelens;
+	realNodes.clear();
+	nodelens.clear();
 
-	int currentNode = rand() % nodeSequences.size();
-	int startNode = nodeIds[currentNode];
+	size_t currentNode = randomIndex(rng, nodeSequences.size());
+	startNode = nodeIds[currentNode];
 	assert(nodeSequences[currentNode].size() > overlap);
-	int startPos = rand() % (nodeSequences[currentNode].size() - overlap);
-	bool startReverse = reverse;
-	std::string realsequence;
+	startPos = randomIndex(rng, nodeSequences[currentNode].size() - overlap);
+	startReverse = reverse;
 	if (reverse)
 	{
 		realsequence = CommonUtils::ReverseComplement(nodeSequences[currentNode]).substr(startPos);
@@ -73,7 +116,7 @@ std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std:
 	realsequence.erase(realsequence.end()-overlap, realsequence.end());
 	while (realsequence.size() < length)
 	{
-		if (currentNode == 0) return simulateOneRead(nodeSequences, nodeIds, overlap, length, substitutionErrorRate, insertionErrorRate, deletionErrorRate, outEdgesRight, outEdgesLeft);
+		if (currentNode == 0) return false;
 		realNodes.emplace_back(nodeIds[currentNode], reverse);
 		if (nodelens.size() == 0)
 		{
@@ -83,22 +126,11 @@ std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std:
 		{
 			nodelens.emplace_back(nodeSequences[currentNode].size() - overlap);
 		}
-		if (reverse)
-		{
-			if (outEdgesLeft.count(currentNode) == 0) return simulateOneRead(nodeSequences, nodeIds, overlap, length, substitutionErrorRate, insertionErrorRate, deletionErrorRate, outEdgesRight, outEdgesLeft);
-			if (outEdgesLeft.at(currentNode).size() == 0) return simulateOneRead(nodeSequences, nodeIds, overlap, length, substitutionErrorRate, insertionErrorRate, deletionErrorRate, outEdgesRight, outEdgesLeft);
-			auto pickedIndex = rand() % outEdgesLeft.at(currentNode).size();
-			reverse = !outEdgesLeft.at(currentNode)[pickedIndex].second;
-			currentNode = outEdgesLeft.at(currentNode)[pickedIndex].first;
-		}
-		else
-		{
-			if (outEdgesRight.count(currentNode) == 0) return simulateOneRead(nodeSequences, nodeIds, overlap, length, substitutionErrorRate, insertionErrorRate, deletionErrorRate, outEdgesRight, outEdgesLeft);
-			if (outEdgesRight.at(currentNode).size() == 0) return simulateOneRead(nodeSequences, nodeIds, overlap, length, substitutionErrorRate, insertionErrorRate, deletionErrorRate, outEdgesRight, outEdgesLeft);
-			auto pickedIndex = rand() % outEdgesRight.at(currentNode).size();
-			reverse = !outEdgesRight.at(currentNode)[pickedIndex].second;
-			currentNode = outEdgesRight.at(currentNode)[pickedIndex].first;
-		}
+		const EdgeList& edges = reverse ? outEdgesLeft : outEdgesRight;
+		if (edges.size(currentNode) == 0) return false;
+		auto picked = edges.get(currentNode, randomIndex(rng, edges.size(currentNode)));
+		reverse = !picked.second;
+		currentNode = picked.first;
 		if (reverse)
 		{
 			realsequence += CommonUtils::ReverseComplement(nodeSequences[currentNode]);
@@ -112,11 +144,25 @@ std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std:
 	}
 	realNodes.emplace_back(nodeIds[currentNode], reverse);
 	nodelens.emplace_back(nodeSequences[currentNode].size() - overlap);
+	return true;
+}
+
+SimulatedRead simulateOneRead(const std::string& name, const std::vector<std::string>& nodeSequences, const std::vector<int>& nodeIds, int overlap, int length, double substitutionErrorRate, double insertionErrorRate, double deletionErrorRate, const EdgeList& outEdgesRight, const EdgeList& outEdgesLeft, std::mt19937_64& rng)
+{
+	std::vector<std::pair<int, bool>> realNodes;
+	std::vector<size_t> nodelens;
+	std::string realsequence;
+	int startNode;
+	bool startReverse;
+	int startPos;
+	while (!tryWalk(nodeSequences, nodeIds, overlap, length, outEdgesRight, outEdgesLeft, rng, realNodes, nodelens, realsequence, startNode, startReverse, startPos));
 	realsequence = realsequence.substr(0, length);
-	auto errorSequence = introduceErrors(realsequence, substitutionErrorRate, insertionErrorRate, deletionErrorRate);
 
-	vg::Alignment result;
-	result.set_name("read_" + std::to_string(rand()));
+	SimulatedRead read;
+	read.sequence = introduceErrors(realsequence, substitutionErrorRate, insertionErrorRate, deletionErrorRate, rng);
+
+	vg::Alignment& result = read.truth;
+	result.set_name(name);
 	result.set_sequence(realsequence);
 	vg::Path* path = new vg::Path;
 	result.set_allocated_path(path);
@@ -132,7 +178,7 @@ std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std:
 		if (i == 0) position->set_offset(startPos);
 	}
 
-	vg::Alignment seed;
+	vg::Alignment& seed = read.seed;
 	seed.set_query_position(1);
 	seed.set_name(result.name());
 	vg::Path* seedpath = new vg::Path;
@@ -143,7 +189,7 @@ std::tuple<vg::Alignment, std::string, vg::Alignment> simulateOneRead(const std:
 	seedposition->set_node_id(startNode);
 	seedposition->set_is_reverse(startReverse);
 
-	return std::make_tuple(result, errorSequence, seed);
+	return read;
 }
 
 int main(int argc, char** argv)
@@ -157,9 +203,12 @@ int main(int argc, char** argv)
 	double insertions = std::stod(argv[7]);
 	std::string seedsOutFile {argv[8]};
 	double deletions = std::stod(argv[9]);
-
-	generator.seed(std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1));
-	srand(std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1));
+	//optional: thread count and random seed. the output is the same for the same seed and thread count
+	size_t numThreads = 1;
+	if (argc > 10) numThreads = std::max(1, std::stoi(argv[10]));
+	uint64_t randomSeed = std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1);
+	if (argc > 11) randomSeed = std::stoull(argv[11]);
+	std::cout << "random seed " << randomSeed << std::endl;
 
 	if (is_file_exist(graphFile)){
 		std::cout << "load graph from " << graphFile << std::endl;
@@ -171,8 +220,8 @@ int main(int argc, char** argv)
 	std::vector<std::string> nodeSequences;
 	std::vector<int> nodeIds;
 	int overlap = 0;
-	std::map<size_t, std::vector<std::pair<size_t, bool>>> outEdgesRight;
-	std::map<size_t, std::vector<std::pair<size_t, bool>>> outEdgesLeft;
+	std::vector<std::vector<std::pair<size_t, bool>>> outEdgesRight;
+	std::vector<std::vector<std::pair<size_t, bool>>> outEdgesLeft;
 
 	if (graphFile.substr(graphFile.size()-3) == ".vg")
 	{
@@ -184,6 +233,8 @@ int main(int argc, char** argv)
 			nodeIds.push_back(graph.node(i).id());
 			ids[graph.node(i).id()] = i;
 		}
+		outEdgesRight.resize(nodeSequences.size());
+		outEdgesLeft.resize(nodeSequences.size());
 		for (int i = 0; i < graph.edge_size(); i++)
 		{
 			if (graph.edge(i).from_start())
@@ -221,6 +272,8 @@ int main(int argc, char** argv)
 			ids[pair.first] = nodenum;
 			nodenum++;
 		}
+		outEdgesRight.resize(nodeSequences.size());
+		outEdgesLeft.resize(nodeSequences.size());
 		for (auto edge : graph.edges)
 		{
 			auto from = edge.first;
@@ -250,29 +303,47 @@ int main(int argc, char** argv)
 		}
 	}
 
-	std::vector<std::tuple<vg::Alignment, std::string, vg::Alignment>> reads;
-	std::vector<vg::Alignment> truth;
-	std::vector<vg::Alignment> seeds;
-	for (int i = 0; i < numReads; i++)
+	EdgeList flatEdgesRight { outEdgesRight };
+	EdgeList flatEdgesLeft { outEdgesLeft };
+	outEdgesRight.clear();
+	outEdgesLeft.clear();
+
+	//one random stream per slice of a batch, so the result doesn't depend on which thread runs which slice
+	std::vector<std::mt19937_64> rngs;
+	for (size_t i = 0; i < numThreads; i++)
 	{
-		reads.push_back(simulateOneRead(nodeSequences, nodeIds, overlap, length, substitution, insertions, deletions, outEdgesRight, outEdgesLeft));
-		truth.emplace_back(std::get<0>(reads[i]));
-		seeds.emplace_back(std::get<2>(reads[i]));
+		std::seed_seq seq { (uint32_t)randomSeed, (uint32_t)(randomSeed >> 32), (uint32_t)i };
+		rngs.emplace_back(seq);
 	}
 
 	std::ofstream alignmentOut { alignmentOutFile, std::ios::out | std::ios::binary };
-	stream::write_buffered(alignmentOut, truth, 0);
-
 	std::ofstream seedsOut { seedsOutFile, std::ios::out | std::ios::binary };
-	stream::write_buffered(seedsOut, seeds, 0);
-
 	std::ofstream fastqOut {fastqOutFile};
-	for (int i = 0; i < numReads; i++)
+	std::vector<SimulatedRead> reads;
+	for (size_t batchStart = 0; batchStart < (size_t)numReads; batchStart += ReadBatchSize)
 	{
-		fastqOut << "@" << std::get<0>(reads[i]).name() << "\n";
-		fastqOut << std::get<1>(reads[i]) << "\n";
-		fastqOut << "+" << "\n";
-		fastqOut << std::string(std::get<1>(reads[i]).size(), '!') << "\n";
+		size_t batchSize = std::min(ReadBatchSize, numReads - batchStart);
+		reads.resize(batchSize);
+		size_t sliceSize = (batchSize + numThreads - 1) / numThreads;
+		Threading::ParallelFor(numThreads, numThreads, [&](size_t slice, size_t thread)
+		{
+			for (size_t i = slice * sliceSize; i < (slice + 1) * sliceSize && i < batchSize; i++)
+			{
+				reads[i] = simulateOneRead("read_" + std::to_string(batchStart + i), nodeSequences, nodeIds, overlap, length, substitution, insertions, deletions, flatEdgesRight, flatEdgesLeft, rngs[slice]);
+			}
+		});
+		std::vector<vg::Alignment> truth;
+		std::vector<vg::Alignment> seeds;
+		for (auto& read : reads)
+		{
+			fastqOut << "@" << read.truth.name() << "\n";
+			fastqOut << read.sequence << "\n";
+			fastqOut << "+" << "\n";
+			fastqOut << std::string(read.sequence.size(), '!') << "\n";
+			truth.emplace_back(std::move(read.truth));
+			seeds.emplace_back(std::move(read.seed));
+		}
+		stream::write_buffered(alignmentOut, truth, 0);
+		stream::write_buffered(seedsOut, seeds, 0);
 	}
-
 }
\ No newline at end of file
@@ -0,0 +1,436 @@
+//checks that the strand folded AlignmentGraph has the topology of the unfolded digraph and aligns like it.
+//random bubble chains, with and without edge overlaps and with nodes in both orientations, are built from GFA text.
+//the reference is a character level digraph built directly from the same edges. every split node must have exactly
+//the neighbors the reference has, and reads sampled from both strands must align along the reference's edges
+//with the optimal edit distance
+//usage: StrandFoldingTest [graphs] [seed]
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "AlignmentGraph.h"
+#include "BigraphToDigraph.h"
+#include "CommonUtils.h"
+#include "GfaGraph.h"
+#include "GraphAlignerWrapper.h"
+#include "ThreadReadAssertion.h"
+
+struct TestGraph
+{
+	std::string gfa;
+	//indexed by the digraph node id, GFA id * 2 for the forward strand and + 1 for the reverse strand
+	std::vector<std::string> sequences;
+	//digraph from, digraph to, overlap
+	std::vector<std::tuple<size_t, size_t, size_t>> edges;
+};
+
+struct CharacterGraph
+{
+	std::vector<char> character;
+	std::vector<size_t> digraphNode;
+	std::vector<size_t> offset;
+	std::vector<std::vector<size_t>> successors;
+	std::vector<std::vector<size_t>> predecessors;
+	std::vector<size_t> topologicalOrder;
+};
+
+std::string randomSequence(std::mt19937_64& rng, size_t length)
+{
+	std::string result;
+	for (size_t i = 0; i < length; i++)
+	{
+		result += "ACGT"[rng() % 4];
+	}
+	return result;
+}
+
+//node sequences in the direction the chain is walked, nodes stored reversed in the GFA are flipped when written
+TestGraph makeBubbleChain(std::mt19937_64& rng, size_t bubbles, size_t overlap)
+{
+	std::vector<std::string> backbone;
+	for (size_t i = 0; i <= bubbles; i++)
+	{
+		backbone.push_back(randomSequence(rng, 2 * overlap + 1 + rng() % 150));
+	}
+	std::vector<std::string> chainSequences;
+	std::vector<std::pair<size_t, size_t>> chainEdges;
+	for (size_t i = 0; i <= bubbles; i++)
+	{
+		chainSequences.push_back(backbone[i]);
+	}
+	for (size_t i = 0; i < bubbles; i++)
+	{
+		for (size_t allele = 0; allele < 2; allele++)
+		{
+			std::string middle = randomSequence(rng, 1 + rng() % 100);
+			chainSequences.push_back(backbone[i].substr(backbone[i].size() - overlap) + middle + backbone[i+1].substr(0, overlap));
+			chainEdges.emplace_back(i, chainSequences.size()-1);
+			chainEdges.emplace_back(chainSequences.size()-1, i+1);
+		}
+	}
+	TestGraph result;
+	std::vector<bool> flipped;
+	std::stringstream gfa;
+	for (size_t i = 0; i < chainSequences.size(); i++)
+	{
+		flipped.push_back(rng() % 3 == 0);
+		std::string stored = flipped[i] ? CommonUtils::ReverseComplement(chainSequences[i]) : chainSequences[i];
+		gfa << "S\t" << i << "\t" << stored << "\n";
+		result.sequences.push_back(stored);
+		result.sequences.push_back(CommonUtils::ReverseComplement(stored));
+	}
+	for (auto edge : chainEdges)
+	{
+		size_t from = edge.first * 2 + (flipped[edge.first] ? 1 : 0);
+		size_t to = edge.second * 2 + (flipped[edge.second] ? 1 : 0);
+		result.edges.emplace_back(from, to, overlap);
+		result.edges.emplace_back(to ^ 1, from ^ 1, overlap);
+		//either direction of the link describes the same edge
+		if (rng() % 2 == 0)
+		{
+			gfa << "L\t" << edge.first << "\t" << (flipped[edge.first] ? "-" : "+") << "\t" << edge.second << "\t" << (flipped[edge.second] ? "-" : "+") << "\t" << overlap << "M\n";
+		}
+		else
+		{
+			gfa << "L\t" << edge.second << "\t" << (flipped[edge.second] ? "+" : "-") << "\t" << edge.first << "\t" << (flipped[edge.first] ? "+" : "-") << "\t" << overlap << "M\n";
+		}
+	}
+	result.gfa = gfa.str();
+	return result;
+}
+
+//an edge leaves the last character of its source and enters its target after the overlap
+CharacterGraph makeCharacterGraph(const TestGraph& graph)
+{
+	CharacterGraph result;
+	std::vector<size_t> firstCharacter;
+	for (size_t node = 0; node < graph.sequences.size(); node++)
+	{
+		firstCharacter.push_back(result.character.size());
+		for (size_t i = 0; i < graph.sequences[node].size(); i++)
+		{
+			result.character.push_back(graph.sequences[node][i]);
+			result.digraphNode.push_back(node);
+			result.offset.push_back(i);
+			result.successors.emplace_back();
+			result.predecessors.emplace_back();
+			if (i > 0)
+			{
+				result.successors[result.character.size()-2].push_back(result.character.size()-1);
+				result.predecessors[result.character.size()-1].push_back(result.character.size()-2);
+			}
+		}
+	}
+	for (auto edge : graph.edges)
+	{
+		size_t from = firstCharacter[std::get<0>(edge)] + graph.sequences[std::get<0>(edge)].size() - 1;
+		size_t to = firstCharacter[std::get<1>(edge)] + std::get<2>(edge);
+		result.successors[from].push_back(to);
+		result.predecessors[to].push_back(from);
+	}
+	std::vector<size_t> inDegree;
+	std::vector<size_t> ready;
+	for (size_t i = 0; i < result.character.size(); i++)
+	{
+		inDegree.push_back(result.predecessors[i].size());
+		if (inDegree[i] == 0) ready.push_back(i);
+	}
+	while (ready.size() > 0)
+	{
+		size_t top = ready.back();
+		ready.pop_back();
+		result.topologicalOrder.push_back(top);
+		for (auto next : result.successors[top])
+		{
+			inDegree[next]--;
+			if (inDegree[next] == 0) ready.push_back(next);
+		}
+	}
+	assert(result.topologicalOrder.size() == result.character.size());
+	return result;
+}
+
+//optimal edit distance of the whole read against any path
+size_t referenceDistance(const CharacterGraph& graph, const std::string& read)
+{
+	size_t n = read.size();
+	std::vector<std::vector<size_t>> distance;
+	distance.resize(graph.character.size());
+	std::vector<size_t> incoming;
+	incoming.resize(n + 1);
+	size_t best = n;
+	for (auto node : graph.topologicalOrder)
+	{
+		//the path may start at any character with any prefix of the read inserted before it
+		for (size_t j = 0; j <= n; j++)
+		{
+			incoming[j] = j;
+		}
+		for (auto previous : graph.predecessors[node])
+		{
+			for (size_t j = 0; j <= n; j++)
+			{
+				incoming[j] = std::min(incoming[j], distance[previous][j]);
+			}
+		}
+		distance[node].resize(n + 1);
+		distance[node][0] = incoming[0] + 1;
+		for (size_t j = 1; j <= n; j++)
+		{
+			distance[node][j] = std::min({ incoming[j-1] + (read[j-1] == graph.character[node] ? 0 : 1), incoming[j] + 1, distance[node][j-1] + 1 });
+		}
+		best = std::min(best, distance[node][n]);
+	}
+	return best;
+}
+
+//the sampled read and the character it starts at
+std::pair<std::string, size_t> sampleRead(std::mt19937_64& rng, const CharacterGraph& graph, size_t length)
+{
+	while (true)
+	{
+		size_t start = rng() % graph.character.size();
+		size_t pos = start;
+		std::string result;
+		result += graph.character[pos];
+		while (result.size() < length && graph.successors[pos].size() > 0)
+		{
+			pos = graph.successors[pos][rng() % graph.successors[pos].size()];
+			result += graph.character[pos];
+		}
+		if (result.size() == length) return std::make_pair(result, start);
+	}
+}
+
+std::string addErrors(std::mt19937_64& rng, const std::string& read, double errorRate)
+{
+	std::string result;
+	std::uniform_real_distribution<double> uniform { 0, 1 };
+	for (size_t i = 0; i < read.size(); i++)
+	{
+		if (uniform(rng) >= errorRate)
+		{
+			result += read[i];
+			continue;
+		}
+		switch(rng() % 3)
+		{
+			case 0:
+				result += "ACGT"[rng() % 4];
+				break;
+			case 1:
+				result += read[i];
+				result += "ACGT"[rng() % 4];
+				break;
+			case 2:
+				break;
+		}
+	}
+	return result;
+}
+
+//neighbors of a split node as (digraph node, offset) pairs. the unfolded digraph's are the next piece inside
+//the node, or at the end of the node the pieces where its edges enter their targets
+bool checkTopology(const AlignmentGraph& graph, const TestGraph& test)
+{
+	std::vector<std::set<std::pair<size_t, size_t>>> edgesOut;
+	std::vector<std::set<std::pair<size_t, size_t>>> edgesIn;
+	edgesOut.resize(test.sequences.size());
+	edgesIn.resize(test.sequences.size());
+	for (auto edge : test.edges)
+	{
+		edgesOut[std::get<0>(edge)].emplace(std::get<1>(edge), std::get<2>(edge));
+		edgesIn[std::get<1>(edge)].emplace(std::get<0>(edge), std::get<2>(edge));
+	}
+	for (size_t node = 0; node < graph.NodeSize(); node++)
+	{
+		size_t digraphNode = graph.NodeID(node);
+		size_t start = graph.NodeOffset(node);
+		size_t end = start + graph.NodeLength(node);
+		std::set<std::pair<size_t, size_t>> expectedOut;
+		std::set<std::pair<size_t, size_t>> expectedIn;
+		if (end < test.sequences[digraphNode].size())
+		{
+			expectedOut.emplace(digraphNode, end);
+		}
+		else
+		{
+			for (auto target : edgesOut[digraphNode]) expectedOut.emplace(target.first, target.second);
+		}
+		if (start > 0)
+		{
+			expectedIn.emplace(digraphNode, std::numeric_limits<size_t>::max());
+		}
+		for (auto source : edgesIn[digraphNode])
+		{
+			if (source.second == start) expectedIn.emplace(source.first, std::numeric_limits<size_t>::max());
+		}
+		std::set<std::pair<size_t, size_t>> foundOut;
+		std::set<std::pair<size_t, size_t>> foundIn;
+		for (auto neighbor : graph.OutNeighbors(node))
+		{
+			foundOut.emplace(graph.NodeID(neighbor), graph.NodeOffset(neighbor));
+		}
+		//in-neighbors are identified by the node they leave, they always leave from its end or the previous piece
+		for (auto neighbor : graph.InNeighbors(node))
+		{
+			foundIn.emplace(graph.NodeID(neighbor), std::numeric_limits<size_t>::max());
+		}
+		if (foundOut != expectedOut || foundIn != expectedIn)
+		{
+			std::cerr << "split node " << node << " (digraph node " << digraphNode << " offset " << start << ") has " << foundOut.size() << " out- and " << foundIn.size() << " in-neighbors, expected " << expectedOut.size() << " and " << expectedIn.size() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+//the alignment must follow the digraph's edges and spell the read with the reported number of edits
+bool checkAlignment(const vg::Alignment& alignment, const TestGraph& test, const std::string& read, size_t expectedScore, bool exactScore)
+{
+	size_t readPos = 0;
+	size_t edits = 0;
+	for (int i = 0; i < alignment.path().mapping_size(); i++)
+	{
+		const auto& mapping = alignment.path().mapping(i);
+		size_t node = mapping.position().node_id();
+		size_t nodePos = mapping.position().offset();
+		if (node >= test.sequences.size() || (node % 2 == 1) != mapping.position().is_reverse())
+		{
+			std::cerr << "alignment visits an invalid node " << node << std::endl;
+			return false;
+		}
+		if (i > 0)
+		{
+			const auto& previous = alignment.path().mapping(i-1);
+			size_t previousNode = previous.position().node_id();
+			size_t previousEnd = previous.position().offset();
+			for (int j = 0; j < previous.edit_size(); j++)
+			{
+				previousEnd += previous.edit(j).from_length();
+			}
+			auto edge = std::make_tuple(previousNode, node, nodePos);
+			if (previousEnd != test.sequences[previousNode].size() || std::find(test.edges.begin(), test.edges.end(), edge) == test.edges.end())
+			{
+				std::cerr << "alignment goes from node " << previousNode << " offset " << previousEnd << " to node " << node << " offset " << nodePos << " which is not an edge" << std::endl;
+				return false;
+			}
+		}
+		for (int j = 0; j < mapping.edit_size(); j++)
+		{
+			const auto& edit = mapping.edit(j);
+			if (nodePos + edit.from_length() > test.sequences[node].size() || readPos + edit.to_length() > read.size())
+			{
+				std::cerr << "alignment runs past a node or the read" << std::endl;
+				return false;
+			}
+			if (edit.from_length() == edit.to_length() && edit.sequence().size() == 0)
+			{
+				if (test.sequences[node].substr(nodePos, edit.from_length()) != read.substr(readPos, edit.to_length()))
+				{
+					std::cerr << "alignment matches different characters" << std::endl;
+					return false;
+				}
+			}
+			else
+			{
+				edits += std::max(edit.from_length(), edit.to_length());
+			}
+			nodePos += edit.from_length();
+			readPos += edit.to_length();
+		}
+	}
+	if (readPos != read.size())
+	{
+		std::cerr << "alignment covers " << readPos << " of " << read.size() << "bp" << std::endl;
+		return false;
+	}
+	if (edits != (size_t)alignment.score() || (exactScore && edits != expectedScore) || edits < expectedScore)
+	{
+		std::cerr << "alignment has score " << alignment.score() << " and " << edits << " edits, the optimum is " << expectedScore << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numGraphs = argc > 1 ? std::stoull(argv[1]) : 20;
+	size_t seed = argc > 2 ? std::stoull(argv[2]) : 1;
+	std::mt19937_64 rng { seed };
+	size_t failed = 0;
+	size_t readsChecked = 0;
+	const size_t overlaps[4] { 0, 0, 5, 31 };
+	for (size_t graphIndex = 0; graphIndex < numGraphs; graphIndex++)
+	{
+		size_t overlap = overlaps[graphIndex % 4];
+		TestGraph test = makeBubbleChain(rng, 5 + rng() % 10, overlap);
+		std::stringstream gfaStream { test.gfa };
+		GfaGraph gfa = GfaGraph::LoadFromStream(gfaStream, true);
+		AlignmentGraph graph = DirectedGraph::BuildFromGFA(gfa, graphIndex % 2 == 0);
+		CharacterGraph reference = makeCharacterGraph(test);
+		std::string name = "graph " + std::to_string(graphIndex) + " (overlap " + std::to_string(overlap) + ")";
+		if (!checkTopology(graph, test))
+		{
+			std::cerr << name << ": topology differs from the unfolded graph" << std::endl;
+			failed++;
+			continue;
+		}
+		GraphAlignerCommon<size_t, int32_t, uint64_t>::AlignerGraphsizedState state { graph, 1000, true };
+		for (size_t readIndex = 0; readIndex < 10; readIndex++)
+		{
+			auto sampled = sampleRead(rng, reference, 100 + rng() % 200);
+			std::string read = addErrors(rng, sampled.first, 0.05);
+			size_t optimum = referenceDistance(reference, read);
+			//a failed assertion leaves the alignment empty, which is reported below
+			AlignmentResult unseeded;
+			try
+			{
+				unseeded = AlignOneWay(graph, "read", read, 1000, 0, true, state, true, true, false, 0);
+			}
+			catch (const ThreadReadAssertion::AssertionFailure& a)
+			{
+				state.clear();
+			}
+			if (unseeded.alignments.size() != 1 || !checkAlignment(*unseeded.alignments[0].alignment, test, read, optimum, true))
+			{
+				std::cerr << name << " read " << readIndex << ": unseeded alignment differs from the unfolded graph" << std::endl;
+				failed++;
+			}
+			readsChecked++;
+			//an exact read from its true start, the part before the seed is aligned on the other strand
+			size_t seedPos = rng() % sampled.first.size();
+			size_t seedChar = sampled.second;
+			for (size_t i = 0; i < seedPos; i++)
+			{
+				seedChar++;
+				if (seedChar == reference.character.size() || reference.digraphNode[seedChar] != reference.digraphNode[seedChar-1] || reference.offset[seedChar] != reference.offset[seedChar-1] + 1) break;
+			}
+			if (reference.digraphNode[seedChar] != reference.digraphNode[sampled.second] || reference.offset[seedChar] != reference.offset[sampled.second] + seedPos) continue;
+			size_t seedNode = reference.digraphNode[seedChar];
+			std::vector<SeedHit> seeds { SeedHit { (int)(seedNode / 2), reference.offset[seedChar], seedPos, 1, seedNode % 2 == 1 } };
+			AlignmentResult seeded;
+			try
+			{
+				seeded = AlignOneWay(graph, "read", sampled.first, 1000, 0, std::numeric_limits<size_t>::max(), true, false, seeds, state, true, true, false, 0, 0, 0);
+			}
+			catch (const ThreadReadAssertion::AssertionFailure& a)
+			{
+				state.clear();
+			}
+			if (seeded.alignments.size() != 1 || !checkAlignment(*seeded.alignments[0].alignment, test, sampled.first, 0, true))
+			{
+				std::cerr << name << " read " << readIndex << ": seeded alignment differs from the unfolded graph" << std::endl;
+				failed++;
+			}
+		}
+	}
+	std::cerr << numGraphs << " graphs, " << readsChecked << " reads, " << failed << " failures" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
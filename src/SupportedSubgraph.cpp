@@ -1,9 +1,11 @@
 #include <algorithm>
 #include <fstream>
-#include <unordered_set>
+#include <unordered_map>
 #include "CommonUtils.h"
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "GamReader.h"
+#include "Threading.h"
 
 
 int main(int argc, char** argv)
@@ -11,48 +13,77 @@ int main(int argc, char** argv)
 	std::string graphFile { argv[1] };
 	std::string alnFile { argv[2] };
 	std::string outputGraph { argv[3] };
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc > 4) numThreads = std::stoi(argv[4]);
 
 	vg::Graph graph = CommonUtils::LoadVGGraph(graphFile);
 
-	std::vector<vg::Alignment> alignments;
+	//dense node ids are indices in the graph, edges are indexed by their position in the graph
+	std::unordered_map<int, size_t> denseId;
+	for (int i = 0; i < graph.node_size(); i++)
 	{
-		std::ifstream alignmentfile {alnFile, std::ios::in | std::ios::binary};
-		std::function<void(vg::Alignment&)> lambda = [&alignments](vg::Alignment& g) {
-			alignments.push_back(g);
-		};
-		stream::for_each(alignmentfile, lambda);
+		denseId[graph.node(i).id()] = i;
 	}
-
-	std::map<int, std::set<int>> existingEdges;
-	for (size_t i = 0; i < graph.edge_size(); i++)
+	//edges touching each node in either direction as (other node, edge index), in CSR form
+	std::vector<size_t> adjacencyStart;
+	std::vector<std::pair<size_t, size_t>> adjacency;
 	{
-		existingEdges[graph.edge(i).from()].insert(graph.edge(i).to());
+		std::vector<std::vector<std::pair<size_t, size_t>>> lists;
+		lists.resize(graph.node_size());
+		for (int i = 0; i < graph.edge_size(); i++)
+		{
+			auto from = denseId.find(graph.edge(i).from());
+			auto to = denseId.find(graph.edge(i).to());
+			if (from == denseId.end() || to == denseId.end()) continue;
+			lists[from->second].emplace_back(to->second, i);
+			lists[to->second].emplace_back(from->second, i);
+		}
+		adjacencyStart.push_back(0);
+		for (size_t i = 0; i < lists.size(); i++)
+		{
+			adjacency.insert(adjacency.end(), lists[i].begin(), lists[i].end());
+			adjacencyStart.push_back(adjacency.size());
+		}
 	}
 
-	std::map<int, std::set<int>> supportedEdges;
-	std::unordered_set<int> supportedNodes;
-
-	for (size_t i = 0; i < alignments.size(); i++)
+	//the alignments are parsed in parallel in the background, the callback runs in file order so the output is in the order of the input
+	std::vector<bool> nodeSupported;
+	std::vector<bool> edgeSupported;
+	nodeSupported.resize(graph.node_size(), false);
+	edgeSupported.resize(graph.edge_size(), false);
+	std::function<void(vg::Alignment&)> lambda = [&](vg::Alignment& aln)
 	{
-		std::cout << "alignment " << alignments[i].name() << std::endl;
-		for (size_t j = 0; j < alignments[i].path().mapping_size()-1; j++)
+		std::cout << "alignment " << aln.name() << std::endl;
+		for (int j = 0; j + 1 < aln.path().mapping_size(); j++)
 		{
-			auto from = alignments[i].path().mapping(j).position().node_id();
-			auto to = alignments[i].path().mapping(j+1).position().node_id();
-			supportedNodes.insert(from);
-			supportedNodes.insert(to);
-			if (existingEdges[from].count(to) == 0 && existingEdges[to].count(from) == 0)
+			auto from = aln.path().mapping(j).position().node_id();
+			auto to = aln.path().mapping(j+1).position().node_id();
+			auto denseFrom = denseId.find(from);
+			auto denseTo = denseId.find(to);
+			if (denseFrom != denseId.end()) nodeSupported[denseFrom->second] = true;
+			if (denseTo != denseId.end()) nodeSupported[denseTo->second] = true;
+			bool found = false;
+			if (denseFrom != denseId.end() && denseTo != denseId.end())
+			{
+				for (size_t k = adjacencyStart[denseFrom->second]; k < adjacencyStart[denseFrom->second+1]; k++)
+				{
+					if (adjacency[k].first != denseTo->second) continue;
+					edgeSupported[adjacency[k].second] = true;
+					found = true;
+				}
+			}
+			if (!found)
 			{
 				std::cout << "nonexistant alignment from " << from << " to " << to << std::endl;
 			}
-			supportedEdges[from].insert(to);
 		}
-	}
+	};
+	GamReader::ForEachOrdered(alnFile, numThreads, lambda);
 
 	vg::Graph resultGraph;
 	for (int i = 0 ; i < graph.node_size(); i++)
 	{
-		if (supportedNodes.count(graph.node(i).id()) == 0) continue;
+		if (!nodeSupported[i]) continue;
 		auto* node = resultGraph.add_node();
 		node->set_sequence(graph.node(i).sequence());
 		node->set_id(graph.node(i).id());
@@ -60,14 +91,7 @@ int main(int argc, char** argv)
 	}
 	for (int i = 0; i < graph.edge_size(); i++)
 	{
-		auto from = graph.edge(i).from();
-		auto to = graph.edge(i).to();
-		bool foundForward = supportedEdges[from].count(to) == 1;
-		auto foundBackward = supportedEdges[to].count(from) == 1;
-		if (!foundForward && !foundBackward)
-		{
-			continue;
-		}
+		if (!edgeSupported[i]) continue;
 		auto* edge = resultGraph.add_edge();
 		edge->set_from(graph.edge(i).from());
 		edge->set_to(graph.edge(i).to());
@@ -79,4 +103,4 @@ int main(int argc, char** argv)
 	std::ofstream graphOut { outputGraph, std::ios::out | std::ios::binary };
 	std::vector<vg::Graph> writeVector {resultGraph};
 	stream::write_buffered(graphOut, writeVector, 0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "Threading.h"
+
+namespace Threading
+{
+	size_t DefaultThreads()
+	{
+		size_t result = std::thread::hardware_concurrency();
+		if (result == 0) result = 1;
+		return result;
+	}
+
+	void ParallelFor(size_t count, size_t numThreads, std::function<void(size_t index, size_t thread)> function)
+	{
+		if (numThreads <= 1 || count <= 1)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				function(i, 0);
+			}
+			return;
+		}
+		std::atomic<size_t> nextIndex { 0 };
+		std::vector<std::thread> threads;
+		std::exception_ptr error;
+		std::atomic<bool> failed { false };
+		for (size_t thread = 0; thread < numThreads && thread < count; thread++)
+		{
+			threads.emplace_back([&nextIndex, &function, &error, &failed, count, thread]()
+			{
+				while (!failed)
+				{
+					size_t index = nextIndex++;
+					if (index >= count) break;
+					try
+					{
+						function(index, thread);
+					}
+					catch (...)
+					{
+						if (!failed.exchange(true)) error = std::current_exception();
+					}
+				}
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		if (error) std::rethrow_exception(error);
+	}
+}
@@ -0,0 +1,16 @@
+#ifndef Threading_h
+#define Threading_h
+
+#include <functional>
+
+//minimal thread helpers for the tools which don't need a work queue
+namespace Threading
+{
+	//hardware concurrency, at least 1
+	size_t DefaultThreads();
+	//runs the function on each index in [0, count) from numThreads threads. thread is in [0, numThreads).
+	//the first exception thrown by the function stops the remaining indices and is rethrown in the calling thread
+	void ParallelFor(size_t count, size_t numThreads, std::function<void(size_t index, size_t thread)> function);
+}
+
+#endif
@@ -1,176 +1,276 @@
 #include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include "CommonUtils.h"
-#include "GfaGraph.h"
+#include "DenseGfa.h"
+#include "Threading.h"
 
-GfaGraph unitigify(const GfaGraph& graph)
+//maximal non-branching paths are found in parallel over chunks of the nodes.
+//a path is walked from both of its ends, the walk from the end with the smaller node id is kept.
+//only the dense graph, the unitig paths and the per node unitig assignment are in memory, the output is streamed in chunks.
+
+//nodes per chunk
+static constexpr size_t ChunkSize = 10000;
+
+//the unitigs found in one chunk, as sides concatenated one unitig after another
+struct UnitigChunk
+{
+	std::vector<size_t> sides;
+	std::vector<size_t> unitigStart;
+	size_t numUnitigs() const { return unitigStart.size(); }
+	size_t unitigEnd(size_t i) const { return i+1 < unitigStart.size() ? unitigStart[i+1] : sides.size(); }
+};
+
+//the side has exactly one out-neighbor and the neighbor has exactly one in-neighbor
+bool continues(const DenseGfa& graph, size_t side)
 {
-	GfaGraph result;
-	result.edgeOverlap = graph.edgeOverlap;
-	std::unordered_map<NodePos, int> belongsInUnitig;
-	std::unordered_set<int> nodesHandled;
-	std::unordered_map<int, NodePos> unitigLeft;
-	std::unordered_map<int, NodePos> unitigRight;
-	std::vector<std::vector<NodePos>> nodesInUnitig;
+	if (graph.OutDegree(side) != 1) return false;
+	return graph.OutDegree(graph.OutEdge(side, 0) ^ 1) == 1;
+}
 
-	for (auto node : graph.nodes)
+//walks forward from start until the path branches or turns back into itself through a hairpin edge (x -> reverse of x)
+void walkPath(const DenseGfa& graph, size_t start, std::vector<size_t>& path, bool& hairpin)
+{
+	hairpin = false;
+	path.push_back(start);
+	size_t pos = start;
+	while (continues(graph, pos))
 	{
-		if (nodesHandled.count(node.first) == 1) continue;
-		NodePos left { node.first, false };		
-		NodePos right { node.first, true };
-		bool leftBreaks = true;
-		bool rightBreaks = true;
-		if (graph.edges.count(left) == 1 && graph.edges.at(left).size() == 1)
+		size_t next = graph.OutEdge(pos, 0);
+		if (next == (pos ^ 1))
 		{
-			auto neighbor = graph.edges.at(left)[0];
-			assert(graph.edges.count(neighbor.Reverse()) == 1);
-			if (graph.edges.at(neighbor.Reverse()).size() == 1) leftBreaks = false;
+			hairpin = true;
+			break;
 		}
-		if (graph.edges.count(right) == 1 && graph.edges.at(right).size() == 1)
+		path.push_back(next);
+		pos = next;
+	}
+}
+
+UnitigChunk getChunkUnitigs(const DenseGfa& graph, size_t chunk)
+{
+	UnitigChunk result;
+	std::vector<size_t> path;
+	for (size_t node = chunk * ChunkSize; node < (chunk + 1) * ChunkSize && node < graph.NumNodes(); node++)
+	{
+		bool leftBreaks = !continues(graph, node * 2 + 1);
+		bool rightBreaks = !continues(graph, node * 2);
+		if (!leftBreaks && !rightBreaks) continue;
+		path.clear();
+		if (leftBreaks && rightBreaks)
 		{
-			auto neighbor = graph.edges.at(right)[0];
-			assert(graph.edges.count(neighbor.Reverse()) == 1);
-			if (graph.edges.at(neighbor.Reverse()).size() == 1) rightBreaks = false;
+			path.push_back(node * 2);
 		}
-		if (leftBreaks && rightBreaks)
+		else
 		{
-			assert(nodesHandled.count(node.first) == 0);
-			nodesHandled.insert(node.first);
-			unitigLeft[nodesInUnitig.size()] = NodePos { node.first, true };
-			unitigRight[nodesInUnitig.size()] = NodePos { node.first, true };
-			assert(belongsInUnitig.count(right) == 0);
-			belongsInUnitig[right] = nodesInUnitig.size();
-			nodesInUnitig.emplace_back();
-			nodesInUnitig.back().emplace_back(node.first, true);
-			continue;
+			bool hairpin;
+			walkPath(graph, leftBreaks ? node * 2 : node * 2 + 1, path, hairpin);
+			//the other end walks the same path in reverse
+			if (!hairpin && path.back() / 2 < node) continue;
 		}
-		if (!leftBreaks && !rightBreaks)
+		result.unitigStart.push_back(result.sides.size());
+		result.sides.insert(result.sides.end(), path.begin(), path.end());
+	}
+	return result;
+}
+
+//components where no node breaks are cycles, or paths closed by hairpins at both ends
+UnitigChunk getCircularUnitigs(const DenseGfa& graph, std::vector<size_t>& nodeSide)
+{
+	UnitigChunk result;
+	std::vector<size_t> path;
+	for (size_t node = 0; node < graph.NumNodes(); node++)
+	{
+		if (nodeSide[node] != DenseGfa::Missing) continue;
+		//find the start of the path backwards, or go around the cycle
+		size_t start = node * 2;
+		size_t pos = node * 2 + 1;
+		while (true)
+		{
+			assert(continues(graph, pos));
+			size_t next = graph.OutEdge(pos, 0);
+			if (next == (pos ^ 1))
+			{
+				start = pos ^ 1;
+				break;
+			}
+			if (next / 2 == node) break;
+			pos = next;
+		}
+		path.clear();
+		path.push_back(start);
+		pos = start;
+		while (true)
 		{
-			continue;
+			assert(continues(graph, pos));
+			size_t next = graph.OutEdge(pos, 0);
+			if (next == start || next == (pos ^ 1)) break;
+			path.push_back(next);
+			pos = next;
 		}
-		assert((leftBreaks && !rightBreaks) || (rightBreaks && !leftBreaks));
-		NodePos start;
-		int id = nodesInUnitig.size();
-		nodesInUnitig.emplace_back();
-		start.id = node.first;
-		start.end = leftBreaks;
-		assert(belongsInUnitig.count(start) == 0);
-		assert(belongsInUnitig.count(start.Reverse()) == 0);
-		assert(nodesHandled.count(start.id) == 0);
-		unitigLeft[id] = start;
-		unitigRight[id] = start;
-		nodesHandled.insert(start.id);
-		belongsInUnitig[start] = id;
-		nodesInUnitig.back().push_back(start);
-		assert(graph.edges.count(start) == 1 && graph.edges.at(start).size() == 1);
-		while (graph.edges.count(start) == 1 && graph.edges.at(start).size() == 1)
+		for (auto side : path)
 		{
-			start = graph.edges.at(start)[0];
-			assert(graph.edges.count(start.Reverse()) == 1);
-			if (graph.edges.at(start.Reverse()).size() != 1) break;
-			assert(belongsInUnitig.count(start) == 0);
-			assert(belongsInUnitig.count(start.Reverse()) == 0);
-			assert(nodesHandled.count(start.id) == 0);
-			unitigRight[id] = start;
-			nodesHandled.insert(start.id);
-			belongsInUnitig[start] = id;
-			nodesInUnitig.back().push_back(start);
+			assert(nodeSide[side / 2] == DenseGfa::Missing);
+			nodeSide[side / 2] = side;
 		}
+		result.unitigStart.push_back(result.sides.size());
+		result.sides.insert(result.sides.end(), path.begin(), path.end());
 	}
-	//circular separate components
-	for (auto node : graph.nodes)
+	return result;
+}
+
+std::string getUnitigSequence(const DenseGfa& graph, const UnitigChunk& chunk, size_t unitig)
+{
+	std::string result = graph.Sequence(chunk.sides[chunk.unitigStart[unitig]]).substr(0, graph.EdgeOverlap());
+	for (size_t i = chunk.unitigStart[unitig]; i < chunk.unitigEnd(unitig); i++)
 	{
-		if (nodesHandled.count(node.first) == 1) continue;
-		NodePos left { node.first, false };		
-		NodePos right { node.first, true };
-		assert(graph.edges.count(left) == 1 && graph.edges.at(left).size() == 1);
-		assert(graph.edges.count(right) == 1 && graph.edges.at(right).size() == 1);
-		NodePos start = right;
-		int id = nodesInUnitig.size();
-		nodesInUnitig.emplace_back();
-		unitigLeft[id] = start;
-		unitigRight[id] = start;
-		do
-		{
-			nodesHandled.insert(node.first);
-			belongsInUnitig[start] = id;
-			nodesInUnitig.back().push_back(start);
-			assert(graph.edges.count(start) == 1 && graph.edges.at(start).size() == 1);
-			assert(graph.edges.count(start.Reverse()) == 1 && graph.edges.at(start.Reverse()).size() == 1);
-			start = graph.edges.at(start)[0];
-		} while (start.id != node.first);
-		result.edges[NodePos { id, true }].emplace_back(id, true);
+		result += graph.Sequence(chunk.sides[i]).substr(graph.EdgeOverlap());
 	}
-	assert(nodesHandled.size() == graph.nodes.size());
-	assert(belongsInUnitig.size() == graph.nodes.size());
-	for (size_t i = 0; i < nodesInUnitig.size(); i++)
+	return result;
+}
+
+void unitigify(const DenseGfa& graph, const std::string& outputGraph, size_t numThreads)
+{
+	std::cerr << "find unitigs" << std::endl;
+	size_t numChunks = (graph.NumNodes() + ChunkSize - 1) / ChunkSize;
+	std::vector<UnitigChunk> chunks;
+	chunks.resize(numChunks);
+	Threading::ParallelFor(numChunks, numThreads, [&graph, &chunks](size_t chunk, size_t thread)
 	{
-		std::string seq;
-		assert(nodesInUnitig[i].size() > 0);
-		seq = graph.nodes.at(nodesInUnitig[i][0].id);
-		if (!nodesInUnitig[i][0].end) seq = CommonUtils::ReverseComplement(seq);
-		seq = seq.substr(0, graph.edgeOverlap);
-		for (auto node : nodesInUnitig[i])
+		chunks[chunk] = getChunkUnitigs(graph, chunk);
+	});
+	std::vector<size_t> firstUnitigId;
+	firstUnitigId.push_back(0);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		firstUnitigId.push_back(firstUnitigId.back() + chunks[i].numUnitigs());
+	}
+	//per node: the unitig and the side of the node in the unitig. unitigs have disjoint nodes so the chunks fill them in parallel
+	std::vector<size_t> nodeUnitig;
+	std::vector<size_t> nodeSide;
+	nodeUnitig.resize(graph.NumNodes(), DenseGfa::Missing);
+	nodeSide.resize(graph.NumNodes(), DenseGfa::Missing);
+	Threading::ParallelFor(numChunks, numThreads, [&chunks, &firstUnitigId, &nodeUnitig, &nodeSide](size_t chunk, size_t thread)
+	{
+		for (size_t i = 0; i < chunks[chunk].numUnitigs(); i++)
 		{
-			std::string add;
-			add = graph.nodes.at(node.id);
-			if (!node.end) add = CommonUtils::ReverseComplement(add);
-			add = add.substr(graph.edgeOverlap);
-			seq += add;
+			for (size_t j = chunks[chunk].unitigStart[i]; j < chunks[chunk].unitigEnd(i); j++)
+			{
+				size_t side = chunks[chunk].sides[j];
+				assert(nodeSide[side / 2] == DenseGfa::Missing);
+				nodeUnitig[side / 2] = firstUnitigId[chunk] + i;
+				nodeSide[side / 2] = side;
+			}
 		}
-		result.nodes[i] = seq;
-	}
-	for (auto edge : graph.edges)
+	});
+	chunks.push_back(getCircularUnitigs(graph, nodeSide));
+	for (size_t i = 0; i < chunks.back().numUnitigs(); i++)
 	{
-		NodePos src = edge.first;
-		NodePos from;
-		assert(belongsInUnitig.count(src) == 1 || belongsInUnitig.count(src.Reverse()) == 1);
-		if (belongsInUnitig.count(src) == 1)
+		for (size_t j = chunks.back().unitigStart[i]; j < chunks.back().unitigEnd(i); j++)
 		{
-			assert(belongsInUnitig.count(src) == 1);
-			assert(belongsInUnitig.count(src.Reverse()) == 0);
-			if (unitigRight[belongsInUnitig[src]] != src) continue;
-			from = NodePos { belongsInUnitig[src], true };
+			nodeUnitig[chunks.back().sides[j] / 2] = firstUnitigId.back() + i;
 		}
-		else
+	}
+	firstUnitigId.push_back(firstUnitigId.back() + chunks.back().numUnitigs());
+	size_t numUnitigs = firstUnitigId.back();
+	std::vector<size_t> unitigLeft;
+	std::vector<size_t> unitigRight;
+	unitigLeft.resize(numUnitigs);
+	unitigRight.resize(numUnitigs);
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+	{
+		for (size_t i = 0; i < chunks[chunk].numUnitigs(); i++)
 		{
-			assert(belongsInUnitig.count(src) == 0);
-			assert(belongsInUnitig.count(src.Reverse()) == 1);
-			if (unitigLeft[belongsInUnitig[src.Reverse()]] != src.Reverse()) continue;
-			from = NodePos { belongsInUnitig[src.Reverse()], false };
+			unitigLeft[firstUnitigId[chunk] + i] = chunks[chunk].sides[chunks[chunk].unitigStart[i]];
+			unitigRight[firstUnitigId[chunk] + i] = chunks[chunk].sides[chunks[chunk].unitigEnd(i) - 1];
 		}
-		for (auto dst : edge.second)
+	}
+	std::cerr << graph.NumNodes() << " nodes, " << numUnitigs << " unitigs" << std::endl;
+
+	std::cerr << "write unitigs" << std::endl;
+	std::ofstream out { outputGraph };
+	//chunks are written in order, numThreads at a time
+	std::vector<std::string> text;
+	for (size_t start = 0; start < chunks.size(); start += numThreads)
+	{
+		size_t count = std::min(numThreads, chunks.size() - start);
+		text.resize(count);
+		Threading::ParallelFor(count, numThreads, [&graph, &chunks, &firstUnitigId, &text, start](size_t index, size_t thread)
 		{
-			NodePos to;
-			assert(belongsInUnitig.count(dst) == 1 || belongsInUnitig.count(dst.Reverse()) == 1);
-			if (belongsInUnitig.count(dst) == 1)
+			const auto& chunk = chunks[start + index];
+			std::stringstream lines;
+			for (size_t i = 0; i < chunk.numUnitigs(); i++)
 			{
-				assert(belongsInUnitig.count(dst) == 1);
-				assert(belongsInUnitig.count(dst.Reverse()) == 0);
-				if (unitigLeft[belongsInUnitig[dst]] != dst) continue;
-				to = NodePos { belongsInUnitig[dst], true };
+				lines << "S\t" << firstUnitigId[start + index] + i << "\t" << getUnitigSequence(graph, chunk, i) << "\n";
 			}
-			else
+			text[index] = lines.str();
+		});
+		for (size_t i = 0; i < count; i++)
+		{
+			out << text[i];
+		}
+	}
+	//an edge is kept if it leaves the unitig's last node and enters the next unitig's first node
+	auto fromEnd = [&nodeUnitig, &nodeSide, &unitigLeft, &unitigRight](size_t side)
+	{
+		size_t unitig = nodeUnitig[side / 2];
+		if (nodeSide[side / 2] == side) return unitigRight[unitig] == side ? unitig * 2 : DenseGfa::Missing;
+		return unitigLeft[unitig] == (side ^ 1) ? unitig * 2 + 1 : DenseGfa::Missing;
+	};
+	auto toEnd = [&nodeUnitig, &nodeSide, &unitigLeft, &unitigRight](size_t side)
+	{
+		size_t unitig = nodeUnitig[side / 2];
+		if (nodeSide[side / 2] == side) return unitigLeft[unitig] == side ? unitig * 2 : DenseGfa::Missing;
+		return unitigRight[unitig] == (side ^ 1) ? unitig * 2 + 1 : DenseGfa::Missing;
+	};
+	for (size_t start = 0; start < numChunks; start += numThreads)
+	{
+		size_t count = std::min(numThreads, numChunks - start);
+		text.resize(count);
+		Threading::ParallelFor(count, numThreads, [&graph, &fromEnd, &toEnd, &text, start](size_t index, size_t thread)
+		{
+			std::stringstream lines;
+			size_t chunk = start + index;
+			for (size_t side = chunk * ChunkSize * 2; side < (chunk + 1) * ChunkSize * 2 && side < graph.NumSides(); side++)
 			{
-				assert(belongsInUnitig.count(dst) == 0);
-				assert(belongsInUnitig.count(dst.Reverse()) == 1);
-				if (unitigRight[belongsInUnitig[dst.Reverse()]] != dst.Reverse()) continue;
-				to = NodePos { belongsInUnitig[dst.Reverse()], false };
+				size_t from = fromEnd(side);
+				if (from == DenseGfa::Missing) continue;
+				for (size_t i = 0; i < graph.OutDegree(side); i++)
+				{
+					size_t to = toEnd(graph.OutEdge(side, i));
+					if (to == DenseGfa::Missing) continue;
+					lines << "L\t" << from / 2 << "\t" << (from % 2 == 0 ? "+" : "-") << "\t" << to / 2 << "\t" << (to % 2 == 0 ? "+" : "-") << "\t" << graph.EdgeOverlap() << "M\n";
+				}
 			}
-			result.edges[from].push_back(to);
+			text[index] = lines.str();
+		});
+		for (size_t i = 0; i < count; i++)
+		{
+			out << text[i];
 		}
 	}
-	return result;
 }
 
 int main(int argc, char** argv)
 {
 	std::string inputGraph { argv[1] };
 	std::string outputGraph { argv[2] };
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc > 3) numThreads = std::stoi(argv[3]);
 
-	auto graph = GfaGraph::LoadFromFile(inputGraph);
-	graph.confirmDoublesidedEdges();
-	auto result = unitigify(graph);
-	result.SaveToFile(outputGraph);
+	std::cerr << "load graph" << std::endl;
+	std::ifstream file { inputGraph };
+	try
+	{
+		auto graph = DenseGfa::LoadFromStream(file);
+		unitigify(graph, outputGraph, numThreads);
+	}
+	catch (const CommonUtils::InvalidGraphException& e)
+	{
+		std::cerr << "Error in the graph: " << e.what() << std::endl;
+		return 1;
+	}
 }
\ No newline at end of file
@@ -1,131 +1,65 @@
 #include <iostream>
 #include <cassert>
-#include <unordered_set>
 #include <unordered_map>
 #include <limits>
 #include <algorithm>
-#include "GfaGraph.h"
+#include <tuple>
+#include "Threading.h"
+#include "DenseGfa.h"
+#include "CommonUtils.h"
 
-std::unordered_map<NodePos, size_t> getNodeMapping(const GfaGraph& graph)
+//the depth and tip computations only look inside weakly connected components, so the components are processed in parallel
+
+size_t sideLength(const DenseGfa& graph, size_t side)
 {
-	std::unordered_map<NodePos, size_t> result;
-	for (auto node : graph.nodes)
-	{
-		size_t id = result.size();
-		result[NodePos { node.first, true }] = id;
-		id = result.size();
-		result[NodePos { node.first, false }] = id;
-	}
-	return result;
+	return graph.SequenceLength(side / 2) - graph.EdgeOverlap();
 }
 
-std::vector<size_t> getLengths(const std::unordered_map<NodePos, size_t>& nodeMapping, const GfaGraph& graph)
+size_t findRoot(std::vector<size_t>& parent, size_t node)
 {
-	std::vector<size_t> result;
-	result.resize(nodeMapping.size(), 0);
-	for (auto node : graph.nodes)
+	while (parent[node] != node)
 	{
-		result[nodeMapping.at(NodePos{ node.first, true })] = node.second.size() - graph.edgeOverlap;
-		result[nodeMapping.at(NodePos{ node.first, false })] = node.second.size() - graph.edgeOverlap;
+		parent[node] = parent[parent[node]];
+		node = parent[node];
 	}
-	return result;
+	return node;
 }
 
-std::vector<std::vector<size_t>> getOutEdges(const std::unordered_map<NodePos, size_t>& nodeMapping, const GfaGraph& graph)
+//weakly connected components, each with its nodes in increasing order
+std::vector<std::vector<size_t>> getWeakComponents(const DenseGfa& graph)
 {
-	std::vector<std::vector<size_t>> result;
-	result.resize(nodeMapping.size());
-	for (auto edge : graph.edges)
+	std::vector<size_t> parent;
+	parent.resize(graph.NumSides());
+	for (size_t i = 0; i < parent.size(); i++)
 	{
-		NodePos source = edge.first;
-		NodePos revSource = source.Reverse();
-		for (auto target : edge.second)
-		{
-			NodePos revTarget = target.Reverse();
-			assert(nodeMapping.at(source) < result.size());
-			assert(nodeMapping.at(target) < result.size());
-			assert(nodeMapping.at(revSource) < result.size());
-			assert(nodeMapping.at(revTarget) < result.size());
-			result[nodeMapping.at(source)].push_back(nodeMapping.at(target));
-			result[nodeMapping.at(revTarget)].push_back(nodeMapping.at(revSource));
-		}
+		parent[i] = i;
 	}
-	return result;
-}
-
-std::vector<size_t> getNodeDepths(const std::vector<std::vector<size_t>>& componentNodes, const std::vector<size_t>& nodeLengths, const std::vector<std::vector<size_t>>& edges)
-{
-	std::vector<size_t> result;
-	result.resize(nodeLengths.size(), 0);
-	for (size_t i = componentNodes.size()-1; i < componentNodes.size(); i--)
+	for (size_t node = 0; node < graph.NumSides(); node++)
 	{
-		if (componentNodes[i].size() > 1)
+		for (size_t i = 0; i < graph.OutDegree(node); i++)
 		{
-			for (auto node : componentNodes[i])
-			{
-				result[node] = std::numeric_limits<size_t>::max();
-			}
-		}
-		else
-		{
-			auto node = componentNodes[i][0];
-			result[node] = nodeLengths[node];
-			for (auto neighbor : edges[node])
-			{
-				if (result[neighbor] == std::numeric_limits<size_t>::max())
-				{
-					result[node] = std::numeric_limits<size_t>::max();
-					break;
-				}
-				if (neighbor == node)
-				{
-					result[node] = std::numeric_limits<size_t>::max();
-					break;
-				}
-				result[node] = std::max(result[node], result[neighbor] + nodeLengths[node]);
-			}
+			size_t left = findRoot(parent, node);
+			size_t right = findRoot(parent, graph.OutEdge(node, i));
+			if (left != right) parent[std::max(left, right)] = std::min(left, right);
 		}
 	}
-	return result;
-}
-
-void removeRec(std::vector<bool>& keepers, size_t pos, const std::vector<std::vector<size_t>>& edges)
-{
-	if (!keepers[pos]) return;
-	keepers[pos] = false;
-	for (auto neighbor : edges[pos])
-	{
-		removeRec(keepers, neighbor, edges);
-	}
-}
-
-std::vector<bool> getKeepers(const std::vector<size_t>& depths, const std::vector<std::vector<size_t>>& edges, const size_t maxRemovableLen, const size_t minSafeLen, const double fraction)
-{
-	std::vector<bool> result;
-	result.resize(depths.size(), true);
-	for (size_t i = 0; i < depths.size(); i++)
+	std::vector<size_t> componentIndex;
+	componentIndex.resize(graph.NumSides(), std::numeric_limits<size_t>::max());
+	std::vector<std::vector<size_t>> result;
+	for (size_t node = 0; node < graph.NumSides(); node++)
 	{
-		if (!result[i]) continue;
-		size_t bigLength = 0;
-		for (auto neighbor : edges[i])
+		size_t root = findRoot(parent, node);
+		if (componentIndex[root] == std::numeric_limits<size_t>::max())
 		{
-			bigLength = std::max(bigLength, depths[neighbor]);
-		}
-		if (bigLength < minSafeLen) continue;
-		size_t removableLen = bigLength * fraction;
-		removableLen = std::min(removableLen, maxRemovableLen);
-		for (auto neighbor : edges[i])
-		{
-			if (depths[neighbor] <= removableLen)
-			{
-				removeRec(result, neighbor, edges);
-			}
+			componentIndex[root] = result.size();
+			result.emplace_back();
 		}
+		result[componentIndex[root]].push_back(node);
 	}
 	return result;
 }
 
-void strongConnectIterative(size_t node, size_t& i, std::vector<size_t>& index, std::vector<size_t>& lowlink, std::vector<bool>& onStack, std::vector<size_t>& S, std::vector<std::vector<size_t>>& result, const std::vector<std::vector<size_t>>& edges)
+void strongConnectIterative(size_t node, size_t& i, std::vector<size_t>& index, std::vector<size_t>& lowlink, std::vector<char>& onStack, std::vector<size_t>& S, std::vector<std::vector<size_t>>& result, const DenseGfa& graph)
 {
 	std::vector<std::tuple<int, size_t, size_t>> stack;
 	stack.emplace_back(0, node, 0);
@@ -148,13 +82,13 @@ void strongConnectIterative(size_t node, size_t& i, std::vector<size_t>& index,
 				onStack[node] = true;
 			START_LOOP:
 			case 1:
-				if (neighborI < edges[node].size())
+				if (neighborI < graph.OutDegree(node))
 				{
-					auto neighbor = edges[node][neighborI];
+					auto neighbor = graph.OutEdge(node, neighborI);
 					if (index[neighbor] == -1)
 					{
 						stack.emplace_back(2, node, neighborI);
-						stack.emplace_back(0, edges[node][neighborI], 0);
+						stack.emplace_back(0, neighbor, 0);
 						continue;
 					}
 					else if (onStack[neighbor])
@@ -164,11 +98,11 @@ void strongConnectIterative(size_t node, size_t& i, std::vector<size_t>& index,
 					}
 					neighborI++;
 				}
-				if (neighborI < edges[node].size()) goto START_LOOP;
+				if (neighborI < graph.OutDegree(node)) goto START_LOOP;
 				goto END_LOOP;
 			case 2:
 				{
-					auto neighbor = edges[node][neighborI];
+					auto neighbor = graph.OutEdge(node, neighborI);
 					assert(lowlink[neighbor] != -1);
 					lowlink[node] = std::min(lowlink[node], lowlink[neighbor]);
 					neighborI++;
@@ -196,60 +130,130 @@ void strongConnectIterative(size_t node, size_t& i, std::vector<size_t>& index,
 	}
 }
 
-std::vector<std::vector<size_t>> topologicalSort(const std::vector<std::vector<size_t>>& edges)
+//strongly connected components of one weak component, sinks first
+std::vector<std::vector<size_t>> strongComponents(const std::vector<size_t>& nodes, std::vector<size_t>& index, std::vector<size_t>& lowlink, std::vector<char>& onStack, const DenseGfa& graph)
 {
-	std::vector<size_t> index;
-	std::vector<size_t> lowlink;
-	std::vector<bool> onStack;
-	index.resize(edges.size(), -1);
-	lowlink.resize(edges.size(), -1);
-	onStack.resize(edges.size(), false);
 	std::vector<size_t> S;
 	std::vector<std::vector<size_t>> result;
 	size_t i = 0;
-	for (size_t node = 0; node < edges.size(); node++)
+	for (auto node : nodes)
 	{
-		if (index[node] == -1) strongConnectIterative(node, i, index, lowlink, onStack, S, result, edges);
+		if (index[node] == -1) strongConnectIterative(node, i, index, lowlink, onStack, S, result, graph);
 		assert(S.size() == 0);
 	}
-	assert(i == edges.size());
-	std::reverse(result.begin(), result.end());
-	std::vector<size_t> belongsToComponent;
-	belongsToComponent.resize(edges.size(), -1);
-	for (size_t i = 0; i < result.size(); i++)
+	assert(i == nodes.size());
+	return result;
+}
+
+void getNodeDepths(const std::vector<std::vector<size_t>>& sccs, const DenseGfa& graph, std::vector<size_t>& depths)
+{
+	for (const auto& scc : sccs)
 	{
-		for (auto node : result[i])
+		if (scc.size() > 1)
 		{
-			belongsToComponent[node] = i;
+			for (auto node : scc)
+			{
+				depths[node] = std::numeric_limits<size_t>::max();
+			}
+		}
+		else
+		{
+			auto node = scc[0];
+			depths[node] = sideLength(graph, node);
+			for (size_t i = 0; i < graph.OutDegree(node); i++)
+			{
+				auto neighbor = graph.OutEdge(node, i);
+				if (depths[neighbor] == std::numeric_limits<size_t>::max())
+				{
+					depths[node] = std::numeric_limits<size_t>::max();
+					break;
+				}
+				if (neighbor == node)
+				{
+					depths[node] = std::numeric_limits<size_t>::max();
+					break;
+				}
+				depths[node] = std::max(depths[node], depths[neighbor] + sideLength(graph, node));
+			}
 		}
 	}
-	for (size_t i = 0; i < edges.size(); i++)
+}
+
+void removeReachable(std::vector<char>& keepers, size_t start, const DenseGfa& graph)
+{
+	std::vector<size_t> stack;
+	stack.push_back(start);
+	while (stack.size() > 0)
 	{
-		assert(belongsToComponent[i] != -1);
-		for (auto edge : edges[i])
+		size_t pos = stack.back();
+		stack.pop_back();
+		if (!keepers[pos]) continue;
+		keepers[pos] = false;
+		for (size_t i = 0; i < graph.OutDegree(pos); i++)
 		{
-			assert(belongsToComponent[edge] != -1);
-			assert(belongsToComponent[edge] >= belongsToComponent[i]);
+			stack.push_back(graph.OutEdge(pos, i));
 		}
 	}
-	return result;
 }
 
-std::unordered_set<int> filterNodes(const GfaGraph& graph, const int maxRemovableLen, const int minSafeLen, const double fraction)
+void getKeepers(const std::vector<size_t>& nodes, const std::vector<size_t>& depths, const DenseGfa& graph, const size_t maxRemovableLen, const size_t minSafeLen, const double fraction, std::vector<char>& keepers)
 {
-	auto nodeMapping = getNodeMapping(graph);
-	auto lengths = getLengths(nodeMapping, graph);
-	auto edges = getOutEdges(nodeMapping, graph);
-	auto order = topologicalSort(edges);
-	auto depths = getNodeDepths(order, lengths, edges);
-	auto keepers = getKeepers(depths, edges, maxRemovableLen, minSafeLen, fraction);
-	std::unordered_set<int> result;
-	for (auto node : graph.nodes)
+	for (auto node : nodes)
 	{
-		if (keepers[nodeMapping[NodePos { node.first, true }]] && keepers[nodeMapping[NodePos { node.first, false }]])
+		if (!keepers[node]) continue;
+		size_t bigLength = 0;
+		for (size_t i = 0; i < graph.OutDegree(node); i++)
 		{
-			result.emplace(node.first);
+			bigLength = std::max(bigLength, depths[graph.OutEdge(node, i)]);
 		}
+		if (bigLength < minSafeLen) continue;
+		size_t removableLen = bigLength * fraction;
+		removableLen = std::min(removableLen, maxRemovableLen);
+		for (size_t i = 0; i < graph.OutDegree(node); i++)
+		{
+			auto neighbor = graph.OutEdge(node, i);
+			if (depths[neighbor] <= removableLen)
+			{
+				removeReachable(keepers, neighbor, graph);
+			}
+		}
+	}
+}
+
+//kept flag for each node line
+std::vector<char> filterNodes(const DenseGfa& graph, const int maxRemovableLen, const int minSafeLen, const double fraction, size_t numThreads)
+{
+	auto components = getWeakComponents(graph);
+	//biggest first so one big component doesn't start last
+	std::vector<size_t> order;
+	for (size_t i = 0; i < components.size(); i++)
+	{
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&components](size_t left, size_t right) { return components[left].size() > components[right].size(); });
+	//components have disjoint nodes so the threads write into shared arrays without conflicts
+	std::vector<size_t> index;
+	std::vector<size_t> lowlink;
+	std::vector<char> onStack;
+	std::vector<size_t> depths;
+	std::vector<char> keepers;
+	index.resize(graph.NumSides(), -1);
+	lowlink.resize(graph.NumSides(), -1);
+	onStack.resize(graph.NumSides(), false);
+	depths.resize(graph.NumSides(), 0);
+	keepers.resize(graph.NumSides(), true);
+	Threading::ParallelFor(order.size(), numThreads, [&](size_t i, size_t thread)
+	{
+		const auto& nodes = components[order[i]];
+		auto sccs = strongComponents(nodes, index, lowlink, onStack, graph);
+		getNodeDepths(sccs, graph, depths);
+		getKeepers(nodes, depths, graph, maxRemovableLen, minSafeLen, fraction, keepers);
+	});
+	std::vector<char> result;
+	result.resize(graph.NumNodes());
+	for (size_t i = 0; i < graph.NumNodes(); i++)
+	{
+		result[i] = keepers[i * 2] && keepers[i * 2 + 1];
 	}
 	return result;
 }
@@ -259,10 +263,28 @@ int main(int argc, char** argv)
 	int maxRemovableLen = std::stoi(argv[1]);
 	int minSafeLen = std::stoi(argv[2]);
 	double fraction = std::stod(argv[3]);
-	auto graph = GfaGraph::LoadFromStream(std::cin);
+	size_t numThreads = Threading::DefaultThreads();
+	if (argc > 4) numThreads = std::stoi(argv[4]);
 	//write to cout
-
-	auto keptNodes = filterNodes(graph, maxRemovableLen, minSafeLen, fraction);
-	auto filteredGraph = graph.GetSubgraph(keptNodes);
-	filteredGraph.SaveToStream(std::cout);
+	try
+	{
+		auto graph = DenseGfa::LoadFromStream(std::cin);
+		auto keptNodes = filterNodes(graph, maxRemovableLen, minSafeLen, fraction, numThreads);
+		for (size_t i = 0; i < graph.NumNodes(); i++)
+		{
+			if (!keptNodes[i]) continue;
+			graph.WriteNodeLine(std::cout, i);
+		}
+		for (size_t i = 0; i < graph.NumEdgeLines(); i++)
+		{
+			auto nodes = graph.EdgeLineNodes(i);
+			if (nodes.first == DenseGfa::Missing || !keptNodes[nodes.first] || !keptNodes[nodes.second]) continue;
+			graph.WriteEdgeLine(std::cout, i);
+		}
+	}
+	catch (const CommonUtils::InvalidGraphException& e)
+	{
+		std::cerr << "Error in the graph: " << e.what() << std::endl;
+		return 1;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include "WindowStitching.h"
+
+namespace WindowStitching
+{
+	//a read base aligned to an equal graph base, with the place of the base in the alignment's edits
+	struct MatchedBase
+	{
+		size_t readPos;
+		int nodeId;
+		bool reverse;
+		size_t nodeOffset;
+		int mapping;
+		int edit;
+		size_t editOffset;
+	};
+
+	//the matched bases of the alignment between read positions start and end
+	std::vector<MatchedBase> matchedBases(const vg::Alignment& alignment, size_t start, size_t end)
+	{
+		std::vector<MatchedBase> result;
+		size_t readPos = alignment.query_position();
+		for (int i = 0; i < alignment.path().mapping_size() && readPos < end; i++)
+		{
+			const vg::Mapping& mapping = alignment.path().mapping(i);
+			size_t nodeOffset = mapping.position().offset();
+			for (int j = 0; j < mapping.edit_size(); j++)
+			{
+				const vg::Edit& edit = mapping.edit(j);
+				if (edit.from_length() == edit.to_length() && edit.sequence().size() == 0)
+				{
+					for (size_t k = 0; k < (size_t)edit.from_length(); k++)
+					{
+						if (readPos + k < start || readPos + k >= end) continue;
+						result.push_back(MatchedBase { readPos + k, (int)mapping.position().node_id(), mapping.position().is_reverse(), nodeOffset + k, i, j, k });
+					}
+				}
+				readPos += edit.to_length();
+				nodeOffset += edit.from_length();
+			}
+		}
+		return result;
+	}
+
+	bool isMatch(const vg::Edit& edit)
+	{
+		return edit.from_length() == edit.to_length() && edit.sequence().size() == 0;
+	}
+
+	//mismatched, inserted and deleted bases after the matched base, the edit distance which the DP scored for that part of the alignment
+	size_t errorsAfter(const vg::Alignment& alignment, const MatchedBase& base)
+	{
+		size_t result = 0;
+		for (int i = base.mapping; i < alignment.path().mapping_size(); i++)
+		{
+			const vg::Mapping& mapping = alignment.path().mapping(i);
+			for (int j = (i == base.mapping ? base.edit + 1 : 0); j < mapping.edit_size(); j++)
+			{
+				const vg::Edit& edit = mapping.edit(j);
+				if (!isMatch(edit)) result += std::max(edit.from_length(), edit.to_length());
+			}
+		}
+		return result;
+	}
+
+	std::shared_ptr<vg::Alignment> StitchAlignments(const vg::Alignment& left, const vg::Alignment& right, const std::string& readSequence)
+	{
+		size_t overlapStart = right.query_position();
+		size_t overlapEnd = left.query_position() + left.sequence().size();
+		size_t middle = (overlapStart + overlapEnd) / 2;
+		auto leftBases = matchedBases(left, overlapStart, overlapEnd);
+		auto rightBases = matchedBases(right, overlapStart, overlapEnd);
+		size_t leftIndex = 0;
+		bool found = false;
+		MatchedBase leftCut;
+		MatchedBase rightCut;
+		for (auto base : rightBases)
+		{
+			while (leftIndex < leftBases.size() && leftBases[leftIndex].readPos < base.readPos) leftIndex++;
+			if (leftIndex == leftBases.size()) break;
+			const MatchedBase& other = leftBases[leftIndex];
+			if (other.readPos != base.readPos || other.nodeId != base.nodeId || other.reverse != base.reverse || other.nodeOffset != base.nodeOffset) continue;
+			if (found && (base.readPos > middle ? base.readPos - middle : middle - base.readPos) >= (rightCut.readPos > middle ? rightCut.readPos - middle : middle - rightCut.readPos)) break;
+			leftCut = other;
+			rightCut = base;
+			found = true;
+		}
+		if (!found) return nullptr;
+		auto result = std::make_shared<vg::Alignment>();
+		result->set_name(left.name());
+		result->set_query_position(left.query_position());
+		result->set_sequence(readSequence.substr(left.query_position(), right.query_position() + right.sequence().size() - left.query_position()));
+		vg::Path* path = result->mutable_path();
+		for (int i = 0; i < leftCut.mapping; i++)
+		{
+			path->add_mapping()->CopyFrom(left.path().mapping(i));
+		}
+		//the mapping with the cut continues with the rest of right's mapping, they are on the same node
+		vg::Mapping* cutMapping = path->add_mapping();
+		cutMapping->mutable_position()->CopyFrom(left.path().mapping(leftCut.mapping).position());
+		for (int j = 0; j < leftCut.edit; j++)
+		{
+			cutMapping->add_edit()->CopyFrom(left.path().mapping(leftCut.mapping).edit(j));
+		}
+		vg::Edit* cutEdit = cutMapping->add_edit();
+		size_t rightRemaining = right.path().mapping(rightCut.mapping).edit(rightCut.edit).from_length() - rightCut.editOffset - 1;
+		cutEdit->set_from_length(leftCut.editOffset + 1 + rightRemaining);
+		cutEdit->set_to_length(leftCut.editOffset + 1 + rightRemaining);
+		for (int j = rightCut.edit + 1; j < right.path().mapping(rightCut.mapping).edit_size(); j++)
+		{
+			cutMapping->add_edit()->CopyFrom(right.path().mapping(rightCut.mapping).edit(j));
+		}
+		for (int i = rightCut.mapping + 1; i < right.path().mapping_size(); i++)
+		{
+			path->add_mapping()->CopyFrom(right.path().mapping(i));
+		}
+		size_t matches = 0;
+		size_t errors = 0;
+		for (int i = 0; i < path->mapping_size(); i++)
+		{
+			path->mutable_mapping(i)->set_rank(i);
+			for (int j = 0; j < path->mapping(i).edit_size(); j++)
+			{
+				const vg::Edit& edit = path->mapping(i).edit(j);
+				if (isMatch(edit))
+				{
+					matches += edit.from_length();
+				}
+				else
+				{
+					errors += std::max(edit.from_length(), edit.to_length());
+				}
+			}
+		}
+		//the windows' own DP scores, with the part of left after the cut replaced by the part of right after it
+		int64_t score = (int64_t)left.score() - (int64_t)errorsAfter(left, leftCut) + (int64_t)errorsAfter(right, rightCut);
+		result->set_score(std::max(score, (int64_t)0));
+		result->set_identity((double)matches / (double)(matches + errors));
+		return result;
+	}
+
+	AlignmentResult StitchWindows(const std::vector<size_t>& windowStart, std::vector<AlignmentResult>& windowAlignments, const std::string& readSequence)
+	{
+		std::vector<std::pair<size_t, AlignmentResult::AlignmentItem>> items;
+		AlignmentResult result;
+		for (size_t i = 0; i < windowAlignments.size(); i++)
+		{
+			result.seedsExtended += windowAlignments[i].seedsExtended;
+			result.seedsDropped += windowAlignments[i].seedsDropped;
+			for (auto item : windowAlignments[i].alignments)
+			{
+				item.alignment->set_query_position(item.alignment->query_position() + windowStart[i]);
+				item.alignmentStart += windowStart[i];
+				item.alignmentEnd += windowStart[i];
+				items.emplace_back(i, item);
+			}
+		}
+		std::sort(items.begin(), items.end(), [](const std::pair<size_t, AlignmentResult::AlignmentItem>& left, const std::pair<size_t, AlignmentResult::AlignmentItem>& right) { return left.second.alignmentStart < right.second.alignmentStart; });
+		//the last window of each stitched alignment
+		std::vector<size_t> lastWindow;
+		for (auto& item : items)
+		{
+			bool stitched = false;
+			for (size_t i = 0; i < result.alignments.size(); i++)
+			{
+				auto& previous = result.alignments[i];
+				if (lastWindow[i] >= item.first) continue;
+				if (previous.alignmentEnd <= item.second.alignmentStart || previous.alignmentEnd >= item.second.alignmentEnd) continue;
+				auto joined = StitchAlignments(*previous.alignment, *item.second.alignment, readSequence);
+				if (joined == nullptr) continue;
+				previous.alignment = joined;
+				previous.alignmentEnd = item.second.alignmentEnd;
+				previous.cellsProcessed += item.second.cellsProcessed;
+				previous.elapsedMilliseconds += item.second.elapsedMilliseconds;
+				lastWindow[i] = item.first;
+				stitched = true;
+				break;
+			}
+			if (stitched) continue;
+			result.alignments.push_back(item.second);
+			lastWindow.push_back(item.first);
+		}
+		return result;
+	}
+}
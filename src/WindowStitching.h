@@ -0,0 +1,21 @@
+#ifndef WindowStitching_h
+#define WindowStitching_h
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "vg.pb.h"
+#include "GraphAlignerWrapper.h"
+
+//joining the alignments of the overlapping windows of a split read
+namespace WindowStitching
+{
+	//joins the start of left to the end of right at a base where both have a match at the same graph position, picking the one closest to the middle of their overlap.
+	//the score is left's score up to the cut plus right's score after it. returns nullptr if they don't agree anywhere in the overlap
+	std::shared_ptr<vg::Alignment> StitchAlignments(const vg::Alignment& left, const vg::Alignment& right, const std::string& readSequence);
+	//the alignments of the windows in read coordinates. an alignment continuing one from an earlier window is stitched to it.
+	//moves the window alignments to read coordinates in place
+	AlignmentResult StitchWindows(const std::vector<size_t>& windowStart, std::vector<AlignmentResult>& windowAlignments, const std::string& readSequence);
+}
+
+#endif
@@ -0,0 +1,272 @@
+//checks the stitching of the alignments of a split read's windows.
+//the reads are copies of a random reference with substitutions, the alignments follow the reference through nodes of NodeLength bp.
+//windows which agree in their overlap must be joined into one valid path whose score counts every substitution once,
+//and windows which align the overlap elsewhere must be reported separately
+//usage: WindowStitchingTest [seed]
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "WindowStitching.h"
+
+static constexpr size_t NodeLength = 10;
+
+struct TestRead
+{
+	std::string reference;
+	std::string read;
+};
+
+TestRead makeRead(std::mt19937& rand, size_t length, size_t substitutions)
+{
+	TestRead result;
+	for (size_t i = 0; i < length; i++)
+	{
+		result.reference += "ACGT"[rand() % 4];
+	}
+	result.read = result.reference;
+	for (size_t i = 0; i < substitutions; i++)
+	{
+		size_t pos = rand() % length;
+		result.read[pos] = result.reference[pos] == 'A' ? 'C' : 'A';
+	}
+	return result;
+}
+
+//read[start, end) aligned to reference[start + shift, end + shift), with query_position relative to windowStart
+AlignmentResult::AlignmentItem makeAlignment(const TestRead& test, size_t start, size_t end, size_t shift, size_t windowStart)
+{
+	auto alignment = std::make_shared<vg::Alignment>();
+	alignment->set_name("read");
+	alignment->set_query_position(start - windowStart);
+	alignment->set_sequence(test.read.substr(start, end - start));
+	size_t mismatches = 0;
+	vg::Mapping* mapping = nullptr;
+	vg::Edit* edit = nullptr;
+	bool editIsMatch = false;
+	for (size_t pos = start; pos < end; pos++)
+	{
+		size_t refPos = pos + shift;
+		if (mapping == nullptr || refPos % NodeLength == 0)
+		{
+			mapping = alignment->mutable_path()->add_mapping();
+			mapping->mutable_position()->set_node_id(refPos / NodeLength);
+			mapping->mutable_position()->set_offset(refPos % NodeLength);
+			mapping->set_rank(alignment->path().mapping_size() - 1);
+			edit = nullptr;
+		}
+		bool match = test.read[pos] == test.reference[refPos];
+		if (!match) mismatches += 1;
+		if (edit == nullptr || match != editIsMatch)
+		{
+			edit = mapping->add_edit();
+			editIsMatch = match;
+		}
+		edit->set_from_length(edit->from_length() + 1);
+		edit->set_to_length(edit->to_length() + 1);
+		if (!match) edit->set_sequence(edit->sequence() + test.read[pos]);
+	}
+	alignment->set_score(mismatches);
+	AlignmentResult::AlignmentItem result { alignment, 0, 0 };
+	result.alignmentStart = start - windowStart;
+	result.alignmentEnd = end - 1 - windowStart;
+	return result;
+}
+
+size_t substitutionsIn(const TestRead& test, size_t start, size_t end)
+{
+	size_t result = 0;
+	for (size_t i = start; i < end; i++)
+	{
+		if (test.read[i] != test.reference[i]) result += 1;
+	}
+	return result;
+}
+
+//the path must be contiguous along the reference and spell the read between start and end
+bool checkPath(const vg::Alignment& alignment, const TestRead& test, size_t start, size_t end, std::string& error)
+{
+	if (alignment.query_position() != (int)start) { error = "query position " + std::to_string(alignment.query_position()); return false; }
+	if (alignment.sequence() != test.read.substr(start, end - start)) { error = "sequence differs from the read"; return false; }
+	size_t readPos = start;
+	size_t refPos = start;
+	for (int i = 0; i < alignment.path().mapping_size(); i++)
+	{
+		const vg::Mapping& mapping = alignment.path().mapping(i);
+		if (mapping.rank() != i) { error = "rank " + std::to_string(mapping.rank()) + " at mapping " + std::to_string(i); return false; }
+		if ((size_t)(mapping.position().node_id() * NodeLength + mapping.position().offset()) != refPos) { error = "mapping " + std::to_string(i) + " doesn't continue the previous one"; return false; }
+		for (int j = 0; j < mapping.edit_size(); j++)
+		{
+			const vg::Edit& edit = mapping.edit(j);
+			if (edit.from_length() != edit.to_length()) { error = "indel edit"; return false; }
+			for (size_t k = 0; k < (size_t)edit.from_length(); k++)
+			{
+				char expected = edit.sequence().size() == 0 ? test.reference[refPos + k] : edit.sequence()[k];
+				if (expected != test.read[readPos + k]) { error = "edit doesn't spell the read at " + std::to_string(readPos + k); return false; }
+				if (edit.sequence().size() > 0 && edit.sequence()[k] == test.reference[refPos + k]) { error = "mismatch edit on a matching base at " + std::to_string(readPos + k); return false; }
+			}
+			readPos += edit.to_length();
+			refPos += edit.from_length();
+		}
+	}
+	if (readPos != end) { error = "path ends at " + std::to_string(readPos); return false; }
+	return true;
+}
+
+bool checkStitched(const std::string& name, const AlignmentResult& result, const TestRead& test, size_t start, size_t end)
+{
+	if (result.alignments.size() != 1)
+	{
+		std::cerr << name << ": " << result.alignments.size() << " alignments instead of one" << std::endl;
+		return false;
+	}
+	const vg::Alignment& alignment = *result.alignments[0].alignment;
+	std::string error;
+	if (!checkPath(alignment, test, start, end, error))
+	{
+		std::cerr << name << ": " << error << std::endl;
+		return false;
+	}
+	size_t expected = substitutionsIn(test, start, end);
+	if (alignment.score() != (int)expected)
+	{
+		std::cerr << name << ": score " << alignment.score() << " instead of " << expected << std::endl;
+		return false;
+	}
+	if (result.alignments[0].alignmentStart != start || result.alignments[0].alignmentEnd != end - 1)
+	{
+		std::cerr << name << ": alignment covers " << result.alignments[0].alignmentStart << "-" << result.alignments[0].alignmentEnd << std::endl;
+		return false;
+	}
+	return true;
+}
+
+struct Windows
+{
+	std::vector<size_t> windowStart;
+	std::vector<AlignmentResult> windowAlignments;
+};
+
+//windows of windowLength bp overlapping by overlap bp. shifted windows align to the reference shift bp further
+Windows makeWindows(const TestRead& test, size_t windowLength, size_t overlap, const std::set<size_t>& shiftedWindows, size_t shift)
+{
+	Windows result;
+	for (size_t start = 0; ; start += windowLength - overlap)
+	{
+		result.windowStart.push_back(std::min(start, test.read.size() - windowLength));
+		if (start + windowLength >= test.read.size()) break;
+	}
+	result.windowAlignments.resize(result.windowStart.size());
+	for (size_t i = 0; i < result.windowStart.size(); i++)
+	{
+		size_t start = result.windowStart[i];
+		result.windowAlignments[i].alignments.push_back(makeAlignment(test, start, start + windowLength, shiftedWindows.count(i) == 1 ? shift : 0, start));
+	}
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	size_t seed = 1;
+	if (argc > 1) seed = std::stoull(argv[1]);
+	std::mt19937 rand { (unsigned int)seed };
+	size_t failures = 0;
+	size_t checks = 0;
+	for (size_t round = 0; round < 100; round++)
+	{
+		size_t windowLength = 100 + rand() % 200;
+		//under a third of the window so that the windows around a disagreeing one don't overlap each other
+		size_t overlap = 20 + rand() % (windowLength / 3 - 20);
+		size_t windows = 2 + rand() % 5;
+		size_t readLength = windowLength + (windows - 1) * (windowLength - overlap) - rand() % (windowLength / 4);
+		//room for the shifted windows
+		TestRead test = makeRead(rand, readLength + 5 * NodeLength, readLength / 20);
+		test.read.resize(readLength);
+		std::string roundName = "round " + std::to_string(round);
+
+		//two windows which agree in the overlap, with substitutions in it, are joined with each substitution scored once
+		{
+			checks += 1;
+			auto left = makeAlignment(test, 0, windowLength, 0, 0);
+			auto right = makeAlignment(test, windowLength - overlap, std::min(readLength, 2 * windowLength - overlap), 0, 0);
+			AlignmentResult result;
+			auto joined = WindowStitching::StitchAlignments(*left.alignment, *right.alignment, test.read);
+			if (joined == nullptr)
+			{
+				std::cerr << roundName << " two windows: not stitched" << std::endl;
+				failures += 1;
+			}
+			else
+			{
+				AlignmentResult::AlignmentItem item { joined, 0, 0 };
+				item.alignmentStart = 0;
+				item.alignmentEnd = std::min(readLength, 2 * windowLength - overlap) - 1;
+				result.alignments.push_back(item);
+				if (!checkStitched(roundName + " two windows", result, test, 0, std::min(readLength, 2 * windowLength - overlap))) failures += 1;
+			}
+		}
+
+		//two windows which align the overlap to different graph positions are not joined
+		{
+			checks += 1;
+			auto left = makeAlignment(test, 0, windowLength, 0, 0);
+			auto right = makeAlignment(test, windowLength - overlap, std::min(readLength, 2 * windowLength - overlap), 1 + rand() % (3 * NodeLength), 0);
+			if (WindowStitching::StitchAlignments(*left.alignment, *right.alignment, test.read) != nullptr)
+			{
+				std::cerr << roundName << " disagreeing windows: stitched" << std::endl;
+				failures += 1;
+			}
+		}
+
+		//all windows of a read agree, they are joined into one alignment of the whole read
+		{
+			checks += 1;
+			Windows split = makeWindows(test, windowLength, overlap, {}, 0);
+			auto result = WindowStitching::StitchWindows(split.windowStart, split.windowAlignments, test.read);
+			if (!checkStitched(roundName + " " + std::to_string(split.windowStart.size()) + " windows", result, test, 0, readLength)) failures += 1;
+		}
+
+		//one window in the middle aligns elsewhere. the windows before it are joined, it is reported alone, and the windows after it are joined
+		{
+			Windows split = makeWindows(test, windowLength, overlap, {}, 0);
+			if (split.windowStart.size() < 3) continue;
+			checks += 1;
+			size_t shifted = 1 + rand() % (split.windowStart.size() - 2);
+			split = makeWindows(test, windowLength, overlap, { shifted }, 1 + rand() % (3 * NodeLength));
+			auto result = WindowStitching::StitchWindows(split.windowStart, split.windowAlignments, test.read);
+			std::string name = roundName + " window " + std::to_string(shifted) + "/" + std::to_string(split.windowStart.size()) + " disagrees";
+			if (result.alignments.size() != 3)
+			{
+				std::cerr << name << ": " << result.alignments.size() << " alignments instead of three" << std::endl;
+				failures += 1;
+				continue;
+			}
+			size_t beforeEnd = split.windowStart[shifted - 1] + windowLength;
+			size_t afterStart = split.windowStart[shifted + 1];
+			bool valid = true;
+			for (const auto& item : result.alignments)
+			{
+				AlignmentResult single;
+				single.alignments.push_back(item);
+				if (item.alignmentStart == 0)
+				{
+					valid = checkStitched(name + " before", single, test, 0, beforeEnd) && valid;
+				}
+				else if (item.alignmentStart == afterStart)
+				{
+					valid = checkStitched(name + " after", single, test, afterStart, readLength) && valid;
+				}
+				else if (item.alignmentStart != split.windowStart[shifted] || item.alignmentEnd != split.windowStart[shifted] + windowLength - 1)
+				{
+					std::cerr << name << ": unexpected alignment at " << item.alignmentStart << "-" << item.alignmentEnd << std::endl;
+					valid = false;
+				}
+			}
+			if (!valid) failures += 1;
+		}
+	}
+	std::cerr << checks << " checks, " << failures << " failures" << std::endl;
+	return failures == 0 ? 0 : 1;
+}